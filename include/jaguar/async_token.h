@@ -0,0 +1,73 @@
+#ifndef ASYNC_TOKEN_H_
+#define ASYNC_TOKEN_H_
+
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include "can_bridge.h"
+
+namespace can {
+
+/*
+ * Token that is completed by its owner, either with the response frame or by
+ * expiring. Completion wakes blocked threads and runs every on_complete()
+ * callback on the completing thread, so waiting is optional: block() is only
+ * a convenience for callers that have nothing else to do.
+ */
+class AsyncToken : public Token
+{
+public:
+    AsyncToken(void);
+    virtual ~AsyncToken(void);
+
+    virtual void block(void);
+    virtual bool timed_block(boost::posix_time::time_duration const &duration);
+    virtual bool ready(void) const;
+    virtual bool timed_out(void) const;
+    virtual bool cancelled(void) const;
+    virtual boost::shared_ptr<CANMessage const> message(void) const;
+    virtual FramePtr frame(void) const;
+    virtual void discard(void);
+    virtual void on_complete(completion_callback cb);
+
+    // Each returns false, and does nothing, if the token was already ready.
+    bool complete(FramePtr const &frame);
+    bool expire(void);
+    bool cancel(void);
+
+protected:
+    // Wait until ready or until the absolute deadline; false on timeout.
+    bool wait_until(boost::posix_time::ptime const &deadline);
+
+private:
+    enum Outcome {
+        kAnswered,
+        kTimedOut,
+        kCancelled
+    };
+
+    bool done_;
+    Outcome outcome_;
+    FramePtr frame_;
+    std::vector<completion_callback> callbacks_;
+    mutable boost::mutex mutex_;
+    boost::condition_variable cond_;
+
+    bool finish(FramePtr const &frame, Outcome outcome);
+};
+
+typedef boost::function<TokenPtr (Token &)> continuation;
+
+// Ready once every token is ready. It is timed out if any of them timed out,
+// and otherwise cancelled if any of them was cancelled.
+TokenPtr when_all(std::vector<TokenPtr> const &tokens);
+
+// Once token is ready, call next with it and follow the token it returns, if
+// any. If token failed, the result fails the same way without calling next.
+TokenPtr then(TokenPtr const &token, continuation next);
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,160 @@
+#ifndef BASIC_CAN_BRIDGE_H_
+#define BASIC_CAN_BRIDGE_H_
+
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <stdint.h>
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/signals2.hpp>
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+#include "async_token.h"
+#include "bridge_metrics.h"
+#include "callback_table.h"
+#include "can_bridge.h"
+#include "timer_wheel.h"
+
+namespace can {
+
+class BasicToken;
+
+/*
+ * Transport-independent half of a CANBridge: callback dispatch, request/ACK
+ * token matching, the received frame pool, and an io_service with a single
+ * I/O thread. Subclasses only move frames on and off the wire; every
+ * received frame is handed to recv_frame().
+ */
+class BasicCANBridge : public CANBridge
+{
+public:
+    typedef masked_number<uint32_t> filter;
+
+    BasicCANBridge(void);
+    virtual ~BasicCANBridge(void);
+
+    virtual TokenPtr recv(uint32_t id);
+    virtual TokenPtr recv(uint32_t id, boost::posix_time::time_duration const &timeout);
+
+    // Requests that are never answered are retransmitted from the I/O
+    // thread, and their final failure is reported through the error signal.
+    // Only a request that is alone in waiting for response_id is sent again,
+    // and once it is answered the duplicate responses that may follow within
+    // one timeout are dropped rather than handed to the next request.
+    virtual TokenPtr request(CANMessage const &message, uint32_t response_id,
+                             boost::posix_time::time_duration const &timeout,
+                             unsigned retries = 0);
+
+    using CANBridge::attach_callback;
+    virtual CallbackToken attach_frame_callback(uint32_t id, frame_callback cb);
+    virtual CallbackToken attach_frame_callback(uint32_t id, uint32_t id_mask,
+            frame_callback cb);
+    virtual CallbackToken attach_callback(error_callback cb);
+
+    // Observe every frame this bridge transmits, stamped as it is written.
+    CallbackToken attach_send_callback(frame_callback cb);
+
+    // Every (id, mask) pair that some callback or request is interested in.
+    // Frames that match none of these can safely be dropped by hardware.
+    std::vector<filter> filters(void) const;
+
+    // Counters and histograms describing the traffic so far. Cheap enough
+    // to poll at any rate; nothing on the data path waits for it.
+    virtual BridgeMetricsSnapshot metrics(void) const;
+
+protected:
+    boost::asio::io_service io_;
+    boost::signals2::signal<error_callback_sig> error_signal_;
+    BridgeMetrics metrics_;
+
+    // Count an error and pass it to the error callbacks. Never allocates,
+    // so it is safe on the receive path.
+    void report_error(BridgeError::Enum code, uint32_t detail,
+                      char const *func, char const *file, unsigned line);
+
+    // Called whenever filters() gains a new entry.
+    virtual void filters_changed(void);
+
+    FramePtr make_frame(CANFrame const &frame);
+    void recv_frame(FramePtr const &frame);
+
+    // Subclasses call this just before writing messages to the bus, so a
+    // request is always observed ahead of its response. A request's timeout
+    // starts here rather than when it was queued.
+    void sent(CANMessage const *begin, CANMessage const *end);
+
+    void start(void);
+    void stop(void);
+
+private:
+    typedef boost::shared_ptr<BasicToken> token_ptr;
+    typedef std::deque<token_ptr> token_queue;
+    typedef std::map<uint32_t, token_queue> token_table;
+    typedef std::deque<boost::weak_ptr<BasicToken> > unsent_queue;
+
+    // Responses still owed to a retransmitted request that was already
+    // answered, and how long to keep waiting for them.
+    struct Surplus {
+        unsigned count;
+        boost::posix_time::ptime until;
+    };
+    typedef std::map<uint32_t, Surplus> surplus_table;
+
+    static size_t const kFramePoolSize;
+    static boost::posix_time::time_duration const kWheelTick;
+    static size_t const kWheelSlots;
+
+    boost::thread io_thread_;
+    TimerWheel wheel_;
+    FramePool pool_;
+    CallbackTable callbacks_;
+    boost::signals2::signal<frame_callback_sig> send_signal_;
+
+    token_table tokens_;
+    std::set<uint32_t> token_ids_;
+    unsent_queue unsent_;
+    surplus_table surplus_;
+    mutable boost::mutex token_mutex_;
+
+    token_ptr add_token(uint32_t id, boost::posix_time::time_duration const &timeout,
+                        boost::shared_ptr<CANMessage const> const &request, unsigned retries);
+    void remove_token(FramePtr const &frame);
+    void discard_token(BasicToken &token);
+    void arm_token(token_ptr const &token);
+    void arm_sent(CANMessage const *begin, CANMessage const *end);
+    void timeout_token(boost::weak_ptr<BasicToken> const &token);
+    void fail_token(token_ptr const &token);
+    void expire_tokens(token_queue &queue, boost::posix_time::ptime const &now,
+                       std::vector<token_ptr> &expired);
+
+    friend class BasicToken;
+};
+
+class BasicToken : public AsyncToken {
+public:
+    virtual ~BasicToken(void);
+    virtual void discard(void);
+
+private:
+    BasicCANBridge &bridge_;
+    uint32_t id_;
+    boost::posix_time::ptime deadline_;
+    boost::posix_time::time_duration timeout_;
+
+    // Only set for tokens created by request().
+    boost::shared_ptr<CANMessage const> request_;
+    unsigned retries_;
+    unsigned attempts_;
+
+    BasicToken(BasicCANBridge &bridge, uint32_t id, boost::posix_time::time_duration const &timeout);
+
+    friend class BasicCANBridge;
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,107 @@
+#ifndef BRIDGE_METRICS_H_
+#define BRIDGE_METRICS_H_
+
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/utility.hpp>
+#include "can_frame.h"
+
+namespace can {
+
+struct BridgeError {
+    enum Enum {
+        kInvalidLength    = 0, // length byte out of range; detail is the byte
+        kInvalidEscape    = 1, // ESC followed by anything else; detail is the byte
+        kReadFailed       = 2, // detail is the system error code
+        kWriteFailed      = 3, // detail is the system error code
+        kRequestTimedOut  = 4, // detail is the request's CAN identifier
+        kRetransmitFailed = 5, // detail is the system error code, if known
+        kCount            = 6
+    };
+
+    static char const *message(Enum code);
+};
+
+/*
+ * Power of two histogram. Bucket 0 counts values below 2, bucket i counts
+ * values in [2^i, 2^(i+1)), and the last bucket also counts everything
+ * larger.
+ */
+class Histogram : boost::noncopyable
+{
+public:
+    static size_t const kBuckets = 16;
+
+    Histogram(void);
+    void record(uint64_t value);
+    void snapshot(uint64_t *buckets) const;
+
+private:
+    boost::atomic<uint64_t> buckets_[kBuckets];
+};
+
+struct BridgeMetricsSnapshot {
+    Timestamp stamp;
+
+    uint64_t frames_in, frames_out;
+    uint64_t bytes_in, bytes_out;
+    uint64_t payload_in, payload_out;
+
+    // Bytes on the wire beyond the framing, identifier and payload. On the
+    // receive side this includes any bytes discarded while resynchronizing.
+    uint64_t escape_bytes_in, escape_bytes_out;
+
+    uint64_t errors[BridgeError::kCount];
+    uint32_t last_error;
+    uint32_t last_error_detail;
+
+    uint64_t tokens_outstanding;
+    uint64_t tokens_timed_out;
+
+    // Time spent dispatching each received frame to callbacks and tokens,
+    // in microseconds, and the size of each read from the device, in bytes.
+    uint64_t dispatch_us[Histogram::kBuckets];
+    uint64_t read_size[Histogram::kBuckets];
+
+    // Longest time spent handling a single read.
+    Timestamp recv_latency_max;
+};
+
+/*
+ * Counters shared by the sending threads and the I/O thread. Every update is
+ * a single relaxed atomic operation, so instrumentation never blocks or
+ * allocates. Each counter in a snapshot is exact, but counters are not read
+ * at the same instant.
+ */
+struct BridgeMetrics : boost::noncopyable
+{
+    BridgeMetrics(void);
+
+    static void count(boost::atomic<uint64_t> &counter, uint64_t n = 1);
+    static void record_max(boost::atomic<uint64_t> &maximum, uint64_t value);
+    void error(BridgeError::Enum code, uint32_t detail);
+    BridgeMetricsSnapshot snapshot(void) const;
+
+    boost::atomic<uint64_t> frames_in, frames_out;
+    boost::atomic<uint64_t> bytes_in, bytes_out;
+    boost::atomic<uint64_t> payload_in, payload_out;
+    boost::atomic<uint64_t> errors[BridgeError::kCount];
+    boost::atomic<uint32_t> last_error;
+    boost::atomic<uint32_t> last_error_detail;
+    boost::atomic<uint64_t> tokens_outstanding;
+    boost::atomic<uint64_t> tokens_timed_out;
+    Histogram dispatch_us;
+    Histogram read_size;
+    boost::atomic<uint64_t> recv_latency_max;
+};
+
+inline void BridgeMetrics::count(boost::atomic<uint64_t> &counter, uint64_t n)
+{
+    counter.fetch_add(n, boost::memory_order_relaxed);
+}
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
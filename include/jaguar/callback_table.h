@@ -0,0 +1,102 @@
+#ifndef CALLBACK_TABLE_H_
+#define CALLBACK_TABLE_H_
+
+#include <cassert>
+#include <map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/signals2.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility.hpp>
+#include "can_bridge.h"
+
+namespace can {
+
+template<typename T>
+class masked_number
+{
+public:
+	typedef T type;
+
+	masked_number(T const& num_, T const& mask_)
+	: num(num_), mask(mask_)
+	{
+		assert((num_ & ~mask_) == 0);
+	}
+
+	template <class U>
+	masked_number(masked_number<U> const &mn)
+	: num(mn.num), mask(mn.mask)
+	{}
+
+	bool matches(T val) const
+	{
+		return (val & mask) == num;
+	}
+
+	bool operator<(masked_number const &other) const
+	{
+		return (mask < other.mask) || (mask == other.mask && num < other.num);
+	}
+
+	T num;
+	T mask;
+};
+
+template<typename T>
+masked_number<T> make_masked_number(T const &n, T const &m)
+{
+	return masked_number<T>(n, m);
+}
+
+/*
+ * Maps CAN identifiers to the callbacks that are subscribed to them.
+ *
+ * Subscriptions with identical (id, mask) pairs share a single signal. The
+ * lookup structure is immutable once published: attach() builds a new index
+ * and swaps it in, so dispatch() only needs an atomic pointer load and never
+ * holds a lock while callbacks run.
+ */
+class CallbackTable : boost::noncopyable {
+public:
+    typedef CANBridge::frame_callback frame_callback;
+    typedef masked_number<uint32_t> subscription;
+
+    static uint32_t const kExactMask;
+
+    CallbackTable(void);
+
+    CallbackToken attach(uint32_t id, uint32_t id_mask, frame_callback cb);
+    void dispatch(FramePtr const &frame) const;
+    std::vector<subscription> subscriptions(void) const;
+
+private:
+    typedef boost::signals2::signal<CANBridge::frame_callback_sig> callback_signal;
+    typedef boost::shared_ptr<callback_signal> callback_signal_ptr;
+    typedef std::vector<callback_signal_ptr> fanout_list;
+
+    struct MaskGroup {
+        uint32_t mask;
+        boost::unordered_map<uint32_t, callback_signal_ptr> signals;
+    };
+
+    struct Index {
+        std::map<subscription, callback_signal_ptr> signals;
+        std::vector<MaskGroup> groups;
+        boost::unordered_map<uint32_t, fanout_list> fanout;
+    };
+
+    boost::shared_ptr<Index const> index_;
+    mutable boost::mutex mutex_;
+
+    static void compile(Index &index);
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -10,6 +10,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
+#include "can_frame.h"
 
 namespace can {
 
@@ -28,6 +29,9 @@ public:
     CANMessage(uint32_t p_id, std::vector<uint8_t> const &p_payload)
         : id(p_id), payload(p_payload) {}
 
+    explicit CANMessage(CANFrame const &frame)
+        : id(frame.id), payload(frame.data, frame.data + frame.dlc) {}
+
     virtual ~CANMessage(void) {}
 
     uint32_t id;
@@ -36,6 +40,8 @@ public:
 
 class CANBridge {
 public:
+    typedef void frame_callback_sig(FramePtr const &);
+    typedef boost::function<frame_callback_sig> frame_callback;
     typedef void recv_callback_sig(CANMessage::Ptr);
     typedef boost::function<recv_callback_sig> recv_callback;
     typedef void error_callback_sig(char const *func, char const *file, unsigned line, std::string const &msg);
@@ -43,24 +49,72 @@ public:
 
     virtual void send(CANMessage const &message) = 0;
     virtual TokenPtr recv(uint32_t id) = 0;
-    virtual CallbackToken attach_callback(uint32_t id, recv_callback cb) = 0;
-    virtual CallbackToken attach_callback(uint32_t id, uint32_t id_mask,
-		    recv_callback cb) = 0;
+
+    // Expect a response with the given identifier. Requests for the same
+    // identifier are matched to responses in FIFO order, so several may be
+    // outstanding at once. If no response arrives within the timeout the
+    // token becomes ready with timed_out() set.
+    virtual TokenPtr recv(uint32_t id, boost::posix_time::time_duration const &timeout) = 0;
+
+    // Send a request and expect a response with the given identifier. If no
+    // response arrives within the timeout the request is sent again, up to
+    // retries more times, so only use retries for idempotent requests. The
+    // default sends once and never retries.
+    virtual TokenPtr request(CANMessage const &message, uint32_t response_id,
+                             boost::posix_time::time_duration const &timeout,
+                             unsigned retries = 0);
+
+    // Transmit a contiguous range of messages. Bridges that can coalesce
+    // multiple frames into a single write should override this; the default
+    // simply sends each message in order.
+    virtual void send_batch(CANMessage const *begin, CANMessage const *end)
+    {
+        for (CANMessage const *it = begin; it != end; ++it) {
+            send(*it);
+        }
+    }
+
+    virtual CallbackToken attach_frame_callback(uint32_t id, frame_callback cb) = 0;
+    virtual CallbackToken attach_frame_callback(uint32_t id, uint32_t id_mask,
+            frame_callback cb) = 0;
     virtual CallbackToken attach_callback(error_callback cb) = 0;
+
+    // Compatibility wrappers for callbacks that expect a heap-allocated
+    // CANMessage. These copy every matching frame, so new code should attach
+    // a frame_callback instead.
+    virtual CallbackToken attach_callback(uint32_t id, recv_callback cb);
+    virtual CallbackToken attach_callback(uint32_t id, uint32_t id_mask,
+		    recv_callback cb);
 };
 
 class Token : boost::noncopyable
 {
 public:
     typedef boost::shared_ptr<Token> Ptr;
+    typedef void completion_sig(Token &token);
+    typedef boost::function<completion_sig> completion_callback;
 
 	Token(void) {}
 	virtual ~Token(void) {}
 	virtual void block(void) = 0;
 	virtual bool timed_block(boost::posix_time::time_duration const &duration) = 0;
     virtual bool ready(void) const = 0;
+    virtual bool timed_out(void) const = 0;
 	virtual boost::shared_ptr<CANMessage const> message(void) const = 0;
+    virtual FramePtr frame(void) const = 0;
+
+    // Gives up on the token. It becomes ready with cancelled() set, which
+    // counts as a failure just like a timeout.
     virtual void discard(void) = 0;
+    virtual bool cancelled(void) const = 0;
+
+    // Ready without a response, either by timing out or by being discarded.
+    bool failed(void) const { return timed_out() || cancelled(); }
+
+    // Call cb exactly once when the token becomes ready: immediately if it
+    // already is, otherwise on the thread that completes it (normally the
+    // bridge's I/O thread). Callbacks must not block.
+    virtual void on_complete(completion_callback cb) = 0;
 };
 
 class CANException : public std::exception {
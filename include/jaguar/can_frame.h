@@ -0,0 +1,84 @@
+#ifndef CAN_FRAME_H_
+#define CAN_FRAME_H_
+
+#include <cstddef>
+#include <stdint.h>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+namespace can {
+
+// Nanoseconds on the monotonic clock. Zero means "unknown".
+typedef uint64_t Timestamp;
+
+Timestamp monotonic_now(void);
+
+/*
+ * Fixed-capacity CAN frame. This is a POD type, so it can be copied with
+ * memcpy, stored in preallocated arrays, and written directly to disk.
+ */
+struct CANFrame {
+    uint32_t  id;
+    uint8_t   dlc;
+    uint8_t   data[8];
+    Timestamp timestamp;
+};
+
+class FramePool;
+
+/*
+ * Reference counted frame that is owned by a FramePool. The last reference
+ * returns the frame to its pool instead of freeing it, so the steady-state
+ * receive path never touches the heap.
+ */
+class PooledFrame : public CANFrame, boost::noncopyable {
+public:
+    PooledFrame(void);
+
+private:
+    mutable boost::detail::atomic_count refs_;
+    FramePool *pool_;
+    PooledFrame *next_;
+
+    friend class FramePool;
+    friend void intrusive_ptr_add_ref(PooledFrame const *frame);
+    friend void intrusive_ptr_release(PooledFrame const *frame);
+};
+
+typedef boost::intrusive_ptr<PooledFrame const> FramePtr;
+
+void intrusive_ptr_add_ref(PooledFrame const *frame);
+void intrusive_ptr_release(PooledFrame const *frame);
+
+/*
+ * Fixed-size free list of frames. If the pool is ever exhausted (e.g. a slow
+ * consumer is holding on to many frames) allocate() falls back to the heap
+ * rather than dropping data. Frames must not outlive the pool they came from.
+ */
+class FramePool : boost::noncopyable {
+public:
+    explicit FramePool(size_t capacity);
+    ~FramePool(void);
+
+    FramePtr allocate(CANFrame const &frame);
+    size_t capacity(void) const;
+
+private:
+    size_t capacity_;
+    boost::scoped_array<PooledFrame> storage_;
+    PooledFrame *free_;
+    boost::mutex mutex_;
+
+    void release(PooledFrame *frame);
+
+    friend void intrusive_ptr_release(PooledFrame const *frame);
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
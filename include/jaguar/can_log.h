@@ -0,0 +1,95 @@
+#ifndef CAN_LOG_H_
+#define CAN_LOG_H_
+
+#include <cstdio>
+#include <string>
+#include <stdint.h>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+#include "basic_can_bridge.h"
+#include "can_frame.h"
+
+namespace can {
+
+/*
+ * On-disk format of a CAN traffic log: a CANLogHeader followed by an
+ * append-only array of fixed-size CANLogRecords in the order they were
+ * observed. Everything is little-endian and naturally aligned, so a log can
+ * be memory-mapped and indexed directly.
+ */
+struct CANLogHeader {
+    static char const kMagic[8];
+    static uint32_t const kVersion;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+struct CANLogRecord {
+    enum Direction {
+        kReceived = 0,
+        kSent     = 1
+    };
+
+    Timestamp timestamp;
+    uint32_t id;
+    uint8_t dlc;
+    uint8_t direction;
+    uint8_t reserved[2];
+    uint8_t data[8];
+
+    CANFrame frame(void) const;
+};
+
+/*
+ * Records every frame a bridge receives or transmits. Records are buffered
+ * by stdio; call flush() to force them to disk. An existing log is appended
+ * to, as long as its header matches.
+ */
+class CANRecorder : boost::noncopyable
+{
+public:
+    CANRecorder(BasicCANBridge &bridge, std::string const &path);
+    ~CANRecorder(void);
+
+    void flush(void);
+    size_t frames(void) const;
+
+private:
+    FILE *file_;
+    size_t frames_;
+    mutable boost::mutex mutex_;
+    boost::signals2::scoped_connection recv_connection_;
+    boost::signals2::scoped_connection send_connection_;
+
+    void record(FramePtr const &frame, CANLogRecord::Direction direction);
+};
+
+/*
+ * Read-only, memory-mapped view of a log written by CANRecorder.
+ */
+class CANLog : boost::noncopyable
+{
+public:
+    explicit CANLog(std::string const &path);
+    ~CANLog(void);
+
+    size_t size(void) const;
+    CANLogRecord const &operator[](size_t index) const;
+    CANLogRecord const *begin(void) const;
+    CANLogRecord const *end(void) const;
+
+private:
+    int fd_;
+    void *map_;
+    size_t map_length_;
+    CANLogRecord const *records_;
+    size_t size_;
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -2,14 +2,22 @@
 #define DIFF_DRIVE_H_
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/signal.hpp>
 #include <boost/thread/thread.hpp>
 #include <jaguar/jaguar.h>
 #include <jaguar/jaguar_api.h>
 #include <jaguar/jaguar_bridge.h>
 #include <jaguar/jaguar_broadcaster.h>
+#include <jaguar/motor_group.h>
+#include <jaguar/odometry_fusion.h>
+#include <jaguar/pose_integrator.h>
+#include <jaguar/seqlock.h>
+#include <jaguar/setpoint_stream.h>
 #include <robot_kf/WheelOdometry.h>
 
 namespace jaguar {
@@ -17,9 +25,15 @@ namespace jaguar {
 struct DiffDriveSettings {
     // CAN bus Configuration
     std::string port;
-    int id_left, id_right;
+    // Motor controllers driving each side, e.g. two or three per side on a
+    // skid-steer platform. All of them are driven with the side's setpoint
+    // and their encoders are fused into the side's odometry.
+    std::vector<int> ids_left, ids_right;
+    FusionMethod::Enum fusion;
     // Periodic Messages
     int heartbeat_ms, status_ms;
+    int ack_timeout_ms;
+    int ack_retries;
     // Robot Model Parameters
     uint16_t ticks_per_rev;
     double wheel_radius_m;
@@ -30,28 +44,60 @@ struct DiffDriveSettings {
     bool flip_right;
 };
 
+// Latest odometry estimate, as published to the odometry callbacks.
+struct OdometrySnapshot {
+    Pose2D pose;
+    double v_linear; // m/s
+    double omega;    // rad/s
+    can::Timestamp stamp;
+};
+
+/*
+ * Differential or skid-steer drive built from Jaguars on a shared bridge.
+ *
+ * Two threads touch the robot: the control thread, which calls drive_*()
+ * and the setters, and the bridge's receive thread, which runs the status
+ * callbacks. State that crosses between them is grouped into snapshots with
+ * a single writer each, published through a SeqLock: geometry and targets
+ * are written by the control thread, odometry and the e-stop state by the
+ * receive thread. Readers copy a snapshot without locking, so the receive
+ * thread never waits on the control thread. Everything else belongs to
+ * exactly one of the two threads.
+ */
 class DiffDriveRobot
 {
 public:
     enum Side { kNone, kLeft, kRight };
     typedef void EStopCallback(bool);
     typedef void DiagnosticsCallback(double, double);
-    typedef void OdometryCallback(double, double, double, double, double, double, double, double, double);
+    typedef void OdometryCallback(Pose2D const &, double, double, double, double, double, double, can::Timestamp);
 
-    DiffDriveRobot(DiffDriveSettings const &settings);
+    // Talks to settings.port over a JaguarBridge unless another bridge is
+    // given, e.g. a ReplayBridge to re-run a recorded session.
+    DiffDriveRobot(DiffDriveSettings const &settings,
+                   boost::shared_ptr<can::CANBridge> bridge = boost::shared_ptr<can::CANBridge>());
     virtual ~DiffDriveRobot(void);
 
     virtual void heartbeat(void);
     virtual void drive(double v, double omega);
     virtual void drive_raw(double v_left, double v_right);
     virtual void drive_brake(bool braking);
+    // Streams the current setpoints without waiting for ACKs. Call once per
+    // control tick; dt is the nominal period of the loop.
     virtual void drive_spin(double dt);
+    virtual SetpointStreamStats drive_stats(void) const;
 
     virtual void odom_set_circumference(double circum_m);
     virtual void odom_set_separation(double separation_m);
     virtual void odom_set_encoders(uint16_t cpr);
     virtual void odom_set_rate(uint8_t rate_ms);
+    // Selects how wheel motion is integrated into the pose, and the variance
+    // of each wheel's distance per meter travelled.
+    virtual void odom_set_integrator(Integrator::Enum method);
+    virtual void odom_set_noise(double variance_per_meter);
     virtual void odom_attach(boost::function<OdometryCallback> callback);
+    // Wait-free; safe to poll from any thread.
+    virtual OdometrySnapshot odom_latest(void) const;
 
     virtual void speed_set_p(double p);
     virtual void speed_set_i(double i);
@@ -64,24 +110,27 @@ public:
 
     virtual void estop_attach(boost::function<EStopCallback> callback);
 
-private:
-    // Wheel Odometry
-    struct Odometry {
-        Odometry(void)
-            : init(false)
-            , pos_curr(0.0)
-            , pos_prev(0.0)
-            , vel(0.0)
-        {}
+    // Motor controllers in the order given by the settings, left side first.
+    virtual size_t motors(void) const;
+    virtual Side motor_side(size_t motor) const;
+    virtual uint8_t motor_id(size_t motor) const;
 
-        Side side;
-        bool init;
-        double pos_curr, pos_prev;
-        double vel;
-    };
+    // Latest status received from one motor controller. Wait-free, so it can
+    // be polled from any thread.
+    virtual DeviceStatus status(size_t motor) const;
+
+    // Pipeline configuration commands: between config_begin() and
+    // config_commit() commands are sent immediately, but their ACKs are only
+    // collected by config_commit(), so N commands cost about one round trip.
+    virtual void config_begin(void);
+    virtual bool config_commit(void);
 
+private:
+    // Wheel Odometry
     virtual void odom_init(void);
-    virtual void odom_update(Odometry &side, double pos, double vel);
+    virtual void odom_update(size_t motor, double pos, double vel, can::Timestamp stamp);
+    bool odom_fuse(Side side, OdometryStep const &step,
+                   double &revs, double &rpm_start, double &rpm) const;
 
     // Speed Control
     virtual void speed_init(void);
@@ -95,33 +144,75 @@ private:
     };
 
     void diag_init(void);
-    void diag_update(Side side, Diagnostics &diag,
+    void diag_update(size_t motor,
                      LimitStatus::Enum limits, Fault::Enum faults,
                      double voltage, double temperature);
+    bool diag_stopped(void) const;
 
-    virtual void block(can::TokenPtr t1, can::TokenPtr t2);
+    // Sends command to every motor on side, or to every motor if side is
+    // kNone, and collects the tokens so one block() waits for all of them.
+    typedef boost::function<can::TokenPtr (Jaguar &)> Command;
+    void send(Side side, Command const &command, std::vector<can::TokenPtr> &tokens);
+    bool send_all(Command const &command);
 
-    can::JaguarBridge bridge_;
+    // Waits for every token, or defers them to config_commit() while
+    // configuration is being pipelined.
+    virtual bool block(std::vector<can::TokenPtr> const &tokens);
+
+    struct Motor {
+        Side side;
+        boost::shared_ptr<Jaguar> jaguar;
+        Diagnostics diag;
+    };
+
+    boost::shared_ptr<can::CANBridge> bridge_;
     jaguar::JaguarBroadcaster jag_broadcast_;
-    jaguar::Jaguar jag_left_, jag_right_;
-    boost::mutex mutex_;
+    std::vector<Motor> motors_;
+
+    // Every motor's speed setpoint, applied by one synchronous update and
+    // verified against the status stream. Motor i is member i of the group.
+    jaguar::MotorGroup drive_group_;
+    boost::scoped_ptr<jaguar::SetpointStream> drive_stream_;
+
+    // Pipelined configuration
+    bool config_batch_;
+    std::vector<can::TokenPtr> config_tokens_;
+
+    // Shared with the receive thread. Written by the setters, which
+    // serialize on mutex_; the receive thread never takes it.
+    struct Geometry {
+        double wheel_circum;
+        double wheel_sep;
+        double odom_noise; // variance per meter travelled
+        Integrator::Enum integrator;
+    };
+
+    // Shared with drive_spin(). Written by drive() and drive_raw().
+    struct Targets {
+        double rpm_left, rpm_right;
+    };
 
-    // Odometry
-    Side odom_state_;
-    Odometry odom_left_, odom_right_;
-    double x_, y_, theta_;
+    boost::mutex mutex_;
+    Geometry geometry_staging_;
+    SeqLock<Geometry> geometry_;
+    SeqLock<Targets> targets_;
+
+    // Odometry, with one stream per motor. Owned by the receive thread.
+    OdometryFusion odom_fusion_;
+    FusionMethod::Enum const odom_fusion_method_;
+    Pose2D pose_;
     boost::signal<OdometryCallback> odom_signal_;
-    double wheel_circum_, wheel_sep_;
+    SeqLock<OdometrySnapshot> odom_latest_;
 
-    // Status message
+    // Status message. Owned by the receive thread, except for the e-stop
+    // state, which the control thread reads.
     bool diag_init_;
-    Diagnostics diag_left_, diag_right_;
+    boost::atomic<bool> estopped_;
     boost::signal<EStopCallback> estop_signal_;
     boost::signal<DiagnosticsCallback> diag_left_signal_, diag_right_signal_;
 
-    // Acceleration limiting code.
-    double current_rpm_left_, current_rpm_right_;
-    double target_rpm_left_, target_rpm_right_;
+    // Acceleration limit, applied by drive_stream_. Owned by the control
+    // thread.
     double accel_max_;
 
     // Flipped encoder orientation.
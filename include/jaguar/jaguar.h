@@ -20,6 +20,8 @@
 #include "jaguar.h"
 #include "jaguar_api.h"
 #include "jaguar_helper.h"
+#include "status_cache.h"
+#include "status_decoder.h"
 
 namespace jaguar {
 
@@ -30,11 +32,33 @@ class AggregateStatus;
 
 class Jaguar {
 public:
-    typedef void DiagCallback(LimitStatus::Enum, Fault::Enum, double, double);
-    typedef void OdomCallback(double, double);
+    // Periodic status callbacks receive the monotonic time at which the
+    // status message started arriving as their last argument.
+    typedef void DiagCallback(LimitStatus::Enum, Fault::Enum, double, double, can::Timestamp);
+    typedef void OdomCallback(double, double, can::Timestamp);
+    typedef void StatusCallback(StatusSample const &);
+
+    // Payload length of the status messages set up by periodic_config_diag()
+    // and periodic_config_odom().
+    static size_t const kDiagStatusLength;
+    static size_t const kOdomStatusLength;
 
     Jaguar(can::CANBridge &can, uint8_t device_num);
 
+    uint8_t device_num(void) const;
+
+    // Maximum time to wait for the device to acknowledge a command.
+    void ack_timeout_set(boost::posix_time::time_duration const &timeout);
+
+    // Number of times an unacknowledged configuration write is sent again
+    // before its token times out. Only takes effect with a finite ACK
+    // timeout. Setpoints and mode changes are never retried: ACKs carry no
+    // sequence number, so a repeat could land after a newer command or
+    // complete the wrong request. For the same reason a write is only sent
+    // again while no other command to this device awaits an ACK, so writes
+    // that are pipelined behind each other fail rather than retry.
+    void ack_retries_set(unsigned retries);
+
     // Motor Control Configuration
     can::TokenPtr config_brushes_set(uint8_t brushes);
     can::TokenPtr config_encoders_set(uint16_t lines);
@@ -49,6 +73,10 @@ public:
     void          voltage_set_noack(double scale);
     void          voltage_set_noack(double scale, uint8_t group);
 
+    // Limits how fast the firmware moves the output towards a new setpoint,
+    // in full scale per second. Zero disables the ramp.
+    can::TokenPtr voltage_set_ramp(double rate);
+
     // Speed Control
     can::TokenPtr speed_enable(void);
     can::TokenPtr speed_disable(void);
@@ -76,34 +104,40 @@ public:
     // Periodic Status Updates
     can::TokenPtr periodic_enable(uint8_t index, uint16_t rate_ms);
     can::TokenPtr periodic_disable(uint8_t index);
-    can::TokenPtr periodic_config(uint8_t index, AggregateStatus statuses);
+    can::TokenPtr periodic_config(uint8_t index, StatusPlan const &plan,
+                                  boost::function<StatusCallback> callback);
     can::TokenPtr periodic_config_diag(uint8_t index, boost::function<DiagCallback> callback);
     can::TokenPtr periodic_config_odom(uint8_t index, boost::function<OdomCallback> callback);
 
+    // Latest value of every field received by any of the periodic status
+    // messages above. Safe to call from any thread, and never blocks.
+    DeviceStatus status(void) const;
+
 private:
     typedef boost::signals2::signal<DiagCallback> DiagSignal;
     typedef boost::signals2::signal<OdomCallback> OdomSignal;
     typedef boost::shared_ptr<DiagSignal> DiagSignalPtr;
     typedef boost::shared_ptr<OdomSignal> OdomSignalPtr;
 
-    void diag_unpack(boost::shared_ptr<can::CANMessage> msg, uint8_t index);
-    void odom_unpack(boost::shared_ptr<can::CANMessage> msg, uint8_t index);
-    void periodic_unpack(boost::shared_ptr<can::CANMessage> message, AggregateStatus statuses);
+    void diag_unpack(can::FramePtr const &frame, uint8_t index);
+    void odom_unpack(can::FramePtr const &frame, uint8_t index);
+    void periodic_unpack(can::FramePtr const &frame, StatusPlan const &plan,
+                         boost::function<StatusCallback> const &callback);
 
-    template <typename T> T rescale(double x);
-
-    template <typename G>
-    void send(APIClass::Enum api_class, uint8_t api_index, G const &generator);
-    template <typename G>
-    can::TokenPtr send_ack(APIClass::Enum api_class, uint8_t api_index, G const &generator);
-    can::TokenPtr recv_ack(void);
+    // Commands are packed by the descriptors in jaguar_message.h.
+    void send(can::CANFrame const &frame);
+    can::TokenPtr send_ack(can::CANFrame const &frame);
+    can::TokenPtr send_config(can::CANFrame const &frame);
+    can::TokenPtr request_ack(can::CANMessage const &msg, unsigned retries);
 
     uint8_t const num_;
     can::CANBridge &can_;
-    can::TokenPtr token_;
+    boost::posix_time::time_duration ack_timeout_;
+    unsigned ack_retries_;
 
     std::vector<DiagSignalPtr> sig_diag_;
     std::vector<OdomSignalPtr> sig_odom_;
+    StatusCache status_;
 
     static Manufacturer::Enum const kManufacturer;
     static DeviceType::Enum   const kDeviceType;
@@ -192,27 +226,55 @@ inline Status::Ptr _name_(_name_##_::Callback callback) {                      \
     return boost::make_shared<_name_##_>(callback);                            \
 }
 
+// Like JAGUAR_MAKE_STATUS, but converts the raw fixed point value read by
+// _parser_ to engineering units with _convert_ before invoking the callback.
+#define JAGUAR_MAKE_FIXED_STATUS(_name_, _Traw_, _generator_, _parser_, _convert_) \
+class _name_##_ : public Status {                                              \
+public:                                                                        \
+    typedef boost::shared_ptr<_name_##_> Ptr;                                  \
+    typedef boost::function<void (double)> Callback;                           \
+                                                                               \
+    explicit _name_##_(Callback callback) : callback_(callback) {}             \
+                                                                               \
+    virtual uint8_t const *read(uint8_t const *begin, uint8_t const *end) {    \
+        _Traw_ raw;                                                            \
+        BOOST_VERIFY(boost::spirit::qi::parse(begin, end, _parser_, raw));     \
+        callback_(_convert_(raw));                                             \
+        return begin;                                                          \
+    }                                                                          \
+                                                                               \
+    virtual void write(std::back_insert_iterator<std::vector<uint8_t> > &data) \
+    {                                                                          \
+        BOOST_VERIFY(boost::spirit::karma::generate(data, _generator_));       \
+    }                                                                          \
+                                                                               \
+private:                                                                       \
+    Callback callback_;                                                        \
+};                                                                             \
+                                                                               \
+inline Status::Ptr _name_(_name_##_::Callback callback) {                      \
+    return boost::make_shared<_name_##_>(callback);                            \
+}
+
+/*
+ * Statuses describe a periodic status layout. Jaguar::periodic_config()
+ * compiles them into a StatusPlan; read() is only used to parse payloads
+ * outside of a Jaguar, e.g. from a log.
+ */
 namespace PeriodicStatus {
 using boost::spirit::byte_;
 using boost::spirit::little_word;
 using boost::spirit::little_dword;
 
-// TOOD: Replace this with proper parsers that automatically convert fixed
-// point numbers to floating point numbers.
-//#define little_s8p8   attr_cast(boost::spirit::little_word)
-//#define little_s16p16 attr_cast(boost::spirit::little_dword)
-#define little_s8p8   boost::spirit::little_word
-#define little_s16p16 boost::spirit::little_dword
-
-JAGUAR_MAKE_STATUS(OutputVoltagePercent, int16_t, byte_(1)  << byte_(2), little_s8p8);
-JAGUAR_MAKE_STATUS(BusVoltage, int16_t,  byte_(3) << byte_(4), little_s8p8)
-JAGUAR_MAKE_STATUS(Current, int16_t, byte_(5) << byte_(6), little_s8p8)
-JAGUAR_MAKE_STATUS(Temperature, int16_t,  byte_(7) << byte_(8), little_s8p8)
-JAGUAR_MAKE_STATUS(Position, int32_t, byte_(9)  << byte_(10) << byte_(11) << byte_(12), little_s16p16)
-JAGUAR_MAKE_STATUS(Speed, int32_t,  byte_(13) << byte_(14) << byte_(15) << byte_(16), little_s16p16);
+JAGUAR_MAKE_FIXED_STATUS(OutputVoltagePercent, int16_t, byte_(1) << byte_(2), little_word, fraction16_to_double)
+JAGUAR_MAKE_FIXED_STATUS(BusVoltage, int16_t, byte_(3) << byte_(4), little_word, s8p8_to_double)
+JAGUAR_MAKE_FIXED_STATUS(Current, int16_t, byte_(5) << byte_(6), little_word, s8p8_to_double)
+JAGUAR_MAKE_FIXED_STATUS(Temperature, int16_t, byte_(7) << byte_(8), little_word, s8p8_to_double)
+JAGUAR_MAKE_FIXED_STATUS(Position, int32_t, byte_(9) << byte_(10) << byte_(11) << byte_(12), little_dword, s16p16_to_double)
+JAGUAR_MAKE_FIXED_STATUS(Speed, int32_t, byte_(13) << byte_(14) << byte_(15) << byte_(16), little_dword, s16p16_to_double)
 JAGUAR_MAKE_STATUS(LimitNonClearing, uint8_t, byte_(17), byte_)
 JAGUAR_MAKE_STATUS(LimitClearing, uint8_t, byte_(18), byte_)
-JAGUAR_MAKE_STATUS(OutputVoltageVolts, int16_t, byte_(22) << byte_(23), little_s8p8)
+JAGUAR_MAKE_FIXED_STATUS(OutputVoltageVolts, int16_t, byte_(22) << byte_(23), little_word, s8p8_to_double)
 JAGUAR_MAKE_STATUS(CurrentFaultCounter, uint8_t, byte_(24), byte_)
 JAGUAR_MAKE_STATUS(TemperatureFaultCounter, uint8_t, byte_(25), byte_)
 JAGUAR_MAKE_STATUS(BusVoltageFaultCounter, uint8_t, byte_(26), byte_)
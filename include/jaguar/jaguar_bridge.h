@@ -5,13 +5,14 @@
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/signals2.hpp>
 #include <boost/thread.hpp>
-#include <map>
 #include <vector>
 #include <stdint.h>
+#include "basic_can_bridge.h"
 #include "can_bridge.h"
+#include "jaguar_codec.h"
 #include "jaguar_helper.h"
+#include "tx_scheduler.h"
 
 typedef boost::asio::buffers_iterator<
     boost::asio::streambuf::const_buffers_type> asio_iterator;
@@ -19,129 +20,72 @@ typedef boost::asio::buffers_iterator<
 
 namespace can {
 
-enum ReceiveState {
-    kWaiting,
-    kLength,
-    kPayload,
-    kComplete
-};
-
-template<typename T>
-class masked_number
+/*
+ * CANBridge that talks to a Jaguar over its RS-232 serial protocol.
+ *
+ * Outgoing frames are queued by traffic class (see tx_class()) and written
+ * in strict priority order. Writes are paced to the line rate so the
+ * kernel's transmit buffer never holds more than about one frame; a
+ * heartbeat or halt therefore overtakes any backlog of configuration or
+ * firmware traffic instead of waiting behind it. send() never blocks on the
+ * serial port, and write errors are reported through the error signal.
+ */
+class JaguarBridge : public BasicCANBridge, private JaguarCodec::Handler
 {
 public:
-	typedef T type;
-
-	masked_number(T const& num_, T const& mask_)
-	: num(num_), mask(mask_)
-	{
-		assert((num_ & ~mask_) == 0);
-	}
-
-	template <class U>
-	masked_number(masked_number<U> const &mn)
-	: num(mn.num), mask(mn.mask)
-	{}
-
-	bool matches(T val)
-	{
-		return (val & mask) == num;
-	}
-
-	T num;
-	T mask;
-};
+    // Cumulative traffic counters. Subtract two samples to measure the load
+    // over the interval between them; see jaguar::LinkPlanner::measured().
+    struct LinkUsage {
+        uint64_t tx_bytes, rx_bytes;
+        uint64_t tx_frames, rx_frames;
+        uint64_t tx_payload, rx_payload;
+        Timestamp stamp;
+    };
 
-template<typename T>
-masked_number<T> make_masked_number(T const &n, T const &m)
-{
-	return masked_number<T>(n, m);
-}
-
-class JaguarToken;
+    static unsigned const kBaudRate;
 
-class JaguarBridge : public CANBridge
-{
-public:
     JaguarBridge(std::string port);
     virtual ~JaguarBridge(void);
 
     virtual void send(CANMessage const &message);
-    virtual TokenPtr recv(uint32_t id);
-
-    virtual CallbackToken attach_callback(uint32_t id, recv_callback cb);
-    virtual CallbackToken attach_callback(uint32_t id, uint32_t id_mask,
-		    recv_callback cb);
-    virtual CallbackToken attach_callback(error_callback cb);
+    virtual void send_batch(CANMessage const *begin, CANMessage const *end);
 
-private:
-    typedef boost::signals2::signal<recv_callback_sig> callback_signal;
-    typedef boost::shared_ptr<callback_signal> callback_signal_ptr;
+    void tx_rate_limit_set(TxClass::Enum cls, double frames_per_sec, size_t burst);
+    TxClassStats tx_stats(TxClass::Enum cls) const;
 
-    typedef std::map<uint32_t, callback_signal_ptr> callback_table;
+    static TxClass::Enum tx_class(uint32_t id);
 
-    typedef std::pair<masked_number<uint32_t>, callback_signal_ptr> mask_callback;
-    typedef std::list<mask_callback> callback_list;
+    LinkUsage link_usage(void) const;
+    virtual BridgeMetricsSnapshot metrics(void) const;
 
-    typedef boost::shared_ptr<JaguarToken> token_ptr;
-    typedef std::map<uint32_t, token_ptr>  token_table;
-
-    static uint8_t const kSOF, kESC;
-    static uint8_t const kSOFESC, kESCESC;
+private:
+    static Timestamp const kByteTime;
+    static Timestamp const kPaceWindow;
     static size_t const kReceiveBufferLength;
+    static size_t const kSendBufferLength;
+    static boost::posix_time::time_duration const kFlushTimeout;
 
-    boost::asio::io_service  io_;
     boost::asio::serial_port serial_;
 
-    boost::signals2::signal<error_callback_sig> error_signal_;
-
-    boost::thread recv_thread_;
+    TxScheduler scheduler_;
+    boost::asio::deadline_timer pace_timer_;
+    bool pace_armed_;
+    Timestamp pace_due_;
+    Timestamp wire_free_;
+    std::vector<CANMessage> send_pending_;
+    std::vector<uint8_t> send_buffer_;
+    mutable boost::mutex send_mutex_;
     std::vector<uint8_t> recv_buffer_;
-    callback_table callbacks_;
-    callback_list  callbacks_list_;
-    boost::mutex callback_mutex_;
-
-    token_table tokens_;
-    boost::mutex token_mutex_;
+    Timestamp recv_stamp_;
 
-    std::vector<uint8_t> packet_;
-    ReceiveState state_;
-    size_t length_;
-    bool escape_;
+    JaguarCodec codec_;
 
-    boost::shared_ptr<CANMessage> recv_byte(uint8_t byte);
+    virtual void frame_decoded(CANFrame const &frame, size_t age);
+    virtual void decode_error(JaguarCodec::Status status, uint8_t byte);
     void recv_handle(boost::system::error_code const& error, size_t count);
-    void recv_message(boost::shared_ptr<CANMessage> msg);
-    void remove_token(boost::shared_ptr<CANMessage> msg);
-    void discard_token(JaguarToken &msg);
-
-    boost::shared_ptr<CANMessage> unpack_packet(std::vector<uint8_t> const &packet);
-    size_t encode_bytes(uint8_t const *bytes, size_t length, std::vector<uint8_t> &buffer);
-
-    friend class JaguarToken;
-};
-
-class JaguarToken : public Token {
-public:
-    virtual ~JaguarToken(void);
-    virtual void block(void);
-    virtual bool timed_block(boost::posix_time::time_duration const &duration);
-    virtual boost::shared_ptr<CANMessage const> message(void) const;
-    virtual bool ready(void) const;
-    virtual void discard(void);
-
-private:
-    bool done_;
-    JaguarBridge &bridge_;
-    uint32_t id_;
-    boost::shared_ptr<CANMessage> message_;
-    boost::condition_variable cond_;
-    boost::mutex mutex_;
-
-    JaguarToken(JaguarBridge &bridge, uint32_t id);
-    void unblock(boost::shared_ptr<CANMessage> message);
 
-    friend class JaguarBridge;
+    void pump(Timestamp now);
+    void pace_handle(boost::system::error_code const &error);
 };
 
 };
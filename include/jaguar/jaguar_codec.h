@@ -0,0 +1,91 @@
+#ifndef JAGUAR_CODEC_H_
+#define JAGUAR_CODEC_H_
+
+#include <stdint.h>
+#include "can_bridge.h"
+#include "can_frame.h"
+
+namespace can {
+
+enum ReceiveState {
+    kWaiting,
+    kLength,
+    kPayload,
+    kComplete
+};
+
+/*
+ * Byte-level framing used by the Jaguar's RS-232 interface: a start of frame
+ * byte, a length, then the little-endian CAN identifier and payload with SOF
+ * and ESC bytes escaped. The encoder is stateless; the decoder consumes one
+ * byte at a time and keeps its state between reads.
+ */
+class JaguarCodec
+{
+public:
+    enum Status {
+        kIncomplete,
+        kFrameComplete,
+        kInvalidLength,
+        kInvalidEscape
+    };
+
+    // Receives the output of a bulk decode, in stream order.
+    class Handler {
+    public:
+        virtual ~Handler(void) {}
+        // age is the number of bytes, from this frame's SOF through the end
+        // of the buffer being decoded, that arrived after the frame began.
+        virtual void frame_decoded(CANFrame const &frame, size_t age) = 0;
+        virtual void decode_error(Status status, uint8_t byte) = 0;
+    };
+
+    static uint8_t const kSOF, kESC;
+    static uint8_t const kSOFESC, kESCESC;
+    static size_t const kMaxEncodedLength;
+
+    JaguarCodec(void);
+
+    // Feed a single received byte. On kFrameComplete, frame holds the
+    // identifier and payload; its timestamp is left untouched. On
+    // kInvalidLength the offending length byte is stored in error_byte().
+    Status decode(uint8_t byte, CANFrame &frame);
+    uint8_t error_byte(void) const;
+
+    // Decode an entire read at once. Produces exactly the same frames and
+    // errors as feeding each byte to decode(uint8_t, CANFrame &), but skips
+    // over runs of ordinary bytes with memcpy() instead of stepping the state
+    // machine once per byte.
+    void decode(uint8_t const *begin, uint8_t const *end, Handler &handler);
+
+    static size_t encode_message(CANMessage const &message, uint8_t *buffer);
+    static size_t encode_bytes(uint8_t const *bytes, size_t length, uint8_t *buffer);
+
+private:
+    // Four byte ID plus at most eight bytes of payload.
+    uint8_t packet_[12];
+    size_t packet_length_;
+    ReceiveState state_;
+    size_t length_;
+    bool escape_;
+    uint8_t error_byte_;
+    size_t encoded_length_;
+
+    typedef void (*scan_function)(uint8_t const *bytes, size_t length, uint64_t *special);
+
+    static size_t const kBlockLength;
+    static scan_function const scan_;
+
+    void unpack_packet(CANFrame &frame) const;
+    void notify(Status status, uint8_t byte, CANFrame const &frame, size_t age,
+                Handler &handler) const;
+
+    static scan_function select_scan(void);
+    static size_t next_special(uint64_t const *special, size_t i, size_t length);
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
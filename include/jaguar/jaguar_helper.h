@@ -30,6 +30,9 @@ int32_t  double_to_s16p16(double x);
 double s8p8_to_double(int16_t x);
 double s16p16_to_double(int32_t x);
 
+// Signed 16-bit fraction of full scale, as used for the output voltage.
+double fraction16_to_double(int16_t x);
+
 uint32_t pack_id(uint8_t device_num, Manufacturer::Enum man, DeviceType::Enum type,
                  APIClass::Enum api_class, uint8_t api_index);
 
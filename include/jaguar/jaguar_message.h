@@ -0,0 +1,263 @@
+#ifndef JAGUAR_MESSAGE_H_
+#define JAGUAR_MESSAGE_H_
+
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+#include "can_frame.h"
+#include "jaguar_api.h"
+#include "jaguar_helper.h"
+
+namespace jaguar {
+
+/*
+ * Payload fields. Each one packs a single argument, little-endian, and
+ * returns the number of bytes it wrote.
+ */
+namespace field {
+
+struct None {
+    typedef uint8_t value_type;
+    static size_t const kLength = 0;
+};
+
+struct U8 {
+    typedef uint8_t value_type;
+    static size_t const kLength = 1;
+
+    static size_t write(uint8_t *p, value_type value)
+    {
+        p[0] = value;
+        return kLength;
+    }
+};
+
+struct U16 {
+    typedef uint16_t value_type;
+    static size_t const kLength = 2;
+
+    static size_t write(uint8_t *p, value_type value)
+    {
+        p[0] = static_cast<uint8_t>(value >> 0);
+        p[1] = static_cast<uint8_t>(value >> 8);
+        return kLength;
+    }
+};
+
+struct U32 {
+    typedef uint32_t value_type;
+    static size_t const kLength = 4;
+
+    static size_t write(uint8_t *p, value_type value)
+    {
+        p[0] = static_cast<uint8_t>(value >> 0);
+        p[1] = static_cast<uint8_t>(value >> 8);
+        p[2] = static_cast<uint8_t>(value >> 16);
+        p[3] = static_cast<uint8_t>(value >> 24);
+        return kLength;
+    }
+};
+
+// Signed 8.8 fixed point.
+struct S8P8 {
+    typedef double value_type;
+    static size_t const kLength = 2;
+
+    static size_t write(uint8_t *p, value_type value)
+    {
+        return U16::write(p, static_cast<uint16_t>(double_to_s8p8(value)));
+    }
+};
+
+// Signed 16.16 fixed point.
+struct S16P16 {
+    typedef double value_type;
+    static size_t const kLength = 4;
+
+    static size_t write(uint8_t *p, value_type value)
+    {
+        return U32::write(p, static_cast<uint32_t>(double_to_s16p16(value)));
+    }
+};
+
+// Fraction of full scale in [-1, +1], as a signed 16-bit integer.
+struct Fraction16 {
+    typedef double value_type;
+    static size_t const kLength = 2;
+
+    static size_t write(uint8_t *p, value_type value)
+    {
+        assert(-1.0 <= value && value <= +1.0);
+
+        int16_t scaled = 0;
+        if (value < 0) {
+            scaled = static_cast<int16_t>(std::numeric_limits<int16_t>::min() * -value);
+        } else if (value > 0) {
+            scaled = static_cast<int16_t>(std::numeric_limits<int16_t>::max() *  value);
+        }
+        return U16::write(p, static_cast<uint16_t>(scaled));
+    }
+};
+
+// Up to eight PeriodicStatusItems, terminated by kEndOfMessage if shorter.
+struct StatusLayout {
+    uint8_t items[8];
+    uint8_t length;
+};
+
+struct Layout {
+    typedef StatusLayout value_type;
+    static size_t const kLength = 8;
+
+    static size_t write(uint8_t *p, value_type const &layout)
+    {
+        assert(layout.length <= kLength);
+        memcpy(p, layout.items, layout.length);
+        if (layout.length < kLength) {
+            p[layout.length] = PeriodicStatusItem::kEndOfMessage;
+            return layout.length + 1;
+        }
+        return kLength;
+    }
+};
+
+};
+
+/*
+ * Compile-time description of one command: its API class and index, which
+ * fix everything in the identifier except the device number, and up to two
+ * payload fields. pack() fills in a CANFrame on the stack, so building a
+ * command never touches the heap.
+ *
+ * pack_at() adds an offset to the API index, for APIs such as the periodic
+ * status messages that come in numbered slots.
+ */
+template <APIClass::Enum Class, unsigned Index,
+          typename F1 = field::None, typename F2 = field::None>
+struct Message {
+    typedef typename F1::value_type first_type;
+    typedef typename F2::value_type second_type;
+
+    static uint32_t const kId
+        = (static_cast<uint32_t>(DeviceType::kMotorController)     << 24)
+        | (static_cast<uint32_t>(Manufacturer::kTexasInstruments) << 16)
+        | (static_cast<uint32_t>(Class) << 10)
+        | (static_cast<uint32_t>(Index) << 6);
+    static size_t const kMaxLength = F1::kLength + F2::kLength;
+
+    static uint32_t id(uint8_t device, uint8_t offset = 0)
+    {
+        assert((device & ~0x3F) == 0);
+        assert(((Index + offset) & ~0x0F) == 0);
+        return kId + (static_cast<uint32_t>(offset) << 6) + device;
+    }
+
+    static can::CANFrame pack_at(uint8_t device, uint8_t offset)
+    {
+        can::CANFrame frame;
+        frame.id = id(device, offset);
+        frame.dlc = 0;
+        frame.timestamp = 0;
+        return frame;
+    }
+
+    static can::CANFrame pack_at(uint8_t device, uint8_t offset, first_type const &a)
+    {
+        can::CANFrame frame = pack_at(device, offset);
+        frame.dlc = F1::write(frame.data, a);
+        return frame;
+    }
+
+    static can::CANFrame pack_at(uint8_t device, uint8_t offset,
+                                 first_type const &a, second_type const &b)
+    {
+        can::CANFrame frame = pack_at(device, offset);
+        frame.dlc = F1::write(frame.data, a);
+        frame.dlc += F2::write(frame.data + frame.dlc, b);
+        return frame;
+    }
+
+    static can::CANFrame pack(uint8_t device)
+    {
+        return pack_at(device, 0);
+    }
+
+    static can::CANFrame pack(uint8_t device, first_type const &a)
+    {
+        return pack_at(device, 0, a);
+    }
+
+    static can::CANFrame pack(uint8_t device, first_type const &a, second_type const &b)
+    {
+        return pack_at(device, 0, a, b);
+    }
+};
+
+template <APIClass::Enum Class, unsigned Index, typename F1, typename F2>
+uint32_t const Message<Class, Index, F1, F2>::kId;
+
+template <APIClass::Enum Class, unsigned Index, typename F1, typename F2>
+size_t const Message<Class, Index, F1, F2>::kMaxLength;
+
+namespace message {
+
+using namespace field;
+
+// Voltage Control
+typedef Message<APIClass::kVoltageControl, VoltageControl::kVoltageModeEnable>  VoltageModeEnable;
+typedef Message<APIClass::kVoltageControl, VoltageControl::kVoltageModeDisable> VoltageModeDisable;
+typedef Message<APIClass::kVoltageControl, VoltageControl::kVoltageSet, Fraction16>     VoltageSet;
+typedef Message<APIClass::kVoltageControl, VoltageControl::kVoltageSet, Fraction16, U8> VoltageSetGroup;
+typedef Message<APIClass::kVoltageControl, VoltageControl::kVoltageRampSet, U16>        VoltageRampSet;
+typedef Message<APIClass::kVoltageControl, VoltageControl::kVoltageSetNoACK, Fraction16>     VoltageSetNoACK;
+typedef Message<APIClass::kVoltageControl, VoltageControl::kVoltageSetNoACK, Fraction16, U8> VoltageSetNoACKGroup;
+
+// Speed Control
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedModeEnable>  SpeedModeEnable;
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedModeDisable> SpeedModeDisable;
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedSet, S16P16>     SpeedSet;
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedSet, S16P16, U8> SpeedSetGroup;
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedProportionalConstant, S16P16> SpeedP;
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedIntegralConstant, S16P16>     SpeedI;
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedDifferentialConstant, S16P16> SpeedD;
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedReference, U8> SpeedReferenceSet;
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedSetNoACK, S16P16>     SpeedSetNoACK;
+typedef Message<APIClass::kSpeedControl, SpeedControl::kSpeedSetNoACK, S16P16, U8> SpeedSetNoACKGroup;
+
+// Position Control
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionModeEnable>  PositionModeEnable;
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionModeDisable> PositionModeDisable;
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionSet, S16P16>     PositionSet;
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionSet, S16P16, U8> PositionSetGroup;
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionProportionalConstant, S16P16> PositionP;
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionIntegralConstant, S16P16>     PositionI;
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionDifferentialConstant, S16P16> PositionD;
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionReference, U8> PositionReferenceSet;
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionSetNoACK, S16P16>     PositionSetNoACK;
+typedef Message<APIClass::kPositionControl, PositionControl::kPositionSetNoACK, S16P16, U8> PositionSetNoACKGroup;
+
+// Configuration
+typedef Message<APIClass::kConfiguration, Configuration::kNumberOfBrushes, U8>             NumberOfBrushes;
+typedef Message<APIClass::kConfiguration, Configuration::kNumberOfEncodersLines, U16>      NumberOfEncoderLines;
+typedef Message<APIClass::kConfiguration, Configuration::kNumberOfPotentiometerTurns, U16> NumberOfPotentiometerTurns;
+typedef Message<APIClass::kConfiguration, Configuration::kBrakeCoastSetting, U8>           BrakeCoast;
+typedef Message<APIClass::kConfiguration, Configuration::kLimitMode, U8>                   LimitMode;
+typedef Message<APIClass::kConfiguration, Configuration::kForwardDirectionLimit, S16P16, U8> ForwardDirectionLimit;
+typedef Message<APIClass::kConfiguration, Configuration::kReverseDirectionLimit, S16P16, U8> ReverseDirectionLimit;
+typedef Message<APIClass::kConfiguration, Configuration::kMaximumOutputVoltage, S8P8>      MaximumOutputVoltage;
+typedef Message<APIClass::kConfiguration, Configuration::kFaultTime, U16>                  FaultTime;
+
+// Periodic Status, one of four slots selected with pack_at().
+typedef Message<APIClass::kPeriodicStatus, PeriodicStatus::kEnableMessage, U16>   PeriodicEnable;
+typedef Message<APIClass::kPeriodicStatus, PeriodicStatus::kEnableMessage, U8>    PeriodicDisable;
+typedef Message<APIClass::kPeriodicStatus, PeriodicStatus::kConfigureMessage, Layout> PeriodicConfigure;
+typedef Message<APIClass::kPeriodicStatus, PeriodicStatus::kPeriodicStatus>       PeriodicStatusMessage;
+
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
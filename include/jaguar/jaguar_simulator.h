@@ -0,0 +1,182 @@
+#ifndef JAGUAR_SIMULATOR_H_
+#define JAGUAR_SIMULATOR_H_
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+#include "can_frame.h"
+#include "jaguar_api.h"
+
+namespace jaguar {
+
+struct SimulatorSettings {
+    SimulatorSettings(void);
+
+    // Delay added to every frame sent by the simulated devices.
+    boost::posix_time::time_duration latency;
+
+    // Probability that a frame is lost, in either direction.
+    double drop_rate;
+
+    // Emulated line rate of the device-to-host link, in bits per second.
+    // Zero disables throttling.
+    unsigned baud_rate;
+
+    // Free speed at full output voltage and the time constant of the motor's
+    // first-order response to a change in output.
+    double max_rpm;
+    double time_constant;
+
+    // Seed for the drop generator, so lossy runs are repeatable.
+    unsigned seed;
+};
+
+/*
+ * Snapshot of a simulated motor controller's state. Speeds are in RPM and
+ * positions in revolutions, matching what the firmware reports.
+ */
+struct VirtualJaguarState {
+    uint8_t device_num;
+    ControlMode::Enum mode;
+    bool enabled;
+    bool halted;
+
+    double voltage;
+    double speed;
+    double position;
+
+    double voltage_target;
+    double speed_target;
+    double position_target;
+
+    // Voltage mode ramp, in full scale per second or zero for none, and the
+    // output it has reached on the way to voltage_target.
+    double voltage_ramp;
+    double voltage_output;
+
+    uint16_t encoder_lines;
+    BrakeCoastSetting::Enum brake;
+    uint16_t periodic_rate[4];
+
+    unsigned frames_received;
+    unsigned acks_sent;
+    unsigned statuses_sent;
+};
+
+/*
+ * Behavioural model of a single Jaguar motor controller. It decodes the
+ * commands addressed to it, acknowledges them the way the firmware does,
+ * integrates a simple first-order motor model, and emits the four periodic
+ * status messages.
+ */
+class VirtualJaguar
+{
+public:
+    VirtualJaguar(uint8_t device_num, SimulatorSettings const &settings);
+
+    bool accepts(uint32_t id) const;
+    void handle(can::CANFrame const &frame, std::vector<can::CANFrame> &responses);
+    void broadcast(can::CANFrame const &frame);
+    void step(double dt, std::vector<can::CANFrame> &responses);
+
+    VirtualJaguarState state(void) const;
+
+private:
+    static double const kHeartbeatTimeout;
+    static size_t const kNumPeriodic;
+    static size_t const kStatusImageLength;
+
+    struct Periodic {
+        uint16_t rate;
+        double elapsed;
+        std::vector<uint8_t> items;
+    };
+
+    SimulatorSettings const &settings_;
+    VirtualJaguarState state_;
+    std::vector<Periodic> periodic_;
+
+    // Setpoint received with a non-zero group, waiting for a synchronous
+    // update that names that group.
+    uint8_t pending_group_;
+    double pending_value_;
+
+    double since_heartbeat_;
+    bool heartbeat_seen_;
+
+    void ack(std::vector<can::CANFrame> &responses);
+    void set_target(double value, can::CANFrame const &frame, size_t offset);
+    void handle_periodic(uint8_t index, can::CANFrame const &frame,
+                         std::vector<can::CANFrame> &responses);
+    void status_image(uint8_t *image) const;
+    can::CANFrame make_frame(uint32_t id, uint8_t const *data, size_t length) const;
+};
+
+/*
+ * Host-side stand-in for a chain of Jaguars behind the RS-232 bridge. The
+ * simulator owns a pseudo-terminal and speaks the same UART framing as the
+ * firmware, so a JaguarBridge opened on port() cannot tell it apart from
+ * real hardware. Everything runs on a single thread with a one millisecond
+ * tick.
+ */
+class JaguarSimulator : boost::noncopyable
+{
+public:
+    JaguarSimulator(std::vector<uint8_t> const &device_nums,
+                    SimulatorSettings const &settings = SimulatorSettings());
+    ~JaguarSimulator(void);
+
+    std::string port(void) const;
+    VirtualJaguarState state(uint8_t device_num) const;
+    unsigned frames_dropped(void) const;
+
+private:
+    typedef boost::shared_ptr<VirtualJaguar> device_ptr;
+    typedef std::map<uint8_t, device_ptr> device_map;
+    typedef std::pair<can::Timestamp, can::CANFrame> pending_frame;
+
+    static uint8_t const kSOF, kESC;
+    static uint8_t const kSOFESC, kESCESC;
+    static size_t const kMaxEncodedLength;
+
+    SimulatorSettings const settings_;
+    int master_, slave_;
+    std::string port_;
+
+    device_map devices_;
+    std::deque<pending_frame> pending_;
+    can::Timestamp link_free_;
+    boost::random::mt19937 random_;
+    unsigned dropped_;
+    mutable boost::mutex mutex_;
+    boost::thread thread_;
+
+    // UART receive state, as in uart_if.c.
+    uint8_t packet_[12];
+    size_t packet_length_;
+    size_t length_;
+    bool escape_;
+    bool in_frame_;
+
+    void run(void);
+    void recv_bytes(uint8_t const *bytes, size_t length);
+    void recv_packet(uint8_t const *packet, size_t length);
+    void queue(std::vector<can::CANFrame> const &frames, can::Timestamp now);
+    void flush(can::Timestamp now);
+    bool drop(void);
+
+    static size_t encode_frame(can::CANFrame const &frame, uint8_t *buffer);
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,106 @@
+#ifndef LINK_PLANNER_H_
+#define LINK_PLANNER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "jaguar.h"
+#include "jaguar_bridge.h"
+
+namespace jaguar {
+
+// Fraction of capacity in use on each leg between the host and the motors.
+// The serial link is full duplex, so each direction is budgeted separately;
+// the CAN bus is shared by traffic in both directions.
+struct LinkLoad {
+    double tx;
+    double rx;
+    double bus;
+
+    double peak(void) const;
+};
+
+/*
+ * Estimates how much of the serial link and the CAN bus a configuration
+ * uses before it is applied. Every stream is costed at its worst case: all
+ * bytes escaped on the serial link and maximum bit stuffing on the bus, so
+ * a plan that fits here cannot be oversubscribed by unlucky data.
+ *
+ * Commands that are only sent when they change have two budgets: their
+ * steady cost shares the headroom with everything else, while their worst
+ * case, every one changing at full rate, only has to fit on the link.
+ */
+class LinkPlanner {
+public:
+    static double const kDefaultHeadroom;
+    static unsigned const kBusBitRate;
+
+    explicit LinkPlanner(unsigned baud_rate = can::JaguarBridge::kBaudRate,
+                         unsigned bus_bit_rate = kBusBitRate);
+
+    // Periodic status message of payload bytes sent by each of devices. The
+    // period of an adjustable stream may be lengthened by adjust().
+    size_t add_status(std::string const &name, size_t payload,
+                      unsigned period_ms, size_t devices, bool adjustable = true);
+    size_t add_status(std::string const &name, AggregateStatus statuses,
+                      unsigned period_ms, size_t devices, bool adjustable = true);
+
+    // Command sent by the host to each of devices. Acknowledged commands are
+    // answered by an empty ACK frame.
+    size_t add_command(std::string const &name, size_t payload,
+                       double period_ms, size_t devices, bool acked);
+
+    // Command that is sent at most every period_ms while it changes, and
+    // repeated every refresh_ms while it holds.
+    size_t add_changes(std::string const &name, size_t payload, double period_ms,
+                       double refresh_ms, size_t devices, bool acked);
+
+    // Steady load, and the load with every command changing at full rate.
+    LinkLoad load(void) const;
+    LinkLoad worst_load(void) const;
+
+    // The steady load must fit in headroom, and the worst case on the link.
+    bool feasible(double headroom = kDefaultHeadroom) const;
+
+    // Lengthen the periods of all adjustable streams by a common factor so
+    // the plan fits in headroom, never exceeding max_period_ms. Returns false
+    // if the fixed streams alone do not fit.
+    bool adjust(double headroom = kDefaultHeadroom, unsigned max_period_ms = 255);
+
+    double period_ms(size_t stream) const;
+    std::string report(void) const;
+
+    // Worst-case cost of a single frame.
+    static size_t serial_bytes(size_t payload);
+    static size_t bus_bits(size_t payload);
+
+    // Load measured by a bridge between two samples of its counters.
+    static LinkLoad measured(can::JaguarBridge::LinkUsage const &before,
+                             can::JaguarBridge::LinkUsage const &after,
+                             unsigned baud_rate = can::JaguarBridge::kBaudRate,
+                             unsigned bus_bit_rate = kBusBitRate);
+
+private:
+    struct Stream {
+        std::string name;
+        size_t payload;
+        double period_ms;
+        double refresh_ms;
+        size_t devices;
+        bool from_device;
+        bool acked;
+        bool adjustable;
+    };
+
+    double const serial_capacity_;
+    double const bus_capacity_;
+    std::vector<Stream> streams_;
+
+    void stream_load(Stream const &stream, bool worst, LinkLoad &load) const;
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,96 @@
+#ifndef MOTOR_GROUP_H_
+#define MOTOR_GROUP_H_
+
+#include <vector>
+#include <stdint.h>
+#include <boost/utility.hpp>
+#include "can_bridge.h"
+#include "jaguar.h"
+#include "jaguar_bridge.h"
+
+namespace jaguar {
+
+namespace GroupMode {
+    enum Enum {
+        kVoltage,
+        kSpeed,
+        kPosition
+    };
+};
+
+// Timing of one MotorGroup::commit().
+struct GroupCommit {
+    size_t motors;
+
+    // When the oldest setpoint in the commit was staged, and when the batch
+    // was handed to the bridge.
+    can::Timestamp staged;
+    can::Timestamp committed;
+
+    // Worst-case time from committed until the synchronous update has been
+    // received by every motor: the whole batch serialized over the serial
+    // link, then the synchronous update on the bus. Queueing behind other
+    // traffic is not included.
+    can::Timestamp apply_skew;
+};
+
+/*
+ * Updates the setpoints of several Jaguars on the same control edge. Each
+ * setpoint is staged in the device without an ACK, tagged with the group
+ * bit, and a single broadcast synchronous update applies all of them at
+ * once. A commit of N motors costs N + 1 frames and no ACKs, compared to 2N
+ * frames for acknowledged setpoints, which also take effect one at a time.
+ *
+ * Every member must already be in the control mode of the group. Not
+ * thread safe; stage and commit from the control loop.
+ */
+class MotorGroup : boost::noncopyable {
+public:
+    // group is the bit that selects this group in a synchronous update, so
+    // groups sharing a bus must use different bits. baud_rate is that of the
+    // serial link in front of the bus, or zero if there is none.
+    MotorGroup(can::CANBridge &can, GroupMode::Enum mode, uint8_t group,
+               unsigned baud_rate = can::JaguarBridge::kBaudRate);
+
+    size_t add(Jaguar const &jaguar);
+    size_t size(void) const;
+    uint8_t group(void) const;
+    GroupMode::Enum mode(void) const;
+
+    // True if the members can limit how fast their output changes in
+    // firmware. Only voltage control has a device-side ramp; see
+    // Jaguar::voltage_set_ramp().
+    bool ramps_on_device(void) const;
+
+    void stage(size_t motor, double value);
+
+    // Sends every staged setpoint, followed by one synchronous update, in a
+    // single batch. Motors with nothing staged keep their current setpoint.
+    GroupCommit commit(void);
+    GroupCommit const &last_commit(void) const;
+
+private:
+    struct Motor {
+        uint8_t device;
+        bool staged;
+        double value;
+    };
+
+    can::CANBridge &can_;
+    GroupMode::Enum const mode_;
+    uint8_t const group_;
+    unsigned const baud_rate_;
+
+    std::vector<Motor> motors_;
+    std::vector<can::CANMessage> batch_;
+    can::Timestamp staged_;
+    GroupCommit last_;
+
+    can::CANFrame pack(Motor const &motor) const;
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,145 @@
+#ifndef ODOMETRY_FUSION_H_
+#define ODOMETRY_FUSION_H_
+
+#include <vector>
+#include <stdint.h>
+#include "can_frame.h"
+
+namespace jaguar {
+
+namespace Wheel {
+    enum Enum {
+        kLeft  = 0,
+        kRight = 1
+    };
+};
+
+struct WheelSample {
+    can::Timestamp stamp;
+    double position; // revolutions
+    double speed;    // RPM
+};
+
+/*
+ * Fixed-size ring buffer of one wheel's most recent samples, kept in time
+ * order. When it is full the oldest sample is overwritten.
+ */
+class WheelHistory {
+public:
+    explicit WheelHistory(size_t capacity);
+
+    bool empty(void) const;
+    size_t size(void) const;
+    void clear(void);
+
+    // Samples by age, where 0 is the oldest.
+    WheelSample const &at(size_t i) const;
+    WheelSample const &oldest(void) const;
+    WheelSample const &latest(void) const;
+
+    // Inserts sample in time order. Samples normally arrive in order, so
+    // this is almost always an append.
+    void insert(WheelSample const &sample);
+
+    // Linearly interpolates between the two samples around stamp. Outside of
+    // the buffered span the nearest sample is returned unchanged.
+    WheelSample interpolate(can::Timestamp stamp) const;
+
+    // Drops every sample that is no longer needed to interpolate at or after
+    // stamp, i.e. all but the newest sample at or before it.
+    void discard_before(can::Timestamp stamp);
+
+private:
+    std::vector<WheelSample> ring_;
+    size_t head_;
+    size_t size_;
+
+    WheelSample &slot(size_t i);
+};
+
+// Motion of every encoder between two consecutive fused instants. Entries
+// are indexed by stream, e.g. by Wheel::Enum for a plain differential drive.
+struct OdometryStep {
+    can::Timestamp stamp;
+    can::Timestamp interval;
+
+    // Streams that were not live, or that were only re-referenced at this
+    // step, do not contribute and their entries are zero.
+    std::vector<bool> live;
+    std::vector<double> revs;
+    std::vector<double> rpm_start; // at the previous step
+    std::vector<double> rpm;       // at stamp
+};
+
+/*
+ * Pairs the independently sampled positions of several encoders. Each
+ * stream's status messages are buffered, and all of them are interpolated to
+ * the newest instant that is covered by every buffer. Every sample moves
+ * that instant forward or refines the interpolation, so none are wasted when
+ * one stream reports twice in a row or frames are reordered.
+ *
+ * The first samples only establish the reference positions, since the
+ * encoders may have come up in an unknown state. If a timeout is set, a
+ * stream that falls that far behind the newest sample, or that has not
+ * reported that long after the first sample, is left out rather than
+ * holding up the others. Its history is dropped, and it is re-referenced
+ * once it reports again.
+ * Not thread safe.
+ */
+class OdometryFusion {
+public:
+    explicit OdometryFusion(size_t streams = 2, size_t capacity = 8,
+                            can::Timestamp timeout = 0);
+
+    // Adds a sample. Returns true, and fills in step, if every live stream
+    // is now known at a later instant than the previous step.
+    bool add(size_t stream, WheelSample const &sample, OdometryStep &step);
+    void reset(void);
+
+    size_t size(void) const;
+
+    // Samples that arrived after every stream had already been fused past
+    // them, and were ignored.
+    uint64_t late(void) const;
+
+private:
+    struct Stream {
+        Stream(size_t capacity);
+
+        WheelHistory history;
+        bool referenced;
+        double position; // at the last fused instant
+        double speed;
+    };
+
+    std::vector<Stream> streams_;
+    can::Timestamp const timeout_;
+    bool init_;
+    can::Timestamp first_; // earliest sample since the last reset
+    can::Timestamp fused_;
+    uint64_t late_;
+
+    bool is_live(Stream const &stream, can::Timestamp newest) const;
+};
+
+namespace FusionMethod {
+    enum Enum {
+        kMedian,
+        kRejectOutliers
+    };
+};
+
+/*
+ * Combines redundant measurements of the same quantity, e.g. the encoders of
+ * several motors driving one side of a skid-steer robot. kRejectOutliers
+ * averages the values within three scaled median absolute deviations of the
+ * median, so a single slipping wheel or failed encoder is ignored without
+ * discarding the others. values is reordered.
+ */
+double fuse(std::vector<double> &values, FusionMethod::Enum method);
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
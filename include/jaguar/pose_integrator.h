@@ -0,0 +1,96 @@
+#ifndef POSE_INTEGRATOR_H_
+#define POSE_INTEGRATOR_H_
+
+namespace jaguar {
+
+namespace Integrator {
+    enum Enum {
+        kMidpoint    = 0,
+        kExactArc    = 1,
+        kRungeKutta4 = 2
+    };
+};
+
+// Planar pose of the robot and the covariance of (x, y, theta).
+struct Pose2D {
+    Pose2D(void);
+
+    double x, y;  // meters
+    double theta; // radians, counter-clockwise, in [-pi, pi]
+    double covariance[3][3];
+};
+
+// Motion of a differential drive between two odometry updates.
+struct DriveMotion {
+    double separation; // meters between the wheels
+
+    // Distance travelled by each wheel, in meters, and the variance of each
+    // distance. The robot turns counter-clockwise if the right wheel travels
+    // further.
+    double left, right;
+    double variance_left, variance_right;
+
+    // Wheel speeds at the start and the end of the motion, in m/s. Only
+    // their shape is used; the distances above are authoritative.
+    double v_left[2], v_right[2];
+};
+
+/*
+ * Integrates wheel odometry into a pose. Subclasses only differ in how the
+ * path between two updates is reconstructed; the covariance is propagated
+ * the same way by all of them, from the wheels' variances through the
+ * linearized motion model.
+ *
+ * Integrators are stateless, so the shared instances returned by
+ * pose_integrator() can be used from any thread.
+ */
+class PoseIntegrator {
+public:
+    virtual ~PoseIntegrator(void);
+
+    void step(Pose2D &pose, DriveMotion const &motion) const;
+    virtual char const *name(void) const = 0;
+
+protected:
+    // Moves pose by motion. theta does not have to be normalized.
+    virtual void advance(Pose2D &pose, DriveMotion const &motion) const = 0;
+};
+
+// Straight line along the mean heading. Second-order accurate; the error
+// grows with the heading change per update.
+class MidpointIntegrator : public PoseIntegrator {
+public:
+    virtual char const *name(void) const;
+
+protected:
+    virtual void advance(Pose2D &pose, DriveMotion const &motion) const;
+};
+
+// Constant-curvature arc. Exact if both wheels turn at a constant ratio
+// between updates, regardless of how far the robot turns.
+class ExactArcIntegrator : public PoseIntegrator {
+public:
+    virtual char const *name(void) const;
+
+protected:
+    virtual void advance(Pose2D &pose, DriveMotion const &motion) const;
+};
+
+// Classic fourth-order Runge-Kutta over a linear wheel speed profile, scaled
+// to the measured distances. Tracks curvature that changes between updates,
+// e.g. while accelerating into a turn.
+class RungeKutta4Integrator : public PoseIntegrator {
+public:
+    virtual char const *name(void) const;
+
+protected:
+    virtual void advance(Pose2D &pose, DriveMotion const &motion) const;
+};
+
+PoseIntegrator const &pose_integrator(Integrator::Enum method);
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
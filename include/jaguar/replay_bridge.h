@@ -0,0 +1,67 @@
+#ifndef REPLAY_BRIDGE_H_
+#define REPLAY_BRIDGE_H_
+
+#include <string>
+#include <boost/thread.hpp>
+#include "basic_can_bridge.h"
+#include "can_log.h"
+
+namespace can {
+
+/*
+ * CANBridge that plays back a log written by CANRecorder instead of talking
+ * to hardware. Received frames are dispatched to callbacks and requests
+ * exactly as a live bridge would; transmitted frames are counted and
+ * discarded.
+ *
+ * Frames are replayed at the recorded pace scaled by speed, so 2.0 is twice
+ * as fast and 0.0 is as fast as possible. In lockstep mode a received frame
+ * is not delivered until the program has transmitted at least as many frames
+ * as preceded it in the log, so a response never overtakes the request it
+ * answers. If the program falls behind the log for longer than
+ * kLockstepTimeout, it took a different path than the recorded session and
+ * the rest is replayed by time alone. Timestamps are shifted onto this process's monotonic clock by a
+ * constant offset; their spacing is preserved exactly.
+ */
+class ReplayBridge : public BasicCANBridge
+{
+public:
+    static boost::posix_time::time_duration const kLockstepTimeout;
+
+    ReplayBridge(std::string const &path, double speed = 1.0, bool lockstep = true);
+    virtual ~ReplayBridge(void);
+
+    virtual void send(CANMessage const &message);
+
+    // Start replaying. Attach callbacks first; nothing is delivered before.
+    void play(void);
+
+    // Block until every frame in the log has been replayed.
+    void wait(void);
+
+    size_t frames_sent(void) const;
+    size_t frames_replayed(void) const;
+
+private:
+    CANLog log_;
+    double speed_;
+    bool lockstep_;
+
+    // There is nothing to read, but the I/O thread still expires tokens.
+    boost::asio::io_service::work work_;
+
+    boost::thread thread_;
+    bool stopping_;
+    size_t sent_;
+    size_t replayed_;
+    mutable boost::mutex mutex_;
+    boost::condition_variable cond_;
+
+    void run(void);
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,80 @@
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+#include <cstring>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/utility.hpp>
+
+namespace jaguar {
+
+/*
+ * Sequence lock around a trivially copyable value. store() never waits and load() never
+ * writes to shared memory, so any number of readers can poll the value
+ * without slowing down the writer or each other. A reader only retries if
+ * it overlapped a store, which is a memcpy long.
+ *
+ * Only one thread may store at a time; callers with several writers must
+ * serialize them.
+ */
+template <typename T>
+class SeqLock : boost::noncopyable {
+public:
+    SeqLock(void)
+        : seq_(0)
+        , value_()
+    {
+    }
+
+    explicit SeqLock(T const &value)
+        : seq_(0)
+    {
+        memcpy(&value_, &value, sizeof value_);
+    }
+
+    void store(T const &value)
+    {
+        uint32_t const seq = seq_.load(boost::memory_order_relaxed);
+        seq_.store(seq + 1, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        memcpy(&value_, &value, sizeof value_);
+        seq_.store(seq + 2, boost::memory_order_release);
+    }
+
+    // Returns false, leaving value unspecified, if a store was in progress.
+    bool try_load(T &value) const
+    {
+        uint32_t const before = seq_.load(boost::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+
+        memcpy(&value, &value_, sizeof value_);
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        return seq_.load(boost::memory_order_relaxed) == before;
+    }
+
+    T load(void) const
+    {
+        T value;
+        while (!try_load(value)) {
+        }
+        return value;
+    }
+
+    // Number of completed stores.
+    uint32_t version(void) const
+    {
+        return seq_.load(boost::memory_order_acquire) >> 1;
+    }
+
+private:
+    boost::atomic<uint32_t> seq_;
+    T value_;
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
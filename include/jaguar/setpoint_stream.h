@@ -0,0 +1,125 @@
+#ifndef SETPOINT_STREAM_H_
+#define SETPOINT_STREAM_H_
+
+#include <vector>
+#include <boost/utility.hpp>
+#include "can_frame.h"
+#include "jaguar.h"
+#include "motor_group.h"
+#include "status_cache.h"
+
+namespace jaguar {
+
+struct SetpointStreamSettings {
+    SetpointStreamSettings(void);
+
+    // How often the status stream is compared against the setpoints.
+    double verify_period_s;
+
+    // A readback older than this means the device stopped reporting.
+    double status_timeout_s;
+
+    // Time a setpoint must be held before the motor is expected to follow.
+    double settle_s;
+
+    // Allowed difference between a setpoint and the readback, in the units
+    // of the setpoint, plus a fraction of its magnitude.
+    double tolerance;
+    double tolerance_fraction;
+
+    // A setpoint that has not changed is only sent again this often, in
+    // case the unacknowledged frame that carried it was lost. The devices
+    // hold their setpoints as long as the heartbeat continues. Zero sends
+    // every setpoint on every tick.
+    double refresh_s;
+};
+
+struct SetpointStreamStats {
+    uint64_t ticks;
+
+    // Ticks that started more than half a period late, and the longest
+    // interval between two ticks.
+    uint64_t overruns;
+    can::Timestamp max_interval;
+
+    // Longest time spent between begin_tick() and commit().
+    can::Timestamp max_work;
+
+    // Setpoints handed to the group, and unchanged setpoints that were not.
+    uint64_t sent;
+    uint64_t suppressed;
+
+    // Readbacks compared against a settled setpoint, readbacks that did not
+    // match, and checks that found no recent status at all.
+    uint64_t readbacks;
+    uint64_t mismatches;
+    uint64_t stale;
+};
+
+/*
+ * Streams unacknowledged setpoints to a MotorGroup from the control loop, so
+ * the loop never waits on a serial round trip. Only setpoints that changed
+ * are sent, plus a refresh every refresh_s, so a motor holding a steady
+ * setpoint costs almost no traffic. Instead of ACKs, delivery is verified
+ * every verify_period_s by comparing each device's cached status with the
+ * setpoint it was last given: a device that stops reporting, or that does
+ * not follow a setpoint it has held for settle_s, is counted.
+ *
+ * The rate at which setpoints change can be limited. Groups whose devices
+ * ramp in firmware are given the targets unchanged, and the caller sets the
+ * device ramp instead (Jaguar::voltage_set_ramp()); the others are stepped
+ * towards their targets here, once per tick.
+ *
+ * Only speed and position groups can be verified; a voltage group is
+ * streamed without readback.
+ */
+class SetpointStream : boost::noncopyable {
+public:
+    // jaguars[i] must be member i of group.
+    SetpointStream(MotorGroup &group, std::vector<Jaguar const *> const &jaguars,
+                   SetpointStreamSettings const &settings = SetpointStreamSettings());
+
+    // Start a tick that is expected period_s after the previous one.
+    void begin_tick(can::Timestamp now, double period_s);
+
+    // Limits how fast the setpoints move towards their targets, in setpoint
+    // units per second. Zero, the default, disables the limit. Has no effect
+    // on groups that ramp on the device.
+    void ramp_set(double rate);
+    void set(size_t motor, double target);
+
+    // Commits the staged setpoints and, if it is time, verifies them. Returns
+    // the number of motors that failed verification, or zero if none did or
+    // none were checked.
+    size_t commit(can::Timestamp now);
+
+    SetpointStreamStats const &stats(void) const;
+
+private:
+    struct Motor {
+        Jaguar const *jaguar;
+        double setpoint;
+        can::Timestamp since; // zero until the first setpoint
+        can::Timestamp sent;  // zero until the first send
+    };
+
+    MotorGroup &group_;
+    SetpointStreamSettings const settings_;
+    std::vector<Motor> motors_;
+    double ramp_;
+    bool staged_;
+
+    can::Timestamp tick_;
+    double period_;
+    can::Timestamp verified_;
+    SetpointStreamStats stats_;
+
+    bool verify(Motor &motor, can::Timestamp now);
+    bool matches(double setpoint, double readback) const;
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,67 @@
+#ifndef SOCKETCAN_BRIDGE_H_
+#define SOCKETCAN_BRIDGE_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/can.h>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include "basic_can_bridge.h"
+#include "can_bridge.h"
+
+namespace can {
+
+/*
+ * CANBridge backed by a Linux SocketCAN network interface (e.g. a USB-CAN
+ * adapter exposed as can0, or vcan0 for testing). Unlike JaguarBridge there
+ * is no serial link in the way, so throughput is limited only by the bus.
+ *
+ * Acceptance filters are pushed into the kernel with CAN_RAW_FILTER, so
+ * frames that no callback or request is interested in never reach user
+ * space. Frames are read in batches with recvmmsg() and are stamped with the
+ * kernel's SO_TIMESTAMP receive time.
+ */
+class SocketCANBridge : public BasicCANBridge
+{
+public:
+    SocketCANBridge(std::string interface);
+    virtual ~SocketCANBridge(void);
+
+    virtual void send(CANMessage const &message);
+    virtual void send_batch(CANMessage const *begin, CANMessage const *end);
+
+protected:
+    virtual void filters_changed(void);
+
+private:
+    static size_t const kBatchLength;
+    static size_t const kMaxFilters;
+
+    int socket_;
+    boost::asio::posix::stream_descriptor descriptor_;
+    boost::mutex send_mutex_;
+    boost::mutex filter_mutex_;
+
+    // Receive buffers for recvmmsg(). One control buffer per frame holds the
+    // SO_TIMESTAMP ancillary data.
+    std::vector<struct can_frame> recv_frames_;
+    std::vector<struct iovec> recv_iovecs_;
+    std::vector<struct mmsghdr> recv_headers_;
+    std::vector<uint8_t> recv_control_;
+
+    void recv_start(void);
+    void recv_handle(boost::system::error_code const &error);
+    Timestamp recv_timestamp(struct msghdr const &header, Timestamp now_mono,
+                             Timestamp now_real) const;
+
+    static void encode_frame(CANMessage const &message, struct can_frame &frame);
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
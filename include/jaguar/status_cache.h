@@ -0,0 +1,55 @@
+#ifndef STATUS_CACHE_H_
+#define STATUS_CACHE_H_
+
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+#include "can_frame.h"
+#include "seqlock.h"
+#include "status_decoder.h"
+
+namespace jaguar {
+
+// Latest value of every status field received from one device.
+struct DeviceStatus {
+    // Fields that have been received at least once are flagged valid.
+    // latest.stamp is the time of the most recent update of any field.
+    StatusSample latest;
+    can::Timestamp stamps[StatusField::kCount];
+
+    bool has(StatusField::Enum field) const;
+
+    // Seconds since field was last received, or infinity if it never was.
+    double age(StatusField::Enum field, can::Timestamp now) const;
+};
+
+/*
+ * Latest-value cache of a device's periodic status messages. Updates come
+ * from the bridge's receive thread and only ever merge newer fields in, so
+ * one status message carrying the odometry and another carrying the
+ * diagnostics fill in a single record. Readers take a consistent snapshot
+ * without locking, so polling it at the control rate never holds up the
+ * receive thread.
+ */
+class StatusCache : boost::noncopyable {
+public:
+    StatusCache(void);
+
+    void update(StatusSample const &sample);
+    DeviceStatus load(void) const;
+
+    // Number of updates so far, e.g. to detect that nothing new arrived.
+    uint32_t version(void) const;
+
+private:
+    // Serializes writers, in case a bridge dispatches from several threads.
+    // Readers never take it.
+    boost::mutex update_mutex_;
+    DeviceStatus staging_;
+    SeqLock<DeviceStatus> published_;
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
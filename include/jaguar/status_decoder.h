@@ -0,0 +1,126 @@
+#ifndef STATUS_DECODER_H_
+#define STATUS_DECODER_H_
+
+#include <stdint.h>
+#include "can_frame.h"
+#include "jaguar_api.h"
+#include "jaguar_message.h"
+
+namespace jaguar {
+
+class AggregateStatus;
+
+// Fields that can be requested in a periodic status message. Each one spans
+// one or more consecutive PeriodicStatusItems.
+namespace StatusField {
+    enum Enum {
+        kOutputVoltagePercent     = 0,
+        kBusVoltage               = 1,
+        kCurrent                  = 2,
+        kTemperature              = 3,
+        kPosition                 = 4,
+        kSpeed                    = 5,
+        kLimitNonClearing         = 6,
+        kLimitClearing            = 7,
+        kFaults                   = 8,
+        kStickyFaultsNonClearing  = 9,
+        kStickyFaultsClearing     = 10,
+        kOutputVoltageVolts       = 11,
+        kCurrentFaultCounter      = 12,
+        kTemperatureFaultCounter  = 13,
+        kBusVoltageFaultCounter   = 14,
+        kGateFaultCounter         = 15,
+        kCommunicationFaultCounter = 16,
+        kCount                    = 17
+    };
+};
+
+/*
+ * One periodic status message, in engineering units. Only the fields
+ * flagged in valid were present in the message; the rest are untouched.
+ */
+struct StatusSample {
+    can::Timestamp stamp;
+    uint32_t valid;
+
+    double output_voltage_percent; // fraction of full scale, [-1, +1)
+    double bus_voltage;            // volts
+    double current;                // amps
+    double temperature;            // degrees Celsius
+    double position;               // revolutions
+    double speed;                  // RPM
+    double output_voltage_volts;   // volts
+
+    uint8_t limit_non_clearing;
+    uint8_t limit_clearing;
+    uint8_t faults;
+    uint8_t sticky_faults_non_clearing;
+    uint8_t sticky_faults_clearing;
+    uint8_t current_fault_counter;
+    uint8_t temperature_fault_counter;
+    uint8_t bus_voltage_fault_counter;
+    uint8_t gate_fault_counter;
+    uint8_t communication_fault_counter;
+
+    bool has(StatusField::Enum field) const
+    {
+        return (valid >> field) & 1;
+    }
+};
+
+// Copies every field that is valid in from into into, and flags it valid.
+void merge(StatusSample const &from, StatusSample &into);
+
+/*
+ * Flat decode plan for one periodic status layout. The layout is compiled
+ * once, when the message is configured, into a list of (offset, width,
+ * scale, slot) entries; decoding a frame is a single pass over that list
+ * with no allocation, parsing or virtual calls.
+ *
+ * A field is only decoded if all of its items appear in order. Items that
+ * cover part of a field are still requested, so the layout is preserved,
+ * but never decoded.
+ */
+class StatusPlan {
+public:
+    struct Entry {
+        uint8_t offset;  // in the payload
+        uint8_t width;   // in bytes
+        uint8_t field;   // StatusField::Enum
+        uint8_t slot;    // byte offset into StatusSample
+        double  scale;   // signed fixed point if non-zero, else a raw byte
+    };
+
+    StatusPlan(void);
+    explicit StatusPlan(field::StatusLayout const &layout);
+    explicit StatusPlan(AggregateStatus statuses);
+
+    // Appends all items of field to the layout. Returns false, leaving the
+    // plan unchanged, if the field does not fit in the eight byte payload.
+    bool add(StatusField::Enum field);
+
+    field::StatusLayout const &layout(void) const;
+    size_t length(void) const;
+    size_t size(void) const;
+    Entry const &entry(size_t i) const;
+
+    // Decodes every field that is complete in data. Returns false if the
+    // payload is shorter than the layout.
+    bool decode(uint8_t const *data, size_t length, StatusSample &sample) const;
+
+    static PeriodicStatusItem::Enum item(StatusField::Enum field);
+    static size_t width(StatusField::Enum field);
+
+private:
+    field::StatusLayout layout_;
+    Entry entries_[8];
+    uint8_t size_;
+
+    void compile(void);
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,58 @@
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+namespace can {
+
+/*
+ * Hashed timer wheel driven by a single deadline_timer on an io_service.
+ * Scheduling is O(1) and each tick only visits one slot, so thousands of
+ * pending timeouts cost no more than a handful. The wheel stops ticking
+ * whenever it is empty.
+ *
+ * Callbacks run on the io_service's thread within one tick of the requested
+ * delay. There is no cancellation; callbacks should check whether they are
+ * still relevant when they fire.
+ */
+class TimerWheel : boost::noncopyable
+{
+public:
+    typedef boost::function<void (void)> callback;
+
+    TimerWheel(boost::asio::io_service &io, boost::posix_time::time_duration const &tick,
+               size_t slots);
+
+    // Safe to call from any thread.
+    void schedule(boost::posix_time::time_duration const &delay, callback cb);
+    size_t pending(void) const;
+
+private:
+    struct Entry {
+        size_t rounds;
+        callback cb;
+    };
+
+    boost::asio::io_service &io_;
+    boost::asio::deadline_timer timer_;
+    boost::posix_time::time_duration const tick_;
+
+    std::vector<std::vector<Entry> > slots_;
+    size_t cursor_;
+    size_t pending_;
+    bool running_;
+    mutable boost::mutex mutex_;
+
+    void start(void);
+    void advance(boost::system::error_code const &error);
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,82 @@
+#ifndef TX_SCHEDULER_H_
+#define TX_SCHEDULER_H_
+
+#include <deque>
+#include <stdint.h>
+#include <boost/utility.hpp>
+#include "can_bridge.h"
+#include "can_frame.h"
+
+namespace can {
+
+struct TxClass {
+    enum Enum {
+        kSystem   = 0, // halt, heartbeat, synchronous update
+        kSetpoint = 1, // voltage, speed, position and current setpoints
+        kConfig   = 2, // everything else
+        kBulk     = 3, // firmware transfers
+        kCount    = 4
+    };
+};
+
+struct TxClassStats {
+    size_t depth;
+    size_t max_depth;
+    uint64_t frames;
+    Timestamp max_wait;
+};
+
+/*
+ * Transmit queue with one FIFO per traffic class. The highest priority class
+ * with a frame that its rate limit allows always goes first, so a backlog of
+ * low priority traffic never delays a heartbeat by more than the frame that
+ * is already on the wire. Not thread safe; the owning bridge serializes
+ * access.
+ */
+class TxScheduler : boost::noncopyable
+{
+public:
+    TxScheduler(void);
+
+    // Token bucket limit of frames_per_sec, allowing bursts of up to burst
+    // frames. Zero frames_per_sec removes the limit.
+    void rate_limit_set(TxClass::Enum cls, double frames_per_sec, size_t burst);
+
+    void push(TxClass::Enum cls, CANMessage const &message, Timestamp now);
+
+    // Dequeue the next frame that may be sent at time now. Returns false if
+    // there is none, in which case wake is set to when a rate limited frame
+    // becomes eligible, or to zero if every queue is empty.
+    bool pop(Timestamp now, CANMessage &message, Timestamp &wake);
+
+    bool empty(void) const;
+    TxClassStats stats(TxClass::Enum cls) const;
+
+private:
+    struct Entry {
+        Entry(CANMessage const &p_message, Timestamp p_enqueued)
+            : message(p_message), enqueued(p_enqueued) {}
+
+        CANMessage message;
+        Timestamp enqueued;
+    };
+
+    struct Queue {
+        std::deque<Entry> entries;
+        double rate;
+        double burst;
+        double tokens;
+        Timestamp refilled;
+        TxClassStats stats;
+    };
+
+    Queue queues_[TxClass::kCount];
+
+    static void refill(Queue &queue, Timestamp now);
+};
+
+};
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
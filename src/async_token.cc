@@ -0,0 +1,225 @@
+#include <cassert>
+#include <boost/bind.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <jaguar/async_token.h>
+
+namespace can {
+
+AsyncToken::AsyncToken(void)
+    : done_(false)
+    , outcome_(kAnswered)
+{
+}
+
+AsyncToken::~AsyncToken(void)
+{
+}
+
+void AsyncToken::block(void)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while (!done_) {
+        cond_.wait(lock);
+    }
+}
+
+bool AsyncToken::timed_block(boost::posix_time::time_duration const &duration)
+{
+    return wait_until(boost::posix_time::microsec_clock::universal_time() + duration);
+}
+
+bool AsyncToken::wait_until(boost::posix_time::ptime const &deadline)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while (!done_) {
+        if (!cond_.timed_wait(lock, deadline)) {
+            return done_;
+        }
+    }
+    return true;
+}
+
+bool AsyncToken::ready(void) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return done_;
+}
+
+bool AsyncToken::timed_out(void) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return done_ && outcome_ == kTimedOut;
+}
+
+bool AsyncToken::cancelled(void) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return done_ && outcome_ == kCancelled;
+}
+
+boost::shared_ptr<CANMessage const> AsyncToken::message(void) const
+{
+    FramePtr const frame = this->frame();
+    if (!frame) {
+        return boost::shared_ptr<CANMessage const>();
+    }
+    return boost::make_shared<CANMessage>(*frame);
+}
+
+FramePtr AsyncToken::frame(void) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    assert(done_);
+    return frame_;
+}
+
+void AsyncToken::discard(void)
+{
+    cancel();
+}
+
+void AsyncToken::on_complete(completion_callback cb)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (!done_) {
+            callbacks_.push_back(cb);
+            return;
+        }
+    }
+    cb(*this);
+}
+
+bool AsyncToken::complete(FramePtr const &frame)
+{
+    return finish(frame, kAnswered);
+}
+
+bool AsyncToken::expire(void)
+{
+    return finish(FramePtr(), kTimedOut);
+}
+
+bool AsyncToken::cancel(void)
+{
+    return finish(FramePtr(), kCancelled);
+}
+
+bool AsyncToken::finish(FramePtr const &frame, Outcome outcome)
+{
+    std::vector<completion_callback> callbacks;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (done_) {
+            return false;
+        }
+        frame_ = frame;
+        outcome_ = outcome;
+        done_ = true;
+        callbacks.swap(callbacks_);
+    }
+    cond_.notify_all();
+
+    // Callbacks run without the lock held, so they are free to inspect this
+    // token or to chain further requests.
+    BOOST_FOREACH(completion_callback const &cb, callbacks) {
+        cb(*this);
+    }
+    return true;
+}
+
+/*
+ * Combinators
+ */
+namespace {
+
+struct WhenAllState {
+    WhenAllState(size_t count)
+        : pending(count)
+        , timeouts(0)
+        , cancellations(0)
+        , result(boost::make_shared<AsyncToken>())
+    {}
+
+    boost::detail::atomic_count pending;
+    boost::detail::atomic_count timeouts;
+    boost::detail::atomic_count cancellations;
+    boost::shared_ptr<AsyncToken> result;
+};
+
+void when_all_step(boost::shared_ptr<WhenAllState> const &state, Token &token)
+{
+    if (token.timed_out()) {
+        ++state->timeouts;
+    } else if (token.cancelled()) {
+        ++state->cancellations;
+    }
+    if (--state->pending == 0) {
+        if (state->timeouts > 0) {
+            state->result->expire();
+        } else if (state->cancellations > 0) {
+            state->result->cancel();
+        } else {
+            state->result->complete(FramePtr());
+        }
+    }
+}
+
+// Finishes result the way token finished.
+void follow(boost::shared_ptr<AsyncToken> const &result, Token &token)
+{
+    if (token.timed_out()) {
+        result->expire();
+    } else if (token.cancelled()) {
+        result->cancel();
+    } else {
+        result->complete(token.frame());
+    }
+}
+
+void then_step(boost::shared_ptr<AsyncToken> const &result, continuation const &next,
+               Token &token)
+{
+    if (token.failed()) {
+        follow(result, token);
+        return;
+    }
+
+    TokenPtr const following = next(token);
+    if (following) {
+        following->on_complete(boost::bind(&follow, result, _1));
+    } else {
+        result->complete(token.frame());
+    }
+}
+
+}
+
+TokenPtr when_all(std::vector<TokenPtr> const &tokens)
+{
+    if (tokens.empty()) {
+        boost::shared_ptr<AsyncToken> result = boost::make_shared<AsyncToken>();
+        result->complete(FramePtr());
+        return result;
+    }
+
+    boost::shared_ptr<WhenAllState> state = boost::make_shared<WhenAllState>(tokens.size());
+    TokenPtr const result = state->result;
+    BOOST_FOREACH(TokenPtr const &token, tokens) {
+        token->on_complete(boost::bind(&when_all_step, state, _1));
+    }
+    return result;
+}
+
+TokenPtr then(TokenPtr const &token, continuation next)
+{
+    boost::shared_ptr<AsyncToken> result = boost::make_shared<AsyncToken>();
+    token->on_complete(boost::bind(&then_step, result, next, _1));
+    return result;
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
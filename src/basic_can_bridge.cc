@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <cassert>
+#include <boost/bind.hpp>
+#include <boost/current_function.hpp>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <jaguar/basic_can_bridge.h>
+
+namespace can {
+
+// Built once at startup, so report_error() never has to allocate.
+static std::string const kErrorMessages[BridgeError::kCount] = {
+    BridgeError::message(BridgeError::kInvalidLength),
+    BridgeError::message(BridgeError::kInvalidEscape),
+    BridgeError::message(BridgeError::kReadFailed),
+    BridgeError::message(BridgeError::kWriteFailed),
+    BridgeError::message(BridgeError::kRequestTimedOut),
+    BridgeError::message(BridgeError::kRetransmitFailed)
+};
+
+// Upper bound on the number of received frames that can be referenced at
+// once before the pool starts falling back to the heap.
+size_t const BasicCANBridge::kFramePoolSize = 256;
+
+// Token timeouts are resolved to a millisecond, about the time one frame
+// spends on the serial link. One revolution of the wheel covers the usual
+// ACK timeouts; longer ones just take more rounds.
+boost::posix_time::time_duration const BasicCANBridge::kWheelTick
+    = boost::posix_time::milliseconds(1);
+size_t const BasicCANBridge::kWheelSlots = 512;
+
+BasicCANBridge::BasicCANBridge(void)
+    : wheel_(io_, kWheelTick, kWheelSlots)
+    , pool_(kFramePoolSize)
+{
+}
+
+BasicCANBridge::~BasicCANBridge(void)
+{
+    // Subclasses must call stop() before their I/O objects are destroyed.
+    assert(!io_thread_.joinable());
+}
+
+void BasicCANBridge::start(void)
+{
+    io_thread_ = boost::thread(boost::bind(&boost::asio::io_service::run, &io_));
+}
+
+void BasicCANBridge::stop(void)
+{
+    io_.stop();
+    if (io_thread_.joinable()) {
+        io_thread_.join();
+    }
+}
+
+void BasicCANBridge::filters_changed(void)
+{
+}
+
+std::vector<BasicCANBridge::filter> BasicCANBridge::filters(void) const
+{
+    std::vector<filter> filters = callbacks_.subscriptions();
+
+    boost::mutex::scoped_lock lock(token_mutex_);
+    BOOST_FOREACH(uint32_t id, token_ids_) {
+        filters.push_back(make_masked_number(id, CallbackTable::kExactMask));
+    }
+    return filters;
+}
+
+BridgeMetricsSnapshot BasicCANBridge::metrics(void) const
+{
+    return metrics_.snapshot();
+}
+
+void BasicCANBridge::report_error(BridgeError::Enum code, uint32_t detail,
+                                  char const *func, char const *file, unsigned line)
+{
+    metrics_.error(code, detail);
+    error_signal_(func, file, line, kErrorMessages[code]);
+}
+
+FramePtr BasicCANBridge::make_frame(CANFrame const &frame)
+{
+    return pool_.allocate(frame);
+}
+
+CallbackToken BasicCANBridge::attach_send_callback(frame_callback cb)
+{
+    return send_signal_.connect(cb);
+}
+
+void BasicCANBridge::sent(CANMessage const *begin, CANMessage const *end)
+{
+    size_t payload = 0;
+    for (CANMessage const *it = begin; it != end; ++it) {
+        payload += it->payload.size();
+    }
+    BridgeMetrics::count(metrics_.frames_out, end - begin);
+    BridgeMetrics::count(metrics_.payload_out, payload);
+    arm_sent(begin, end);
+
+    // Nothing is copied unless somebody is listening.
+    if (send_signal_.empty()) {
+        return;
+    }
+
+    Timestamp const now = monotonic_now();
+    for (CANMessage const *it = begin; it != end; ++it) {
+        CANFrame frame = CANFrame();
+        frame.id  = it->id;
+        frame.dlc = std::min<size_t>(it->payload.size(), 8);
+        std::copy(it->payload.begin(), it->payload.begin() + frame.dlc, frame.data);
+        frame.timestamp = now;
+        send_signal_(make_frame(frame));
+    }
+}
+
+TokenPtr BasicCANBridge::recv(uint32_t id)
+{
+    return recv(id, boost::posix_time::pos_infin);
+}
+
+TokenPtr BasicCANBridge::recv(uint32_t id, boost::posix_time::time_duration const &timeout)
+{
+    return add_token(id, timeout, boost::shared_ptr<CANMessage const>(), 0);
+}
+
+TokenPtr BasicCANBridge::request(CANMessage const &message, uint32_t response_id,
+                                 boost::posix_time::time_duration const &timeout,
+                                 unsigned retries)
+{
+    // Expect the response before sending, so it can't arrive unclaimed.
+    token_ptr token = add_token(response_id, timeout,
+                                boost::make_shared<CANMessage const>(message), retries);
+    try {
+        send(message);
+    } catch (...) {
+        // Still time out if the request never made it to sent().
+        arm_token(token);
+        throw;
+    }
+    return token;
+}
+
+BasicCANBridge::token_ptr BasicCANBridge::add_token(uint32_t id,
+    boost::posix_time::time_duration const &timeout,
+    boost::shared_ptr<CANMessage const> const &request, unsigned retries)
+{
+    // We can't use boost::make_shared because BasicToken's constructor is
+    // private, so we can only call it from a friend class.
+    token_ptr token(new BasicToken(*this, id, timeout));
+    token->request_ = request;
+    token->retries_ = retries;
+
+    // A request may wait behind other traffic before it reaches the wire, so
+    // its deadline is only set once sent() sees it go out.
+    bool const deferred = request && !timeout.is_special();
+    if (deferred) {
+        token->deadline_ = boost::posix_time::ptime();
+    }
+
+    // Responses are matched in the order the requests were made, so any
+    // number of requests may be outstanding for the same identifier.
+    bool new_id;
+    {
+        boost::mutex::scoped_lock lock(token_mutex_);
+        tokens_[id].push_back(token);
+        new_id = token_ids_.insert(id).second;
+        if (deferred) {
+            unsent_.push_back(token);
+        }
+    }
+    BridgeMetrics::count(metrics_.tokens_outstanding);
+
+    // The wheel only holds a weak reference, so it never extends the life of
+    // a token that nobody is interested in any more.
+    if (!timeout.is_special() && !deferred) {
+        wheel_.schedule(timeout, boost::bind(&BasicCANBridge::timeout_token, this,
+            boost::weak_ptr<BasicToken>(token)));
+    }
+
+    if (new_id) {
+        filters_changed();
+    }
+    return token;
+}
+
+CallbackToken BasicCANBridge::attach_frame_callback(uint32_t id, uint32_t id_mask, frame_callback cb)
+{
+    CallbackToken token = callbacks_.attach(id, id_mask, cb);
+    filters_changed();
+    return token;
+}
+
+CallbackToken BasicCANBridge::attach_callback(boost::function<error_callback_sig> cb)
+{
+    return error_signal_.connect(cb);
+}
+
+CallbackToken BasicCANBridge::attach_frame_callback(uint32_t id, frame_callback cb)
+{
+    return attach_frame_callback(id, CallbackTable::kExactMask, cb);
+}
+
+void BasicCANBridge::discard_token(BasicToken &token)
+{
+    boost::mutex::scoped_lock lock(token_mutex_);
+    token_table::iterator token_it = tokens_.find(token.id_);
+    if (token_it == tokens_.end()) {
+        return;
+    }
+
+    token_queue &queue = token_it->second;
+    for (token_queue::iterator it = queue.begin(); it != queue.end(); ++it) {
+        if (it->get() == &token) {
+            queue.erase(it);
+            metrics_.tokens_outstanding.fetch_sub(1, boost::memory_order_relaxed);
+            break;
+        }
+    }
+    if (queue.empty()) {
+        tokens_.erase(token_it);
+    }
+}
+
+void BasicCANBridge::timeout_token(boost::weak_ptr<BasicToken> const &weak)
+{
+    token_ptr const token = weak.lock();
+    if (!token) {
+        return;
+    }
+
+    // Only act if the token is still pending. Otherwise the response raced
+    // with the timeout and won.
+    bool retransmit = false;
+    bool expired = false;
+    {
+        boost::mutex::scoped_lock lock(token_mutex_);
+        token_table::iterator token_it = tokens_.find(token->id_);
+        if (token_it == tokens_.end()) {
+            return;
+        }
+
+        token_queue &queue = token_it->second;
+        token_queue::iterator it = std::find(queue.begin(), queue.end(), token);
+        if (it == queue.end()) {
+            return;
+        }
+
+        // Retransmitted requests keep their place in the queue, since the
+        // device still answers them in order. With anything queued behind
+        // it, a late answer to the first attempt followed by the answer to
+        // the retry would complete the next request too, so give up instead.
+        if (token->retries_ > 0 && queue.size() == 1) {
+            --token->retries_;
+            ++token->attempts_;
+            token->deadline_ = boost::posix_time::ptime();
+            unsent_.push_back(token);
+            retransmit = true;
+        } else {
+            queue.erase(it);
+            metrics_.tokens_outstanding.fetch_sub(1, boost::memory_order_relaxed);
+            expired = true;
+        }
+        if (queue.empty()) {
+            tokens_.erase(token_it);
+        }
+    }
+
+    // Neither sending nor completion may happen with token_mutex_ held:
+    // completion callbacks are free to issue new requests.
+    if (retransmit) {
+        // This runs on the I/O thread, so a failed write must not escape.
+        try {
+            send(*token->request_);
+        } catch (boost::system::system_error const &e) {
+            report_error(BridgeError::kRetransmitFailed, e.code().value(),
+                         BOOST_CURRENT_FUNCTION, __FILE__, __LINE__);
+            arm_token(token);
+        } catch (std::exception const &) {
+            report_error(BridgeError::kRetransmitFailed, 0,
+                         BOOST_CURRENT_FUNCTION, __FILE__, __LINE__);
+            arm_token(token);
+        }
+    } else if (expired) {
+        fail_token(token);
+    }
+}
+
+void BasicCANBridge::arm_token(token_ptr const &token)
+{
+    {
+        boost::mutex::scoped_lock lock(token_mutex_);
+        unsent_queue::iterator it = unsent_.begin();
+        while (it != unsent_.end() && it->lock() != token) {
+            ++it;
+        }
+        if (it == unsent_.end()) {
+            return;
+        }
+        unsent_.erase(it);
+        token->deadline_ = boost::posix_time::microsec_clock::universal_time()
+                         + token->timeout_;
+    }
+    wheel_.schedule(token->timeout_, boost::bind(&BasicCANBridge::timeout_token, this,
+        boost::weak_ptr<BasicToken>(token)));
+}
+
+void BasicCANBridge::arm_sent(CANMessage const *begin, CANMessage const *end)
+{
+    std::vector<token_ptr> armed;
+    {
+        boost::mutex::scoped_lock lock(token_mutex_);
+        if (unsent_.empty()) {
+            return;
+        }
+
+        // Each transmitted message starts the clock on the oldest request
+        // that is waiting for it; the transmit queue keeps them in order.
+        boost::posix_time::ptime const now = boost::posix_time::microsec_clock::universal_time();
+        for (CANMessage const *msg = begin; msg != end && !unsent_.empty(); ++msg) {
+            unsent_queue::iterator it = unsent_.begin();
+            while (it != unsent_.end()) {
+                token_ptr const token = it->lock();
+                if (!token) {
+                    it = unsent_.erase(it);
+                } else if (token->request_->id == msg->id) {
+                    token->deadline_ = now + token->timeout_;
+                    armed.push_back(token);
+                    unsent_.erase(it);
+                    break;
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    BOOST_FOREACH(token_ptr const &token, armed) {
+        wheel_.schedule(token->timeout_, boost::bind(&BasicCANBridge::timeout_token, this,
+            boost::weak_ptr<BasicToken>(token)));
+    }
+}
+
+void BasicCANBridge::fail_token(token_ptr const &token)
+{
+    // Report before waking anybody blocked on the token, so they see it.
+    if (token->request_ && !token->ready()) {
+        report_error(BridgeError::kRequestTimedOut, token->request_->id,
+                     BOOST_CURRENT_FUNCTION, __FILE__, __LINE__);
+    }
+    BridgeMetrics::count(metrics_.tokens_timed_out);
+    token->expire();
+}
+
+void BasicCANBridge::expire_tokens(token_queue &queue, boost::posix_time::ptime const &now,
+                                   std::vector<token_ptr> &expired)
+{
+    token_queue::iterator it = queue.begin();
+    while (it != queue.end()) {
+        // Requests that will be retransmitted may still be answered late.
+        token_ptr token = *it;
+        if (!token->deadline_.is_special() && token->deadline_ <= now
+         && (token->retries_ == 0 || queue.size() > 1)) {
+            it = queue.erase(it);
+            metrics_.tokens_outstanding.fetch_sub(1, boost::memory_order_relaxed);
+            expired.push_back(token);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void BasicCANBridge::remove_token(FramePtr const &frame)
+{
+    std::vector<token_ptr> expired;
+    token_ptr matched;
+    {
+        boost::posix_time::ptime const now = boost::posix_time::microsec_clock::universal_time();
+        boost::mutex::scoped_lock lock(token_mutex_);
+
+        // Every attempt at a retransmitted request may be answered, so the
+        // answers after the first belong to nobody. Dropping a genuine
+        // response instead costs at worst a timeout and a retry.
+        surplus_table::iterator surplus = surplus_.find(frame->id);
+        if (surplus != surplus_.end()) {
+            if (surplus->second.until > now) {
+                if (--surplus->second.count == 0) {
+                    surplus_.erase(surplus);
+                }
+                return;
+            }
+            surplus_.erase(surplus);
+        }
+
+        token_table::iterator token_it = tokens_.find(frame->id);
+        if (token_it == tokens_.end()) {
+            return;
+        }
+
+        // Requests whose deadline has already passed must not steal this
+        // response from a request that is still waiting for it.
+        token_queue &queue = token_it->second;
+        expire_tokens(queue, now, expired);
+
+        // Wake the oldest request that is blocking for a response.
+        if (!queue.empty()) {
+            matched = queue.front();
+            queue.pop_front();
+            metrics_.tokens_outstanding.fetch_sub(1, boost::memory_order_relaxed);
+
+            if (matched->attempts_ > 1) {
+                Surplus &owed = surplus_[frame->id];
+                owed.count = matched->attempts_ - 1;
+                owed.until = now + matched->timeout_;
+            }
+        }
+        if (queue.empty()) {
+            tokens_.erase(token_it);
+        }
+    }
+
+    BOOST_FOREACH(token_ptr const &token, expired) {
+        fail_token(token);
+    }
+    if (matched) {
+        matched->complete(frame);
+    }
+}
+
+void BasicCANBridge::recv_frame(FramePtr const &frame)
+{
+    BridgeMetrics::count(metrics_.frames_in);
+    BridgeMetrics::count(metrics_.payload_in, frame->dlc);
+
+    Timestamp const start = monotonic_now();
+    callbacks_.dispatch(frame);
+    remove_token(frame);
+    metrics_.dispatch_us.record((monotonic_now() - start) / 1000);
+}
+
+/*
+ * BasicToken
+ */
+BasicToken::BasicToken(BasicCANBridge &bridge, uint32_t id,
+                       boost::posix_time::time_duration const &timeout)
+    : bridge_(bridge)
+    , id_(id)
+    , timeout_(timeout)
+    , retries_(0)
+    , attempts_(1)
+{
+    if (!timeout.is_special()) {
+        deadline_ = boost::posix_time::microsec_clock::universal_time() + timeout;
+    }
+}
+
+BasicToken::~BasicToken(void)
+{
+    // FIXME: This causes deadlock (or something similar).
+    //bridge_.discard_token(*this);
+}
+
+void BasicToken::discard(void)
+{
+    bridge_.discard_token(*this);
+    AsyncToken::discard();
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,111 @@
+#include <jaguar/bridge_metrics.h>
+
+namespace can {
+
+char const *BridgeError::message(Enum code)
+{
+    switch (code) {
+    case kInvalidLength:    return "received frame with invalid length";
+    case kInvalidEscape:    return "received invalid escape sequence";
+    case kReadFailed:       return "read failed";
+    case kWriteFailed:      return "write failed";
+    case kRequestTimedOut:  return "request was not answered";
+    case kRetransmitFailed: return "unable to retransmit request";
+    default:             return "unknown error";
+    }
+}
+
+/*
+ * Histogram
+ */
+size_t const Histogram::kBuckets;
+
+Histogram::Histogram(void)
+{
+    for (size_t i = 0; i < kBuckets; ++i) {
+        buckets_[i].store(0, boost::memory_order_relaxed);
+    }
+}
+
+void Histogram::record(uint64_t value)
+{
+    size_t bucket = (value < 2) ? 0 : 63 - __builtin_clzll(value);
+    if (bucket >= kBuckets) {
+        bucket = kBuckets - 1;
+    }
+    buckets_[bucket].fetch_add(1, boost::memory_order_relaxed);
+}
+
+void Histogram::snapshot(uint64_t *buckets) const
+{
+    for (size_t i = 0; i < kBuckets; ++i) {
+        buckets[i] = buckets_[i].load(boost::memory_order_relaxed);
+    }
+}
+
+/*
+ * BridgeMetrics
+ */
+BridgeMetrics::BridgeMetrics(void)
+    : frames_in(0), frames_out(0)
+    , bytes_in(0), bytes_out(0)
+    , payload_in(0), payload_out(0)
+    , last_error(BridgeError::kCount)
+    , last_error_detail(0)
+    , tokens_outstanding(0)
+    , tokens_timed_out(0)
+    , recv_latency_max(0)
+{
+    for (size_t i = 0; i < BridgeError::kCount; ++i) {
+        errors[i].store(0, boost::memory_order_relaxed);
+    }
+}
+
+void BridgeMetrics::record_max(boost::atomic<uint64_t> &maximum, uint64_t value)
+{
+    uint64_t current = maximum.load(boost::memory_order_relaxed);
+    while (value > current
+        && !maximum.compare_exchange_weak(current, value, boost::memory_order_relaxed)) {
+    }
+}
+
+void BridgeMetrics::error(BridgeError::Enum code, uint32_t detail)
+{
+    errors[code].fetch_add(1, boost::memory_order_relaxed);
+    last_error.store(code, boost::memory_order_relaxed);
+    last_error_detail.store(detail, boost::memory_order_relaxed);
+}
+
+BridgeMetricsSnapshot BridgeMetrics::snapshot(void) const
+{
+    BridgeMetricsSnapshot s;
+    s.stamp = monotonic_now();
+    s.frames_in   = frames_in.load(boost::memory_order_relaxed);
+    s.frames_out  = frames_out.load(boost::memory_order_relaxed);
+    s.bytes_in    = bytes_in.load(boost::memory_order_relaxed);
+    s.bytes_out   = bytes_out.load(boost::memory_order_relaxed);
+    s.payload_in  = payload_in.load(boost::memory_order_relaxed);
+    s.payload_out = payload_out.load(boost::memory_order_relaxed);
+
+    // Only transports that know their framing can tell escapes apart.
+    s.escape_bytes_in  = 0;
+    s.escape_bytes_out = 0;
+
+    for (size_t i = 0; i < BridgeError::kCount; ++i) {
+        s.errors[i] = errors[i].load(boost::memory_order_relaxed);
+    }
+    s.last_error        = last_error.load(boost::memory_order_relaxed);
+    s.last_error_detail = last_error_detail.load(boost::memory_order_relaxed);
+
+    s.tokens_outstanding = tokens_outstanding.load(boost::memory_order_relaxed);
+    s.tokens_timed_out   = tokens_timed_out.load(boost::memory_order_relaxed);
+
+    dispatch_us.snapshot(s.dispatch_us);
+    read_size.snapshot(s.read_size);
+    s.recv_latency_max = recv_latency_max.load(boost::memory_order_relaxed);
+    return s;
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,118 @@
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <jaguar/callback_table.h>
+
+namespace can {
+
+uint32_t const CallbackTable::kExactMask = 0xFFFFFFFF;
+
+CallbackTable::CallbackTable(void)
+    : index_(boost::make_shared<Index>())
+{
+}
+
+CallbackToken CallbackTable::attach(uint32_t id, uint32_t id_mask, frame_callback cb)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+
+    // Subscribing to an (id, mask) pair that already has a signal only adds
+    // another slot, so the index does not need to be rebuilt.
+    subscription const key = make_masked_number(id, id_mask);
+    std::map<subscription, callback_signal_ptr>::const_iterator it
+        = index_->signals.find(key);
+    if (it != index_->signals.end()) {
+        return it->second->connect(cb);
+    }
+
+    // Otherwise copy the current index, add the new signal, and publish the
+    // copy. Readers holding the old index keep it alive until they finish.
+    boost::shared_ptr<Index> index = boost::make_shared<Index>(*index_);
+    callback_signal_ptr signal = boost::make_shared<callback_signal>();
+    CallbackToken token = signal->connect(cb);
+    index->signals.insert(std::make_pair(key, signal));
+    compile(*index);
+
+    boost::shared_ptr<Index const> const_index = index;
+    boost::atomic_store(&index_, const_index);
+    return token;
+}
+
+void CallbackTable::dispatch(FramePtr const &frame) const
+{
+    boost::shared_ptr<Index const> index = boost::atomic_load(&index_);
+
+    // Identifiers with an exact subscription have their complete fan-out list
+    // precomputed, including every masked subscription that matches them.
+    boost::unordered_map<uint32_t, fanout_list>::const_iterator fanout_it
+        = index->fanout.find(frame->id);
+    if (fanout_it != index->fanout.end()) {
+        BOOST_FOREACH(callback_signal_ptr const &signal, fanout_it->second) {
+            (*signal)(frame);
+        }
+        return;
+    }
+
+    // Everything else needs one hash lookup per distinct mask. In practice
+    // there are only a handful of masks (e.g. "everything" and "one device").
+    BOOST_FOREACH(MaskGroup const &group, index->groups) {
+        boost::unordered_map<uint32_t, callback_signal_ptr>::const_iterator it
+            = group.signals.find(frame->id & group.mask);
+        if (it != group.signals.end()) {
+            (*it->second)(frame);
+        }
+    }
+}
+
+std::vector<CallbackTable::subscription> CallbackTable::subscriptions(void) const
+{
+    boost::shared_ptr<Index const> index = boost::atomic_load(&index_);
+
+    std::vector<subscription> subscriptions;
+    subscriptions.reserve(index->signals.size());
+
+    typedef std::pair<subscription const, callback_signal_ptr> signal_pair;
+    BOOST_FOREACH(signal_pair const &pair, index->signals) {
+        subscriptions.push_back(pair.first);
+    }
+    return subscriptions;
+}
+
+void CallbackTable::compile(Index &index)
+{
+    typedef std::pair<subscription const, callback_signal_ptr> signal_pair;
+
+    // Group subscriptions by mask. The map is ordered by mask first, so each
+    // group is a contiguous run. Exact matches are handled by the fan-out
+    // table instead.
+    index.groups.clear();
+    BOOST_FOREACH(signal_pair const &pair, index.signals) {
+        if (pair.first.mask == kExactMask) {
+            continue;
+        } else if (index.groups.empty() || index.groups.back().mask != pair.first.mask) {
+            index.groups.push_back(MaskGroup());
+            index.groups.back().mask = pair.first.mask;
+        }
+        index.groups.back().signals.insert(std::make_pair(pair.first.num, pair.second));
+    }
+
+    // Precompute the complete list of signals for every exactly-subscribed
+    // identifier: the exact subscription followed by every matching mask.
+    index.fanout.clear();
+    BOOST_FOREACH(signal_pair const &exact, index.signals) {
+        if (exact.first.mask != kExactMask) continue;
+
+        uint32_t const id = exact.first.num;
+        fanout_list &fanout = index.fanout[id];
+        fanout.push_back(exact.second);
+
+        BOOST_FOREACH(signal_pair const &masked, index.signals) {
+            if (masked.first.mask != kExactMask && masked.first.matches(id)) {
+                fanout.push_back(masked.second);
+            }
+        }
+    }
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,36 @@
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <jaguar/can_bridge.h>
+
+namespace can {
+
+static void adapt_recv_callback(CANBridge::recv_callback const &cb, FramePtr const &frame)
+{
+    cb(boost::make_shared<CANMessage>(*frame));
+}
+
+TokenPtr CANBridge::request(CANMessage const &message, uint32_t response_id,
+                            boost::posix_time::time_duration const &timeout,
+                            unsigned /* retries */)
+{
+    // Expect the response before sending, so it can't arrive unclaimed. The
+    // default implementation sends once and ignores retries; bridges that
+    // can retransmit override this.
+    TokenPtr token = recv(response_id, timeout);
+    send(message);
+    return token;
+}
+
+CallbackToken CANBridge::attach_callback(uint32_t id, recv_callback cb)
+{
+    return attach_frame_callback(id, boost::bind(&adapt_recv_callback, cb, _1));
+}
+
+CallbackToken CANBridge::attach_callback(uint32_t id, uint32_t id_mask, recv_callback cb)
+{
+    return attach_frame_callback(id, id_mask, boost::bind(&adapt_recv_callback, cb, _1));
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
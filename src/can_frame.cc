@@ -0,0 +1,96 @@
+#include <cassert>
+#include <time.h>
+#include <jaguar/can_frame.h>
+
+namespace can {
+
+Timestamp monotonic_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<Timestamp>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+/*
+ * PooledFrame
+ */
+PooledFrame::PooledFrame(void)
+    : refs_(0)
+    , pool_(NULL)
+    , next_(NULL)
+{
+}
+
+void intrusive_ptr_add_ref(PooledFrame const *frame)
+{
+    ++frame->refs_;
+}
+
+void intrusive_ptr_release(PooledFrame const *frame)
+{
+    if (--frame->refs_ == 0) {
+        PooledFrame *mutable_frame = const_cast<PooledFrame *>(frame);
+        if (mutable_frame->pool_) {
+            mutable_frame->pool_->release(mutable_frame);
+        } else {
+            delete mutable_frame;
+        }
+    }
+}
+
+/*
+ * FramePool
+ */
+FramePool::FramePool(size_t capacity)
+    : capacity_(capacity)
+    , storage_(new PooledFrame[capacity])
+    , free_(NULL)
+{
+    for (size_t i = 0; i < capacity_; ++i) {
+        storage_[i].pool_ = this;
+        storage_[i].next_ = free_;
+        free_ = &storage_[i];
+    }
+}
+
+FramePool::~FramePool(void)
+{
+}
+
+size_t FramePool::capacity(void) const
+{
+    return capacity_;
+}
+
+FramePtr FramePool::allocate(CANFrame const &frame)
+{
+    PooledFrame *pooled;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        pooled = free_;
+        if (pooled) {
+            free_ = pooled->next_;
+        }
+    }
+
+    // Overflow frames are heap allocated and deleted on release.
+    if (!pooled) {
+        pooled = new PooledFrame;
+    }
+
+    static_cast<CANFrame &>(*pooled) = frame;
+    return FramePtr(pooled);
+}
+
+void FramePool::release(PooledFrame *frame)
+{
+    assert(frame->pool_ == this);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    frame->next_ = free_;
+    free_ = frame;
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
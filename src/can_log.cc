@@ -0,0 +1,187 @@
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/bind.hpp>
+#include <jaguar/can_log.h>
+
+namespace can {
+
+char const CANLogHeader::kMagic[8] = { 'C', 'A', 'N', 'L', 'O', 'G', '\0', '\0' };
+uint32_t const CANLogHeader::kVersion = 1;
+
+static CANException log_error(std::string const &what, std::string const &path)
+{
+    int const code = errno;
+    return CANException(code, what + " " + path + ": " + strerror(code));
+}
+
+static bool header_valid(CANLogHeader const &header)
+{
+    return memcmp(header.magic, CANLogHeader::kMagic, sizeof(header.magic)) == 0
+        && header.version == CANLogHeader::kVersion
+        && header.record_size == sizeof(CANLogRecord);
+}
+
+/*
+ * CANLogRecord
+ */
+CANFrame CANLogRecord::frame(void) const
+{
+    CANFrame frame;
+    frame.id  = id;
+    frame.dlc = dlc;
+    memcpy(frame.data, data, sizeof(frame.data));
+    frame.timestamp = timestamp;
+    return frame;
+}
+
+/*
+ * CANRecorder
+ */
+CANRecorder::CANRecorder(BasicCANBridge &bridge, std::string const &path)
+    : file_(NULL)
+    , frames_(0)
+{
+    file_ = fopen(path.c_str(), "a+b");
+    if (!file_) {
+        throw log_error("unable to open log", path);
+    }
+
+    // Append to an existing log only if it is in the same format.
+    CANLogHeader header;
+    fseek(file_, 0, SEEK_END);
+    if (ftell(file_) == 0) {
+        memcpy(header.magic, CANLogHeader::kMagic, sizeof(header.magic));
+        header.version = CANLogHeader::kVersion;
+        header.record_size = sizeof(CANLogRecord);
+        fwrite(&header, sizeof(header), 1, file_);
+    } else {
+        rewind(file_);
+        if (fread(&header, sizeof(header), 1, file_) != 1 || !header_valid(header)) {
+            fclose(file_);
+            throw CANException(EINVAL, "incompatible log " + path);
+        }
+        fseek(file_, 0, SEEK_END);
+    }
+
+    recv_connection_ = bridge.attach_frame_callback(0, 0,
+        boost::bind(&CANRecorder::record, this, _1, CANLogRecord::kReceived));
+    send_connection_ = bridge.attach_send_callback(
+        boost::bind(&CANRecorder::record, this, _1, CANLogRecord::kSent));
+}
+
+CANRecorder::~CANRecorder(void)
+{
+    recv_connection_.disconnect();
+    send_connection_.disconnect();
+
+    boost::mutex::scoped_lock lock(mutex_);
+    fclose(file_);
+}
+
+void CANRecorder::flush(void)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    fflush(file_);
+}
+
+size_t CANRecorder::frames(void) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return frames_;
+}
+
+void CANRecorder::record(FramePtr const &frame, CANLogRecord::Direction direction)
+{
+    CANLogRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = frame->timestamp;
+    record.id  = frame->id;
+    record.dlc = frame->dlc;
+    record.direction = direction;
+    memcpy(record.data, frame->data, frame->dlc);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    fwrite(&record, sizeof(record), 1, file_);
+    ++frames_;
+}
+
+/*
+ * CANLog
+ */
+CANLog::CANLog(std::string const &path)
+    : fd_(-1)
+    , map_(MAP_FAILED)
+    , map_length_(0)
+    , records_(NULL)
+    , size_(0)
+{
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        throw log_error("unable to open log", path);
+    }
+
+    struct stat info;
+    if (fstat(fd_, &info) < 0) {
+        close(fd_);
+        throw log_error("unable to stat log", path);
+    }
+    map_length_ = info.st_size;
+
+    if (map_length_ < sizeof(CANLogHeader)) {
+        close(fd_);
+        throw CANException(EINVAL, "truncated log " + path);
+    }
+
+    map_ = mmap(NULL, map_length_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map_ == MAP_FAILED) {
+        close(fd_);
+        throw log_error("unable to map log", path);
+    }
+
+    CANLogHeader const *header = static_cast<CANLogHeader const *>(map_);
+    if (!header_valid(*header)) {
+        munmap(map_, map_length_);
+        close(fd_);
+        throw CANException(EINVAL, "incompatible log " + path);
+    }
+
+    // A partially written trailing record is ignored.
+    records_ = reinterpret_cast<CANLogRecord const *>(header + 1);
+    size_ = (map_length_ - sizeof(CANLogHeader)) / sizeof(CANLogRecord);
+}
+
+CANLog::~CANLog(void)
+{
+    munmap(map_, map_length_);
+    close(fd_);
+}
+
+size_t CANLog::size(void) const
+{
+    return size_;
+}
+
+CANLogRecord const &CANLog::operator[](size_t index) const
+{
+    assert(index < size_);
+    return records_[index];
+}
+
+CANLogRecord const *CANLog::begin(void) const
+{
+    return records_;
+}
+
+CANLogRecord const *CANLog::end(void) const
+{
+    return records_ + size_;
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -1,46 +1,93 @@
+#include <algorithm>
+#include <cassert>
 #include <cmath>
 #include <limits>
 #include <sstream>
 #include <string>
-#include <angles/angles.h>
+#include <boost/make_shared.hpp>
+#include <jaguar/async_token.h>
 #include <jaguar/diff_drive.h>
 
 using can::JaguarBridge;
 
+// Synchronous update group bit used for the drive wheels.
+static uint8_t const kDriveGroup = 0x01;
+
+// A motor whose odometry falls this far behind the others is left out of
+// the fused estimate until it reports again.
+static can::Timestamp const kOdomTimeout = 1000000000;
+
 namespace jaguar {
 
-template <typename T>
-inline T sgn(T x)
+static void report_error(char const *, char const *, unsigned, std::string const &msg)
 {
-    if      (x > 0) return  1;
-    else if (x < 0) return -1;
-    else            return  0;
+    std::cerr << "err: " << msg << std::endl;
 }
 
-DiffDriveRobot::DiffDriveRobot(DiffDriveSettings const &settings)
-    : bridge_(settings.port)
-    , jag_broadcast_(bridge_)
-    , jag_left_(bridge_, settings.id_left)
-    , jag_right_(bridge_, settings.id_right)
+DiffDriveRobot::DiffDriveRobot(DiffDriveSettings const &settings,
+                               boost::shared_ptr<can::CANBridge> bridge)
+    : bridge_(bridge ? bridge : boost::shared_ptr<can::CANBridge>(new JaguarBridge(settings.port)))
+    , jag_broadcast_(*bridge_)
+    , drive_group_(*bridge_, GroupMode::kSpeed, kDriveGroup)
+    , config_batch_(false)
+    , odom_fusion_(settings.ids_left.size() + settings.ids_right.size(), 8, kOdomTimeout)
+    , odom_fusion_method_(settings.fusion)
     , diag_init_(false)
-    // These are set by dynamic_reconfigure. However, there is a race condition
-    // in waiting for the callback. These are sane defaults to prevent
-    // generating +/-infinity or NaN during the race.
+    , estopped_(false)
     , accel_max_(settings.accel_max_mps2)
-    , wheel_circum_(0.0), wheel_sep_(0.0)
     , flip_left_((settings.flip_left) ? -1.0 : 1.0)
     , flip_right_((settings.flip_right) ? -1.0 : 1.0)
 {
+    assert(!settings.ids_left.empty() && !settings.ids_right.empty());
+
+    // The geometry is set by dynamic_reconfigure. However, there is a race
+    // condition in waiting for the callback. A zero geometry disables driving
+    // and odometry, rather than generating +/-infinity or NaN during the race.
+    // The targets and odometry start zeroed.
+    geometry_staging_.wheel_circum = 0.0;
+    geometry_staging_.wheel_sep = 0.0;
+    geometry_staging_.odom_noise = 0.0;
+    geometry_staging_.integrator = Integrator::kExactArc;
+    geometry_.store(geometry_staging_);
+
+    boost::posix_time::time_duration const ack_timeout
+        = boost::posix_time::milliseconds(settings.ack_timeout_ms);
+    bridge_->attach_callback(&report_error);
+
+    std::vector<Jaguar const *> drive_jaguars;
+    for (size_t i = 0; i < settings.ids_left.size() + settings.ids_right.size(); ++i) {
+        bool const left = i < settings.ids_left.size();
+        int const id = left ? settings.ids_left[i] : settings.ids_right[i - settings.ids_left.size()];
+
+        Motor motor;
+        motor.side = left ? kLeft : kRight;
+        motor.jaguar = boost::make_shared<Jaguar>(boost::ref(*bridge_), id);
+        motor.jaguar->ack_timeout_set(ack_timeout);
+        motor.jaguar->ack_retries_set(settings.ack_retries);
+        motor.diag.init = false;
+        motor.diag.stopped = false;
+        motor.diag.voltage = 0.0;
+        motor.diag.temperature = 0.0;
+        motors_.push_back(motor);
+
+        drive_group_.add(*motor.jaguar);
+        drive_jaguars.push_back(motor.jaguar.get());
+    }
+    drive_stream_.reset(new SetpointStream(drive_group_, drive_jaguars));
+
+    // Every command is acknowledged in order, so fire the entire startup
+    // sequence to every motor at once and wait for all of the ACKs together.
+    config_begin();
+
     // This is necessary for the Jaguars to work after a fresh boot, even if
     // we never called system_halt() or system_reset().
-    block(
-        jag_left_.config_brake_set(settings.brake),
-        jag_right_.config_brake_set(settings.brake)
-    );
+    send_all(boost::bind(&Jaguar::config_brake_set, _1, settings.brake));
 
     speed_init();
     odom_init();
     diag_init();
+    config_commit();
+
     jag_broadcast_.system_resume();
 }
 
@@ -50,44 +97,57 @@ DiffDriveRobot::~DiffDriveRobot(void)
 
 void DiffDriveRobot::drive(double v, double omega)
 {
-    if (wheel_circum_ == 0 || wheel_sep_ == 0) return;
-    double const v_left  = v - 0.5 * wheel_sep_ * omega;
-    double const v_right = v + 0.5 * wheel_sep_ * omega;
+    Geometry const geometry = geometry_.load();
+    if (geometry.wheel_circum == 0 || geometry.wheel_sep == 0) return;
+    double const v_left  = v - 0.5 * geometry.wheel_sep * omega;
+    double const v_right = v + 0.5 * geometry.wheel_sep * omega;
     drive_raw(v_left, v_right);
 }
 
 void DiffDriveRobot::drive_raw(double v_left, double v_right)
 {
-    if (wheel_circum_ == 0 || wheel_sep_ == 0) return;
-    target_rpm_left_  = v_left  * 60 / wheel_circum_;
-    target_rpm_right_ = v_right * 60 / wheel_circum_;
+    Geometry const geometry = geometry_.load();
+    if (geometry.wheel_circum == 0 || geometry.wheel_sep == 0) return;
+
+    Targets targets;
+    targets.rpm_left  = v_left  * 60 / geometry.wheel_circum;
+    targets.rpm_right = v_right * 60 / geometry.wheel_circum;
+
+    boost::mutex::scoped_lock lock(mutex_);
+    targets_.store(targets);
 }
 
 void DiffDriveRobot::drive_spin(double dt)
 {
-    if (wheel_circum_ == 0 || wheel_sep_ == 0) return;
-    double const residual_rpm_left  = target_rpm_left_  - current_rpm_left_;
-    double const residual_rpm_right = target_rpm_right_ - current_rpm_right_;
-
-    // Cap the acceleration at the limiting value.
-    double const drpm_max = accel_max_ * dt * 60 / wheel_circum_;
-
-    if (fabs(residual_rpm_left) <= drpm_max) {
-        current_rpm_left_ = target_rpm_left_;
-    } else {
-        current_rpm_left_ += sgn(residual_rpm_left) * drpm_max;
+    Geometry const geometry = geometry_.load();
+    if (geometry.wheel_circum == 0 || geometry.wheel_sep == 0) return;
+    Targets const targets = targets_.load();
+    can::Timestamp const now = can::monotonic_now();
+    drive_stream_->begin_tick(now, dt);
+
+    // Cap the acceleration at the limiting value. Speed control has no ramp
+    // in the firmware, so the stream steps the setpoints towards the targets
+    // itself, and stops sending them once they have been reached.
+    drive_stream_->ramp_set(accel_max_ * 60 / geometry.wheel_circum);
+
+    // Setpoints are not acknowledged, so the loop never waits on the serial
+    // link; the stream refreshes them every so often instead. Every motor
+    // applies its setpoint on the same synchronous update, and the status
+    // stream is checked every so often to make sure they are being followed.
+    // Motors held by the e-stop are not expected to follow.
+    for (size_t i = 0; i < motors_.size(); ++i) {
+        bool const left = motors_[i].side == kLeft;
+        drive_stream_->set(i, left ? targets.rpm_left : targets.rpm_right);
     }
-
-    if (fabs(residual_rpm_right) <= drpm_max) {
-        current_rpm_right_ = target_rpm_right_;
-    } else {
-        current_rpm_right_ += sgn(residual_rpm_right) * drpm_max;
+    size_t const failures = drive_stream_->commit(now);
+    if (failures > 0 && !estopped_.load(boost::memory_order_acquire)) {
+        std::cerr << "war: motors are not following their speed setpoints" << std::endl;
     }
+}
 
-    block(
-        jag_left_.speed_set(current_rpm_left_),
-        jag_right_.speed_set(current_rpm_right_)
-    );
+SetpointStreamStats DiffDriveRobot::drive_stats(void) const
+{
+    return drive_stream_->stats();
 }
 
 void DiffDriveRobot::drive_brake(bool braking)
@@ -99,44 +159,36 @@ void DiffDriveRobot::drive_brake(bool braking)
         value = jaguar::BrakeCoastSetting::kOverrideCoast;
     }
 
-    block(
-        jag_left_.config_brake_set(value),
-        jag_right_.config_brake_set(value)
-    );
+    send_all(boost::bind(&Jaguar::config_brake_set, _1, value));
 }
 
 void DiffDriveRobot::odom_set_circumference(double circum_m)
 {
-    wheel_circum_ = circum_m;
+    boost::mutex::scoped_lock lock(mutex_);
+    geometry_staging_.wheel_circum = circum_m;
+    geometry_.store(geometry_staging_);
 }
 
 void DiffDriveRobot::odom_set_separation(double separation_m)
 {
-    wheel_sep_ = separation_m;
+    boost::mutex::scoped_lock lock(mutex_);
+    geometry_staging_.wheel_sep = separation_m;
+    geometry_.store(geometry_staging_);
 }
 
 void DiffDriveRobot::odom_set_encoders(uint16_t cpr)
 {
-    block(
-        jag_left_.config_encoders_set(cpr),
-        jag_right_.config_encoders_set(cpr)
-    );
+    send_all(boost::bind(&Jaguar::config_encoders_set, _1, cpr));
 }
 
 void DiffDriveRobot::odom_set_rate(uint8_t rate_ms)
 {
-    block(
-        jag_left_.periodic_enable(0, rate_ms),
-        jag_right_.periodic_enable(0, rate_ms)
-    );
+    send_all(boost::bind(&Jaguar::periodic_enable, _1, 0, rate_ms));
 }
 
 void DiffDriveRobot::diag_set_rate(uint8_t rate_ms)
 {
-    block(
-        jag_left_.periodic_enable(1, rate_ms),
-        jag_right_.periodic_enable(1, rate_ms)
-    );
+    send_all(boost::bind(&Jaguar::periodic_enable, _1, 1, rate_ms));
 }
 
 void DiffDriveRobot::heartbeat(void)
@@ -149,40 +201,45 @@ void DiffDriveRobot::heartbeat(void)
  */
 void DiffDriveRobot::odom_init(void)
 {
-    x_ = 0.0;
-    y_ = 0.0;
-    theta_ = 0.0;
-
-    // Ignore the first odometry message to establish the reference point.:
-    // TODO: This is wrong.
-    odom_left_.side = kLeft;
-    odom_left_.init = false;
-    odom_right_.side = kRight;
-    odom_right_.init = false;
+    // This runs before the status callbacks are registered, so it is the one
+    // place the control thread may touch the receive thread's state.
+    pose_ = Pose2D();
 
-    // Just in case. This shouldn't really matter.
-    odom_left_.pos_prev = 0;
-    odom_left_.pos_curr = 0;
-    odom_right_.pos_prev = 0;
-    odom_right_.pos_curr = 0;
+    // The first samples from every motor establish the reference point.
+    odom_fusion_.reset();
 
     // Configure the Jaguars to use optical encoders. They are used as both a
     // speed reference for velocity control and position reference for
     // odometry. As such, they must be configured for position control even
     // though we are are using speed control mode.
-    block(
-        jag_left_.position_set_reference(PositionReference::kQuadratureEncoder),
-        jag_right_.position_set_reference(PositionReference::kQuadratureEncoder)
-    );
+    send_all(boost::bind(&Jaguar::position_set_reference, _1,
+                         PositionReference::kQuadratureEncoder));
+
+    std::vector<can::TokenPtr> tokens;
+    for (size_t i = 0; i < motors_.size(); ++i) {
+        tokens.push_back(motors_[i].jaguar->periodic_config_odom(0,
+            boost::bind(&DiffDriveRobot::odom_update, this, i, _1, _2, _3)));
+    }
+    block(tokens);
+}
 
-    block(
-        jag_left_.periodic_config_odom(0,
-            boost::bind(&DiffDriveRobot::odom_update, this,
-                boost::ref(odom_left_), _1, _2)),
-        jag_right_.periodic_config_odom(0,
-            boost::bind(&DiffDriveRobot::odom_update, this,
-                boost::ref(odom_right_), _1, _2))
-    );
+void DiffDriveRobot::odom_set_integrator(Integrator::Enum method)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    geometry_staging_.integrator = method;
+    geometry_.store(geometry_staging_);
+}
+
+void DiffDriveRobot::odom_set_noise(double variance_per_meter)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    geometry_staging_.odom_noise = variance_per_meter;
+    geometry_.store(geometry_staging_);
+}
+
+OdometrySnapshot DiffDriveRobot::odom_latest(void) const
+{
+    return odom_latest_.load();
 }
 
 void DiffDriveRobot::odom_attach(boost::function<OdometryCallback> callback)
@@ -203,59 +260,111 @@ void DiffDriveRobot::estop_attach(boost::function<EStopCallback> callback)
     estop_signal_.connect(callback);
 }
 
-void DiffDriveRobot::odom_update(Odometry &odom, double pos, double vel)
+size_t DiffDriveRobot::motors(void) const
+{
+    return motors_.size();
+}
+
+DiffDriveRobot::Side DiffDriveRobot::motor_side(size_t motor) const
+{
+    return motors_.at(motor).side;
+}
+
+uint8_t DiffDriveRobot::motor_id(size_t motor) const
 {
-    if (wheel_circum_ == 0 || wheel_sep_ == 0) return;
+    return motors_.at(motor).jaguar->device_num();
+}
+
+DeviceStatus DiffDriveRobot::status(size_t motor) const
+{
+    return motors_.at(motor).jaguar->status();
+}
 
-    odom.pos_prev = odom.pos_curr;
-    odom.pos_curr = pos;
-    odom.vel = vel;
+void DiffDriveRobot::odom_update(size_t motor, double pos, double vel, can::Timestamp stamp)
+{
+    // Copy the geometry once, so a concurrent reconfigure cannot change it
+    // halfway through the update.
+    Geometry const geometry = geometry_.load();
+    if (geometry.wheel_circum == 0 || geometry.wheel_sep == 0) return;
+
+    // Every motor is interpolated to the latest instant at which all of them
+    // have been sampled, so every status message contributes to the estimate
+    // and one motor reporting twice in a row is harmless. Speed is measured
+    // in RPMs, so all of these values are measured in revolutions.
+    WheelSample sample;
+    sample.stamp = stamp;
+    sample.position = pos;
+    sample.speed = vel;
+
+    OdometryStep step;
+    if (!odom_fusion_.add(motor, sample, step)) {
+        return;
+    }
 
-    // Skip the first sample from each wheel. This is necessary in case the
-    // encoders came up in an unknown state.
-    if (!odom.init) {
-        odom.pos_prev = pos;
-        odom.pos_curr = pos;
-        odom.init = true;
+    double revs_left, rpm_start_left, rpm_left;
+    double revs_right, rpm_start_right, rpm_right;
+    if (!odom_fuse(kLeft, step, revs_left, rpm_start_left, rpm_left)
+     || !odom_fuse(kRight, step, revs_right, rpm_start_right, rpm_right)) {
+        std::cerr << "war: no odometry from one side of the robot" << std::endl;
         return;
     }
 
-    // Update the state variables to indicate which odometry readings we
-    // already have. Trigger a callback once we've received a pair of readings.
-    if (odom_state_ == kNone) {
-        odom_state_ = odom.side;
-    } else if (odom.side != odom_state_) {
-        // Compute the difference between the last two updates. Speed is
-        // measured in RPMs, so all of these values are measured in
-        // revolutions.
-        double revs_left  = odom_left_.pos_curr  - odom_left_.pos_prev;
-        double revs_right = odom_right_.pos_curr - odom_right_.pos_prev;
-        std::swap(revs_left, revs_right);
-
-        // Convert from revolutions to meters.
-        double const meters_left  = revs_left * wheel_circum_;
-        double const meters_right = revs_right * wheel_circum_;
-
-        // Use the robot model to convert from wheel odometry to
-        // two-dimensional motion.
-        // TODO: Switch to a better odometry model.
-        double const meters  = (meters_left + meters_right) / 2;
-        double const radians = (meters_left - meters_right) / wheel_sep_;
-        x_ += meters * cos(theta_ + radians / 2);
-        y_ += meters * sin(theta_ + radians / 2);
-        theta_ = angles::normalize_angle(theta_ + radians);
-
-        // Estimate the robot's current velocity.
-        double const vl = odom_left_.vel * wheel_circum_ / 60;
-        double const vr = odom_right_.vel * wheel_circum_ / 60;
-        double const v_linear = (vr + vl) / 2;
-        double const omega    = (vr - vl) / wheel_sep_;
-
-        odom_signal_(x_, y_, theta_, v_linear, omega, meters_left, meters_right, vl, vr);
-        odom_state_ = kNone;
-    } else {
-        std::cerr << "war: periodic update message was dropped" << std::endl;
+    // Convert from revolutions to meters.
+    double const circum = geometry.wheel_circum;
+    double const meters_left  = revs_left  * circum;
+    double const meters_right = revs_right * circum;
+
+    DriveMotion motion;
+    motion.separation = geometry.wheel_sep;
+    motion.left  = meters_left;
+    motion.right = meters_right;
+    motion.variance_left  = geometry.odom_noise * fabs(meters_left);
+    motion.variance_right = geometry.odom_noise * fabs(meters_right);
+    motion.v_left[0]  = rpm_start_left  * circum / 60;
+    motion.v_left[1]  = rpm_left        * circum / 60;
+    motion.v_right[0] = rpm_start_right * circum / 60;
+    motion.v_right[1] = rpm_right       * circum / 60;
+    pose_integrator(geometry.integrator).step(pose_, motion);
+
+    // Estimate the robot's current velocity.
+    double const vl = motion.v_left[1];
+    double const vr = motion.v_right[1];
+    double const v_linear = (vr + vl) / 2;
+    double const omega    = (vr - vl) / geometry.wheel_sep;
+
+    OdometrySnapshot latest;
+    latest.pose = pose_;
+    latest.v_linear = v_linear;
+    latest.omega = omega;
+    latest.stamp = step.stamp;
+    odom_latest_.store(latest);
+
+    // The wheel distances have always been reported swapped, and listeners
+    // compensate for it.
+    odom_signal_(pose_, v_linear, omega, meters_right, meters_left, vl, vr, step.stamp);
+}
+
+// Combines the motors on one side of the robot into a single wheel. Returns
+// false if none of them contributed to step.
+bool DiffDriveRobot::odom_fuse(Side side, OdometryStep const &step,
+                               double &revs, double &rpm_start, double &rpm) const
+{
+    std::vector<double> all_revs, all_rpm_start, all_rpm;
+    for (size_t i = 0; i < motors_.size(); ++i) {
+        if (motors_[i].side == side && step.live[i]) {
+            all_revs.push_back(step.revs[i]);
+            all_rpm_start.push_back(step.rpm_start[i]);
+            all_rpm.push_back(step.rpm[i]);
+        }
     }
+    if (all_revs.empty()) {
+        return false;
+    }
+
+    revs      = fuse(all_revs, odom_fusion_method_);
+    rpm_start = fuse(all_rpm_start, odom_fusion_method_);
+    rpm       = fuse(all_rpm, odom_fusion_method_);
+    return true;
 }
 
 /*
@@ -263,37 +372,44 @@ void DiffDriveRobot::odom_update(Odometry &odom, double pos, double vel)
  */
 void DiffDriveRobot::diag_init(void)
 {
-    block(
-        jag_left_.periodic_config_diag(1,
-            boost::bind(&DiffDriveRobot::diag_update, this,
-                kLeft, boost::ref(diag_left_), _1, _2, _3, _4)
-        ),
-        jag_right_.periodic_config_diag(1,
-            boost::bind(&DiffDriveRobot::diag_update, this,
-                kRight, boost::ref(diag_right_), _1, _2, _3, _4)
-        )
-    );
+    std::vector<can::TokenPtr> tokens;
+    for (size_t i = 0; i < motors_.size(); ++i) {
+        tokens.push_back(motors_[i].jaguar->periodic_config_diag(1,
+            boost::bind(&DiffDriveRobot::diag_update, this, i, _1, _2, _3, _4)));
+    }
+    block(tokens);
 
     // TODO: Make this a parameter.
-    block(
-        jag_left_.periodic_enable(1, 500),
-        jag_right_.periodic_enable(1, 500)
-    );
+    send_all(boost::bind(&Jaguar::periodic_enable, _1, 1, 500));
+}
+
+// Called from the receive thread only; everyone else reads estopped_.
+bool DiffDriveRobot::diag_stopped(void) const
+{
+    BOOST_FOREACH(Motor const &motor, motors_) {
+        if (motor.diag.stopped) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void DiffDriveRobot::diag_update(
-    Side side, Diagnostics &diag,
+    size_t motor,
     LimitStatus::Enum limits, Fault::Enum faults,
     double voltage, double temperature)
 {
-    bool const estop_before = diag_left_.stopped || diag_right_.stopped;
+    bool const estop_before = diag_stopped();
 
     // TODO: Check for a fault.
+    Diagnostics &diag = motors_[motor].diag;
+    diag.init = true;
     diag.stopped = !(limits & 0x03);
     diag.voltage = voltage;
     diag.temperature = temperature;
 
-    bool const estop_after = diag_left_.stopped || diag_right_.stopped;
+    bool const estop_after = diag_stopped();
+    estopped_.store(estop_after, boost::memory_order_release);
 
     // Only trigger an e-stop callback if the state changed. We don't know the
     // initial state, so the first update always triggers a callback.
@@ -303,7 +419,16 @@ void DiffDriveRobot::diag_update(
     diag_init_ = true;
 
     // Other diagnostics (i.e. bus voltage and temperature) use separate left
-    // and right callbacks.
+    // and right callbacks, which report the lowest bus voltage and the
+    // hottest controller on that side.
+    Side const side = motors_[motor].side;
+    BOOST_FOREACH(Motor const &other, motors_) {
+        if (other.side == side && other.diag.init) {
+            voltage = std::min(voltage, other.diag.voltage);
+            temperature = std::max(temperature, other.diag.temperature);
+        }
+    }
+
     if (side == kLeft) {
         diag_left_signal_(voltage, temperature);
     } else if (side == kRight) {
@@ -316,47 +441,87 @@ void DiffDriveRobot::diag_update(
  */
 void DiffDriveRobot::speed_set_p(double p)
 {
-    block(
-        jag_left_.speed_set_p(flip_left_ * p),
-        jag_right_.speed_set_p(flip_right_ * p)
-    );
+    std::vector<can::TokenPtr> tokens;
+    send(kLeft, boost::bind(&Jaguar::speed_set_p, _1, flip_left_ * p), tokens);
+    send(kRight, boost::bind(&Jaguar::speed_set_p, _1, flip_right_ * p), tokens);
+    block(tokens);
 }
 
 void DiffDriveRobot::speed_set_i(double i)
 {
-    block(
-        jag_left_.speed_set_i(flip_left_ * i),
-        jag_right_.speed_set_i(flip_right_ * i)
-    );
+    std::vector<can::TokenPtr> tokens;
+    send(kLeft, boost::bind(&Jaguar::speed_set_i, _1, flip_left_ * i), tokens);
+    send(kRight, boost::bind(&Jaguar::speed_set_i, _1, flip_right_ * i), tokens);
+    block(tokens);
 }
 
 void DiffDriveRobot::speed_set_d(double d)
 {
-    block(
-        jag_left_.speed_set_d(flip_left_ * d),
-        jag_right_.speed_set_d(flip_right_ * d)
-    );
+    std::vector<can::TokenPtr> tokens;
+    send(kLeft, boost::bind(&Jaguar::speed_set_d, _1, flip_left_ * d), tokens);
+    send(kRight, boost::bind(&Jaguar::speed_set_d, _1, flip_right_ * d), tokens);
+    block(tokens);
 }
 
 void DiffDriveRobot::speed_init(void)
 {
-    block(
-        jag_left_.speed_set_reference(SpeedReference::kQuadratureEncoder),
-        jag_right_.speed_set_reference(SpeedReference::kQuadratureEncoder)
-    );
-    block(
-        jag_left_.speed_enable(),
-        jag_right_.speed_enable()
-    );
+    send_all(boost::bind(&Jaguar::speed_set_reference, _1, SpeedReference::kQuadratureEncoder));
+    send_all(boost::bind(&Jaguar::speed_enable, _1));
 }
 
 /*
  * Helper Methods
  */
-void DiffDriveRobot::block(can::TokenPtr t1, can::TokenPtr t2)
+void DiffDriveRobot::config_begin(void)
+{
+    config_batch_ = true;
+}
+
+bool DiffDriveRobot::config_commit(void)
+{
+    config_batch_ = false;
+
+    std::vector<can::TokenPtr> tokens;
+    tokens.swap(config_tokens_);
+    return block(tokens);
+}
+
+void DiffDriveRobot::send(Side side, Command const &command, std::vector<can::TokenPtr> &tokens)
+{
+    BOOST_FOREACH(Motor &motor, motors_) {
+        if (side == kNone || motor.side == side) {
+            tokens.push_back(command(*motor.jaguar));
+        }
+    }
+}
+
+bool DiffDriveRobot::send_all(Command const &command)
 {
-    t1->block();
-    t2->block();
+    std::vector<can::TokenPtr> tokens;
+    send(kNone, command, tokens);
+    return block(tokens);
+}
+
+bool DiffDriveRobot::block(std::vector<can::TokenPtr> const &tokens)
+{
+    if (config_batch_) {
+        config_tokens_.insert(config_tokens_.end(), tokens.begin(), tokens.end());
+        return true;
+    }
+
+    // Wait once for the whole batch rather than once per command.
+    can::when_all(tokens)->block();
+
+    size_t failures = 0;
+    BOOST_FOREACH(can::TokenPtr const &token, tokens) {
+        failures += token->failed();
+    }
+
+    if (failures > 0) {
+        std::cerr << "war: " << failures << " of " << tokens.size()
+                  << " commands were not acknowledged" << std::endl;
+    }
+    return failures == 0;
 }
 
 };
@@ -1,12 +1,19 @@
+#include <algorithm>
 #include <cmath>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <dynamic_reconfigure/server.h>
 #include <tf/transform_broadcaster.h>
 #include <nav_msgs/Odometry.h>
 #include <std_msgs/Bool.h>
 #include <std_msgs/Float64.h>
+#include <jaguar/can_log.h>
 #include <jaguar/diff_drive.h>
+#include <jaguar/link_planner.h>
+#include <jaguar/replay_bridge.h>
 #include <jaguar/JaguarConfig.h>
 
 using namespace can;
@@ -18,33 +25,77 @@ static ros::Publisher pub_estop;
 static ros::Publisher pub_temp_left, pub_temp_right;
 static ros::Publisher pub_voltage_left, pub_voltage_right;
 static ros::Publisher pub_vleft, pub_vright, pub_wheel;
+static ros::Publisher pub_diagnostics;
 
 static ros::Time last_time;
 static DiffDriveSettings settings;
 static boost::shared_ptr<DiffDriveRobot> robot;
+static boost::shared_ptr<JaguarBridge> jaguar_bridge;
+static boost::shared_ptr<CANRecorder> recorder;
 static boost::shared_ptr<tf::TransformBroadcaster> pub_tf;
 static std::string frame_parent;
 static std::string frame_child;
 static int heartbeat_rate;
+static int odom_rate, diag_rate;
+static double control_rate;
+static double const link_check_period = 5.0;
+static double const diagnostics_period = 1.0;
 static double wheel_separation, alpha;
 static volatile bool spinlock = false;
 
-static void callback_odom(double x, double y, double theta,
+// Device ids of one side, either a list ~ids_<side> for several motors per
+// side or a single ~id_<side>.
+static std::vector<int> param_ids(std::string const &side)
+{
+    std::vector<int> ids;
+    XmlRpc::XmlRpcValue list;
+    if (ros::param::get("~ids_" + side, list) && list.getType() == XmlRpc::XmlRpcValue::TypeArray) {
+        for (int i = 0; i < list.size(); ++i) {
+            if (list[i].getType() == XmlRpc::XmlRpcValue::TypeInt) {
+                ids.push_back(static_cast<int>(list[i]));
+            } else {
+                ids.push_back(0);
+            }
+        }
+    } else {
+        int id;
+        if (ros::param::get("~id_" + side, id)) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+
+// Convert a monotonic frame timestamp to ROS time by measuring its age. Both
+// clocks are read back to back, so callback latency does not add jitter.
+static ros::Time to_ros_time(can::Timestamp stamp)
+{
+    ros::Time const now_ros = ros::Time::now();
+    can::Timestamp const now_mono = can::monotonic_now();
+    can::Timestamp const age = (now_mono > stamp) ? now_mono - stamp : 0;
+
+    ros::Time when;
+    when.fromNSec(now_ros.toNSec() - age);
+    return when;
+}
+
+static void callback_odom(Pose2D const &pose,
                           double velocity, double omega,
                           double delta_left, double delta_right,
-                          double v_left, double v_right)
+                          double v_left, double v_right,
+                          can::Timestamp stamp)
 {
-    ros::Time now = ros::Time::now();
+    ros::Time now = to_ros_time(stamp);
 
     // odom TF Frame
     geometry_msgs::TransformStamped msg_tf;
     msg_tf.header.stamp = now;
     msg_tf.header.frame_id = frame_parent;
     msg_tf.child_frame_id  = frame_child;
-    msg_tf.transform.translation.x = x;
-    msg_tf.transform.translation.y = y;
+    msg_tf.transform.translation.x = pose.x;
+    msg_tf.transform.translation.y = pose.y;
     msg_tf.transform.translation.z = 0;
-    msg_tf.transform.rotation = tf::createQuaternionMsgFromYaw(theta);
+    msg_tf.transform.rotation = tf::createQuaternionMsgFromYaw(pose.theta);
     pub_tf->sendTransform(msg_tf);
 
     // Publish instantaneous velocity.
@@ -59,9 +110,17 @@ static void callback_odom(double x, double y, double theta,
     msg_odom.header.stamp = now;
     msg_odom.header.frame_id = frame_parent;
     msg_odom.child_frame_id  = frame_child;
-    msg_odom.pose.pose.position.x = x;
-    msg_odom.pose.pose.position.y = y;
-    msg_odom.pose.pose.orientation = tf::createQuaternionMsgFromYaw(theta);
+    msg_odom.pose.pose.position.x = pose.x;
+    msg_odom.pose.pose.position.y = pose.y;
+    msg_odom.pose.pose.orientation = tf::createQuaternionMsgFromYaw(pose.theta);
+
+    // Row-major 6x6 covariance of (x, y, z, roll, pitch, yaw).
+    static size_t const kIndex[3] = { 0, 1, 5 };
+    for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            msg_odom.pose.covariance[kIndex[i] * 6 + kIndex[j]] = pose.covariance[i][j];
+        }
+    }
     msg_odom.twist.twist.linear.x = velocity;
     msg_odom.twist.twist.linear.y = 0;
     msg_odom.twist.twist.angular.z = omega;
@@ -134,8 +193,255 @@ void callback_cmd(geometry_msgs::Twist const &twist)
     robot->drive(twist.linear.x, twist.angular.z);
 }
 
+// Check the requested status rates against the serial link and CAN bus
+// budget, lengthening them if the traffic would saturate either one. A
+// heartbeat_ms of zero means no heartbeat is being sent yet.
+static bool plan_link(int &odom_ms, int &diag_ms, int heartbeat_ms)
+{
+    size_t const devices = settings.ids_left.size() + settings.ids_right.size();
+    double const control_ms = 1000 / control_rate;
+    double const refresh_ms = 1000 * SetpointStreamSettings().refresh_s;
+
+    LinkPlanner plan;
+    size_t const odom = plan.add_status("odometry", Jaguar::kOdomStatusLength, odom_ms, devices);
+    size_t const diag = plan.add_status("diagnostics", Jaguar::kDiagStatusLength, diag_ms, devices);
+    if (heartbeat_ms > 0) {
+        plan.add_command("heartbeat", 0, heartbeat_ms, 1, false);
+    }
+
+    // Setpoints are only sent when they change, plus a periodic refresh that
+    // may fall on a different tick for each device.
+    plan.add_changes("speed setpoint", 5, control_ms, refresh_ms, devices, false);
+    plan.add_changes("synchronous update", 1, control_ms, refresh_ms / devices, 1, false);
+
+    if (plan.feasible()) {
+        return true;
+    }
+
+    ROS_WARN("Requested status rates would saturate the link: %s", plan.report().c_str());
+    if (!plan.adjust()) {
+        return false;
+    }
+    odom_ms = static_cast<int>(plan.period_ms(odom));
+    diag_ms = static_cast<int>(plan.period_ms(diag));
+    ROS_WARN("Slowed status updates to fit: %s", plan.report().c_str());
+    return true;
+}
+
+// Warn if the traffic actually measured on the link exceeds the budget,
+// e.g. because of retransmissions or devices we did not plan for.
+static void check_link(void)
+{
+    static JaguarBridge::LinkUsage last;
+    static bool init = false;
+
+    JaguarBridge::LinkUsage const usage = jaguar_bridge->link_usage();
+    if (init) {
+        LinkLoad const load = LinkPlanner::measured(last, usage);
+        ROS_DEBUG("Link load: serial tx %.1f%%, serial rx %.1f%%, bus %.1f%%",
+                  100 * load.tx, 100 * load.rx, 100 * load.bus);
+        if (load.peak() > LinkPlanner::kDefaultHeadroom) {
+            ROS_WARN("Link is oversubscribed: serial tx %.1f%%, serial rx %.1f%%, bus %.1f%%",
+                     100 * load.tx, 100 * load.rx, 100 * load.bus);
+        }
+    }
+    last = usage;
+    init = true;
+}
+
+template <typename T>
+static void diagnostics_add(diagnostic_msgs::DiagnosticStatus &status,
+                            std::string const &key, T const &value)
+{
+    std::ostringstream ss;
+    ss << value;
+
+    diagnostic_msgs::KeyValue pair;
+    pair.key = key;
+    pair.value = ss.str();
+    status.values.push_back(pair);
+}
+
+static void diagnostics_add_histogram(diagnostic_msgs::DiagnosticStatus &status,
+                                      std::string const &key, uint64_t const *buckets)
+{
+    std::ostringstream ss;
+    for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+        ss << ((i > 0) ? " " : "") << buckets[i];
+    }
+    diagnostics_add(status, key, ss.str());
+}
+
+// Latest values cached for one motor controller. Stale if the diagnostic
+// status message has missed several periods.
+static diagnostic_msgs::DiagnosticStatus motor_diagnostics(std::string const &name, int id,
+                                                           DeviceStatus const &device)
+{
+    can::Timestamp const now = can::monotonic_now();
+    double const stale_age = 3 * diag_rate * 1e-3;
+    double const diag_age = device.age(StatusField::kBusVoltage, now);
+    double const odom_age = device.age(StatusField::kPosition, now);
+
+    std::ostringstream hardware_id;
+    hardware_id << settings.port << " #" << id;
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = "jaguar: " + name + " motor";
+    status.hardware_id = hardware_id.str();
+    if (diag_age > stale_age) {
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = "no recent status";
+    } else {
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.message = "OK";
+    }
+
+    diagnostics_add(status, "Bus Voltage (V)", device.latest.bus_voltage);
+    diagnostics_add(status, "Temperature (C)", device.latest.temperature);
+    diagnostics_add(status, "Status Age (s)", diag_age);
+    diagnostics_add(status, "Odometry Age (s)", odom_age);
+    return status;
+}
+
+// Control loop timing and setpoint verification. Warns if the loop overran
+// or a motor failed verification since the last update.
+static diagnostic_msgs::DiagnosticStatus loop_diagnostics(SetpointStreamStats const &stats)
+{
+    static SetpointStreamStats last;
+    static bool init = false;
+
+    uint64_t const overruns   = init ? stats.overruns - last.overruns : stats.overruns;
+    uint64_t const mismatches = init ? stats.mismatches - last.mismatches : stats.mismatches;
+    uint64_t const stale      = init ? stats.stale - last.stale : stats.stale;
+    last = stats;
+    init = true;
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = "jaguar: control loop";
+    status.hardware_id = settings.port;
+    if (overruns > 0 || mismatches > 0 || stale > 0) {
+        std::ostringstream ss;
+        ss << overruns << " overruns, " << mismatches << " setpoint mismatches and "
+           << stale << " missing readbacks";
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = ss.str();
+    } else {
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.message = "OK";
+    }
+
+    diagnostics_add(status, "Rate (Hz)", control_rate);
+    diagnostics_add(status, "Ticks", stats.ticks);
+    diagnostics_add(status, "Overruns", stats.overruns);
+    diagnostics_add(status, "Max Interval (ms)", stats.max_interval * 1e-6);
+    diagnostics_add(status, "Max Tick Time (ms)", stats.max_work * 1e-6);
+    diagnostics_add(status, "Setpoints Sent", stats.sent);
+    diagnostics_add(status, "Setpoints Suppressed", stats.suppressed);
+    diagnostics_add(status, "Readbacks", stats.readbacks);
+    diagnostics_add(status, "Setpoint Mismatches", stats.mismatches);
+    diagnostics_add(status, "Missing Readbacks", stats.stale);
+    return status;
+}
+
+// Publish the bridge's counters, and warn if any errors or unanswered
+// requests have appeared since the last update.
+static void publish_diagnostics(void)
+{
+    static BridgeMetricsSnapshot last;
+    static bool init = false;
+
+    BridgeMetricsSnapshot const metrics = jaguar_bridge->metrics();
+
+    // Unanswered requests are also counted as errors; report them once.
+    uint64_t errors = 0, errors_last = 0;
+    for (size_t i = 0; i < BridgeError::kCount; ++i) {
+        if (i == BridgeError::kRequestTimedOut) {
+            continue;
+        }
+        errors += metrics.errors[i];
+        errors_last += last.errors[i];
+    }
+    uint64_t const new_errors = init ? errors - errors_last : errors;
+    uint64_t const new_timeouts = init ? metrics.tokens_timed_out - last.tokens_timed_out
+                                       : metrics.tokens_timed_out;
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = "jaguar: bridge";
+    status.hardware_id = settings.port;
+    if (new_errors > 0 || new_timeouts > 0) {
+        std::ostringstream ss;
+        ss << new_errors << " errors and " << new_timeouts << " unanswered requests";
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = ss.str();
+    } else {
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.message = "OK";
+    }
+
+    diagnostics_add(status, "Frames In", metrics.frames_in);
+    diagnostics_add(status, "Frames Out", metrics.frames_out);
+    diagnostics_add(status, "Bytes In", metrics.bytes_in);
+    diagnostics_add(status, "Bytes Out", metrics.bytes_out);
+    diagnostics_add(status, "Escape Bytes In", metrics.escape_bytes_in);
+    diagnostics_add(status, "Escape Bytes Out", metrics.escape_bytes_out);
+    for (size_t i = 0; i < BridgeError::kCount; ++i) {
+        BridgeError::Enum const code = static_cast<BridgeError::Enum>(i);
+        diagnostics_add(status, BridgeError::message(code), metrics.errors[i]);
+    }
+    diagnostics_add(status, "Tokens Outstanding", metrics.tokens_outstanding);
+    diagnostics_add(status, "Tokens Timed Out", metrics.tokens_timed_out);
+    diagnostics_add(status, "Max Receive Latency (us)", metrics.recv_latency_max / 1000);
+    diagnostics_add_histogram(status, "Dispatch Time (log2 us)", metrics.dispatch_us);
+    diagnostics_add_histogram(status, "Read Size (log2 bytes)", metrics.read_size);
+
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = ros::Time::now();
+    msg.status.push_back(status);
+    msg.status.push_back(loop_diagnostics(robot->drive_stats()));
+    for (size_t i = 0; i < robot->motors(); ++i) {
+        bool const left = robot->motor_side(i) == DiffDriveRobot::kLeft;
+        std::ostringstream name;
+        name << (left ? "left" : "right");
+        if (settings.ids_left.size() > 1 || settings.ids_right.size() > 1) {
+            name << " " << (left ? i + 1 : i + 1 - settings.ids_left.size());
+        }
+        msg.status.push_back(motor_diagnostics(name.str(), robot->motor_id(i),
+                                               robot->status(i)));
+    }
+    pub_diagnostics.publish(msg);
+
+    last = metrics;
+    init = true;
+}
+
 void callback_reconfigure(jaguar::JaguarConfig &config, uint32_t level)
 {
+    // Plan with the heartbeat this reconfigure will leave in place; on the
+    // first call nothing has been applied yet.
+    int heartbeat_ms = heartbeat_rate;
+    if ((level & 512) && 0 < config.heartbeat_rate && config.heartbeat_rate <= 100) {
+        heartbeat_ms = config.heartbeat_rate;
+    }
+
+    if ((level & (128 | 256)) && config.odom_rate > 0 && config.diag_rate > 0) {
+        if (!plan_link(config.odom_rate, config.diag_rate, heartbeat_ms)) {
+            if (odom_rate > 0 && diag_rate > 0) {
+                ROS_ERROR("Rejecting status rates; the fixed traffic alone saturates the link.");
+                config.odom_rate = odom_rate;
+                config.diag_rate = diag_rate;
+            } else {
+                // Nothing has been applied yet to fall back on, and the
+                // devices must report at some rate.
+                ROS_ERROR("The fixed traffic alone saturates the link; using the requested status rates.");
+            }
+        }
+        if (config.odom_rate != odom_rate) level |= 128;
+        if (config.diag_rate != diag_rate) level |= 256;
+    }
+
+    // Send every changed parameter before waiting for any acknowledgements.
+    robot->config_begin();
+
     // Speed Control Gains
     if (level & 1) {
         robot->speed_set_p(config.gain_p);
@@ -183,6 +489,7 @@ void callback_reconfigure(jaguar::JaguarConfig &config, uint32_t level)
             ROS_WARN("Odometry update rate must be positive.");
         } else {
             robot->odom_set_rate(config.odom_rate);
+            odom_rate = config.odom_rate;
             ROS_INFO("Reconfigure, Odometry Update Rate = %d ms", config.odom_rate);
         }
     }
@@ -191,6 +498,7 @@ void callback_reconfigure(jaguar::JaguarConfig &config, uint32_t level)
             ROS_WARN("Diagnostics update rate must be positive.");
         } else {
             robot->diag_set_rate(config.diag_rate);
+            diag_rate = config.diag_rate;
             ROS_INFO("Reconfigure, Diagnostics Update Rate = %d ms", config.diag_rate);
         }
     }
@@ -213,9 +521,23 @@ void callback_reconfigure(jaguar::JaguarConfig &config, uint32_t level)
             ROS_WARN("Alpha must be positive");
         } else {
             alpha = config.alpha;
+            robot->odom_set_noise(alpha);
             ROS_INFO("Reconfigure, alpha = %f", alpha);
         }
     }
+    if (level & 4096) {
+        if (config.integrator < Integrator::kMidpoint || config.integrator > Integrator::kRungeKutta4) {
+            ROS_WARN("Unknown pose integrator.");
+        } else {
+            Integrator::Enum const method = static_cast<Integrator::Enum>(config.integrator);
+            robot->odom_set_integrator(method);
+            ROS_INFO("Reconfigure, Integrator = %s", pose_integrator(method).name());
+        }
+    }
+
+    if (!robot->config_commit()) {
+        ROS_WARN("Reconfigure, some commands were not acknowledged");
+    }
     spinlock = true;
 }
 
@@ -224,12 +546,25 @@ int main(int argc, char **argv)
     ros::init(argc, argv, "diff_drive_node");
     ros::NodeHandle nh;
 
+    std::string record_path, replay_path;
+    double replay_speed;
+    ros::param::get("~record", record_path);
+    ros::param::get("~replay", replay_path);
+    ros::param::param("~replay_speed", replay_speed, 1.0);
+
     ros::param::get("~port", settings.port);
-    ros::param::get("~id_left", settings.id_left);
-    ros::param::get("~id_right", settings.id_right);
+    settings.ids_left = param_ids("left");
+    settings.ids_right = param_ids("right");
     ros::param::get("~frame_parent", frame_parent);
     ros::param::get("~frame_child", frame_child);
     ros::param::get("~accel_max", settings.accel_max_mps2);
+    ros::param::param("~ack_timeout", settings.ack_timeout_ms, 500);
+    ros::param::param("~ack_retries", settings.ack_retries, 2);
+    ros::param::param("~control_rate", control_rate, 50.0);
+
+    std::string fusion;
+    ros::param::param<std::string>("~fusion", fusion, "reject_outliers");
+    settings.fusion = (fusion == "median") ? FusionMethod::kMedian : FusionMethod::kRejectOutliers;
     ros::param::get("~flip_left", settings.flip_left);
     ros::param::get("~flip_right", settings.flip_left);
 
@@ -237,18 +572,48 @@ int main(int argc, char **argv)
     last_time = ros::Time::now();
     settings.brake = BrakeCoastSetting::kOverrideCoast;
 
-    if (!(1 <= settings.id_left  && settings.id_left  <= 63)
-     || !(1 <= settings.id_right && settings.id_right <= 63)) {
-        ROS_FATAL("Invalid CAN device id. Must be in the range 1-63.");
-        return 1;
-    } else if (settings.id_left == settings.id_right){
-        ROS_FATAL("Invalid CAN device ID. Left and right IDs must be unique.");
+    std::vector<int> ids(settings.ids_left);
+    ids.insert(ids.end(), settings.ids_right.begin(), settings.ids_right.end());
+    std::ostringstream id_list;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        id_list << ((i > 0) ? ", " : "") << ids[i];
+    }
+
+    if (settings.ids_left.empty() || settings.ids_right.empty()) {
+        ROS_FATAL("At least one CAN device id is required on each side.");
         return 1;
     }
-    ROS_INFO("Communicating to IDs %d and %d over %s", settings.id_left,
-             settings.id_right, settings.port.c_str());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (!(1 <= ids[i] && ids[i] <= 63)) {
+            ROS_FATAL("Invalid CAN device id. Must be in the range 1-63.");
+            return 1;
+        } else if (std::count(ids.begin(), ids.end(), ids[i]) > 1) {
+            ROS_FATAL("Invalid CAN device ID. Every motor's ID must be unique.");
+            return 1;
+        }
+    }
+
+    // Either re-run a recorded session or talk to the real robot, optionally
+    // recording everything that crosses the bus.
+    boost::shared_ptr<CANBridge> bridge;
+    boost::shared_ptr<ReplayBridge> replay;
+    if (!replay_path.empty()) {
+        replay = boost::make_shared<ReplayBridge>(replay_path, replay_speed);
+        bridge = replay;
+        ROS_INFO("Replaying %s at %gx", replay_path.c_str(), replay_speed);
+    } else {
+        jaguar_bridge = boost::make_shared<JaguarBridge>(settings.port);
+        if (!record_path.empty()) {
+            recorder = boost::make_shared<CANRecorder>(
+                boost::ref(*jaguar_bridge), record_path);
+            ROS_INFO("Recording CAN traffic to %s", record_path.c_str());
+        }
+        bridge = jaguar_bridge;
+        ROS_INFO("Communicating to IDs %s over %s", id_list.str().c_str(),
+                 settings.port.c_str());
+    }
 
-    robot = boost::make_shared<DiffDriveRobot>(settings);
+    robot = boost::make_shared<DiffDriveRobot>(settings, bridge);
 
     // Use dynamic reconfigure for all remaining parameters.
     dynamic_reconfigure::Server<jaguar::JaguarConfig> server;
@@ -266,6 +631,7 @@ int main(int argc, char **argv)
     pub_temp_right = nh.advertise<std_msgs::Float64>("temperature_right", 10);
     pub_voltage_left  = nh.advertise<std_msgs::Float64>("voltage_left", 10);
     pub_voltage_right = nh.advertise<std_msgs::Float64>("voltage_right", 10);
+    pub_diagnostics = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
     pub_tf = boost::make_shared<tf::TransformBroadcaster>();
 
     // These must be registered after the publishers are initialized. Otherwise
@@ -274,15 +640,40 @@ int main(int argc, char **argv)
     robot->diag_attach(&callback_diag_left, &callback_diag_right);
     robot->estop_attach(&callback_estop);
 
+    // Only start a replay once every callback is attached, so none of the
+    // recorded statuses are dropped and every run sees the same stream. The
+    // startup commands above are not acknowledged until then, so a replay
+    // waits out their ACK timeouts before it starts.
+    if (replay) {
+        replay->play();
+    }
+
     while (!spinlock);
 
-    // TODO: Read this heartbeat rate from a parameter.
-    ros::Rate heartbeat_rate(50);
+    // Setpoints are streamed without ACKs, so the loop period does not
+    // depend on the serial round trip. Heartbeats only need to arrive within
+    // the Jaguar's timeout, so they are sent at their own, slower rate.
+    ros::Rate loop_rate(control_rate);
+    ros::Time heartbeat_sent = ros::Time(0);
+    ros::Time link_checked = ros::Time::now();
+    ros::Time diagnostics_published = ros::Time::now();
     while (ros::ok()) {
-        robot->drive_spin(1 / 50.);
-        robot->heartbeat();
+        robot->drive_spin(1 / control_rate);
+        if ((ros::Time::now() - heartbeat_sent).toSec() * 1000 >= heartbeat_rate) {
+            robot->heartbeat();
+            heartbeat_sent = ros::Time::now();
+        }
         ros::spinOnce();
-        heartbeat_rate.sleep();
+
+        if (jaguar_bridge && (ros::Time::now() - link_checked).toSec() >= link_check_period) {
+            check_link();
+            link_checked = ros::Time::now();
+        }
+        if (jaguar_bridge && (ros::Time::now() - diagnostics_published).toSec() >= diagnostics_period) {
+            publish_diagnostics();
+            diagnostics_published = ros::Time::now();
+        }
+        loop_rate.sleep();
     }
     return 0;
 }
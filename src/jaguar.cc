@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <limits>
 #include <stdint.h>
 #include <vector>
@@ -6,17 +8,9 @@
 #include <iostream>
 #include <cstring>
 #include <boost/bind.hpp>
-#include <boost/spirit/include/karma.hpp>
-#include <boost/spirit/include/phoenix_core.hpp>
-#include <boost/spirit/include/phoenix_operator.hpp>
-#include <boost/fusion/include/std_pair.hpp>
 #include <jaguar/jaguar.h>
 #include <jaguar/jaguar_helper.h>
-
-using boost::spirit::eps;
-using boost::spirit::byte_;
-using boost::spirit::little_word;
-using boost::spirit::little_dword;
+#include <jaguar/jaguar_message.h>
 
 
 namespace jaguar {
@@ -24,6 +18,31 @@ namespace jaguar {
 Manufacturer::Enum const Jaguar::kManufacturer = Manufacturer::kTexasInstruments;
 DeviceType::Enum   const Jaguar::kDeviceType   = DeviceType::kMotorController;
 
+size_t const Jaguar::kDiagStatusLength = 6;
+size_t const Jaguar::kOdomStatusLength = 8;
+
+static StatusPlan make_diag_plan(void)
+{
+    StatusPlan plan;
+    plan.add(StatusField::kLimitNonClearing);
+    plan.add(StatusField::kStickyFaultsNonClearing);
+    plan.add(StatusField::kBusVoltage);
+    plan.add(StatusField::kTemperature);
+    return plan;
+}
+
+static StatusPlan make_odom_plan(void)
+{
+    StatusPlan plan;
+    plan.add(StatusField::kPosition);
+    plan.add(StatusField::kSpeed);
+    return plan;
+}
+
+// Layouts requested by periodic_config_diag() and periodic_config_odom().
+static StatusPlan const kDiagPlan = make_diag_plan();
+static StatusPlan const kOdomPlan = make_odom_plan();
+
 struct speed_group_t {
     int32_t speed;
     uint8_t group;
@@ -32,6 +51,8 @@ struct speed_group_t {
 Jaguar::Jaguar(can::CANBridge &can, uint8_t device_num)
     : num_(device_num)
     , can_(can)
+    , ack_timeout_(boost::posix_time::pos_infin)
+    , ack_retries_(0)
     , sig_diag_(4)
     , sig_odom_(4)
 {
@@ -41,41 +62,44 @@ Jaguar::Jaguar(can::CANBridge &can, uint8_t device_num)
     }
 }
 
+uint8_t Jaguar::device_num(void) const
+{
+    return num_;
+}
+
+void Jaguar::ack_timeout_set(boost::posix_time::time_duration const &timeout)
+{
+    ack_timeout_ = timeout;
+}
+
+void Jaguar::ack_retries_set(unsigned retries)
+{
+    ack_retries_ = retries;
+}
+
 /*
  * Motor Control Configuration
  */
 
 can::TokenPtr Jaguar::config_brushes_set(uint8_t brushes)
 {
-    return send_ack(
-        APIClass::kConfiguration, Configuration::kNumberOfBrushes,
-        byte_(brushes)
-    );
+    return send_config(message::NumberOfBrushes::pack(num_, brushes));
 }
 
 can::TokenPtr Jaguar::config_encoders_set(uint16_t lines)
 {
-    return send_ack(
-        APIClass::kConfiguration, Configuration::kNumberOfEncodersLines,
-        little_word(lines)
-    );
+    return send_config(message::NumberOfEncoderLines::pack(num_, lines));
 }
 
 can::TokenPtr Jaguar::config_brake_set(BrakeCoastSetting::Enum brake)
 {
-    return send_ack(
-        APIClass::kConfiguration, Configuration::kBrakeCoastSetting,
-        byte_(brake)
-    );
+    return send_config(message::BrakeCoast::pack(num_, brake));
 }
 
 can::TokenPtr Jaguar::config_fault_set(uint16_t ms)
 {
     assert(ms >= 500);
-    return send_ack(
-        APIClass::kConfiguration,Configuration::kFaultTime,
-        little_word(ms)
-    );
+    return send_config(message::FaultTime::pack(num_, ms));
 }
 
 /*
@@ -83,50 +107,43 @@ can::TokenPtr Jaguar::config_fault_set(uint16_t ms)
  */
 can::TokenPtr Jaguar::voltage_enable(void)
 {
-    return send_ack(
-        APIClass::kVoltageControl, VoltageControl::kVoltageModeEnable,
-        eps
-    );
+    return send_ack(message::VoltageModeEnable::pack(num_));
 }
 
 can::TokenPtr Jaguar::voltage_disable(void)
 {
-    return send_ack(
-        APIClass::kVoltageControl, VoltageControl::kVoltageModeDisable,
-        eps
-    );
+    return send_ack(message::VoltageModeDisable::pack(num_));
 }
 
 can::TokenPtr Jaguar::voltage_set(double voltage)
 {
-    return send_ack(
-        APIClass::kVoltageControl, VoltageControl::kVoltageSet,
-        little_word(rescale<int16_t>(voltage))
-    );
+    return send_ack(message::VoltageSet::pack(num_, voltage));
 }
 
 can::TokenPtr Jaguar::voltage_set(double voltage, uint8_t group)
 {
-    return send_ack(
-        APIClass::kVoltageControl, VoltageControl::kVoltageSet,
-        little_word(rescale<int16_t>(voltage)) << byte_(group)
-    );
+    return send_ack(message::VoltageSetGroup::pack(num_, voltage, group));
 }
 
 void Jaguar::voltage_set_noack(double voltage)
 {
-    send(
-        APIClass::kVoltageControl, VoltageControl::kVoltageSetNoACK,
-        little_word(rescale<int16_t>(voltage))
-    );
+    send(message::VoltageSetNoACK::pack(num_, voltage));
 }
 
 void Jaguar::voltage_set_noack(double voltage, uint8_t group)
 {
-    send(
-        APIClass::kVoltageControl, VoltageControl::kVoltageSetNoACK,
-        little_word(rescale<int16_t>(voltage)) << byte_(group)
-    );
+    send(message::VoltageSetNoACKGroup::pack(num_, voltage, group));
+}
+
+can::TokenPtr Jaguar::voltage_set_ramp(double rate)
+{
+    // The firmware takes the change per millisecond, in the same units as
+    // the voltage setpoint, where zero disables the ramp. Round any non-zero
+    // rate up, so a slow ramp does not turn into no ramp at all.
+    double const per_ms = std::max(rate, 0.0) * 32767 / 1000;
+    uint16_t const raw = (per_ms <= 0) ? 0
+                       : static_cast<uint16_t>(std::min(std::ceil(per_ms), 65535.0));
+    return send_config(message::VoltageRampSet::pack(num_, raw));
 }
 
 /*
@@ -134,156 +151,96 @@ void Jaguar::voltage_set_noack(double voltage, uint8_t group)
  */
 can::TokenPtr Jaguar::speed_enable(void)
 {
-    return send_ack(
-        APIClass::kSpeedControl, SpeedControl::kSpeedModeEnable,
-        eps
-    );
+    return send_ack(message::SpeedModeEnable::pack(num_));
 }
 
 can::TokenPtr Jaguar::speed_disable(void)
 {
-    return send_ack(
-        APIClass::kSpeedControl, SpeedControl::kSpeedModeDisable,
-        eps
-    );
+    return send_ack(message::SpeedModeDisable::pack(num_));
 }
 
 can::TokenPtr Jaguar::speed_set_p(double p)
 {
-    return send_ack(
-        APIClass::kSpeedControl, SpeedControl::kSpeedProportionalConstant,
-        little_dword(double_to_s16p16(p))
-    );
+    return send_config(message::SpeedP::pack(num_, p));
 }
 
 can::TokenPtr Jaguar::speed_set_i(double i)
 {
-    return send_ack(
-        APIClass::kSpeedControl, SpeedControl::kSpeedIntegralConstant,
-        little_dword(double_to_s16p16(i))
-    );
+    return send_config(message::SpeedI::pack(num_, i));
 }
 
 can::TokenPtr Jaguar::speed_set_d(double d)
 {
-    return send_ack(
-        APIClass::kSpeedControl, SpeedControl::kSpeedDifferentialConstant,
-        little_dword(double_to_s16p16(d))
-    );
+    return send_config(message::SpeedD::pack(num_, d));
 }
 
 can::TokenPtr Jaguar::speed_set_reference(SpeedReference::Enum reference)
 {
-    return send_ack(
-        APIClass::kSpeedControl, SpeedControl::kSpeedReference,
-        byte_(reference)
-    );
+    return send_config(message::SpeedReferenceSet::pack(num_, reference));
 }
 
 can::TokenPtr Jaguar::speed_set(double speed)
 {
-    return send_ack(
-        APIClass::kSpeedControl, SpeedControl::kSpeedSet,
-        little_dword(double_to_s16p16(speed))
-    );
+    return send_ack(message::SpeedSet::pack(num_, speed));
 }
 
 can::TokenPtr Jaguar::speed_set(double speed, uint8_t group)
 {
-    return send_ack(
-        APIClass::kSpeedControl, SpeedControl::kSpeedSet,
-        little_dword(double_to_s16p16(speed)) << byte_(group)
-    );
+    return send_ack(message::SpeedSetGroup::pack(num_, speed, group));
 }
 
 void Jaguar::speed_set_noack(double speed)
 {
-    send(
-        APIClass::kSpeedControl, SpeedControl::kSpeedSetNoACK,
-        little_dword(double_to_s16p16(speed))
-    );
+    send(message::SpeedSetNoACK::pack(num_, speed));
 }
 
 void Jaguar::speed_set_noack(double speed, uint8_t group)
 {
-    send(
-        APIClass::kSpeedControl, SpeedControl::kSpeedSetNoACK,
-        little_dword(double_to_s16p16(speed)) << byte_(group)
-    );
+    send(message::SpeedSetNoACKGroup::pack(num_, speed, group));
 }
 
 /*
  * Position Mode
  */
 can::TokenPtr Jaguar::position_enable(void) {
-    return send_ack(
-        APIClass::kPositionControl, PositionControl::kPositionModeEnable,
-        eps
-    );
+    return send_ack(message::PositionModeEnable::pack(num_));
 }
 
 can::TokenPtr Jaguar::position_disable(void) {
-    return send_ack(
-        APIClass::kPositionControl, PositionControl::kPositionModeDisable,
-        eps
-    );
+    return send_ack(message::PositionModeDisable::pack(num_));
 }
 
 can::TokenPtr Jaguar::position_set_p(double p) {
-    return send_ack(
-        APIClass::kPositionControl, PositionControl::kPositionProportionalConstant,
-        little_dword(double_to_s16p16(p))
-    );
+    return send_config(message::PositionP::pack(num_, p));
 }
 
 can::TokenPtr Jaguar::position_set_i(double i) {
-    return send_ack(
-        APIClass::kPositionControl, PositionControl::kPositionIntegralConstant,
-        little_dword(double_to_s16p16(i))
-    );
+    return send_config(message::PositionI::pack(num_, i));
 }
 
 can::TokenPtr Jaguar::position_set_d(double d) {
-    return send_ack(
-        APIClass::kPositionControl, PositionControl::kPositionDifferentialConstant,
-        little_dword(double_to_s16p16(d))
-    );
+    return send_config(message::PositionD::pack(num_, d));
 }
 
 can::TokenPtr Jaguar::position_set_reference(PositionReference::Enum reference)
 {
-    return send_ack(
-        APIClass::kPositionControl, PositionControl::kPositionReference,
-        byte_(reference)
-    );
+    return send_config(message::PositionReferenceSet::pack(num_, reference));
 }
 
 can::TokenPtr Jaguar::position_set(double position) {
-    return send_ack(
-        APIClass::kPositionControl, PositionControl::kPositionSet,
-        little_dword(double_to_s16p16(position))
-    );
+    return send_ack(message::PositionSet::pack(num_, position));
 }
 
 can::TokenPtr Jaguar::position_set(double position, uint8_t group) {
-    return send_ack(
-        APIClass::kPositionControl, PositionControl::kPositionSet,
-        little_dword(double_to_s16p16(position)) << byte_(group)
-    );
+    return send_ack(message::PositionSetGroup::pack(num_, position, group));
 }
 
 void Jaguar::position_set_noack(double position) {
-    send(
-        APIClass::kPositionControl, PositionControl::kPositionSetNoACK,
-        little_dword(double_to_s16p16(position))
-    );
+    send(message::PositionSetNoACK::pack(num_, position));
 }
 
 void Jaguar::position_set_noack(double position, uint8_t group) {
-    send(
-        APIClass::kPositionControl, PositionControl::kPositionSetNoACK,
-        little_dword(double_to_s16p16(position)) << byte_(group)
-    );
+    send(message::PositionSetNoACKGroup::pack(num_, position, group));
 }
 
 
@@ -292,204 +249,130 @@ void Jaguar::position_set_noack(double position, uint8_t group) {
  */
 can::TokenPtr Jaguar::periodic_enable(uint8_t index, uint16_t rate_ms)
 {
-    return send_ack(
-        APIClass::kPeriodicStatus, PeriodicStatus::kEnableMessage + index,
-        little_word(rate_ms)
-    );
+    return send_config(message::PeriodicEnable::pack_at(num_, index, rate_ms));
 }
 
 can::TokenPtr Jaguar::periodic_disable(uint8_t index)
 {
     // TODO: Unregister the callback.
 
-    return send_ack(
-        APIClass::kPeriodicStatus, PeriodicStatus::kEnableMessage + index,
-        byte_(0)
-    );
+    return send_config(message::PeriodicDisable::pack_at(num_, index, 0));
 }
 
 can::TokenPtr Jaguar::periodic_config_diag(uint8_t index, boost::function<DiagCallback> callback)
 {
     // Tell the Jaguar which status fields we're interested in. Due to CAN
     // limitations, we can only receive eight bytes per update message.
-    uint32_t const config_id = pack_id(num_,
-        kManufacturer, kDeviceType,
-        APIClass::kPeriodicStatus, PeriodicStatus::kConfigureMessage + index
-    );
-    uint32_t const ack_id = pack_ack(num_, kManufacturer, kDeviceType);
-    can::CANMessage msg(config_id);
-
-    // Request the limit switch status, fault status, temperature
-    msg.payload.resize(8);
-    msg.payload[0] = PeriodicStatusItem::kLimitNonClearing;
-    msg.payload[1] = PeriodicStatusItem::kStickyFaultsNonClearing;
-    msg.payload[2] = PeriodicStatusItem::kBusVoltageBase + 0;
-    msg.payload[3] = PeriodicStatusItem::kBusVoltageBase + 1;
-    msg.payload[4] = PeriodicStatusItem::kTemperatureBase + 0;
-    msg.payload[5] = PeriodicStatusItem::kTemperatureBase + 1;
-    msg.payload[6] = PeriodicStatusItem::kEndOfMessage;
+    // Request the limit switch status, fault status, bus voltage and
+    // temperature.
+    assert(kDiagPlan.length() == kDiagStatusLength);
 
     // Register a callback to process the periodic status updates.
-    uint32_t const status_id = pack_id(num_,
-        kManufacturer, kDeviceType,
-        APIClass::kPeriodicStatus, PeriodicStatus::kPeriodicStatus + index
-    );
     sig_diag_[index]->connect(callback);
-    can_.attach_callback(status_id, boost::bind(&Jaguar::diag_unpack, this, _1, index));
+    can_.attach_frame_callback(message::PeriodicStatusMessage::id(num_, index),
+                               boost::bind(&Jaguar::diag_unpack, this, _1, index));
 
     // Wait for an ACK in response to the config message.
-    can::TokenPtr token =  can_.recv(ack_id);
-    can_.send(msg);
-    return token;
+    return send_config(message::PeriodicConfigure::pack_at(num_, index, kDiagPlan.layout()));
 }
 
 can::TokenPtr Jaguar::periodic_config_odom(uint8_t index, boost::function<OdomCallback> callback)
 {
     // Tell the Jaguar which status fields we're interested in. Due to CAN
     // limitations, we can only receive eight bytes per update message.
-    uint32_t const config_id = pack_id(num_,
-        kManufacturer, kDeviceType,
-        APIClass::kPeriodicStatus, PeriodicStatus::kConfigureMessage + index
-    );
-    uint32_t const ack_id = pack_ack(num_, kManufacturer, kDeviceType);
-    can::CANMessage msg(config_id);
-
     // Request the 16.16 position and 16.16 velocity.
-    msg.payload.reserve(8);
-    for (int i = 0; i < 4; i++) {
-        msg.payload.push_back(PeriodicStatusItem::kPositionBase + i);
-    }
-    for (int i = 0; i < 4; i++) {
-        msg.payload.push_back(PeriodicStatusItem::kSpeedBase + i);
-    }
+    assert(kOdomPlan.length() == kOdomStatusLength);
 
     // Register a callback to process the periodic status updates.
-    uint32_t const status_id = pack_id(num_,
-        kManufacturer, kDeviceType,
-        APIClass::kPeriodicStatus, PeriodicStatus::kPeriodicStatus + index
-    );
     sig_odom_[index]->connect(callback);
-    can_.attach_callback(status_id, boost::bind(&Jaguar::odom_unpack, this, _1, index));
+    can_.attach_frame_callback(message::PeriodicStatusMessage::id(num_, index),
+                               boost::bind(&Jaguar::odom_unpack, this, _1, index));
 
     // Wait for an ACK in response to the config message.
-    can::TokenPtr token =  can_.recv(ack_id);
-    can_.send(msg);
-    return token;
+    return send_config(message::PeriodicConfigure::pack_at(num_, index, kOdomPlan.layout()));
 }
 
-can::TokenPtr Jaguar::periodic_config(uint8_t index, AggregateStatus statuses)
+can::TokenPtr Jaguar::periodic_config(uint8_t index, StatusPlan const &plan,
+                                      boost::function<StatusCallback> callback)
 {
-    // Tell the Jaguar which status fields we're interested in. Due to CAN
-    // limitations, we can only receive eight bytes per update message.
-    uint32_t const config_id = pack_id(num_,
-        kManufacturer, kDeviceType,
-        APIClass::kPeriodicStatus, PeriodicStatus::kConfigureMessage + index
-    );
-    uint32_t const ack_id = pack_ack(num_, kManufacturer, kDeviceType);
-    can::CANMessage msg(config_id);
-
-    std::back_insert_iterator<std::vector<uint8_t> > payload(msg.payload);
-    statuses.write(payload);
-
-    // Terminate short methods the EOM item.
-    assert(msg.payload.size() <= 8);
-    if (msg.payload.size() < 8) {
-        msg.payload.push_back(PeriodicStatusItem::kEndOfMessage);
-    }
-
-    // Register a callback to process the periodic status updates.
-    uint32_t const status_id = pack_id(num_,
-        kManufacturer, kDeviceType,
-        APIClass::kPeriodicStatus, PeriodicStatus::kPeriodicStatus + index
-    );
-    can_.attach_callback(status_id, boost::bind(&Jaguar::periodic_unpack, this, _1, statuses));
+    // The plan is compiled once here and bound by value, so each frame is
+    // decoded without allocating or walking the Status objects.
+    can_.attach_frame_callback(message::PeriodicStatusMessage::id(num_, index),
+                               boost::bind(&Jaguar::periodic_unpack, this, _1, plan, callback));
 
     // Wait for an ACK in response to the config message.
-    can::TokenPtr token =  can_.recv(ack_id);
-    can_.send(msg);
-    return token;
+    return send_config(message::PeriodicConfigure::pack_at(num_, index, plan.layout()));
 }
 
-
 /*
  * Helpers
  */
-void Jaguar::diag_unpack(boost::shared_ptr<can::CANMessage> msg, uint8_t index)
+DeviceStatus Jaguar::status(void) const
 {
-    uint8_t raw_limits = 0, raw_faults = 0;
-    uint16_t raw_bus_voltage = 0, raw_temperature = 0;
-    boost::spirit::qi::parse(msg->payload.begin(), msg->payload.end(),
-        byte_ >> byte_ >> little_word >> little_word,
-        raw_limits, raw_faults, raw_bus_voltage, raw_temperature
-    );
-
-    LimitStatus::Enum const limits = static_cast<LimitStatus::Enum>(raw_limits);
-    Fault::Enum const faults = static_cast<Fault::Enum>(raw_faults);
-    double const bus_voltage = s8p8_to_double(raw_bus_voltage);
-    double const temperature = s8p8_to_double(raw_temperature);
-    (*sig_diag_[index])(limits, faults, bus_voltage, temperature);
+    return status_.load();
 }
 
-void Jaguar::odom_unpack(boost::shared_ptr<can::CANMessage> msg, uint8_t index)
+void Jaguar::diag_unpack(can::FramePtr const &frame, uint8_t index)
 {
-    int32_t raw_position = 0, raw_speed = 0;
-    boost::spirit::qi::parse(msg->payload.begin(), msg->payload.end(),
-        little_dword >> little_dword, raw_position, raw_speed
-    );
-    double const position = s16p16_to_double(raw_position);
-    double const speed = s16p16_to_double(raw_speed);
-    (*sig_odom_[index])(position, speed);
-}
-
+    StatusSample sample;
+    sample.stamp = frame->timestamp;
+    bool const complete = kDiagPlan.decode(frame->data, frame->dlc, sample);
+    status_.update(sample);
+    if (!complete) {
+        return;
+    }
 
-void Jaguar::periodic_unpack(boost::shared_ptr<can::CANMessage> message, AggregateStatus statuses)
-{
-    std::vector<uint8_t> const &payload = message->payload;
-    statuses.read(&payload.front(), &payload.back() + 1);
+    LimitStatus::Enum const limits = static_cast<LimitStatus::Enum>(sample.limit_non_clearing);
+    Fault::Enum const faults = static_cast<Fault::Enum>(sample.sticky_faults_non_clearing);
+    (*sig_diag_[index])(limits, faults, sample.bus_voltage, sample.temperature, frame->timestamp);
 }
 
-template <typename T>
-T Jaguar::rescale(double x)
+void Jaguar::odom_unpack(can::FramePtr const &frame, uint8_t index)
 {
-    assert(-1.0 <= x && x <= +1.0);
-
-    if (x < 0) {
-        return static_cast<T>(std::numeric_limits<T>::min() * -x);
-    } else if (x > 0) {
-        return static_cast<T>(std::numeric_limits<T>::max() *  x);
-    } else {
-        return 0;
+    StatusSample sample;
+    sample.stamp = frame->timestamp;
+    bool const complete = kOdomPlan.decode(frame->data, frame->dlc, sample);
+    status_.update(sample);
+    if (!complete) {
+        return;
     }
 
+    (*sig_odom_[index])(sample.position, sample.speed, frame->timestamp);
 }
 
-template <typename G>
-void Jaguar::send(APIClass::Enum api_class, uint8_t api_index, G const &generator)
+void Jaguar::periodic_unpack(can::FramePtr const &frame, StatusPlan const &plan,
+                             boost::function<StatusCallback> const &callback)
 {
-    uint32_t const id = pack_id(num_, kManufacturer, kDeviceType, api_class, api_index);
-    can::CANMessage msg(id);
+    StatusSample sample;
+    sample.stamp = frame->timestamp;
+    plan.decode(frame->data, frame->dlc, sample);
+    status_.update(sample);
+    callback(sample);
+}
 
-    std::back_insert_iterator<std::vector<uint8_t> > payload(msg.payload);
-    bool success = boost::spirit::karma::generate(payload, generator);
-    assert(success);
+void Jaguar::send(can::CANFrame const &frame)
+{
+    can_.send(can::CANMessage(frame));
+}
 
-    can_.send(msg);
+can::TokenPtr Jaguar::send_ack(can::CANFrame const &frame)
+{
+    return request_ack(can::CANMessage(frame), 0);
 }
 
-template <typename G>
-can::TokenPtr Jaguar::send_ack(APIClass::Enum api_class, uint8_t api_index, G const &generator)
+can::TokenPtr Jaguar::send_config(can::CANFrame const &frame)
 {
-    assert(!token_ || token_->ready());
-    uint32_t const ack_id = pack_ack(num_, kManufacturer, kDeviceType);
-    can::TokenPtr token =  can_.recv(ack_id);
-    send(api_class, api_index, generator);
-    return token;
+    // Configuration writes are idempotent, so a lost frame or ACK can be
+    // recovered by sending the write again.
+    return request_ack(can::CANMessage(frame), ack_retries_);
 }
 
-can::TokenPtr Jaguar::recv_ack(void)
+can::TokenPtr Jaguar::request_ack(can::CANMessage const &msg, unsigned retries)
 {
-    token_ = can_.recv(pack_ack(num_, kManufacturer, kDeviceType));
-    return token_;
+    // The Jaguar acknowledges commands in the order they were received, so
+    // any number of requests can be pipelined without waiting.
+    return can_.request(msg, pack_ack(num_, kManufacturer, kDeviceType),
+                        ack_timeout_, retries);
 }
 
 AggregateStatus operator<<(AggregateStatus aggregate, Status::Ptr const &status) {
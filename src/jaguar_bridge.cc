@@ -1,45 +1,54 @@
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <boost/make_shared.hpp>
 #include <boost/foreach.hpp>
-#include <boost/lambda/lambda.hpp>
 #include <boost/assert.hpp>
+#include <jaguar/jaguar_api.h>
 #include <jaguar/jaguar_bridge.h>
 
 namespace asio = boost::asio;
 
 namespace can {
 
-#define CAN_JAGUARBRIDGE_ERROR(msg) do {                                    \
-    std::stringstream __m__;                                                \
-    __m__ << msg;                                                           \
-    error_signal_(BOOST_CURRENT_FUNCTION, __FILE__, __LINE__, __m__.str()); \
-} while(0)
+#define CAN_JAGUARBRIDGE_ERROR(code, detail) \
+    report_error((code), (detail), BOOST_CURRENT_FUNCTION, __FILE__, __LINE__)
+
+unsigned const JaguarBridge::kBaudRate = 115200;
+
+// Time on the wire for one byte of 8N1 serial, in nanoseconds (~86.8 us).
+Timestamp const JaguarBridge::kByteTime = 10 * 1000000000ull / JaguarBridge::kBaudRate;
+
+// Never let more than about one encoded frame sit in the kernel's transmit
+// buffer; anything queued later must still be able to jump ahead of it.
+Timestamp const JaguarBridge::kPaceWindow = JaguarCodec::kMaxEncodedLength * JaguarBridge::kByteTime;
 
-uint8_t const JaguarBridge::kSOF = 0xFF;
-uint8_t const JaguarBridge::kESC = 0xFE;
-uint8_t const JaguarBridge::kSOFESC = 0xFE;
-uint8_t const JaguarBridge::kESCESC = 0xFD;
 size_t const JaguarBridge::kReceiveBufferLength = 1024;
 
+boost::posix_time::time_duration const JaguarBridge::kFlushTimeout = boost::posix_time::milliseconds(100);
+
+// pump() stops encoding once the pacing window is full, so a single write
+// never exceeds the window plus the frame that crossed it.
+size_t const JaguarBridge::kSendBufferLength = 2 * JaguarCodec::kMaxEncodedLength;
+
 JaguarBridge::JaguarBridge(std::string port)
     : serial_(io_, port),
+      pace_timer_(io_),
+      pace_armed_(false),
+      pace_due_(0),
+      wire_free_(0),
+      send_buffer_(kSendBufferLength),
       recv_buffer_(kReceiveBufferLength),
-      state_(kWaiting),
-      length_(0),
-      escape_(false)
+      recv_stamp_(0)
 {
     using asio::serial_port_base;
 
-    serial_.set_option(serial_port_base::baud_rate(115200u));
+    serial_.set_option(serial_port_base::baud_rate(kBaudRate));
     serial_.set_option(serial_port_base::character_size(8));
     serial_.set_option(serial_port_base::stop_bits(serial_port_base::stop_bits::one));
     serial_.set_option(serial_port_base::parity(serial_port_base::parity::none));
     serial_.set_option(serial_port_base::flow_control(serial_port_base::flow_control::none));
 
-    // Four byte ID plus at most eight bytes of payload.
-    packet_.reserve(12);
-
     // Schedule an asynchronous read. This will persist for the entire
     // lifetime of the program.
     serial_.async_read_some(asio::buffer(recv_buffer_),
@@ -48,334 +57,228 @@ JaguarBridge::JaguarBridge(std::string port)
                     asio::placeholders::bytes_transferred
         )
     );
-    recv_thread_ = boost::thread(boost::bind(&asio::io_service::run, &io_));
+    start();
 }
 
 JaguarBridge::~JaguarBridge(void)
 {
+    // Give the pacing timer a chance to drain anything still queued, e.g. a
+    // final halt, before the I/O thread goes away.
+    boost::system_time const deadline = boost::get_system_time() + kFlushTimeout;
+    for (;;) {
+        {
+            boost::mutex::scoped_lock lock(send_mutex_);
+            if (scheduler_.empty()) break;
+        }
+        if (boost::get_system_time() >= deadline) break;
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+
     serial_.cancel();
-    recv_thread_.join();
+    stop();
     serial_.close();
 }
 
 void JaguarBridge::send(CANMessage const &message)
 {
-    assert(message.payload.size() <= 8);
-    assert((message.id & 0xE0000000) == 0);
-
-    // Each message consists of two bytes of framing, a 29-bit CAN identifier
-    // packed into four bytes, and a maximum of eight bytes of data. All of
-    // these, except the start of frame byte, may need to be escaped. In all,
-    // this is: 2 + (4 + 8)*2 = 26 bytes.
-    std::vector<uint8_t> buffer;
-    buffer.reserve(26);
-
-    // 29-bit CAN id encoded as a 32-bit integer. Note the Endian-ness
-    // conversion because the integer is being treated as an array of bytes.
-    union {
-        uint32_t id;
-        uint8_t  bytes[4];
-    } id_conversion = { htole32(message.id) };
-
-    buffer.push_back(kSOF);
-    buffer.push_back(message.payload.size() + 4);
-    encode_bytes(id_conversion.bytes, 4, buffer);
-    encode_bytes(&message.payload[0], message.payload.size(), buffer);
-
-    asio::write(serial_, asio::buffer(&buffer[0], buffer.size()));
+    send_batch(&message, &message + 1);
 }
 
-TokenPtr JaguarBridge::recv(uint32_t id)
+void JaguarBridge::send_batch(CANMessage const *begin, CANMessage const *end)
 {
-    boost::mutex::scoped_lock lock(token_mutex_);
+    boost::mutex::scoped_lock lock(send_mutex_);
+    Timestamp const now = monotonic_now();
 
-    // We can't use boost::make_shared because JaguarToken's constructor is
-    // private, so we can only call it from a friend class.
-    std::pair<token_table::iterator, bool> it = tokens_.insert(
-        std::make_pair(id, boost::shared_ptr<JaguarToken>(new JaguarToken(*this, id)))
-    );
-    assert(it.second);
-    return it.first->second;
+    for (CANMessage const *it = begin; it != end; ++it) {
+        scheduler_.push(tx_class(it->id), *it, now);
+    }
+    pump(now);
 }
 
-CallbackToken JaguarBridge::attach_callback(uint32_t id, uint32_t id_mask, recv_callback cb)
+void JaguarBridge::tx_rate_limit_set(TxClass::Enum cls, double frames_per_sec, size_t burst)
 {
-    boost::mutex::scoped_lock lock(callback_mutex_);
-
-    /* FIXME: connect signals with identical id & id_mask */
-    boost::shared_ptr<callback_signal> signal = boost::make_shared<callback_signal>();
-    callbacks_list_.insert(
-        callbacks_list_.end(),
-        std::make_pair(
-            make_masked_number(id, id_mask),
-            signal
-        )
-    );
-    return signal->connect(cb);
+    boost::mutex::scoped_lock lock(send_mutex_);
+    scheduler_.rate_limit_set(cls, frames_per_sec, burst);
 }
 
-/* FIXME: should be `void JaguarBridge::attack_callback(error_callback cb)` */
-CallbackToken JaguarBridge::attach_callback(boost::function<error_callback_sig> cb)
+TxClassStats JaguarBridge::tx_stats(TxClass::Enum cls) const
 {
-    return error_signal_.connect(cb);
+    boost::mutex::scoped_lock lock(send_mutex_);
+    return scheduler_.stats(cls);
 }
 
-CallbackToken JaguarBridge::attach_callback(uint32_t id, recv_callback cb)
+JaguarBridge::LinkUsage JaguarBridge::link_usage(void) const
 {
-    boost::mutex::scoped_lock lock(callback_mutex_);
-
-    // Calling map::insert() is equivalent to map::find() if the key already
-    // exists; i.e. the map is not changed in any way.
-    std::pair<callback_table::iterator, bool> old_callback = callbacks_.insert(
-        std::make_pair(
-            id,
-            boost::make_shared<callback_signal>()
-        )
-    );
-
-    callback_signal_ptr signal = old_callback.first->second;
-    return signal->connect(cb);
+    BridgeMetricsSnapshot const snapshot = metrics_.snapshot();
+
+    LinkUsage usage;
+    usage.tx_bytes   = snapshot.bytes_out;
+    usage.rx_bytes   = snapshot.bytes_in;
+    usage.tx_frames  = snapshot.frames_out;
+    usage.rx_frames  = snapshot.frames_in;
+    usage.tx_payload = snapshot.payload_out;
+    usage.rx_payload = snapshot.payload_in;
+    usage.stamp      = snapshot.stamp;
+    return usage;
 }
 
-boost::shared_ptr<CANMessage> JaguarBridge::recv_byte(uint8_t byte)
+BridgeMetricsSnapshot JaguarBridge::metrics(void) const
 {
-    // Due to escaping, the SOF byte only appears at frame starts.
-    if (byte == kSOF) {
-        state_  = kLength;
-        length_ = 0;
-        escape_ = 0;
-        packet_.clear();
-    }
-    // Packet length can never be SOF or ESC, so we can ignore escaping.
-    else if (state_ == kLength) {
-        if (byte < 4 || byte > 12) {
-            CAN_JAGUARBRIDGE_ERROR("recieved invalid length = " << static_cast<int>(byte));
-            state_  = kWaiting;
-        } else {
-            state_  = kPayload;
-            length_ = byte;
-        }
-    }
-    // This is the second byte in a two-byte escape code.
-    else if (state_ == kPayload && escape_) {
-        switch (byte) {
-        case kSOFESC:
-            packet_.push_back(kSOF);
-            break;
-
-        case kESCESC:
-            packet_.push_back(kESC);
-            break;
-
-        default:
-            CAN_JAGUARBRIDGE_ERROR("should never happen");
-            state_ = kWaiting;
-        }
-        escape_ = false;
-    }
-    // Escape character, so the next byte has special meaning.
-    else if (state_ == kPayload && byte == kESC) {
-        escape_ = true;
-    }
-    // Normal data.
-    else if (state_ == kPayload) {
-        packet_.push_back(byte);
-    }
-
-    // Emit a packet as soon as it is finished.
-    boost::shared_ptr<CANMessage> message;
-
-    if (state_ == kPayload && packet_.size() >= length_) {
-        message = unpack_packet(packet_);
-        state_  = kWaiting;
-        length_ = 0;
-        escape_ = 0;
-        packet_.clear();
-    }
-    return message;
+    BridgeMetricsSnapshot snapshot = metrics_.snapshot();
+
+    // Everything on the wire beyond SOF, length, identifier and payload.
+    uint64_t const framed_in  = 6 * snapshot.frames_in  + snapshot.payload_in;
+    uint64_t const framed_out = 6 * snapshot.frames_out + snapshot.payload_out;
+    snapshot.escape_bytes_in  = (snapshot.bytes_in  > framed_in)  ? snapshot.bytes_in  - framed_in  : 0;
+    snapshot.escape_bytes_out = (snapshot.bytes_out > framed_out) ? snapshot.bytes_out - framed_out : 0;
+    return snapshot;
 }
 
-void JaguarBridge::recv_handle(boost::system::error_code const& error, size_t count)
+TxClass::Enum JaguarBridge::tx_class(uint32_t id)
 {
-    if (error == boost::system::errc::success) {
-        for (size_t i = 0; i < count; ++i) {
-            boost::shared_ptr<CANMessage> msg = recv_byte(recv_buffer_[i]);
-            if (msg) {
-                recv_message(msg);
-            }
+    using namespace jaguar;
+
+    // NoACK setpoint index for each control mode, indexed by APIClass.
+    static uint8_t const kSetNoACK[] = {
+        VoltageControl::kVoltageSetNoACK,
+        SpeedControl::kSpeedSetNoACK,
+        VoltageCompensationControl::kVoltageSetNoACK,
+        PositionControl::kPositionSetNoACK,
+        CurrentControl::kCurrentSetNoACK
+    };
+
+    CANId const can_id(id);
+    switch (can_id.device_type) {
+    case DeviceType::kBroadcastMessage:
+        // A synchronous update must not overtake the group setpoints that
+        // are still queued ahead of it.
+        if (can_id.api == SystemControl::kSynchronousUpdate) {
+            return TxClass::kSetpoint;
         }
-    } else if (error == asio::error::operation_aborted) {
-        return;
-    } else {
-        CAN_JAGUARBRIDGE_ERROR(error.message());
-        return;
-    }
+        return TxClass::kSystem;
 
-    // Start the next asynchronous read. This chaining is necessary to avoid
-    // explicit threading.
-    serial_.async_read_some(asio::buffer(recv_buffer_),
-        boost::bind(&JaguarBridge::recv_handle, this,
-                    asio::placeholders::error,
-                    asio::placeholders::bytes_transferred
-        )
-    );
-}
+    case DeviceType::kFirmwareUpdate:
+        return TxClass::kBulk;
 
-void JaguarBridge::discard_token(JaguarToken &token)
-{
-    boost::mutex::scoped_lock lock(token_mutex_);
-    token_table::iterator token_it = tokens_.find(token.id_);
-    if (token_it != tokens_.end()) {
-        token_ptr token = token_it->second;
-        tokens_.erase(token_it);
-    }
-}
+    case DeviceType::kMotorController:
+        // Every control mode uses index 2 for its ACKed setpoint.
+        if (can_id.api_class <= APIClass::kCurrentControl
+         && (can_id.api_index == VoltageControl::kVoltageSet
+          || can_id.api_index == kSetNoACK[can_id.api_class])) {
+            return TxClass::kSetpoint;
+        }
+        return TxClass::kConfig;
 
-void JaguarBridge::remove_token(boost::shared_ptr<CANMessage> msg)
-{
-    boost::mutex::scoped_lock lock(token_mutex_);
-
-    // Wake anyone who is blocking for a response.
-    token_table::iterator token_it = tokens_.find(msg->id);
-    if (token_it != tokens_.end()) {
-        token_ptr token = token_it->second;
-        token->unblock(msg);
-        tokens_.erase(token_it);
+    default:
+        return TxClass::kConfig;
     }
 }
 
-void JaguarBridge::recv_message(boost::shared_ptr<CANMessage> msg)
+void JaguarBridge::pump(Timestamp now)
 {
-    {
-        boost::mutex::scoped_lock lock(callback_mutex_);
+    // Encode everything that fits in the pacing window into a single write.
+    Timestamp const backlog = (wire_free_ > now) ? wire_free_ - now : 0;
+    Timestamp wake = 0;
+    size_t length = 0;
+    CANMessage message(0);
+
+    send_pending_.clear();
+    while (backlog + length * kByteTime < kPaceWindow
+        && length + JaguarCodec::kMaxEncodedLength <= send_buffer_.size()
+        && scheduler_.pop(now, message, wake)) {
+        send_pending_.push_back(message);
+        length += JaguarCodec::encode_message(message, &send_buffer_[length]);
+    }
 
-        // Invoke callbacks registered to this CAN identifier.
-        callback_table::iterator callback_it = callbacks_.find(msg->id);
-        if (callback_it != callbacks_.end()) {
-            (*callback_it->second)(msg);
-        }
+    if (length > 0) {
+        sent(&send_pending_[0], &send_pending_[0] + send_pending_.size());
 
-        // Invoke more callbacks
-        BOOST_FOREACH(mask_callback m, callbacks_list_) {
-            if (m.first.matches(msg->id))
-                (*m.second)(msg);
+        boost::system::error_code error;
+        asio::write(serial_, asio::buffer(&send_buffer_[0], length), error);
+        if (error) {
+            CAN_JAGUARBRIDGE_ERROR(BridgeError::kWriteFailed, error.value());
+        } else {
+            BridgeMetrics::count(metrics_.bytes_out, length);
         }
+        wire_free_ = std::max(wire_free_, now) + length * kByteTime;
     }
 
-    remove_token(msg);
-}
-
-boost::shared_ptr<CANMessage> JaguarBridge::unpack_packet(std::vector<uint8_t> const &packet)
-{
-    assert(4 <= packet.size() && packet.size() <= 12);
-
-    uint32_t le_id;
-    memcpy(&le_id, &packet[0], sizeof(uint32_t));
-    uint32_t id = le32toh(le_id);
-
-    std::vector<uint8_t> payload(packet.size() - 4);
-    if (packet.size() > 4) {
-        memcpy(&payload[0], &packet[4], packet.size() - 4);
+    if (scheduler_.empty()) {
+        return;
     }
-    return boost::make_shared<CANMessage>(id, payload);
-}
 
-size_t JaguarBridge::encode_bytes(uint8_t const *bytes, size_t length, std::vector<uint8_t> &buffer)
-{
-    size_t emitted = 0;
-
-    for (size_t i = 0; i < length; ++i) {
-        uint8_t byte = bytes[i];
-        switch (byte) {
-        case kSOF:
-            buffer.push_back(kESC);
-            buffer.push_back(kSOFESC);
-            emitted += 2;
-            break;
-
-        case kESC:
-            buffer.push_back(kESC);
-            buffer.push_back(kESCESC);
-            emitted += 2;
-            break;
-
-        default:
-            buffer.push_back(byte);
-            ++emitted;
-        }
+    // Come back once the wire has drained into the window, or once a rate
+    // limited class becomes eligible, whichever is later.
+    Timestamp due = (wire_free_ > kPaceWindow) ? wire_free_ - kPaceWindow : 0;
+    due = std::max(due, wake);
+
+    if (!pace_armed_ || due < pace_due_) {
+        Timestamp const delay = (due > now) ? due - now : 0;
+        pace_armed_ = true;
+        pace_due_ = due;
+        pace_timer_.expires_from_now(boost::posix_time::microseconds((delay + 999) / 1000));
+        pace_timer_.async_wait(boost::bind(&JaguarBridge::pace_handle, this,
+                                           asio::placeholders::error));
     }
-    return emitted;
-}
-
-/*
- * JaguarToken
- */
-JaguarToken::JaguarToken(JaguarBridge &bridge, uint32_t id)
-    : done_(false)
-    , bridge_(bridge)
-    , id_(id)
-{
 }
 
-JaguarToken::~JaguarToken(void)
+void JaguarBridge::pace_handle(boost::system::error_code const &error)
 {
-    // FIXME: This causes deadlock (or something similar).
-    //bridge_.discard_token(*this);
-}
-
-void JaguarToken::discard(void)
-{
-    bridge_.discard_token(*this);
-    {
-        boost::mutex::scoped_lock lock(mutex_);
-        done_ = true;
+    // Re-arming an earlier deadline cancels the pending wait.
+    if (error == asio::error::operation_aborted) {
+        return;
     }
-}
 
-void JaguarToken::block(void)
-{
-    boost::unique_lock<boost::mutex> lock(mutex_);
-    cond_.wait(lock, boost::lambda::var(done_));
+    boost::mutex::scoped_lock lock(send_mutex_);
+    pace_armed_ = false;
+    pump(monotonic_now());
 }
 
-bool JaguarToken::timed_block(boost::posix_time::time_duration const& rel_time)
+void JaguarBridge::frame_decoded(CANFrame const &frame, size_t age)
 {
-    boost::unique_lock<boost::mutex> lock(mutex_);
-    bool r = cond_.timed_wait(lock, rel_time, boost::lambda::var(done_));
-    std::cerr << "[ in timed_block " << done_ << "]" << std::endl;
-    //bridge->remove_token();
-    return r;
+    // The read completed when the last byte in the buffer arrived. Every
+    // byte from this frame's SOF onwards took one byte time on the wire, so
+    // back-date the frame to when the Jaguar started transmitting it.
+    Timestamp const delay = age * kByteTime;
+
+    CANFrame stamped = frame;
+    stamped.timestamp = (recv_stamp_ > delay) ? recv_stamp_ - delay : 0;
+    recv_frame(make_frame(stamped));
 }
 
-bool JaguarToken::ready(void) const
+void JaguarBridge::decode_error(JaguarCodec::Status status, uint8_t byte)
 {
-    return done_;
-}
-
-boost::shared_ptr<CANMessage const> JaguarToken::message(void) const
-{
-    assert(done_);
-    return message_;
+    if (status == JaguarCodec::kInvalidLength) {
+        CAN_JAGUARBRIDGE_ERROR(BridgeError::kInvalidLength, byte);
+    } else {
+        CAN_JAGUARBRIDGE_ERROR(BridgeError::kInvalidEscape, byte);
+    }
 }
 
-#if 0
-void JaguarToken::clear_block(void)
+void JaguarBridge::recv_handle(boost::system::error_code const& error, size_t count)
 {
-    boost::lock_guard<boost::mutex> lock(mutex_);
-    message_ = message;
-    done_ = true;
-}
-#endif
+    if (error == boost::system::errc::success) {
+        recv_stamp_ = monotonic_now();
+        codec_.decode(&recv_buffer_[0], &recv_buffer_[0] + count, *this);
 
-void JaguarToken::unblock(boost::shared_ptr<CANMessage> message)
-{
-    assert(!done_);
-    {
-        boost::lock_guard<boost::mutex> lock(mutex_);
-        message_ = message;
-        done_ = true;
+        BridgeMetrics::count(metrics_.bytes_in, count);
+        metrics_.read_size.record(count);
+        BridgeMetrics::record_max(metrics_.recv_latency_max, monotonic_now() - recv_stamp_);
+    } else if (error == asio::error::operation_aborted) {
+        return;
+    } else {
+        CAN_JAGUARBRIDGE_ERROR(BridgeError::kReadFailed, error.value());
+        return;
     }
-    cond_.notify_all();
+
+    // Start the next asynchronous read. This chaining is necessary to avoid
+    // explicit threading.
+    serial_.async_read_some(asio::buffer(recv_buffer_),
+        boost::bind(&JaguarBridge::recv_handle, this,
+                    asio::placeholders::error,
+                    asio::placeholders::bytes_transferred
+        )
+    );
 }
 
 };
@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <jaguar/jaguar_codec.h>
+#include <jaguar/jaguar_helper.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define JAGUAR_CODEC_X86
+# include <emmintrin.h>
+# include <immintrin.h>
+#endif
+
+namespace can {
+
+uint8_t const JaguarCodec::kSOF = 0xFF;
+uint8_t const JaguarCodec::kESC = 0xFE;
+uint8_t const JaguarCodec::kSOFESC = 0xFE;
+uint8_t const JaguarCodec::kESCESC = 0xFD;
+
+// Each message consists of two bytes of framing, a 29-bit CAN identifier
+// packed into four bytes, and a maximum of eight bytes of data. All of these,
+// except the start of frame byte, may need to be escaped. In all, this is:
+// 2 + (4 + 8)*2 = 26 bytes.
+size_t const JaguarCodec::kMaxEncodedLength = 26;
+
+// Bytes classified per pass of the bulk decoder; one bit each on the stack.
+size_t const JaguarCodec::kBlockLength = 256;
+
+/*
+ * Special byte scanners. Each sets bit i of special for every byte i that is
+ * SOF or ESC, i.e. every byte >= 0xFE. The caller zeroes special.
+ */
+static inline void mark_special(uint64_t *special, size_t i)
+{
+    special[i >> 6] |= static_cast<uint64_t>(1) << (i & 63);
+}
+
+static void scan_scalar(uint8_t const *bytes, size_t length, uint64_t *special)
+{
+    uint64_t const kLow  = 0x7F7F7F7F7F7F7F7Full;
+    size_t i = 0;
+
+    // Eight bytes at a time: invert so that SOF and ESC become 0x00 and 0x01,
+    // clear the low bit, and find the zero bytes exactly.
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+
+        uint64_t const z = ~word & 0xFEFEFEFEFEFEFEFEull;
+        uint64_t zeros = ~(((z & kLow) + kLow) | z | kLow);
+        while (zeros) {
+            mark_special(special, i + (__builtin_ctzll(zeros) >> 3));
+            zeros &= zeros - 1;
+        }
+    }
+
+    for (; i < length; ++i) {
+        if (bytes[i] >= JaguarCodec::kESC) {
+            mark_special(special, i);
+        }
+    }
+}
+
+#ifdef JAGUAR_CODEC_X86
+static void scan_sse2(uint8_t const *bytes, size_t length, uint64_t *special)
+{
+    __m128i const threshold = _mm_set1_epi8(static_cast<char>(JaguarCodec::kESC));
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i const x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(bytes + i));
+        __m128i const hit = _mm_cmpeq_epi8(_mm_max_epu8(x, threshold), x);
+        uint64_t const mask = static_cast<uint16_t>(_mm_movemask_epi8(hit));
+        special[i >> 6] |= mask << (i & 63);
+    }
+
+    for (; i < length; ++i) {
+        if (bytes[i] >= JaguarCodec::kESC) {
+            mark_special(special, i);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void scan_avx2(uint8_t const *bytes, size_t length, uint64_t *special)
+{
+    __m256i const threshold = _mm256_set1_epi8(static_cast<char>(JaguarCodec::kESC));
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i const x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(bytes + i));
+        __m256i const hit = _mm256_cmpeq_epi8(_mm256_max_epu8(x, threshold), x);
+        uint64_t const mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        special[i >> 6] |= mask << (i & 63);
+    }
+
+    for (; i < length; ++i) {
+        if (bytes[i] >= JaguarCodec::kESC) {
+            mark_special(special, i);
+        }
+    }
+}
+#endif
+
+JaguarCodec::scan_function const JaguarCodec::scan_ = JaguarCodec::select_scan();
+
+JaguarCodec::scan_function JaguarCodec::select_scan(void)
+{
+#ifdef JAGUAR_CODEC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &scan_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        return &scan_sse2;
+    }
+#endif
+    return &scan_scalar;
+}
+
+JaguarCodec::JaguarCodec(void)
+    : packet_length_(0),
+      state_(kWaiting),
+      length_(0),
+      escape_(false),
+      error_byte_(0),
+      encoded_length_(0)
+{
+}
+
+JaguarCodec::Status JaguarCodec::decode(uint8_t byte, CANFrame &frame)
+{
+    Status status = kIncomplete;
+
+    // Count every byte of the current frame, for the bulk decoder's ages.
+    if (byte == kSOF) {
+        encoded_length_ = 0;
+    }
+    ++encoded_length_;
+
+    // Due to escaping, the SOF byte only appears at frame starts.
+    if (byte == kSOF) {
+        state_  = kLength;
+        length_ = 0;
+        escape_ = 0;
+        packet_length_ = 0;
+    }
+    // Packet length can never be SOF or ESC, so we can ignore escaping.
+    else if (state_ == kLength) {
+        if (byte < 4 || byte > 12) {
+            error_byte_ = byte;
+            status = kInvalidLength;
+            state_  = kWaiting;
+        } else {
+            state_  = kPayload;
+            length_ = byte;
+        }
+    }
+    // This is the second byte in a two-byte escape code.
+    else if (state_ == kPayload && escape_) {
+        switch (byte) {
+        case kSOFESC:
+            packet_[packet_length_++] = kSOF;
+            break;
+
+        case kESCESC:
+            packet_[packet_length_++] = kESC;
+            break;
+
+        default:
+            status = kInvalidEscape;
+            state_ = kWaiting;
+        }
+        escape_ = false;
+    }
+    // Escape character, so the next byte has special meaning.
+    else if (state_ == kPayload && byte == kESC) {
+        escape_ = true;
+    }
+    // Normal data.
+    else if (state_ == kPayload) {
+        packet_[packet_length_++] = byte;
+    }
+
+    // Emit a packet as soon as it is finished.
+    if (state_ == kPayload && packet_length_ >= length_) {
+        unpack_packet(frame);
+        status  = kFrameComplete;
+        state_  = kWaiting;
+        length_ = 0;
+        escape_ = 0;
+        packet_length_ = 0;
+    }
+    return status;
+}
+
+void JaguarCodec::decode(uint8_t const *begin, uint8_t const *end, Handler &handler)
+{
+    uint64_t special[kBlockLength / 64];
+    CANFrame frame;
+
+    while (begin < end) {
+        size_t const length = std::min<size_t>(end - begin, kBlockLength);
+        memset(special, 0, sizeof(special));
+        scan_(begin, length, special);
+
+        size_t i = 0;
+        while (i < length) {
+            // Inside a packet, every byte up to the next SOF or ESC is
+            // payload. Copy as much of it as the packet still needs.
+            if (state_ == kPayload && !escape_) {
+                size_t const next = next_special(special, i, length);
+                size_t const run  = std::min(length_ - packet_length_, next - i);
+
+                memcpy(&packet_[packet_length_], begin + i, run);
+                packet_length_  += run;
+                encoded_length_ += run;
+                i += run;
+
+                if (packet_length_ >= length_) {
+                    unpack_packet(frame);
+                    state_  = kWaiting;
+                    length_ = 0;
+                    packet_length_ = 0;
+                    handler.frame_decoded(frame, encoded_length_ + (end - begin) - i);
+                    continue;
+                } else if (i == length) {
+                    break;
+                }
+            }
+            // Between packets, only SOF has any effect.
+            else if (state_ == kWaiting) {
+                while ((i = next_special(special, i, length)) < length && begin[i] != kSOF) {
+                    ++i;
+                }
+                if (i == length) {
+                    break;
+                }
+
+                // A well-formed header is SOF followed by a valid length.
+                if (i + 1 < length && 4 <= begin[i + 1] && begin[i + 1] <= 12) {
+                    state_  = kPayload;
+                    length_ = begin[i + 1];
+                    escape_ = false;
+                    packet_length_  = 0;
+                    encoded_length_ = 2;
+                    i += 2;
+                    continue;
+                }
+            }
+
+            // Framing bytes, escape sequences, and lengths take the slow path.
+            uint8_t const byte = begin[i++];
+            notify(decode(byte, frame), byte, frame,
+                   encoded_length_ + (end - begin) - i, handler);
+        }
+        begin += length;
+    }
+}
+
+uint8_t JaguarCodec::error_byte(void) const
+{
+    return error_byte_;
+}
+
+size_t JaguarCodec::next_special(uint64_t const *special, size_t i, size_t length)
+{
+    if (i >= length) {
+        return length;
+    }
+
+    size_t word = i >> 6;
+    uint64_t bits = special[word] & (~static_cast<uint64_t>(0) << (i & 63));
+    size_t const words = (length + 63) >> 6;
+
+    while (!bits) {
+        if (++word >= words) {
+            return length;
+        }
+        bits = special[word];
+    }
+    return std::min(length, (word << 6) + __builtin_ctzll(bits));
+}
+
+void JaguarCodec::notify(Status status, uint8_t byte, CANFrame const &frame,
+                         size_t age, Handler &handler) const
+{
+    switch (status) {
+    case kFrameComplete:
+        handler.frame_decoded(frame, age);
+        break;
+
+    case kInvalidLength:
+    case kInvalidEscape:
+        handler.decode_error(status, byte);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void JaguarCodec::unpack_packet(CANFrame &frame) const
+{
+    assert(4 <= packet_length_ && packet_length_ <= 12);
+
+    uint32_t le_id;
+    memcpy(&le_id, &packet_[0], sizeof(uint32_t));
+    frame.id  = le32toh(le_id);
+    frame.dlc = packet_length_ - 4;
+    memcpy(frame.data, &packet_[4], frame.dlc);
+}
+
+size_t JaguarCodec::encode_message(CANMessage const &message, uint8_t *buffer)
+{
+    assert(message.payload.size() <= 8);
+    assert((message.id & 0xE0000000) == 0);
+
+    // 29-bit CAN id encoded as a 32-bit integer. Note the Endian-ness
+    // conversion because the integer is being treated as an array of bytes.
+    union {
+        uint32_t id;
+        uint8_t  bytes[4];
+    } id_conversion = { htole32(message.id) };
+
+    size_t length = 0;
+    buffer[length++] = kSOF;
+    buffer[length++] = message.payload.size() + 4;
+    length += encode_bytes(id_conversion.bytes, 4, buffer + length);
+    if (!message.payload.empty()) {
+        length += encode_bytes(&message.payload[0], message.payload.size(), buffer + length);
+    }
+
+    assert(length <= kMaxEncodedLength);
+    return length;
+}
+
+size_t JaguarCodec::encode_bytes(uint8_t const *bytes, size_t length, uint8_t *buffer)
+{
+    size_t emitted = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t byte = bytes[i];
+        switch (byte) {
+        case kSOF:
+            buffer[emitted++] = kESC;
+            buffer[emitted++] = kSOFESC;
+            break;
+
+        case kESC:
+            buffer[emitted++] = kESC;
+            buffer[emitted++] = kESCESC;
+            break;
+
+        default:
+            buffer[emitted++] = byte;
+        }
+    }
+    return emitted;
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -23,6 +23,11 @@ double s16p16_to_double(int32_t x)
     return x / 65536.;
 }
 
+double fraction16_to_double(int16_t x)
+{
+    return x / 32768.;
+}
+
 
 uint32_t pack_id(uint8_t dnum, Manufacturer::Enum man, DeviceType::Enum type, uint16_t api)
 {
@@ -0,0 +1,695 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <jaguar/can_bridge.h>
+#include <jaguar/jaguar_helper.h>
+#include <jaguar/jaguar_simulator.h>
+
+namespace jaguar {
+
+/*
+ * SimulatorSettings
+ */
+SimulatorSettings::SimulatorSettings(void)
+    : latency(boost::posix_time::milliseconds(0))
+    , drop_rate(0.0)
+    , baud_rate(115200)
+    , max_rpm(5000.0)
+    , time_constant(0.05)
+    , seed(0)
+{
+}
+
+/*
+ * VirtualJaguar
+ */
+// Outputs fall back to neutral if heartbeats stop for this long, in seconds.
+double const VirtualJaguar::kHeartbeatTimeout = 0.1;
+size_t const VirtualJaguar::kNumPeriodic = 4;
+
+// One byte for every PeriodicStatusItem code, including kEndOfMessage.
+size_t const VirtualJaguar::kStatusImageLength = 29;
+
+VirtualJaguar::VirtualJaguar(uint8_t device_num, SimulatorSettings const &settings)
+    : settings_(settings)
+    , periodic_(kNumPeriodic)
+    , pending_group_(0)
+    , pending_value_(0.0)
+    , since_heartbeat_(0.0)
+    , heartbeat_seen_(false)
+{
+    memset(&state_, 0, sizeof(state_));
+    state_.device_num = device_num;
+    state_.mode  = ControlMode::kVoltageMode;
+    state_.brake = BrakeCoastSetting::kUseJumper;
+
+    BOOST_FOREACH(Periodic &periodic, periodic_) {
+        periodic.rate = 0;
+        periodic.elapsed = 0.0;
+    }
+}
+
+bool VirtualJaguar::accepts(uint32_t id) const
+{
+    CANId const can_id(id);
+    return can_id.device_num  == state_.device_num
+        && can_id.manuf       == Manufacturer::kTexasInstruments
+        && can_id.device_type == DeviceType::kMotorController;
+}
+
+void VirtualJaguar::handle(can::CANFrame const &frame, std::vector<can::CANFrame> &responses)
+{
+    CANId const id(frame.id);
+    ++state_.frames_received;
+
+    // Setpoints are the only commands with a NoACK form; everything else is
+    // acknowledged once it has been applied.
+    bool acknowledge = true;
+
+    switch (id.api_class) {
+    case APIClass::kVoltageControl:
+        switch (id.api_index) {
+        case VoltageControl::kVoltageModeEnable:
+            state_.mode = ControlMode::kVoltageMode;
+            state_.enabled = true;
+            state_.voltage_target = 0.0;
+            state_.voltage_output = 0.0;
+            break;
+
+        case VoltageControl::kVoltageModeDisable:
+            state_.enabled = false;
+            break;
+
+        case VoltageControl::kVoltageSetNoACK:
+            acknowledge = false;
+            // fall through
+        case VoltageControl::kVoltageSet:
+            if (frame.dlc >= 2) {
+                int16_t raw;
+                memcpy(&raw, frame.data, sizeof(raw));
+                raw = le16toh(raw);
+                set_target((raw < 0) ? raw / 32768.0 : raw / 32767.0, frame, 2);
+            }
+            break;
+
+        case VoltageControl::kVoltageRampSet:
+            if (frame.dlc >= 2) {
+                uint16_t raw;
+                memcpy(&raw, frame.data, sizeof(raw));
+                state_.voltage_ramp = le16toh(raw) * 1000.0 / 32767;
+            }
+            break;
+        }
+        break;
+
+    case APIClass::kSpeedControl:
+        switch (id.api_index) {
+        case SpeedControl::kSpeedModeEnable:
+            state_.mode = ControlMode::kSpeedMode;
+            state_.enabled = true;
+            state_.speed_target = 0.0;
+            break;
+
+        case SpeedControl::kSpeedModeDisable:
+            state_.enabled = false;
+            break;
+
+        case SpeedControl::kSpeedSetNoACK:
+            acknowledge = false;
+            // fall through
+        case SpeedControl::kSpeedSet:
+            if (frame.dlc >= 4) {
+                int32_t raw;
+                memcpy(&raw, frame.data, sizeof(raw));
+                set_target(s16p16_to_double(le32toh(raw)), frame, 4);
+            }
+            break;
+        }
+        break;
+
+    case APIClass::kPositionControl:
+        switch (id.api_index) {
+        case PositionControl::kPositionModeEnable:
+            state_.mode = ControlMode::kPositionMode;
+            state_.enabled = true;
+            if (frame.dlc >= 4) {
+                int32_t raw;
+                memcpy(&raw, frame.data, sizeof(raw));
+                state_.position = s16p16_to_double(le32toh(raw));
+            }
+            state_.position_target = state_.position;
+            break;
+
+        case PositionControl::kPositionModeDisable:
+            state_.enabled = false;
+            break;
+
+        case PositionControl::kPositionSetNoACK:
+            acknowledge = false;
+            // fall through
+        case PositionControl::kPositionSet:
+            if (frame.dlc >= 4) {
+                int32_t raw;
+                memcpy(&raw, frame.data, sizeof(raw));
+                set_target(s16p16_to_double(le32toh(raw)), frame, 4);
+            }
+            break;
+        }
+        break;
+
+    case APIClass::kConfiguration:
+        if (id.api_index == Configuration::kNumberOfEncodersLines && frame.dlc >= 2) {
+            uint16_t raw;
+            memcpy(&raw, frame.data, sizeof(raw));
+            state_.encoder_lines = le16toh(raw);
+        } else if (id.api_index == Configuration::kBrakeCoastSetting && frame.dlc >= 1) {
+            state_.brake = static_cast<BrakeCoastSetting::Enum>(frame.data[0]);
+        }
+        break;
+
+    case APIClass::kPeriodicStatus:
+        handle_periodic(id.api_index, frame, responses);
+        return;
+
+    default:
+        // Gains, references, and voltage compensation settings are accepted
+        // but have no effect on the model.
+        break;
+    }
+
+    if (acknowledge) {
+        ack(responses);
+    }
+}
+
+void VirtualJaguar::broadcast(can::CANFrame const &frame)
+{
+    switch (CANId(frame.id).api_index) {
+    case SystemControl::kSystemHalt:
+        state_.halted = true;
+        break;
+
+    case SystemControl::kSystemResume:
+        state_.halted = false;
+        break;
+
+    case SystemControl::kSystemReset:
+        state_.enabled = false;
+        state_.halted  = false;
+        pending_group_ = 0;
+        state_.voltage_ramp = 0.0;
+        BOOST_FOREACH(Periodic &periodic, periodic_) {
+            periodic.rate = 0;
+            periodic.items.clear();
+        }
+        break;
+
+    case SystemControl::kHeartbeat:
+        heartbeat_seen_  = true;
+        since_heartbeat_ = 0.0;
+        break;
+
+    case SystemControl::kSynchronousUpdate:
+        if (frame.dlc >= 1 && (frame.data[0] & pending_group_)) {
+            switch (state_.mode) {
+            case ControlMode::kVoltageMode:  state_.voltage_target  = pending_value_; break;
+            case ControlMode::kSpeedMode:    state_.speed_target    = pending_value_; break;
+            case ControlMode::kPositionMode: state_.position_target = pending_value_; break;
+            default: break;
+            }
+            pending_group_ = 0;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void VirtualJaguar::step(double dt, std::vector<can::CANFrame> &responses)
+{
+    since_heartbeat_ += dt;
+    bool const link_fault = heartbeat_seen_ && since_heartbeat_ > kHeartbeatTimeout;
+    bool const active = state_.enabled && !state_.halted && !link_fault;
+    double const max_rpm = settings_.max_rpm;
+
+    // Reduce every control mode to the speed the motor is being driven
+    // towards, then let the motor approach it with a first-order lag.
+    double speed_goal = 0.0;
+    if (active) {
+        switch (state_.mode) {
+        case ControlMode::kVoltageMode:
+            if (state_.voltage_ramp > 0) {
+                double const step = state_.voltage_ramp * dt;
+                state_.voltage_output = std::max(state_.voltage_output - step,
+                    std::min(state_.voltage_target, state_.voltage_output + step));
+            } else {
+                state_.voltage_output = state_.voltage_target;
+            }
+            speed_goal = state_.voltage_output * max_rpm;
+            break;
+
+        case ControlMode::kSpeedMode:
+            speed_goal = state_.speed_target;
+            break;
+
+        case ControlMode::kPositionMode:
+            speed_goal = (state_.position_target - state_.position) * 60.0
+                       / std::max(settings_.time_constant, 1e-3);
+            break;
+
+        default:
+            break;
+        }
+    }
+    speed_goal = std::max(-max_rpm, std::min(speed_goal, max_rpm));
+
+    double const alpha = 1.0 - std::exp(-dt / std::max(settings_.time_constant, 1e-6));
+    state_.speed    += (speed_goal - state_.speed) * alpha;
+    state_.position += state_.speed / 60.0 * dt;
+    state_.voltage   = (max_rpm > 0) ? state_.speed / max_rpm : 0.0;
+
+    // Periodic status messages.
+    uint8_t image[kStatusImageLength];
+    bool have_image = false;
+
+    for (size_t i = 0; i < periodic_.size(); ++i) {
+        Periodic &periodic = periodic_[i];
+        if (periodic.rate == 0 || periodic.items.empty()) {
+            continue;
+        }
+
+        periodic.elapsed += dt;
+        if (periodic.elapsed * 1000.0 < periodic.rate) {
+            continue;
+        }
+        periodic.elapsed -= periodic.rate / 1000.0;
+
+        if (!have_image) {
+            status_image(image);
+            have_image = true;
+        }
+
+        uint8_t data[8];
+        for (size_t j = 0; j < periodic.items.size(); ++j) {
+            data[j] = image[periodic.items[j]];
+        }
+
+        uint32_t const status_id = pack_id(state_.device_num,
+            Manufacturer::kTexasInstruments, DeviceType::kMotorController,
+            APIClass::kPeriodicStatus, PeriodicStatus::kPeriodicStatus + i
+        );
+        responses.push_back(make_frame(status_id, data, periodic.items.size()));
+        ++state_.statuses_sent;
+    }
+}
+
+VirtualJaguarState VirtualJaguar::state(void) const
+{
+    return state_;
+}
+
+void VirtualJaguar::ack(std::vector<can::CANFrame> &responses)
+{
+    uint32_t const ack_id = pack_ack(state_.device_num,
+        Manufacturer::kTexasInstruments, DeviceType::kMotorController);
+    responses.push_back(make_frame(ack_id, NULL, 0));
+    ++state_.acks_sent;
+}
+
+void VirtualJaguar::set_target(double value, can::CANFrame const &frame, size_t offset)
+{
+    // A trailing non-zero group byte defers the setpoint until the matching
+    // synchronous update is broadcast.
+    if (frame.dlc > offset && frame.data[offset] != 0) {
+        pending_group_ = frame.data[offset];
+        pending_value_ = value;
+        return;
+    }
+
+    switch (state_.mode) {
+    case ControlMode::kVoltageMode:  state_.voltage_target  = value; break;
+    case ControlMode::kSpeedMode:    state_.speed_target    = value; break;
+    case ControlMode::kPositionMode: state_.position_target = value; break;
+    default: break;
+    }
+}
+
+void VirtualJaguar::handle_periodic(uint8_t index, can::CANFrame const &frame,
+                                    std::vector<can::CANFrame> &responses)
+{
+    if (PeriodicStatus::kEnableMessage <= index
+     && index < PeriodicStatus::kEnableMessage + kNumPeriodic) {
+        Periodic &periodic = periodic_[index - PeriodicStatus::kEnableMessage];
+
+        // Two bytes set the period, a single byte disables the message.
+        if (frame.dlc >= 2) {
+            uint16_t raw;
+            memcpy(&raw, frame.data, sizeof(raw));
+            periodic.rate = le16toh(raw);
+            periodic.elapsed = 0.0;
+        } else if (frame.dlc == 1) {
+            periodic.rate = 0;
+        }
+        state_.periodic_rate[index - PeriodicStatus::kEnableMessage] = periodic.rate;
+    } else if (PeriodicStatus::kConfigureMessage <= index
+            && index < PeriodicStatus::kConfigureMessage + kNumPeriodic) {
+        Periodic &periodic = periodic_[index - PeriodicStatus::kConfigureMessage];
+
+        periodic.items.clear();
+        for (size_t i = 0; i < frame.dlc; ++i) {
+            if (frame.data[i] == PeriodicStatusItem::kEndOfMessage
+             || frame.data[i] >= kStatusImageLength) {
+                break;
+            }
+            periodic.items.push_back(frame.data[i]);
+        }
+    } else {
+        return;
+    }
+    ack(responses);
+}
+
+void VirtualJaguar::status_image(uint8_t *image) const
+{
+    // Lay every status value out at the offset of its PeriodicStatusItem, so
+    // a periodic message is just a gather from this array.
+    memset(image, 0, kStatusImageLength);
+
+    int16_t const voltage_percent = htole16(static_cast<int16_t>(state_.voltage * 32767));
+    int16_t const bus_voltage = htole16(double_to_s8p8(12.0));
+    int16_t const current = htole16(double_to_s8p8(std::fabs(state_.voltage) * 10.0));
+    int16_t const temperature = htole16(double_to_s8p8(25.0));
+    int32_t const position = htole32(double_to_s16p16(state_.position));
+    int32_t const speed = htole32(double_to_s16p16(state_.speed));
+    int16_t const voltage_volts = htole16(double_to_s8p8(state_.voltage * 12.0));
+
+    memcpy(&image[PeriodicStatusItem::kOutputVoltagePercentBase], &voltage_percent, 2);
+    memcpy(&image[PeriodicStatusItem::kBusVoltageBase], &bus_voltage, 2);
+    memcpy(&image[PeriodicStatusItem::kMotorCurrentBase], &current, 2);
+    memcpy(&image[PeriodicStatusItem::kTemperatureBase], &temperature, 2);
+    memcpy(&image[PeriodicStatusItem::kPositionBase], &position, 4);
+    memcpy(&image[PeriodicStatusItem::kSpeedBase], &speed, 4);
+    memcpy(&image[PeriodicStatusItem::kOutputVoltageVolts], &voltage_volts, 2);
+
+    // Both limit switches report "not tripped".
+    image[PeriodicStatusItem::kLimitNonClearing] = 0x03;
+    image[PeriodicStatusItem::kLimitClearing]    = 0x03;
+}
+
+can::CANFrame VirtualJaguar::make_frame(uint32_t id, uint8_t const *data, size_t length) const
+{
+    assert(length <= 8);
+
+    can::CANFrame frame = can::CANFrame();
+    frame.id  = id;
+    frame.dlc = length;
+    if (length > 0) {
+        memcpy(frame.data, data, length);
+    }
+    return frame;
+}
+
+/*
+ * JaguarSimulator
+ */
+uint8_t const JaguarSimulator::kSOF = 0xFF;
+uint8_t const JaguarSimulator::kESC = 0xFE;
+uint8_t const JaguarSimulator::kSOFESC = 0xFE;
+uint8_t const JaguarSimulator::kESCESC = 0xFD;
+size_t const JaguarSimulator::kMaxEncodedLength = 26;
+
+JaguarSimulator::JaguarSimulator(std::vector<uint8_t> const &device_nums,
+                                 SimulatorSettings const &settings)
+    : settings_(settings)
+    , master_(-1)
+    , slave_(-1)
+    , link_free_(0)
+    , random_(settings.seed)
+    , dropped_(0)
+    , packet_length_(0)
+    , length_(0)
+    , escape_(false)
+    , in_frame_(false)
+{
+    master_ = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_ < 0 || grantpt(master_) < 0 || unlockpt(master_) < 0) {
+        int const code = errno;
+        if (master_ >= 0) close(master_);
+        throw can::CANException(code, std::string("unable to open pseudo-terminal: ") + strerror(code));
+    }
+    port_ = ptsname(master_);
+
+    // Hold the slave side open so the master never sees a hangup between
+    // bridges, and put it in raw mode so no byte is ever translated.
+    slave_ = open(port_.c_str(), O_RDWR | O_NOCTTY);
+    if (slave_ < 0) {
+        int const code = errno;
+        close(master_);
+        throw can::CANException(code, "unable to open " + port_ + ": " + strerror(code));
+    }
+
+    struct termios tio;
+    tcgetattr(slave_, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave_, TCSANOW, &tio);
+
+    BOOST_FOREACH(uint8_t num, device_nums) {
+        devices_[num] = boost::make_shared<VirtualJaguar>(num, settings_);
+    }
+    thread_ = boost::thread(&JaguarSimulator::run, this);
+}
+
+JaguarSimulator::~JaguarSimulator(void)
+{
+    thread_.interrupt();
+    thread_.join();
+    close(slave_);
+    close(master_);
+}
+
+std::string JaguarSimulator::port(void) const
+{
+    return port_;
+}
+
+VirtualJaguarState JaguarSimulator::state(uint8_t device_num) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    device_map::const_iterator it = devices_.find(device_num);
+    assert(it != devices_.end());
+    return it->second->state();
+}
+
+unsigned JaguarSimulator::frames_dropped(void) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return dropped_;
+}
+
+void JaguarSimulator::run(void)
+{
+    uint8_t buffer[256];
+    std::vector<can::CANFrame> responses;
+    can::Timestamp last = can::monotonic_now();
+
+    for (;;) {
+        boost::this_thread::interruption_point();
+
+        struct pollfd fd;
+        fd.fd = master_;
+        fd.events = POLLIN;
+        fd.revents = 0;
+
+        if (poll(&fd, 1, 1) > 0 && (fd.revents & POLLIN)) {
+            ssize_t const count = read(master_, buffer, sizeof(buffer));
+            if (count > 0) {
+                recv_bytes(buffer, count);
+            }
+        }
+
+        can::Timestamp const now = can::monotonic_now();
+        double const dt = (now - last) * 1e-9;
+
+        if (dt >= 0.001) {
+            boost::mutex::scoped_lock lock(mutex_);
+            responses.clear();
+            BOOST_FOREACH(device_map::value_type &pair, devices_) {
+                pair.second->step(dt, responses);
+            }
+            queue(responses, now);
+            last = now;
+        }
+        flush(now);
+    }
+}
+
+void JaguarSimulator::recv_bytes(uint8_t const *bytes, size_t length)
+{
+    // Same state machine as the firmware's UARTIFReceive().
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t const byte = bytes[i];
+
+        if (byte == kSOF) {
+            in_frame_ = true;
+            length_ = 0;
+            packet_length_ = 0;
+            escape_ = false;
+        } else if (!in_frame_) {
+            continue;
+        } else if (length_ == 0) {
+            if (byte < 4 || byte > 12) {
+                in_frame_ = false;
+            } else {
+                length_ = byte;
+            }
+        } else if (escape_) {
+            if (byte == kSOFESC) {
+                packet_[packet_length_++] = kSOF;
+            } else if (byte == kESCESC) {
+                packet_[packet_length_++] = kESC;
+            } else {
+                in_frame_ = false;
+            }
+            escape_ = false;
+        } else if (byte == kESC) {
+            escape_ = true;
+        } else {
+            packet_[packet_length_++] = byte;
+        }
+
+        if (in_frame_ && length_ > 0 && packet_length_ == length_) {
+            recv_packet(packet_, packet_length_);
+            in_frame_ = false;
+        }
+    }
+}
+
+void JaguarSimulator::recv_packet(uint8_t const *packet, size_t length)
+{
+    can::CANFrame frame = can::CANFrame();
+    uint32_t le_id;
+    memcpy(&le_id, packet, sizeof(le_id));
+    frame.id  = le32toh(le_id);
+    frame.dlc = length - 4;
+    memcpy(frame.data, packet + 4, frame.dlc);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (drop()) {
+        return;
+    }
+
+    std::vector<can::CANFrame> responses;
+    CANId const id(frame.id);
+
+    if (id.device_type == DeviceType::kBroadcastMessage
+     && id.manuf == Manufacturer::kBroadcastMessage) {
+        BOOST_FOREACH(device_map::value_type &pair, devices_) {
+            pair.second->broadcast(frame);
+        }
+    } else {
+        device_map::iterator it = devices_.find(id.device_num);
+        if (it != devices_.end() && it->second->accepts(frame.id)) {
+            it->second->handle(frame, responses);
+        }
+    }
+    queue(responses, can::monotonic_now());
+}
+
+void JaguarSimulator::queue(std::vector<can::CANFrame> const &frames, can::Timestamp now)
+{
+    can::Timestamp const due = now + settings_.latency.total_nanoseconds();
+
+    BOOST_FOREACH(can::CANFrame const &frame, frames) {
+        if (drop()) {
+            continue;
+        }
+        pending_.push_back(std::make_pair(due, frame));
+    }
+}
+
+void JaguarSimulator::flush(can::Timestamp now)
+{
+    uint8_t buffer[kMaxEncodedLength];
+
+    for (;;) {
+        size_t length;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (pending_.empty() || pending_.front().first > now || link_free_ > now) {
+                return;
+            }
+            length = encode_frame(pending_.front().second, buffer);
+            pending_.pop_front();
+
+            // Each byte on an 8N1 line costs ten bit times.
+            if (settings_.baud_rate > 0) {
+                can::Timestamp const start = std::max(link_free_, now);
+                link_free_ = start + length * 10ull * 1000000000ull / settings_.baud_rate;
+            }
+        }
+
+        size_t written = 0;
+        while (written < length) {
+            ssize_t const count = write(master_, buffer + written, length - written);
+            if (count < 0 && errno != EINTR) {
+                return;
+            }
+            written += std::max<ssize_t>(count, 0);
+        }
+    }
+}
+
+bool JaguarSimulator::drop(void)
+{
+    if (settings_.drop_rate <= 0.0) {
+        return false;
+    }
+
+    boost::random::uniform_01<double> uniform;
+    if (uniform(random_) < settings_.drop_rate) {
+        ++dropped_;
+        return true;
+    }
+    return false;
+}
+
+size_t JaguarSimulator::encode_frame(can::CANFrame const &frame, uint8_t *buffer)
+{
+    uint8_t raw[12];
+    uint32_t const le_id = htole32(frame.id);
+    memcpy(raw, &le_id, sizeof(le_id));
+    memcpy(raw + 4, frame.data, frame.dlc);
+    size_t const raw_length = 4 + frame.dlc;
+
+    size_t length = 0;
+    buffer[length++] = kSOF;
+    buffer[length++] = raw_length;
+
+    for (size_t i = 0; i < raw_length; ++i) {
+        if (raw[i] == kSOF) {
+            buffer[length++] = kESC;
+            buffer[length++] = kSOFESC;
+        } else if (raw[i] == kESC) {
+            buffer[length++] = kESC;
+            buffer[length++] = kESCESC;
+        } else {
+            buffer[length++] = raw[i];
+        }
+    }
+    return length;
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
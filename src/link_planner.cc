@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <boost/foreach.hpp>
+#include <jaguar/link_planner.h>
+
+namespace jaguar {
+
+// Leave room for retransmissions, enumeration and ad-hoc configuration.
+double const LinkPlanner::kDefaultHeadroom = 0.7;
+
+// Jaguars only run their CAN interface at 1 Mbit/s.
+unsigned const LinkPlanner::kBusBitRate = 1000000;
+
+double LinkLoad::peak(void) const
+{
+    return std::max(tx, std::max(rx, bus));
+}
+
+LinkPlanner::LinkPlanner(unsigned baud_rate, unsigned bus_bit_rate)
+    : serial_capacity_(baud_rate / 10.0) // 8N1
+    , bus_capacity_(bus_bit_rate)
+{
+}
+
+size_t LinkPlanner::add_status(std::string const &name, size_t payload,
+                               unsigned period_ms, size_t devices, bool adjustable)
+{
+    Stream stream;
+    stream.name = name;
+    stream.payload = payload;
+    stream.period_ms = period_ms;
+    stream.refresh_ms = 0.0;
+    stream.devices = devices;
+    stream.from_device = true;
+    stream.acked = false;
+    stream.adjustable = adjustable;
+    streams_.push_back(stream);
+    return streams_.size() - 1;
+}
+
+size_t LinkPlanner::add_status(std::string const &name, AggregateStatus statuses,
+                               unsigned period_ms, size_t devices, bool adjustable)
+{
+    // The status message carries one byte per item in the layout.
+    std::vector<uint8_t> layout;
+    std::back_insert_iterator<std::vector<uint8_t> > it(layout);
+    statuses.write(it);
+    return add_status(name, layout.size(), period_ms, devices, adjustable);
+}
+
+size_t LinkPlanner::add_command(std::string const &name, size_t payload,
+                                double period_ms, size_t devices, bool acked)
+{
+    Stream stream;
+    stream.name = name;
+    stream.payload = payload;
+    stream.period_ms = period_ms;
+    stream.refresh_ms = 0.0;
+    stream.devices = devices;
+    stream.from_device = false;
+    stream.acked = acked;
+    stream.adjustable = false;
+    streams_.push_back(stream);
+    return streams_.size() - 1;
+}
+
+size_t LinkPlanner::add_changes(std::string const &name, size_t payload, double period_ms,
+                                double refresh_ms, size_t devices, bool acked)
+{
+    size_t const stream = add_command(name, payload, period_ms, devices, acked);
+    streams_[stream].refresh_ms = std::max(period_ms, refresh_ms);
+    return stream;
+}
+
+LinkLoad LinkPlanner::load(void) const
+{
+    LinkLoad load = { 0.0, 0.0, 0.0 };
+    BOOST_FOREACH(Stream const &stream, streams_) {
+        stream_load(stream, false, load);
+    }
+    return load;
+}
+
+LinkLoad LinkPlanner::worst_load(void) const
+{
+    LinkLoad load = { 0.0, 0.0, 0.0 };
+    BOOST_FOREACH(Stream const &stream, streams_) {
+        stream_load(stream, true, load);
+    }
+    return load;
+}
+
+bool LinkPlanner::feasible(double headroom) const
+{
+    return load().peak() <= headroom && worst_load().peak() <= 1.0;
+}
+
+bool LinkPlanner::adjust(double headroom, unsigned max_period_ms)
+{
+    LinkLoad fixed = { 0.0, 0.0, 0.0 };
+    LinkLoad fixed_worst = { 0.0, 0.0, 0.0 };
+    LinkLoad adjustable = { 0.0, 0.0, 0.0 };
+    BOOST_FOREACH(Stream const &stream, streams_) {
+        if (stream.adjustable) {
+            stream_load(stream, false, adjustable);
+        } else {
+            stream_load(stream, false, fixed);
+            stream_load(stream, true, fixed_worst);
+        }
+    }
+
+    if (fixed.peak() >= headroom || fixed_worst.peak() >= 1.0) {
+        return false;
+    }
+
+    // Adjustable load scales with the inverse of the period, so a single
+    // factor that satisfies the tightest leg satisfies all of them. Status
+    // streams are periodic, so they cost the same in the worst case.
+    double const factor = std::max(1.0, std::max(
+        adjustable.tx  / (headroom - fixed.tx), std::max(
+        adjustable.rx  / (headroom - fixed.rx), std::max(
+        adjustable.bus / (headroom - fixed.bus), std::max(
+        adjustable.tx  / (1.0 - fixed_worst.tx), std::max(
+        adjustable.rx  / (1.0 - fixed_worst.rx),
+        adjustable.bus / (1.0 - fixed_worst.bus)))))));
+
+    BOOST_FOREACH(Stream &stream, streams_) {
+        if (stream.adjustable && factor > 1.0) {
+            double const period = std::ceil(stream.period_ms * factor);
+            stream.period_ms = std::min(period, static_cast<double>(max_period_ms));
+        }
+    }
+    return feasible(headroom);
+}
+
+double LinkPlanner::period_ms(size_t stream) const
+{
+    return streams_.at(stream).period_ms;
+}
+
+std::string LinkPlanner::report(void) const
+{
+    LinkLoad const total = load();
+    LinkLoad const worst = worst_load();
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1)
+       << "serial tx " << 100 * total.tx << "%, "
+       << "serial rx " << 100 * total.rx << "%, "
+       << "bus " << 100 * total.bus << "% "
+       << "(worst case " << 100 * worst.peak() << "%)";
+
+    BOOST_FOREACH(Stream const &stream, streams_) {
+        LinkLoad part = { 0.0, 0.0, 0.0 };
+        stream_load(stream, false, part);
+        ss << "; " << stream.name << " every " << stream.period_ms << " ms";
+        if (stream.refresh_ms > 0.0) {
+            ss << " (" << stream.refresh_ms << " ms steady)";
+        }
+        ss << " = " << 100 * part.peak() << "%";
+    }
+    return ss.str();
+}
+
+size_t LinkPlanner::serial_bytes(size_t payload)
+{
+    // SOF and length, then the identifier and payload with every byte
+    // escaped. For a full frame this is JaguarCodec::kMaxEncodedLength.
+    return 2 + 2 * (4 + payload);
+}
+
+size_t LinkPlanner::bus_bits(size_t payload)
+{
+    // Extended data frame: 67 bits of framing plus the payload, and one
+    // stuff bit for every four of the 54 + 8n stuffable bits.
+    return 67 + 8 * payload + (54 + 8 * payload - 1) / 4;
+}
+
+LinkLoad LinkPlanner::measured(can::JaguarBridge::LinkUsage const &before,
+                               can::JaguarBridge::LinkUsage const &after,
+                               unsigned baud_rate, unsigned bus_bit_rate)
+{
+    LinkLoad load = { 0.0, 0.0, 0.0 };
+    if (after.stamp <= before.stamp) {
+        return load;
+    }
+
+    double const seconds = (after.stamp - before.stamp) * 1e-9;
+    double const serial_capacity = seconds * baud_rate / 10.0;
+
+    // The bus cost of a frame is affine in its payload, so the totals are
+    // enough to recover it.
+    uint64_t const frames  = (after.tx_frames  - before.tx_frames)
+                           + (after.rx_frames  - before.rx_frames);
+    uint64_t const payload = (after.tx_payload - before.tx_payload)
+                           + (after.rx_payload - before.rx_payload);
+    double const bits = frames * static_cast<double>(bus_bits(0))
+                      + payload * static_cast<double>(bus_bits(1) - bus_bits(0));
+
+    load.tx  = (after.tx_bytes - before.tx_bytes) / serial_capacity;
+    load.rx  = (after.rx_bytes - before.rx_bytes) / serial_capacity;
+    load.bus = bits / (seconds * bus_bit_rate);
+    return load;
+}
+
+void LinkPlanner::stream_load(Stream const &stream, bool worst, LinkLoad &load) const
+{
+    double const period_ms = (worst || stream.refresh_ms <= 0.0)
+                           ? stream.period_ms : stream.refresh_ms;
+    double const rate = stream.devices * 1000.0 / period_ms;
+    double const serial = rate * serial_bytes(stream.payload) / serial_capacity_;
+    double const ack = stream.acked ? rate * serial_bytes(0) / serial_capacity_ : 0.0;
+
+    if (stream.from_device) {
+        load.rx += serial;
+    } else {
+        load.tx += serial;
+        load.rx += ack;
+    }
+
+    load.bus += rate * bus_bits(stream.payload) / bus_capacity_;
+    if (stream.acked) {
+        load.bus += rate * bus_bits(0) / bus_capacity_;
+    }
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,131 @@
+#include <cassert>
+#include <jaguar/jaguar_helper.h>
+#include <jaguar/jaguar_message.h>
+#include <jaguar/link_planner.h>
+#include <jaguar/motor_group.h>
+
+namespace jaguar {
+
+MotorGroup::MotorGroup(can::CANBridge &can, GroupMode::Enum mode, uint8_t group,
+                       unsigned baud_rate)
+    : can_(can)
+    , mode_(mode)
+    , group_(group)
+    , baud_rate_(baud_rate)
+    , staged_(0)
+{
+    assert(group != 0);
+    last_.motors = 0;
+    last_.staged = 0;
+    last_.committed = 0;
+    last_.apply_skew = 0;
+}
+
+size_t MotorGroup::add(Jaguar const &jaguar)
+{
+    Motor motor;
+    motor.device = jaguar.device_num();
+    motor.staged = false;
+    motor.value = 0.0;
+    motors_.push_back(motor);
+    return motors_.size() - 1;
+}
+
+size_t MotorGroup::size(void) const
+{
+    return motors_.size();
+}
+
+uint8_t MotorGroup::group(void) const
+{
+    return group_;
+}
+
+GroupMode::Enum MotorGroup::mode(void) const
+{
+    return mode_;
+}
+
+bool MotorGroup::ramps_on_device(void) const
+{
+    return mode_ == GroupMode::kVoltage;
+}
+
+void MotorGroup::stage(size_t motor, double value)
+{
+    Motor &entry = motors_.at(motor);
+    if (staged_ == 0) {
+        staged_ = can::monotonic_now();
+    }
+    entry.staged = true;
+    entry.value = value;
+}
+
+GroupCommit MotorGroup::commit(void)
+{
+    GroupCommit commit;
+    commit.motors = 0;
+    commit.staged = staged_;
+    commit.apply_skew = 0;
+
+    batch_.clear();
+    size_t serial_bytes = 0;
+    for (size_t i = 0; i < motors_.size(); ++i) {
+        Motor &motor = motors_[i];
+        if (motor.staged) {
+            can::CANFrame const frame = pack(motor);
+            batch_.push_back(can::CANMessage(frame));
+            serial_bytes += LinkPlanner::serial_bytes(frame.dlc);
+            motor.staged = false;
+            ++commit.motors;
+        }
+    }
+
+    // The synchronous update is queued in the same traffic class as the
+    // setpoints, so it is always sent after them.
+    std::vector<uint8_t> const payload(1, group_);
+    uint32_t const sync_id = pack_id(0, Manufacturer::kBroadcastMessage,
+        DeviceType::kBroadcastMessage, APIClass::kBroadcastMessage,
+        SystemControl::kSynchronousUpdate);
+    batch_.push_back(can::CANMessage(sync_id, payload));
+    serial_bytes += LinkPlanner::serial_bytes(payload.size());
+
+    commit.committed = can::monotonic_now();
+    can_.send_batch(&batch_.front(), &batch_.front() + batch_.size());
+
+    double seconds = static_cast<double>(LinkPlanner::bus_bits(payload.size()))
+                   / LinkPlanner::kBusBitRate;
+    if (baud_rate_ > 0) {
+        seconds += serial_bytes * 10.0 / baud_rate_; // 8N1
+    }
+    commit.apply_skew = static_cast<can::Timestamp>(seconds * 1e9);
+
+    if (commit.staged == 0) {
+        commit.staged = commit.committed;
+    }
+    staged_ = 0;
+    last_ = commit;
+    return commit;
+}
+
+GroupCommit const &MotorGroup::last_commit(void) const
+{
+    return last_;
+}
+
+can::CANFrame MotorGroup::pack(Motor const &motor) const
+{
+    switch (mode_) {
+    case GroupMode::kVoltage:
+        return message::VoltageSetNoACKGroup::pack(motor.device, motor.value, group_);
+    case GroupMode::kPosition:
+        return message::PositionSetNoACKGroup::pack(motor.device, motor.value, group_);
+    case GroupMode::kSpeed:
+    default:
+        return message::SpeedSetNoACKGroup::pack(motor.device, motor.value, group_);
+    }
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <boost/foreach.hpp>
+#include <jaguar/odometry_fusion.h>
+
+namespace jaguar {
+
+/*
+ * WheelHistory
+ */
+WheelHistory::WheelHistory(size_t capacity)
+    : ring_(capacity)
+    , head_(0)
+    , size_(0)
+{
+    assert(capacity >= 2);
+}
+
+bool WheelHistory::empty(void) const
+{
+    return size_ == 0;
+}
+
+size_t WheelHistory::size(void) const
+{
+    return size_;
+}
+
+void WheelHistory::clear(void)
+{
+    head_ = 0;
+    size_ = 0;
+}
+
+WheelSample const &WheelHistory::at(size_t i) const
+{
+    assert(i < size_);
+    return ring_[(head_ + i) % ring_.size()];
+}
+
+WheelSample &WheelHistory::slot(size_t i)
+{
+    return ring_[(head_ + i) % ring_.size()];
+}
+
+WheelSample const &WheelHistory::oldest(void) const
+{
+    return at(0);
+}
+
+WheelSample const &WheelHistory::latest(void) const
+{
+    return at(size_ - 1);
+}
+
+void WheelHistory::insert(WheelSample const &sample)
+{
+    if (size_ == ring_.size()) {
+        head_ = (head_ + 1) % ring_.size();
+        --size_;
+    }
+
+    size_t i = size_++;
+    for (; i > 0 && slot(i - 1).stamp > sample.stamp; --i) {
+        slot(i) = slot(i - 1);
+    }
+    slot(i) = sample;
+}
+
+WheelSample WheelHistory::interpolate(can::Timestamp stamp) const
+{
+    assert(size_ > 0);
+    if (stamp <= oldest().stamp) {
+        return oldest();
+    } else if (stamp >= latest().stamp) {
+        return latest();
+    }
+
+    // The buffer is small and the target is almost always near the end.
+    size_t i = size_ - 1;
+    while (at(i - 1).stamp > stamp) {
+        --i;
+    }
+    WheelSample const &a = at(i - 1);
+    WheelSample const &b = at(i);
+
+    double const t = static_cast<double>(stamp - a.stamp) / (b.stamp - a.stamp);
+    WheelSample sample;
+    sample.stamp = stamp;
+    sample.position = a.position + (b.position - a.position) * t;
+    sample.speed = a.speed + (b.speed - a.speed) * t;
+    return sample;
+}
+
+void WheelHistory::discard_before(can::Timestamp stamp)
+{
+    while (size_ >= 2 && at(1).stamp <= stamp) {
+        head_ = (head_ + 1) % ring_.size();
+        --size_;
+    }
+}
+
+/*
+ * OdometryFusion
+ */
+OdometryFusion::Stream::Stream(size_t capacity)
+    : history(capacity)
+    , referenced(false)
+    , position(0.0)
+    , speed(0.0)
+{
+}
+
+OdometryFusion::OdometryFusion(size_t streams, size_t capacity, can::Timestamp timeout)
+    : streams_(streams, Stream(capacity))
+    , timeout_(timeout)
+    , init_(false)
+    , first_(std::numeric_limits<can::Timestamp>::max())
+    , fused_(0)
+    , late_(0)
+{
+    assert(streams > 0);
+}
+
+bool OdometryFusion::is_live(Stream const &stream, can::Timestamp newest) const
+{
+    return !stream.history.empty()
+        && (timeout_ == 0 || stream.history.latest().stamp + timeout_ >= newest);
+}
+
+bool OdometryFusion::add(size_t stream, WheelSample const &sample, OdometryStep &step)
+{
+    if (init_ && sample.stamp <= fused_) {
+        ++late_;
+        return false;
+    }
+    streams_.at(stream).history.insert(sample);
+    first_ = std::min(first_, sample.stamp);
+
+    can::Timestamp newest = 0;
+    BOOST_FOREACH(Stream const &s, streams_) {
+        if (!s.history.empty()) {
+            newest = std::max(newest, s.history.latest().stamp);
+        }
+    }
+
+    // Before the first step, wait for every stream to report, but only for
+    // as long as a live stream would be waited for afterwards. A stream that
+    // never reports is then left out like one that stopped.
+    if (!init_) {
+        bool const waiting = timeout_ == 0 || first_ + timeout_ >= newest;
+        BOOST_FOREACH(Stream const &s, streams_) {
+            if (s.history.empty() && waiting) {
+                return false;
+            }
+        }
+    }
+
+    can::Timestamp horizon = std::numeric_limits<can::Timestamp>::max();
+    can::Timestamp oldest = 0;
+    BOOST_FOREACH(Stream const &s, streams_) {
+        if (is_live(s, newest)) {
+            horizon = std::min(horizon, s.history.latest().stamp);
+            oldest = std::max(oldest, s.history.oldest().stamp);
+        }
+    }
+
+    // Establish the references once every stream has a sample at or before
+    // a common instant, so no reference position is extrapolated.
+    if (!init_) {
+        if (horizon < oldest) {
+            return false;
+        }
+        BOOST_FOREACH(Stream &s, streams_) {
+            if (!is_live(s, newest)) {
+                s.history.clear();
+                continue;
+            }
+            WheelSample const reference = s.history.interpolate(horizon);
+            s.position = reference.position;
+            s.speed = reference.speed;
+            s.referenced = true;
+            s.history.discard_before(horizon);
+        }
+        fused_ = horizon;
+        init_ = true;
+        return false;
+    } else if (horizon <= fused_) {
+        return false;
+    }
+
+    step.stamp = horizon;
+    step.interval = horizon - fused_;
+    step.live.assign(streams_.size(), false);
+    step.revs.assign(streams_.size(), 0.0);
+    step.rpm_start.assign(streams_.size(), 0.0);
+    step.rpm.assign(streams_.size(), 0.0);
+
+    for (size_t i = 0; i < streams_.size(); ++i) {
+        Stream &s = streams_[i];
+        // Forget everything from before the outage, so the stream is not
+        // re-referenced by interpolating across it once it reports again.
+        if (!is_live(s, newest)) {
+            s.referenced = false;
+            s.history.clear();
+            continue;
+        }
+
+        WheelSample const now = s.history.interpolate(horizon);
+        if (s.referenced) {
+            step.live[i] = true;
+            step.revs[i] = now.position - s.position;
+            step.rpm_start[i] = s.speed;
+            step.rpm[i] = now.speed;
+        }
+        s.position = now.position;
+        s.speed = now.speed;
+        s.referenced = true;
+        s.history.discard_before(horizon);
+    }
+    fused_ = horizon;
+    return true;
+}
+
+void OdometryFusion::reset(void)
+{
+    BOOST_FOREACH(Stream &s, streams_) {
+        s.history.clear();
+        s.referenced = false;
+    }
+    init_ = false;
+    first_ = std::numeric_limits<can::Timestamp>::max();
+    fused_ = 0;
+    late_ = 0;
+}
+
+size_t OdometryFusion::size(void) const
+{
+    return streams_.size();
+}
+
+uint64_t OdometryFusion::late(void) const
+{
+    return late_;
+}
+
+double fuse(std::vector<double> &values, FusionMethod::Enum method)
+{
+    assert(!values.empty());
+    size_t const n = values.size();
+    std::sort(values.begin(), values.end());
+    double const median = (n % 2) ? values[n / 2]
+                                  : (values[n / 2 - 1] + values[n / 2]) / 2;
+    if (method == FusionMethod::kMedian || n <= 2) {
+        return median;
+    }
+
+    std::vector<double> deviations(n);
+    for (size_t i = 0; i < n; ++i) {
+        deviations[i] = fabs(values[i] - median);
+    }
+    std::sort(deviations.begin(), deviations.end());
+    double const mad = (n % 2) ? deviations[n / 2]
+                               : (deviations[n / 2 - 1] + deviations[n / 2]) / 2;
+
+    // 1.4826 scales the MAD to a standard deviation for normal noise.
+    double const threshold = 3 * 1.4826 * mad;
+    double sum = 0.0;
+    size_t count = 0;
+    BOOST_FOREACH(double value, values) {
+        if (fabs(value - median) <= threshold) {
+            sum += value;
+            ++count;
+        }
+    }
+    return (count > 0) ? sum / count : median;
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,187 @@
+#include <cmath>
+#include <jaguar/pose_integrator.h>
+
+namespace jaguar {
+
+static double normalize_angle(double angle)
+{
+    return atan2(sin(angle), cos(angle));
+}
+
+// Fraction of the distance covered by a linear speed profile, per unit of
+// normalized time tau. Constant if the speeds do not describe the motion,
+// e.g. because the wheel reversed or stood still.
+static double speed_shape(double distance, double const speed[2], double tau)
+{
+    double const mean = (speed[0] + speed[1]) / 2;
+    if (distance == 0.0 || fabs(mean) < 1e-9
+     || speed[0] * distance < 0 || speed[1] * distance < 0) {
+        return 1.0;
+    }
+    return (speed[0] + (speed[1] - speed[0]) * tau) / mean;
+}
+
+Pose2D::Pose2D(void)
+    : x(0.0)
+    , y(0.0)
+    , theta(0.0)
+{
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            covariance[i][j] = 0.0;
+        }
+    }
+}
+
+/*
+ * PoseIntegrator
+ */
+PoseIntegrator::~PoseIntegrator(void)
+{
+}
+
+void PoseIntegrator::step(Pose2D &pose, DriveMotion const &motion) const
+{
+    double const distance = (motion.left + motion.right) / 2;
+    double const rotation = (motion.right - motion.left) / motion.separation;
+    double const heading = pose.theta + rotation / 2;
+    double const c = cos(heading);
+    double const s = sin(heading);
+    double const k = distance / (2 * motion.separation);
+
+    // Jacobians of the midpoint model with respect to the previous pose and
+    // to the (left, right) wheel distances.
+    double const Fp[3][3] = {
+        { 1, 0, -distance * s },
+        { 0, 1,  distance * c },
+        { 0, 0,  1 }
+    };
+    double const Fw[3][2] = {
+        { c / 2 + k * s, c / 2 - k * s },
+        { s / 2 - k * c, s / 2 + k * c },
+        { -1 / motion.separation, 1 / motion.separation }
+    };
+
+    double P[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            double sum = Fw[i][0] * motion.variance_left * Fw[j][0]
+                       + Fw[i][1] * motion.variance_right * Fw[j][1];
+            for (int a = 0; a < 3; ++a) {
+                for (int b = 0; b < 3; ++b) {
+                    sum += Fp[i][a] * pose.covariance[a][b] * Fp[j][b];
+                }
+            }
+            P[i][j] = sum;
+        }
+    }
+
+    advance(pose, motion);
+    pose.theta = normalize_angle(pose.theta);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            pose.covariance[i][j] = P[i][j];
+        }
+    }
+}
+
+/*
+ * MidpointIntegrator
+ */
+char const *MidpointIntegrator::name(void) const
+{
+    return "midpoint";
+}
+
+void MidpointIntegrator::advance(Pose2D &pose, DriveMotion const &motion) const
+{
+    double const distance = (motion.left + motion.right) / 2;
+    double const rotation = (motion.right - motion.left) / motion.separation;
+    pose.x += distance * cos(pose.theta + rotation / 2);
+    pose.y += distance * sin(pose.theta + rotation / 2);
+    pose.theta += rotation;
+}
+
+/*
+ * ExactArcIntegrator
+ */
+char const *ExactArcIntegrator::name(void) const
+{
+    return "exact_arc";
+}
+
+void ExactArcIntegrator::advance(Pose2D &pose, DriveMotion const &motion) const
+{
+    double const distance = (motion.left + motion.right) / 2;
+    double const rotation = (motion.right - motion.left) / motion.separation;
+
+    // The chord of the arc points along the mean heading and is shorter than
+    // the arc by sin(h) / h. Use the series near zero, where the arc becomes
+    // a straight line.
+    double const h = rotation / 2;
+    double const sinc = (fabs(h) < 1e-4) ? 1.0 - h * h / 6 : sin(h) / h;
+    double const chord = distance * sinc;
+    pose.x += chord * cos(pose.theta + h);
+    pose.y += chord * sin(pose.theta + h);
+    pose.theta += rotation;
+}
+
+/*
+ * RungeKutta4Integrator
+ */
+char const *RungeKutta4Integrator::name(void) const
+{
+    return "rk4";
+}
+
+void RungeKutta4Integrator::advance(Pose2D &pose, DriveMotion const &motion) const
+{
+    // Integrate over normalized time, so each wheel's rate integrates to its
+    // measured distance.
+    double const taus[4] = { 0.0, 0.5, 0.5, 1.0 };
+    double const weights[4] = { 1.0, 2.0, 2.0, 1.0 };
+    double k[3] = { 0.0, 0.0, 0.0 };
+    double sum[3] = { 0.0, 0.0, 0.0 };
+
+    for (int i = 0; i < 4; ++i) {
+        double const tau = taus[i];
+        double const scale = (i == 0) ? 0.0 : (i == 3) ? 1.0 : 0.5;
+        double const theta = pose.theta + scale * k[2];
+
+        double const left  = motion.left  * speed_shape(motion.left,  motion.v_left,  tau);
+        double const right = motion.right * speed_shape(motion.right, motion.v_right, tau);
+        double const v = (left + right) / 2;
+
+        k[0] = v * cos(theta);
+        k[1] = v * sin(theta);
+        k[2] = (right - left) / motion.separation;
+        for (int j = 0; j < 3; ++j) {
+            sum[j] += weights[i] * k[j];
+        }
+    }
+
+    pose.x += sum[0] / 6;
+    pose.y += sum[1] / 6;
+    pose.theta += sum[2] / 6;
+}
+
+PoseIntegrator const &pose_integrator(Integrator::Enum method)
+{
+    static MidpointIntegrator const midpoint;
+    static ExactArcIntegrator const exact_arc;
+    static RungeKutta4Integrator const rk4;
+
+    switch (method) {
+    case Integrator::kMidpoint:
+        return midpoint;
+    case Integrator::kRungeKutta4:
+        return rk4;
+    case Integrator::kExactArc:
+    default:
+        return exact_arc;
+    }
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/current_function.hpp>
+#include <jaguar/replay_bridge.h>
+
+namespace can {
+
+#define CAN_REPLAYBRIDGE_ERROR(msg) do {                                    \
+    std::stringstream __m__;                                                \
+    __m__ << msg;                                                           \
+    error_signal_(BOOST_CURRENT_FUNCTION, __FILE__, __LINE__, __m__.str()); \
+} while(0)
+
+// Longest we wait for the program to catch up with the log before assuming
+// it took a different path than the recorded session. The rest of the log
+// is then played at the recorded pace, since waiting again on every record
+// would stall the replay for good.
+boost::posix_time::time_duration const ReplayBridge::kLockstepTimeout
+    = boost::posix_time::seconds(1);
+
+ReplayBridge::ReplayBridge(std::string const &path, double speed, bool lockstep)
+    : log_(path)
+    , speed_(speed)
+    , lockstep_(lockstep)
+    , work_(io_)
+    , stopping_(false)
+    , sent_(0)
+    , replayed_(0)
+{
+    start();
+}
+
+ReplayBridge::~ReplayBridge(void)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    stop();
+}
+
+void ReplayBridge::play(void)
+{
+    if (!thread_.joinable()) {
+        thread_ = boost::thread(boost::bind(&ReplayBridge::run, this));
+    }
+}
+
+void ReplayBridge::wait(void)
+{
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void ReplayBridge::send(CANMessage const &message)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        ++sent_;
+    }
+    cond_.notify_all();
+    sent(&message, &message + 1);
+}
+
+size_t ReplayBridge::frames_sent(void) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return sent_;
+}
+
+size_t ReplayBridge::frames_replayed(void) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return replayed_;
+}
+
+void ReplayBridge::run(void)
+{
+    if (log_.size() == 0) {
+        return;
+    }
+
+    Timestamp const first = log_[0].timestamp;
+    Timestamp const start = monotonic_now();
+    Timestamp base = start;
+    size_t expected = 0;
+    bool lockstep = lockstep_;
+
+    for (CANLogRecord const *it = log_.begin(); it != log_.end(); ++it) {
+        if (it->direction == CANLogRecord::kSent) {
+            ++expected;
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        size_t diverged = expected;
+        if (lockstep) {
+            boost::posix_time::ptime const deadline
+                = boost::posix_time::microsec_clock::universal_time() + kLockstepTimeout;
+            while (!stopping_ && sent_ < expected) {
+                if (!cond_.timed_wait(lock, deadline)) {
+                    diverged = sent_;
+                    lockstep = false;
+                    break;
+                }
+            }
+        }
+
+        if (speed_ > 0) {
+            // Received frames are back-dated, so they are not strictly in
+            // timestamp order; one that predates the first is due at once.
+            Timestamp const stamp = std::max(it->timestamp, first);
+            Timestamp const offset = static_cast<Timestamp>((stamp - first) / speed_);
+
+            // Sleep until this frame is due, unless waiting for the program
+            // already made us late; then the schedule slips instead.
+            Timestamp now = monotonic_now();
+            while (!stopping_ && now < base + offset) {
+                cond_.timed_wait(lock, boost::posix_time::microseconds((base + offset - now) / 1000 + 1));
+                now = monotonic_now();
+            }
+            if (now > base + offset + 1000000) {
+                base = now - offset;
+            }
+        }
+
+        if (stopping_) {
+            return;
+        }
+        lock.unlock();
+
+        if (diverged < expected) {
+            CAN_REPLAYBRIDGE_ERROR("replay diverged at record " << (it - log_.begin())
+                << ": sent " << diverged << " of " << expected << " frames;"
+                << " continuing without lockstep");
+        }
+
+        CANFrame frame = it->frame();
+        frame.timestamp = start + (it->timestamp - first);
+        recv_frame(make_frame(frame));
+
+        lock.lock();
+        ++replayed_;
+    }
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
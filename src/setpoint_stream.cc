@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <boost/foreach.hpp>
+#include <jaguar/setpoint_stream.h>
+
+namespace jaguar {
+
+SetpointStreamSettings::SetpointStreamSettings(void)
+    : verify_period_s(0.5)
+    , status_timeout_s(1.0)
+    , settle_s(1.0)
+    , tolerance(5.0)
+    , tolerance_fraction(0.2)
+    , refresh_s(0.5)
+{
+}
+
+SetpointStream::SetpointStream(MotorGroup &group, std::vector<Jaguar const *> const &jaguars,
+                               SetpointStreamSettings const &settings)
+    : group_(group)
+    , settings_(settings)
+    , ramp_(0.0)
+    , staged_(false)
+    , tick_(0)
+    , period_(0.0)
+    , verified_(0)
+{
+    assert(jaguars.size() == group.size());
+
+    BOOST_FOREACH(Jaguar const *jaguar, jaguars) {
+        Motor motor;
+        motor.jaguar = jaguar;
+        motor.setpoint = 0.0;
+        motor.since = 0;
+        motor.sent = 0;
+        motors_.push_back(motor);
+    }
+
+    stats_.ticks = 0;
+    stats_.overruns = 0;
+    stats_.max_interval = 0;
+    stats_.max_work = 0;
+    stats_.sent = 0;
+    stats_.suppressed = 0;
+    stats_.readbacks = 0;
+    stats_.mismatches = 0;
+    stats_.stale = 0;
+}
+
+void SetpointStream::begin_tick(can::Timestamp now, double period_s)
+{
+    if (tick_ != 0 && now > tick_) {
+        can::Timestamp const interval = now - tick_;
+        stats_.max_interval = std::max(stats_.max_interval, interval);
+        if (interval * 1e-9 > 1.5 * period_s) {
+            ++stats_.overruns;
+        }
+    }
+    tick_ = now;
+    period_ = period_s;
+    ++stats_.ticks;
+}
+
+void SetpointStream::ramp_set(double rate)
+{
+    ramp_ = rate;
+}
+
+void SetpointStream::set(size_t motor, double target)
+{
+    Motor &entry = motors_.at(motor);
+    can::Timestamp const now = (tick_ != 0) ? tick_ : can::monotonic_now();
+
+    // Step towards the target, unless the device does its own ramping. The
+    // first setpoint starts from zero, where the devices come up.
+    double value = target;
+    if (ramp_ > 0 && !group_.ramps_on_device()) {
+        double const step = ramp_ * period_;
+        value = std::max(entry.setpoint - step, std::min(target, entry.setpoint + step));
+    }
+
+    // Small adjustments do not restart the settling time, so a setpoint that
+    // is re-sent with jitter can still be verified.
+    if (entry.since == 0 || !matches(entry.setpoint, value)) {
+        entry.since = now;
+    }
+
+    can::Timestamp const refresh = static_cast<can::Timestamp>(settings_.refresh_s * 1e9);
+    if (entry.sent != 0 && value == entry.setpoint && now < entry.sent + refresh) {
+        ++stats_.suppressed;
+        return;
+    }
+
+    entry.setpoint = value;
+    entry.sent = now;
+    group_.stage(motor, value);
+    staged_ = true;
+    ++stats_.sent;
+}
+
+size_t SetpointStream::commit(can::Timestamp now)
+{
+    // A synchronous update with nothing staged would be wasted traffic.
+    if (staged_) {
+        group_.commit();
+        staged_ = false;
+    }
+
+    size_t failures = 0;
+    if (group_.mode() != GroupMode::kVoltage
+     && now >= verified_ + static_cast<can::Timestamp>(settings_.verify_period_s * 1e9)) {
+        BOOST_FOREACH(Motor &motor, motors_) {
+            failures += !verify(motor, now);
+        }
+        verified_ = now;
+    }
+
+    can::Timestamp const done = can::monotonic_now();
+    if (done > tick_) {
+        stats_.max_work = std::max(stats_.max_work, done - tick_);
+    }
+    return failures;
+}
+
+SetpointStreamStats const &SetpointStream::stats(void) const
+{
+    return stats_;
+}
+
+bool SetpointStream::verify(Motor &motor, can::Timestamp now)
+{
+    if (motor.since == 0) {
+        return true;
+    }
+
+    StatusField::Enum const field = (group_.mode() == GroupMode::kPosition)
+                                  ? StatusField::kPosition : StatusField::kSpeed;
+    DeviceStatus const status = motor.jaguar->status();
+
+    // Nothing to compare against until the setpoint has been held long
+    // enough for the motor to reach it.
+    can::Timestamp const settle = static_cast<can::Timestamp>(settings_.settle_s * 1e9);
+    if (now < motor.since + settle) {
+        return true;
+    } else if (status.age(field, now) > settings_.status_timeout_s) {
+        ++stats_.stale;
+        return false;
+    } else if (status.stamps[field] < motor.since + settle) {
+        return true;
+    }
+
+    double const readback = (field == StatusField::kPosition)
+                          ? status.latest.position : status.latest.speed;
+    ++stats_.readbacks;
+    if (!matches(motor.setpoint, readback)) {
+        ++stats_.mismatches;
+        return false;
+    }
+    return true;
+}
+
+bool SetpointStream::matches(double setpoint, double readback) const
+{
+    double const allowed = settings_.tolerance + settings_.tolerance_fraction * fabs(setpoint);
+    return fabs(setpoint - readback) <= allowed;
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
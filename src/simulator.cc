@@ -0,0 +1,76 @@
+#include <csignal>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include <jaguar/can_bridge.h>
+#include <jaguar/jaguar_simulator.h>
+
+template <typename T>
+static T convert(std::string str)
+{
+    std::stringstream ss(str);
+    T x;
+    ss >> x;
+    return x;
+}
+
+static volatile sig_atomic_t running = 1;
+
+static void interrupt(int)
+{
+    running = 0;
+}
+
+int main(int argc, char *argv[])
+{
+    jaguar::SimulatorSettings settings;
+    std::vector<uint8_t> devices;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:d:b:")) != -1) {
+        switch (opt) {
+        case 'l':
+            settings.latency = boost::posix_time::microseconds(convert<long>(optarg));
+            break;
+        case 'd':
+            settings.drop_rate = convert<double>(optarg);
+            break;
+        case 'b':
+            settings.baud_rate = convert<unsigned>(optarg);
+            break;
+        default:
+            argc = 0;
+        }
+    }
+
+    for (int i = optind; i < argc; ++i) {
+        devices.push_back(convert<uint16_t>(argv[i]));
+    }
+
+    if (devices.empty()) {
+        std::cerr << "err: incorrect number of arguments\n"
+                  << "usage: ./simulator [-l latency_us] [-d drop_rate] [-b baud] <device id>..."
+                  << std::endl;
+        return 1;
+    }
+
+    try {
+        jaguar::JaguarSimulator simulator(devices, settings);
+        std::cout << simulator.port() << std::endl;
+
+        signal(SIGINT, &interrupt);
+        signal(SIGTERM, &interrupt);
+        while (running) {
+            pause();
+        }
+    } catch (can::CANException &e) {
+        std::cerr << "error " << e.code() << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <linux/can/raw.h>
+#include <boost/bind.hpp>
+#include <boost/current_function.hpp>
+#include <boost/foreach.hpp>
+#include <jaguar/socketcan_bridge.h>
+
+namespace asio = boost::asio;
+
+namespace can {
+
+#define CAN_SOCKETCANBRIDGE_ERROR(code, detail) \
+    report_error((code), (detail), BOOST_CURRENT_FUNCTION, __FILE__, __LINE__)
+
+// Number of frames read from the socket with a single recvmmsg() call.
+size_t const SocketCANBridge::kBatchLength = 32;
+
+// Past this many distinct filters the kernel's linear filter scan costs
+// more than it saves, so we fall back to accepting every frame.
+size_t const SocketCANBridge::kMaxFilters = 64;
+
+static Timestamp realtime_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<Timestamp>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+static CANException socket_error(int socket, std::string const &what)
+{
+    int const code = errno;
+    if (socket >= 0) {
+        close(socket);
+    }
+    return CANException(code, what + ": " + strerror(code));
+}
+
+SocketCANBridge::SocketCANBridge(std::string interface)
+    : socket_(-1)
+    , descriptor_(io_)
+    , recv_frames_(kBatchLength)
+    , recv_iovecs_(kBatchLength)
+    , recv_headers_(kBatchLength)
+    , recv_control_(kBatchLength * CMSG_SPACE(sizeof(struct timeval)))
+{
+    socket_ = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (socket_ < 0) {
+        throw socket_error(socket_, "unable to open CAN socket");
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    if (ioctl(socket_, SIOCGIFINDEX, &ifr) < 0) {
+        throw socket_error(socket_, "unknown CAN interface " + interface);
+    }
+
+    // Don't receive anything until a callback or request asks for it. The
+    // filter list is rebuilt by filters_changed() as subscriptions arrive.
+    if (setsockopt(socket_, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0) < 0) {
+        throw socket_error(socket_, "unable to set CAN filters");
+    }
+
+    int const enable = 1;
+    if (setsockopt(socket_, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable)) < 0) {
+        throw socket_error(socket_, "unable to enable receive timestamps");
+    }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(socket_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+        throw socket_error(socket_, "unable to bind to CAN interface " + interface);
+    }
+
+    // Point each recvmmsg() header at its own frame and control buffer.
+    size_t const control_length = CMSG_SPACE(sizeof(struct timeval));
+    for (size_t i = 0; i < kBatchLength; ++i) {
+        recv_iovecs_[i].iov_base = &recv_frames_[i];
+        recv_iovecs_[i].iov_len  = sizeof(struct can_frame);
+
+        struct msghdr &header = recv_headers_[i].msg_hdr;
+        memset(&header, 0, sizeof(header));
+        header.msg_iov        = &recv_iovecs_[i];
+        header.msg_iovlen     = 1;
+        header.msg_control    = &recv_control_[i * control_length];
+        header.msg_controllen = control_length;
+    }
+
+    descriptor_.assign(socket_);
+    recv_start();
+    start();
+}
+
+SocketCANBridge::~SocketCANBridge(void)
+{
+    descriptor_.cancel();
+    stop();
+    descriptor_.close();
+}
+
+void SocketCANBridge::send(CANMessage const &message)
+{
+    struct can_frame frame;
+    encode_frame(message, frame);
+
+    boost::mutex::scoped_lock lock(send_mutex_);
+    sent(&message, &message + 1);
+    if (write(socket_, &frame, sizeof(frame)) != sizeof(frame)) {
+        throw CANException(errno, std::string("unable to send CAN frame: ") + strerror(errno));
+    }
+}
+
+void SocketCANBridge::send_batch(CANMessage const *begin, CANMessage const *end)
+{
+    struct can_frame frames[kBatchLength];
+    struct iovec iovecs[kBatchLength];
+    struct mmsghdr headers[kBatchLength];
+
+    boost::mutex::scoped_lock lock(send_mutex_);
+
+    // Hand the kernel up to kBatchLength frames per system call.
+    while (begin != end) {
+        size_t const count = std::min<size_t>(end - begin, kBatchLength);
+
+        for (size_t i = 0; i < count; ++i) {
+            encode_frame(begin[i], frames[i]);
+            iovecs[i].iov_base = &frames[i];
+            iovecs[i].iov_len  = sizeof(struct can_frame);
+
+            memset(&headers[i], 0, sizeof(headers[i]));
+            headers[i].msg_hdr.msg_iov    = &iovecs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        sent(begin, begin + count);
+
+        size_t written = 0;
+        while (written < count) {
+            int const result = sendmmsg(socket_, headers + written, count - written, 0);
+            if (result < 0) {
+                throw CANException(errno, std::string("unable to send CAN frames: ") + strerror(errno));
+            }
+            written += result;
+        }
+        begin += count;
+    }
+}
+
+void SocketCANBridge::filters_changed(void)
+{
+    std::vector<filter> const filters = this->filters();
+
+    // Every Jaguar identifier is a 29-bit extended identifier. Including the
+    // RTR flag in the mask rejects remote frames.
+    bool accept_all = filters.size() > kMaxFilters;
+    std::vector<struct can_filter> raw_filters;
+    raw_filters.reserve(filters.size());
+
+    BOOST_FOREACH(filter const &f, filters) {
+        uint32_t const mask = f.mask & CAN_EFF_MASK;
+        if (mask == 0) {
+            accept_all = true;
+            break;
+        }
+
+        struct can_filter raw_filter;
+        raw_filter.can_id   = (f.num & CAN_EFF_MASK) | CAN_EFF_FLAG;
+        raw_filter.can_mask = mask | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        raw_filters.push_back(raw_filter);
+    }
+
+    if (accept_all) {
+        raw_filters.resize(1);
+        raw_filters[0].can_id   = 0;
+        raw_filters[0].can_mask = 0;
+    }
+
+    boost::mutex::scoped_lock lock(filter_mutex_);
+    int const result = setsockopt(socket_, SOL_CAN_RAW, CAN_RAW_FILTER,
+        &raw_filters[0], raw_filters.size() * sizeof(struct can_filter));
+    if (result < 0) {
+        // Without the new filters frames are dropped or flood the receive
+        // path, so this counts against reading.
+        CAN_SOCKETCANBRIDGE_ERROR(BridgeError::kReadFailed, errno);
+    }
+}
+
+void SocketCANBridge::recv_start(void)
+{
+    // Wait for the socket to become readable, then drain it with recvmmsg()
+    // instead of letting asio issue one read() per frame.
+    descriptor_.async_read_some(asio::null_buffers(),
+        boost::bind(&SocketCANBridge::recv_handle, this,
+                    asio::placeholders::error
+        )
+    );
+}
+
+void SocketCANBridge::recv_handle(boost::system::error_code const &error)
+{
+    if (error == asio::error::operation_aborted) {
+        return;
+    } else if (error) {
+        CAN_SOCKETCANBRIDGE_ERROR(BridgeError::kReadFailed, error.value());
+        return;
+    }
+
+    size_t const control_length = CMSG_SPACE(sizeof(struct timeval));
+    for (size_t i = 0; i < kBatchLength; ++i) {
+        recv_headers_[i].msg_hdr.msg_controllen = control_length;
+    }
+
+    int const count = recvmmsg(socket_, &recv_headers_[0], kBatchLength, MSG_DONTWAIT, NULL);
+    if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        CAN_SOCKETCANBRIDGE_ERROR(BridgeError::kReadFailed, errno);
+        return;
+    }
+
+    Timestamp const now_mono = monotonic_now();
+    Timestamp const now_real = realtime_now();
+
+    for (int i = 0; i < count; ++i) {
+        struct can_frame const &raw = recv_frames_[i];
+        if (raw.can_id & (CAN_ERR_FLAG | CAN_RTR_FLAG)) {
+            continue;
+        }
+
+        CANFrame frame;
+        frame.id  = raw.can_id & ((raw.can_id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+        frame.dlc = std::min<uint8_t>(raw.can_dlc, 8);
+        memcpy(frame.data, raw.data, frame.dlc);
+        frame.timestamp = recv_timestamp(recv_headers_[i].msg_hdr, now_mono, now_real);
+        recv_frame(make_frame(frame));
+    }
+
+    recv_start();
+}
+
+Timestamp SocketCANBridge::recv_timestamp(struct msghdr const &header,
+                                          Timestamp now_mono, Timestamp now_real) const
+{
+    // SO_TIMESTAMP reports the kernel's receive time on the realtime clock.
+    // Convert it to the monotonic clock by measuring how long ago it was.
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(const_cast<struct msghdr *>(&header));
+         cmsg != NULL;
+         cmsg = CMSG_NXTHDR(const_cast<struct msghdr *>(&header), cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMP) {
+            struct timeval stamp;
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+
+            Timestamp const stamp_real = static_cast<Timestamp>(stamp.tv_sec) * 1000000000ull
+                                       + static_cast<Timestamp>(stamp.tv_usec) * 1000ull;
+            Timestamp const age = (now_real > stamp_real) ? now_real - stamp_real : 0;
+            return (now_mono > age) ? now_mono - age : now_mono;
+        }
+    }
+    return now_mono;
+}
+
+void SocketCANBridge::encode_frame(CANMessage const &message, struct can_frame &frame)
+{
+    assert(message.payload.size() <= 8);
+    assert((message.id & ~CAN_EFF_MASK) == 0);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id  = message.id | CAN_EFF_FLAG;
+    frame.can_dlc = message.payload.size();
+    if (!message.payload.empty()) {
+        memcpy(frame.data, &message.payload[0], message.payload.size());
+    }
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
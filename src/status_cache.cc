@@ -0,0 +1,53 @@
+#include <cstring>
+#include <limits>
+#include <jaguar/status_cache.h>
+
+namespace jaguar {
+
+bool DeviceStatus::has(StatusField::Enum field) const
+{
+    return latest.has(field);
+}
+
+double DeviceStatus::age(StatusField::Enum field, can::Timestamp now) const
+{
+    if (!has(field)) {
+        return std::numeric_limits<double>::infinity();
+    } else if (now <= stamps[field]) {
+        return 0.0;
+    }
+    return (now - stamps[field]) * 1e-9;
+}
+
+StatusCache::StatusCache(void)
+{
+    memset(&staging_, 0, sizeof staging_);
+}
+
+void StatusCache::update(StatusSample const &sample)
+{
+    boost::mutex::scoped_lock lock(update_mutex_);
+
+    merge(sample, staging_.latest);
+    staging_.latest.stamp = sample.stamp;
+    for (size_t i = 0; i < StatusField::kCount; ++i) {
+        if ((sample.valid >> i) & 1) {
+            staging_.stamps[i] = sample.stamp;
+        }
+    }
+    published_.store(staging_);
+}
+
+DeviceStatus StatusCache::load(void) const
+{
+    return published_.load();
+}
+
+uint32_t StatusCache::version(void) const
+{
+    return published_.version();
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <vector>
+#include <jaguar/jaguar.h>
+#include <jaguar/status_decoder.h>
+
+namespace jaguar {
+
+namespace {
+
+struct FieldInfo {
+    uint8_t item;
+    uint8_t width;
+    uint8_t slot;
+    double  scale;
+};
+
+#define STATUS_SLOT(_member_) offsetof(StatusSample, _member_)
+
+// Indexed by StatusField::Enum.
+FieldInfo const kFields[StatusField::kCount] = {
+    { PeriodicStatusItem::kOutputVoltagePercentBase,  2, STATUS_SLOT(output_voltage_percent), 1 / 32768. },
+    { PeriodicStatusItem::kBusVoltageBase,            2, STATUS_SLOT(bus_voltage),            1 / 256. },
+    { PeriodicStatusItem::kMotorCurrentBase,          2, STATUS_SLOT(current),                1 / 256. },
+    { PeriodicStatusItem::kTemperatureBase,           2, STATUS_SLOT(temperature),            1 / 256. },
+    { PeriodicStatusItem::kPositionBase,              4, STATUS_SLOT(position),               1 / 65536. },
+    { PeriodicStatusItem::kSpeedBase,                 4, STATUS_SLOT(speed),                  1 / 65536. },
+    { PeriodicStatusItem::kLimitNonClearing,          1, STATUS_SLOT(limit_non_clearing),          0 },
+    { PeriodicStatusItem::kLimitClearing,             1, STATUS_SLOT(limit_clearing),              0 },
+    { PeriodicStatusItem::kFaults,                    1, STATUS_SLOT(faults),                      0 },
+    { PeriodicStatusItem::kStickyFaultsNonClearing,   1, STATUS_SLOT(sticky_faults_non_clearing),  0 },
+    { PeriodicStatusItem::kStickyFaultsClearing,      1, STATUS_SLOT(sticky_faults_clearing),      0 },
+    { PeriodicStatusItem::kOutputVoltageVolts,        2, STATUS_SLOT(output_voltage_volts),   1 / 256. },
+    { PeriodicStatusItem::kCurrentFaultCounter,       1, STATUS_SLOT(current_fault_counter),       0 },
+    { PeriodicStatusItem::kTemperatureFaultCounter,   1, STATUS_SLOT(temperature_fault_counter),   0 },
+    { PeriodicStatusItem::kBusVoltageFaultCounter,    1, STATUS_SLOT(bus_voltage_fault_counter),   0 },
+    { PeriodicStatusItem::kGateFaultCounter,          1, STATUS_SLOT(gate_fault_counter),          0 },
+    { PeriodicStatusItem::kCommunicationFaultCounter, 1, STATUS_SLOT(communication_fault_counter), 0 }
+};
+
+#undef STATUS_SLOT
+
+// Field that starts with item, or kCount if it is not the first item of one.
+StatusField::Enum field_starting_at(uint8_t item)
+{
+    for (size_t i = 0; i < StatusField::kCount; ++i) {
+        if (kFields[i].item == item) {
+            return static_cast<StatusField::Enum>(i);
+        }
+    }
+    return StatusField::kCount;
+}
+
+};
+
+void merge(StatusSample const &from, StatusSample &into)
+{
+    uint8_t const *const src = reinterpret_cast<uint8_t const *>(&from);
+    uint8_t *const dst = reinterpret_cast<uint8_t *>(&into);
+
+    for (size_t i = 0; i < StatusField::kCount; ++i) {
+        if ((from.valid >> i) & 1) {
+            FieldInfo const &info = kFields[i];
+            size_t const size = (info.scale == 0) ? 1 : sizeof(double);
+            memcpy(dst + info.slot, src + info.slot, size);
+        }
+    }
+    into.valid |= from.valid;
+}
+
+StatusPlan::StatusPlan(void)
+    : size_(0)
+{
+    layout_.length = 0;
+}
+
+StatusPlan::StatusPlan(field::StatusLayout const &layout)
+    : layout_(layout)
+    , size_(0)
+{
+    assert(layout_.length <= 8);
+    compile();
+}
+
+StatusPlan::StatusPlan(AggregateStatus statuses)
+    : size_(0)
+{
+    std::vector<uint8_t> items;
+    std::back_insert_iterator<std::vector<uint8_t> > it(items);
+    statuses.write(it);
+    assert(items.size() <= 8);
+
+    std::copy(items.begin(), items.end(), layout_.items);
+    layout_.length = items.size();
+    compile();
+}
+
+bool StatusPlan::add(StatusField::Enum field)
+{
+    FieldInfo const &info = kFields[field];
+    if (layout_.length + info.width > 8) {
+        return false;
+    }
+
+    for (size_t i = 0; i < info.width; ++i) {
+        layout_.items[layout_.length++] = info.item + i;
+    }
+    compile();
+    return true;
+}
+
+field::StatusLayout const &StatusPlan::layout(void) const
+{
+    return layout_;
+}
+
+size_t StatusPlan::length(void) const
+{
+    return layout_.length;
+}
+
+size_t StatusPlan::size(void) const
+{
+    return size_;
+}
+
+StatusPlan::Entry const &StatusPlan::entry(size_t i) const
+{
+    assert(i < size_);
+    return entries_[i];
+}
+
+bool StatusPlan::decode(uint8_t const *data, size_t length, StatusSample &sample) const
+{
+    uint8_t *const base = reinterpret_cast<uint8_t *>(&sample);
+    sample.valid = 0;
+
+    for (size_t i = 0; i < size_; ++i) {
+        Entry const &entry = entries_[i];
+        if (entry.offset + entry.width > length) {
+            break;
+        }
+
+        uint8_t const *p = data + entry.offset;
+        if (entry.scale == 0) {
+            base[entry.slot] = p[0];
+        } else {
+            // Sign extend from the width of the field.
+            uint32_t raw = 0;
+            for (size_t j = 0; j < entry.width; ++j) {
+                raw |= static_cast<uint32_t>(p[j]) << (8 * j);
+            }
+            int32_t const value = (entry.width == 2)
+                                ? static_cast<int16_t>(raw)
+                                : static_cast<int32_t>(raw);
+            double const scaled = value * entry.scale;
+            memcpy(base + entry.slot, &scaled, sizeof scaled);
+        }
+        sample.valid |= 1u << entry.field;
+    }
+    return length >= layout_.length;
+}
+
+PeriodicStatusItem::Enum StatusPlan::item(StatusField::Enum field)
+{
+    return static_cast<PeriodicStatusItem::Enum>(kFields[field].item);
+}
+
+size_t StatusPlan::width(StatusField::Enum field)
+{
+    return kFields[field].width;
+}
+
+void StatusPlan::compile(void)
+{
+    size_ = 0;
+
+    size_t offset = 0;
+    while (offset < layout_.length) {
+        uint8_t const item = layout_.items[offset];
+        if (item == PeriodicStatusItem::kEndOfMessage) {
+            break;
+        }
+
+        StatusField::Enum const field = field_starting_at(item);
+        if (field == StatusField::kCount) {
+            ++offset;
+            continue;
+        }
+
+        FieldInfo const &info = kFields[field];
+        bool complete = offset + info.width <= layout_.length;
+        for (size_t i = 1; complete && i < info.width; ++i) {
+            complete = layout_.items[offset + i] == info.item + i;
+        }
+        if (!complete) {
+            ++offset;
+            continue;
+        }
+
+        Entry &entry = entries_[size_++];
+        entry.offset = offset;
+        entry.width = info.width;
+        entry.field = field;
+        entry.slot = info.slot;
+        entry.scale = info.scale;
+        offset += info.width;
+    }
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
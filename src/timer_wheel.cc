@@ -0,0 +1,98 @@
+#include <cassert>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <jaguar/timer_wheel.h>
+
+namespace can {
+
+TimerWheel::TimerWheel(boost::asio::io_service &io,
+                       boost::posix_time::time_duration const &tick, size_t slots)
+    : io_(io)
+    , timer_(io)
+    , tick_(tick)
+    , slots_(slots)
+    , cursor_(0)
+    , pending_(0)
+    , running_(false)
+{
+    assert(slots > 0);
+    assert(tick.total_microseconds() > 0);
+}
+
+void TimerWheel::schedule(boost::posix_time::time_duration const &delay, callback cb)
+{
+    int64_t const tick_us = tick_.total_microseconds();
+    int64_t const delay_us = delay.total_microseconds();
+    size_t const ticks = (delay_us > 0) ? (delay_us + tick_us - 1) / tick_us : 1;
+
+    // An entry that is `ticks` ahead of the cursor is visited (ticks - 1) / N
+    // times before it is due.
+    Entry entry;
+    entry.rounds = (ticks - 1) / slots_.size();
+    entry.cb = cb;
+
+    boost::mutex::scoped_lock lock(mutex_);
+    slots_[(cursor_ + ticks) % slots_.size()].push_back(entry);
+    ++pending_;
+
+    // The timer may only be touched from the I/O thread.
+    if (!running_) {
+        running_ = true;
+        io_.post(boost::bind(&TimerWheel::start, this));
+    }
+}
+
+size_t TimerWheel::pending(void) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return pending_;
+}
+
+void TimerWheel::start(void)
+{
+    timer_.expires_from_now(tick_);
+    timer_.async_wait(boost::bind(&TimerWheel::advance, this, _1));
+}
+
+void TimerWheel::advance(boost::system::error_code const &error)
+{
+    if (error) {
+        return;
+    }
+
+    std::vector<callback> due;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        cursor_ = (cursor_ + 1) % slots_.size();
+
+        std::vector<Entry> &slot = slots_[cursor_];
+        size_t kept = 0;
+        for (size_t i = 0; i < slot.size(); ++i) {
+            if (slot[i].rounds == 0) {
+                due.push_back(slot[i].cb);
+            } else {
+                --slot[i].rounds;
+                slot[kept++] = slot[i];
+            }
+        }
+        slot.resize(kept);
+        pending_ -= due.size();
+
+        // Tick relative to the previous deadline, not to now, so the wheel
+        // catches up rather than drifting if the I/O thread was busy.
+        if (pending_ > 0) {
+            timer_.expires_at(timer_.expires_at() + tick_);
+            timer_.async_wait(boost::bind(&TimerWheel::advance, this, _1));
+        } else {
+            running_ = false;
+        }
+    }
+
+    BOOST_FOREACH(callback const &cb, due) {
+        cb();
+    }
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <jaguar/tx_scheduler.h>
+
+namespace can {
+
+TxScheduler::TxScheduler(void)
+{
+    for (size_t i = 0; i < TxClass::kCount; ++i) {
+        Queue &queue = queues_[i];
+        queue.rate = 0.0;
+        queue.burst = 0.0;
+        queue.tokens = 0.0;
+        queue.refilled = 0;
+        queue.stats = TxClassStats();
+    }
+}
+
+void TxScheduler::rate_limit_set(TxClass::Enum cls, double frames_per_sec, size_t burst)
+{
+    Queue &queue = queues_[cls];
+    queue.rate = frames_per_sec;
+    queue.burst = std::max<size_t>(burst, 1);
+    queue.tokens = queue.burst;
+    queue.refilled = monotonic_now();
+}
+
+void TxScheduler::push(TxClass::Enum cls, CANMessage const &message, Timestamp now)
+{
+    Queue &queue = queues_[cls];
+    queue.entries.push_back(Entry(message, now));
+    queue.stats.depth = queue.entries.size();
+    queue.stats.max_depth = std::max(queue.stats.max_depth, queue.stats.depth);
+}
+
+bool TxScheduler::pop(Timestamp now, CANMessage &message, Timestamp &wake)
+{
+    wake = 0;
+    for (size_t i = 0; i < TxClass::kCount; ++i) {
+        Queue &queue = queues_[i];
+        if (queue.entries.empty()) {
+            continue;
+        }
+
+        // A rate limited class yields to lower priorities until it has a
+        // token again.
+        if (queue.rate > 0.0) {
+            refill(queue, now);
+            if (queue.tokens < 1.0) {
+                Timestamp const ready = now
+                    + static_cast<Timestamp>((1.0 - queue.tokens) / queue.rate * 1e9);
+                wake = (wake == 0) ? ready : std::min(wake, ready);
+                continue;
+            }
+            queue.tokens -= 1.0;
+        }
+
+        Entry const &entry = queue.entries.front();
+        message = entry.message;
+        queue.stats.max_wait = std::max(queue.stats.max_wait,
+                                        (now > entry.enqueued) ? now - entry.enqueued : 0);
+        queue.entries.pop_front();
+        queue.stats.depth = queue.entries.size();
+        ++queue.stats.frames;
+        return true;
+    }
+    return false;
+}
+
+bool TxScheduler::empty(void) const
+{
+    for (size_t i = 0; i < TxClass::kCount; ++i) {
+        if (!queues_[i].entries.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TxClassStats TxScheduler::stats(TxClass::Enum cls) const
+{
+    return queues_[cls].stats;
+}
+
+void TxScheduler::refill(Queue &queue, Timestamp now)
+{
+    if (now > queue.refilled) {
+        queue.tokens = std::min(queue.burst, queue.tokens + (now - queue.refilled) * 1e-9 * queue.rate);
+        queue.refilled = now;
+    }
+}
+
+};
+
+/* vim: set et ts=4 sts=4 sw=4: */
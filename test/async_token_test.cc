@@ -0,0 +1,202 @@
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/async_token.h>
+
+using namespace testing;
+using can::AsyncToken;
+using can::TokenPtr;
+
+class AsyncTokenTest : public ::testing::Test
+{
+public:
+	virtual void SetUp(void)
+	{
+		called_ = 0;
+	}
+
+	void callback(can::Token &token)
+	{
+		++called_;
+		ASSERT_TRUE(token.ready());
+	}
+
+	TokenPtr next(TokenPtr const &following, can::Token &)
+	{
+		++called_;
+		return following;
+	}
+
+	can::FramePtr make_frame(uint32_t id)
+	{
+		can::CANFrame frame = can::CANFrame();
+		frame.id = id;
+		return pool_.allocate(frame);
+	}
+
+	static std::vector<TokenPtr> tokens(TokenPtr const &a, TokenPtr const &b)
+	{
+		std::vector<TokenPtr> tokens;
+		tokens.push_back(a);
+		tokens.push_back(b);
+		return tokens;
+	}
+
+	can::FramePool pool_;
+	int called_;
+
+	AsyncTokenTest(void) : pool_(4) {}
+};
+
+TEST_F(AsyncTokenTest, callbackRunsOnCompletion)
+{
+	boost::shared_ptr<AsyncToken> token = boost::make_shared<AsyncToken>();
+	token->on_complete(boost::bind(&AsyncTokenTest::callback, this, _1));
+	ASSERT_EQ(called_, 0);
+
+	ASSERT_TRUE(token->complete(make_frame(0x01)));
+	ASSERT_EQ(called_, 1);
+	ASSERT_FALSE(token->timed_out());
+	ASSERT_EQ(token->frame()->id, 0x01u);
+
+	// Completing twice is a no-op and never runs callbacks again.
+	ASSERT_FALSE(token->expire());
+	ASSERT_EQ(called_, 1);
+	ASSERT_FALSE(token->timed_out());
+}
+
+TEST_F(AsyncTokenTest, callbackRunsImmediatelyWhenReady)
+{
+	boost::shared_ptr<AsyncToken> token = boost::make_shared<AsyncToken>();
+	token->expire();
+	token->on_complete(boost::bind(&AsyncTokenTest::callback, this, _1));
+
+	ASSERT_EQ(called_, 1);
+	ASSERT_TRUE(token->timed_out());
+}
+
+TEST_F(AsyncTokenTest, blockWaitsForOtherThread)
+{
+	boost::shared_ptr<AsyncToken> token = boost::make_shared<AsyncToken>();
+	ASSERT_FALSE(token->timed_block(boost::posix_time::milliseconds(1)));
+
+	boost::thread completer(boost::bind(&AsyncToken::complete, token, make_frame(0x02)));
+	token->block();
+	completer.join();
+
+	ASSERT_TRUE(token->ready());
+	ASSERT_TRUE(token->timed_block(boost::posix_time::milliseconds(1)));
+}
+
+TEST_F(AsyncTokenTest, whenAllWaitsForEveryToken)
+{
+	boost::shared_ptr<AsyncToken> a = boost::make_shared<AsyncToken>();
+	boost::shared_ptr<AsyncToken> b = boost::make_shared<AsyncToken>();
+	TokenPtr const all = can::when_all(tokens(a, b));
+
+	b->complete(make_frame(0x02));
+	ASSERT_FALSE(all->ready());
+	a->complete(make_frame(0x01));
+	ASSERT_TRUE(all->ready());
+	ASSERT_FALSE(all->timed_out());
+}
+
+TEST_F(AsyncTokenTest, whenAllTimesOutIfAnyTokenDoes)
+{
+	boost::shared_ptr<AsyncToken> a = boost::make_shared<AsyncToken>();
+	boost::shared_ptr<AsyncToken> b = boost::make_shared<AsyncToken>();
+	TokenPtr const all = can::when_all(tokens(a, b));
+
+	a->expire();
+	b->complete(make_frame(0x02));
+	ASSERT_TRUE(all->ready());
+	ASSERT_TRUE(all->timed_out());
+}
+
+TEST_F(AsyncTokenTest, whenAllOfNothingIsReady)
+{
+	TokenPtr const all = can::when_all(std::vector<TokenPtr>());
+	ASSERT_TRUE(all->ready());
+	ASSERT_FALSE(all->timed_out());
+}
+
+TEST_F(AsyncTokenTest, thenFollowsContinuation)
+{
+	boost::shared_ptr<AsyncToken> first  = boost::make_shared<AsyncToken>();
+	boost::shared_ptr<AsyncToken> second = boost::make_shared<AsyncToken>();
+	TokenPtr const chained = can::then(first,
+		boost::bind(&AsyncTokenTest::next, this, TokenPtr(second), _1));
+
+	first->complete(make_frame(0x01));
+	ASSERT_EQ(called_, 1);
+	ASSERT_FALSE(chained->ready());
+
+	second->complete(make_frame(0x02));
+	ASSERT_TRUE(chained->ready());
+	ASSERT_EQ(chained->frame()->id, 0x02u);
+}
+
+TEST_F(AsyncTokenTest, thenSkipsContinuationOnTimeout)
+{
+	boost::shared_ptr<AsyncToken> first  = boost::make_shared<AsyncToken>();
+	boost::shared_ptr<AsyncToken> second = boost::make_shared<AsyncToken>();
+	TokenPtr const chained = can::then(first,
+		boost::bind(&AsyncTokenTest::next, this, TokenPtr(second), _1));
+
+	first->expire();
+	ASSERT_EQ(called_, 0);
+	ASSERT_TRUE(chained->ready());
+	ASSERT_TRUE(chained->timed_out());
+}
+
+TEST_F(AsyncTokenTest, discardedTokenIsCancelled)
+{
+	boost::shared_ptr<AsyncToken> token = boost::make_shared<AsyncToken>();
+	token->discard();
+	ASSERT_TRUE(token->ready());
+	ASSERT_FALSE(token->timed_out());
+	ASSERT_TRUE(token->cancelled());
+	ASSERT_TRUE(token->failed());
+}
+
+TEST_F(AsyncTokenTest, whenAllFailsIfAnyTokenIsDiscarded)
+{
+	boost::shared_ptr<AsyncToken> a = boost::make_shared<AsyncToken>();
+	boost::shared_ptr<AsyncToken> b = boost::make_shared<AsyncToken>();
+	TokenPtr const all = can::when_all(tokens(a, b));
+
+	a->discard();
+	b->complete(make_frame(0x02));
+	ASSERT_TRUE(all->ready());
+	ASSERT_TRUE(all->cancelled());
+	ASSERT_TRUE(all->failed());
+}
+
+TEST_F(AsyncTokenTest, thenSkipsContinuationOnDiscard)
+{
+	boost::shared_ptr<AsyncToken> first  = boost::make_shared<AsyncToken>();
+	boost::shared_ptr<AsyncToken> second = boost::make_shared<AsyncToken>();
+	TokenPtr const chained = can::then(first,
+		boost::bind(&AsyncTokenTest::next, this, TokenPtr(second), _1));
+
+	first->discard();
+	ASSERT_EQ(called_, 0);
+	ASSERT_TRUE(chained->ready());
+	ASSERT_TRUE(chained->cancelled());
+}
+
+TEST_F(AsyncTokenTest, thenFollowsDiscardedContinuation)
+{
+	boost::shared_ptr<AsyncToken> first  = boost::make_shared<AsyncToken>();
+	boost::shared_ptr<AsyncToken> second = boost::make_shared<AsyncToken>();
+	TokenPtr const chained = can::then(first,
+		boost::bind(&AsyncTokenTest::next, this, TokenPtr(second), _1));
+
+	first->complete(make_frame(0x01));
+	second->discard();
+	ASSERT_TRUE(chained->ready());
+	ASSERT_TRUE(chained->failed());
+}
@@ -0,0 +1,75 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/bridge_metrics.h>
+
+using namespace testing;
+using can::BridgeError;
+using can::BridgeMetrics;
+using can::Histogram;
+
+TEST(HistogramTest, bucketsArePowersOfTwo)
+{
+	Histogram histogram;
+	histogram.record(0);
+	histogram.record(1);
+	histogram.record(2);
+	histogram.record(3);
+	histogram.record(4);
+	histogram.record(1023);
+	histogram.record(1024);
+
+	uint64_t buckets[Histogram::kBuckets];
+	histogram.snapshot(buckets);
+	ASSERT_EQ(buckets[0], 2u);
+	ASSERT_EQ(buckets[1], 2u);
+	ASSERT_EQ(buckets[2], 1u);
+	ASSERT_EQ(buckets[9], 1u);
+	ASSERT_EQ(buckets[10], 1u);
+}
+
+TEST(HistogramTest, lastBucketCountsOverflow)
+{
+	Histogram histogram;
+	histogram.record(1ull << 40);
+
+	uint64_t buckets[Histogram::kBuckets];
+	histogram.snapshot(buckets);
+	ASSERT_EQ(buckets[Histogram::kBuckets - 1], 1u);
+}
+
+TEST(BridgeMetricsTest, startsEmpty)
+{
+	BridgeMetrics metrics;
+	can::BridgeMetricsSnapshot const snapshot = metrics.snapshot();
+	ASSERT_EQ(snapshot.frames_in, 0u);
+	ASSERT_EQ(snapshot.bytes_out, 0u);
+	ASSERT_EQ(snapshot.tokens_outstanding, 0u);
+	ASSERT_EQ(snapshot.last_error, static_cast<uint32_t>(BridgeError::kCount));
+	for (size_t i = 0; i < BridgeError::kCount; ++i) {
+		ASSERT_EQ(snapshot.errors[i], 0u);
+	}
+}
+
+TEST(BridgeMetricsTest, errorsAreCountedByCode)
+{
+	BridgeMetrics metrics;
+	metrics.error(BridgeError::kInvalidLength, 42);
+	metrics.error(BridgeError::kInvalidLength, 43);
+	metrics.error(BridgeError::kReadFailed, 5);
+
+	can::BridgeMetricsSnapshot const snapshot = metrics.snapshot();
+	ASSERT_EQ(snapshot.errors[BridgeError::kInvalidLength], 2u);
+	ASSERT_EQ(snapshot.errors[BridgeError::kReadFailed], 1u);
+	ASSERT_EQ(snapshot.errors[BridgeError::kWriteFailed], 0u);
+	ASSERT_EQ(snapshot.last_error, static_cast<uint32_t>(BridgeError::kReadFailed));
+	ASSERT_EQ(snapshot.last_error_detail, 5u);
+}
+
+TEST(BridgeMetricsTest, recordMaxKeepsLargest)
+{
+	BridgeMetrics metrics;
+	BridgeMetrics::record_max(metrics.recv_latency_max, 10);
+	BridgeMetrics::record_max(metrics.recv_latency_max, 30);
+	BridgeMetrics::record_max(metrics.recv_latency_max, 20);
+	ASSERT_EQ(metrics.snapshot().recv_latency_max, 30u);
+}
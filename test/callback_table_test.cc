@@ -0,0 +1,95 @@
+#include <boost/bind.hpp>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/callback_table.h>
+
+using namespace testing;
+
+class CallbackTableTest : public ::testing::Test
+{
+public:
+	virtual void SetUp(void)
+	{
+		pool_ = new can::FramePool(4);
+		called1_ = 0;
+		called2_ = 0;
+		calledAll_ = 0;
+	}
+
+	virtual void TearDown(void)
+	{
+		delete pool_;
+	}
+
+	can::FramePtr frame(uint32_t id)
+	{
+		can::CANFrame frame = can::CANFrame();
+		frame.id = id;
+		return pool_->allocate(frame);
+	}
+
+	void callback1(can::FramePtr const &) { ++called1_; }
+	void callback2(can::FramePtr const &) { ++called2_; }
+	void callbackAll(can::FramePtr const &) { ++calledAll_; }
+
+	can::CallbackTable table_;
+	can::FramePool *pool_;
+	int called1_, called2_, calledAll_;
+};
+
+TEST_F(CallbackTableTest, exactMatchInvoked)
+{
+	table_.attach(0x01, can::CallbackTable::kExactMask,
+	              boost::bind(&CallbackTableTest::callback1, this, _1));
+
+	table_.dispatch(frame(0x01));
+	table_.dispatch(frame(0x02));
+
+	ASSERT_EQ(called1_, 1);
+}
+
+TEST_F(CallbackTableTest, maskedMatchInvoked)
+{
+	table_.attach(0x100, 0xF00, boost::bind(&CallbackTableTest::callback1, this, _1));
+
+	table_.dispatch(frame(0x123));
+	table_.dispatch(frame(0x223));
+
+	ASSERT_EQ(called1_, 1);
+}
+
+TEST_F(CallbackTableTest, exactAndMaskedFanOut)
+{
+	table_.attach(0x01, can::CallbackTable::kExactMask,
+	              boost::bind(&CallbackTableTest::callback1, this, _1));
+	table_.attach(0, 0, boost::bind(&CallbackTableTest::callbackAll, this, _1));
+
+	table_.dispatch(frame(0x01));
+	table_.dispatch(frame(0x02));
+
+	ASSERT_EQ(called1_, 1);
+	ASSERT_EQ(calledAll_, 2);
+}
+
+TEST_F(CallbackTableTest, duplicateSubscriptionsShareSignal)
+{
+	table_.attach(0x100, 0xF00, boost::bind(&CallbackTableTest::callback1, this, _1));
+	table_.attach(0x100, 0xF00, boost::bind(&CallbackTableTest::callback2, this, _1));
+
+	table_.dispatch(frame(0x101));
+
+	ASSERT_EQ(table_.subscriptions().size(), 1u);
+	ASSERT_EQ(called1_, 1);
+	ASSERT_EQ(called2_, 1);
+}
+
+TEST_F(CallbackTableTest, disconnectedCallbackNotInvoked)
+{
+	can::CallbackToken token = table_.attach(0x01, can::CallbackTable::kExactMask,
+	    boost::bind(&CallbackTableTest::callback1, this, _1));
+	token.disconnect();
+
+	table_.dispatch(frame(0x01));
+
+	ASSERT_EQ(called1_, 0);
+}
@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/can_log.h>
+#include <jaguar/jaguar.h>
+#include <jaguar/jaguar_bridge.h>
+#include <jaguar/jaguar_simulator.h>
+#include <jaguar/replay_bridge.h>
+
+using namespace testing;
+
+static uint8_t const kDevice = 1;
+
+class CANLogTest : public ::testing::Test
+{
+public:
+	virtual void SetUp(void)
+	{
+		char path[] = "/tmp/jaguar_can_log_XXXXXX";
+		int const fd = mkstemp(path);
+		ASSERT_GE(fd, 0);
+		close(fd);
+		unlink(path);
+		path_ = path;
+	}
+
+	virtual void TearDown(void)
+	{
+		unlink(path_.c_str());
+	}
+
+	// Drives one device through a short session: a few commands, then a
+	// burst of periodic odometry.
+	std::vector<double> session(can::CANBridge &bridge)
+	{
+		std::vector<double> positions;
+		jaguar::Jaguar jaguar(bridge, kDevice);
+		jaguar.ack_timeout_set(boost::posix_time::milliseconds(200));
+
+		acknowledged(jaguar.speed_enable());
+		acknowledged(jaguar.speed_set(600.0));
+		acknowledged(jaguar.periodic_config_odom(0,
+			boost::bind(&CANLogTest::odom_callback, this, &positions, _1)));
+		acknowledged(jaguar.periodic_enable(0, 5));
+		usleep(100000);
+		acknowledged(jaguar.periodic_disable(0));
+		return positions;
+	}
+
+	void acknowledged(can::TokenPtr token)
+	{
+		token->block();
+		ASSERT_FALSE(token->timed_out());
+	}
+
+	void odom_callback(std::vector<double> *positions, double position)
+	{
+		positions->push_back(position);
+	}
+
+	std::string path_;
+};
+
+TEST_F(CANLogTest, recordsBothDirections)
+{
+	std::vector<uint8_t> const devices(1, kDevice);
+	jaguar::JaguarSimulator sim(devices);
+	can::JaguarBridge bridge(sim.port());
+	{
+		can::CANRecorder recorder(bridge, path_);
+		session(bridge);
+	}
+
+	can::CANLog log(path_);
+	size_t sent = 0, received = 0;
+	for (can::CANLogRecord const *it = log.begin(); it != log.end(); ++it) {
+		if (it->direction == can::CANLogRecord::kSent) {
+			++sent;
+		} else {
+			++received;
+		}
+	}
+	ASSERT_EQ(sent, 5u);
+	ASSERT_GT(received, 5u);
+	ASSERT_EQ(log[0].direction, can::CANLogRecord::kSent);
+}
+
+TEST_F(CANLogTest, appendsToExistingLog)
+{
+	std::vector<uint8_t> const devices(1, kDevice);
+	jaguar::JaguarSimulator sim(devices);
+	can::JaguarBridge bridge(sim.port());
+	jaguar::Jaguar jaguar(bridge, kDevice);
+
+	for (size_t i = 0; i < 2; ++i) {
+		can::CANRecorder recorder(bridge, path_);
+		acknowledged(jaguar.speed_enable());
+	}
+
+	can::CANLog log(path_);
+	ASSERT_EQ(log.size(), 4u);
+}
+
+TEST_F(CANLogTest, rejectsForeignFile)
+{
+	FILE *file = fopen(path_.c_str(), "wb");
+	fputs("definitely not a CAN log", file);
+	fclose(file);
+
+	ASSERT_THROW(can::CANLog log(path_), can::CANException);
+
+	std::vector<uint8_t> const devices(1, kDevice);
+	jaguar::JaguarSimulator sim(devices);
+	can::JaguarBridge bridge(sim.port());
+	ASSERT_THROW(can::CANRecorder recorder(bridge, path_), can::CANException);
+}
+
+TEST_F(CANLogTest, replayReproducesSession)
+{
+	std::vector<double> recorded;
+	{
+		std::vector<uint8_t> const devices(1, kDevice);
+		jaguar::JaguarSimulator sim(devices);
+		can::JaguarBridge bridge(sim.port());
+		can::CANRecorder recorder(bridge, path_);
+		recorded = session(bridge);
+	}
+	ASSERT_GT(recorded.size(), 5u);
+
+	// As fast as possible, held in lockstep with the commands we send.
+	can::ReplayBridge replay(path_, 0.0);
+	replay.play();
+	std::vector<double> const replayed = session(replay);
+	replay.wait();
+
+	ASSERT_EQ(replay.frames_sent(), 5u);
+	ASSERT_THAT(replayed, ContainerEq(recorded));
+}
+
+TEST_F(CANLogTest, replayKeepsRecordedPace)
+{
+	{
+		std::vector<uint8_t> const devices(1, kDevice);
+		jaguar::JaguarSimulator sim(devices);
+		can::JaguarBridge bridge(sim.port());
+		can::CANRecorder recorder(bridge, path_);
+		session(bridge);
+	}
+
+	can::CANLog log(path_);
+	can::Timestamp const duration = log[log.size() - 1].timestamp - log[0].timestamp;
+
+	can::ReplayBridge replay(path_, 2.0, false);
+	can::Timestamp const begin = can::monotonic_now();
+	replay.play();
+	replay.wait();
+	can::Timestamp const elapsed = can::monotonic_now() - begin;
+
+	ASSERT_EQ(replay.frames_replayed() + 5u, log.size());
+	ASSERT_GT(elapsed, duration / 2 * 9 / 10);
+	ASSERT_LT(elapsed, duration);
+}
+
+TEST_F(CANLogTest, replayContinuesAfterDivergence)
+{
+	{
+		std::vector<uint8_t> const devices(1, kDevice);
+		jaguar::JaguarSimulator sim(devices);
+		can::JaguarBridge bridge(sim.port());
+		can::CANRecorder recorder(bridge, path_);
+		session(bridge);
+	}
+	can::CANLog log(path_);
+
+	// Nothing is sent back, so lockstep gives up once and does not wait
+	// again for each of the other recorded commands.
+	can::ReplayBridge replay(path_, 0.0);
+	can::Timestamp const begin = can::monotonic_now();
+	replay.play();
+	replay.wait();
+	can::Timestamp const elapsed = can::monotonic_now() - begin;
+
+	ASSERT_EQ(replay.frames_replayed() + 5u, log.size());
+	ASSERT_LT(elapsed, 2000000000u);
+}
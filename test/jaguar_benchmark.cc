@@ -0,0 +1,433 @@
+/*
+ * Throughput and latency benchmarks for the serial bridge. Every measurement
+ * is printed to stdout as one JSON object per line, so runs can be collected
+ * and compared for regressions. Pass a substring to run only the benchmarks
+ * whose names contain it, e.g. "./benchmark codec".
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <jaguar/callback_table.h>
+#include <jaguar/jaguar.h>
+#include <jaguar/jaguar_bridge.h>
+#include <jaguar/jaguar_codec.h>
+#include <jaguar/jaguar_helper.h>
+#include <jaguar/jaguar_message.h>
+#include <jaguar/jaguar_simulator.h>
+#include <jaguar/status_decoder.h>
+
+using can::Timestamp;
+using can::monotonic_now;
+
+static std::string filter;
+
+static bool enabled(char const *name)
+{
+    return filter.empty() || std::string(name).find(filter) != std::string::npos;
+}
+
+static double seconds(Timestamp begin, Timestamp end)
+{
+    return (end - begin) * 1e-9;
+}
+
+static double percentile(std::vector<double> const &sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t const i = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[i];
+}
+
+// Messages with random identifiers and payloads. Roughly 1% of the bytes
+// need escaping, as with real traffic.
+static std::vector<can::CANMessage> random_messages(size_t count)
+{
+    boost::random::mt19937 random(42);
+    boost::random::uniform_int_distribution<uint32_t> id(0, 0x1FFFFFFF);
+    boost::random::uniform_int_distribution<int> byte(0, 0xFF);
+    boost::random::uniform_int_distribution<int> dlc(0, 8);
+
+    std::vector<can::CANMessage> messages;
+    messages.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        can::CANMessage message(id(random));
+        message.payload.resize(dlc(random));
+        for (size_t j = 0; j < message.payload.size(); ++j) {
+            message.payload[j] = byte(random);
+        }
+        messages.push_back(message);
+    }
+    return messages;
+}
+
+/*
+ * Raw codec throughput, with no I/O.
+ */
+class FrameCounter : public can::JaguarCodec::Handler
+{
+public:
+    FrameCounter(void) : frames(0), errors(0) {}
+    virtual void frame_decoded(can::CANFrame const &, size_t) { ++frames; }
+    virtual void decode_error(can::JaguarCodec::Status, uint8_t) { ++errors; }
+
+    size_t frames;
+    size_t errors;
+};
+
+static void bench_codec(void)
+{
+    size_t const kMessages = 200000;
+    std::vector<can::CANMessage> const messages = random_messages(kMessages);
+    std::vector<uint8_t> encoded(kMessages * can::JaguarCodec::kMaxEncodedLength);
+
+    Timestamp const encode_begin = monotonic_now();
+    size_t length = 0;
+    for (size_t i = 0; i < kMessages; ++i) {
+        length += can::JaguarCodec::encode_message(messages[i], &encoded[length]);
+    }
+    Timestamp const encode_end = monotonic_now();
+
+    printf("{\"benchmark\": \"codec_encode\", \"frames\": %zu, \"bytes\": %zu, "
+           "\"frames_per_sec\": %.0f, \"ns_per_byte\": %.3f}\n",
+           kMessages, length,
+           kMessages / seconds(encode_begin, encode_end),
+           (encode_end - encode_begin) / static_cast<double>(length));
+
+    can::JaguarCodec codec;
+    can::CANFrame frame;
+    size_t frames = 0;
+
+    Timestamp const decode_begin = monotonic_now();
+    for (size_t i = 0; i < length; ++i) {
+        if (codec.decode(encoded[i], frame) == can::JaguarCodec::kFrameComplete) {
+            ++frames;
+        }
+    }
+    Timestamp const decode_end = monotonic_now();
+
+    printf("{\"benchmark\": \"codec_decode\", \"frames\": %zu, \"bytes\": %zu, "
+           "\"frames_per_sec\": %.0f, \"ns_per_byte\": %.3f}\n",
+           frames, length,
+           frames / seconds(decode_begin, decode_end),
+           (decode_end - decode_begin) / static_cast<double>(length));
+
+    // Bulk decoder, fed in reads the size of JaguarBridge's receive buffer.
+    size_t const kReadLength = 1024;
+    can::JaguarCodec bulk;
+    FrameCounter counter;
+
+    Timestamp const bulk_begin = monotonic_now();
+    for (size_t i = 0; i < length; i += kReadLength) {
+        size_t const count = std::min(kReadLength, length - i);
+        bulk.decode(&encoded[i], &encoded[i] + count, counter);
+    }
+    Timestamp const bulk_end = monotonic_now();
+
+    printf("{\"benchmark\": \"codec_decode_bulk\", \"frames\": %zu, \"bytes\": %zu, "
+           "\"frames_per_sec\": %.0f, \"ns_per_byte\": %.3f}\n",
+           counter.frames, length,
+           counter.frames / seconds(bulk_begin, bulk_end),
+           (bulk_end - bulk_begin) / static_cast<double>(length));
+}
+
+/*
+ * Cost of building one speed_set() command, the way Jaguar used to with
+ * Spirit karma and with the compile-time descriptors that replaced it.
+ */
+static can::CANMessage karma_speed_set(uint8_t device, double speed)
+{
+    using namespace jaguar;
+
+    uint32_t const id = pack_id(device, Manufacturer::kTexasInstruments,
+        DeviceType::kMotorController, APIClass::kSpeedControl, SpeedControl::kSpeedSet);
+    can::CANMessage msg(id);
+
+    std::back_insert_iterator<std::vector<uint8_t> > payload(msg.payload);
+    boost::spirit::karma::generate(payload, boost::spirit::little_dword(double_to_s16p16(speed)));
+    return msg;
+}
+
+static void bench_command_encode(void)
+{
+    size_t const kCommands = 1000000;
+    uint32_t checksum = 0;
+
+    Timestamp const karma_begin = monotonic_now();
+    for (size_t i = 0; i < kCommands; ++i) {
+        can::CANMessage const msg = karma_speed_set(1, i * 1e-3);
+        checksum += msg.id + msg.payload[0];
+    }
+    Timestamp const karma_end = monotonic_now();
+
+    Timestamp const frame_begin = monotonic_now();
+    for (size_t i = 0; i < kCommands; ++i) {
+        can::CANFrame const frame = jaguar::message::SpeedSet::pack(1, i * 1e-3);
+        checksum += frame.id + frame.data[0];
+    }
+    Timestamp const frame_end = monotonic_now();
+
+    // What Jaguar::speed_set() pays today: the bridge still takes a
+    // CANMessage, so the frame is copied into one.
+    Timestamp const message_begin = monotonic_now();
+    for (size_t i = 0; i < kCommands; ++i) {
+        can::CANMessage const msg(jaguar::message::SpeedSet::pack(1, i * 1e-3));
+        checksum += msg.id + msg.payload[0];
+    }
+    Timestamp const message_end = monotonic_now();
+
+    printf("{\"benchmark\": \"command_encode\", \"commands\": %zu, "
+           "\"karma_ns\": %.1f, \"descriptor_ns\": %.1f, "
+           "\"descriptor_message_ns\": %.1f, \"checksum\": %u}\n",
+           kCommands,
+           (karma_end - karma_begin) / static_cast<double>(kCommands),
+           (frame_end - frame_begin) / static_cast<double>(kCommands),
+           (message_end - message_begin) / static_cast<double>(kCommands),
+           checksum);
+}
+
+static void accumulate(double *sum, double value)
+{
+    *sum += value;
+}
+
+static void accumulate_sample(double *sum, jaguar::StatusSample const &sample)
+{
+    *sum += sample.position + sample.speed;
+}
+
+/*
+ * Decoding an odometry-sized periodic status message: the Status chain that
+ * Jaguar::periodic_config() used to walk, then the compiled StatusPlan.
+ */
+static void bench_status_decode(void)
+{
+    using namespace jaguar::PeriodicStatus;
+    size_t const kFrames = 1000000;
+    uint8_t const data[] = { 0x00, 0x80, 0x01, 0x00, 0x00, 0x40, 0xFF, 0xFF };
+    double sum = 0;
+
+    jaguar::AggregateStatus const statuses
+        = Position(boost::bind(&accumulate, &sum, _1))
+       << Speed(boost::bind(&accumulate, &sum, _1));
+    Timestamp const chain_begin = monotonic_now();
+    for (size_t i = 0; i < kFrames; ++i) {
+        // Bound by value, as the old frame callback did.
+        jaguar::AggregateStatus copy(statuses);
+        copy.read(data, data + sizeof data);
+    }
+    Timestamp const chain_end = monotonic_now();
+
+    jaguar::StatusPlan const plan(statuses);
+    boost::function<void (jaguar::StatusSample const &)> const callback
+        = boost::bind(&accumulate_sample, &sum, _1);
+    Timestamp const plan_begin = monotonic_now();
+    for (size_t i = 0; i < kFrames; ++i) {
+        jaguar::StatusSample sample;
+        plan.decode(data, sizeof data, sample);
+        callback(sample);
+    }
+    Timestamp const plan_end = monotonic_now();
+
+    printf("{\"benchmark\": \"status_decode\", \"frames\": %zu, "
+           "\"status_chain_ns\": %.1f, \"plan_ns\": %.1f, \"checksum\": %.1f}\n",
+           kFrames,
+           (chain_end - chain_begin) / static_cast<double>(kFrames),
+           (plan_end - plan_begin) / static_cast<double>(kFrames),
+           sum);
+}
+
+/*
+ * Request to acknowledgement round trip through JaguarBridge and the
+ * simulator, at the real line rate and with an unthrottled link.
+ */
+static void bench_ack_latency(unsigned baud_rate)
+{
+    size_t const kRequests = 2000;
+
+    jaguar::SimulatorSettings settings;
+    settings.baud_rate = baud_rate;
+
+    std::vector<uint8_t> devices(1, 1);
+    jaguar::JaguarSimulator simulator(devices, settings);
+    can::JaguarBridge bridge(simulator.port());
+    jaguar::Jaguar jaguar(bridge, 1);
+    jaguar.ack_timeout_set(boost::posix_time::milliseconds(100));
+    jaguar.speed_enable()->block();
+
+    std::vector<double> latencies;
+    latencies.reserve(kRequests);
+    size_t timeouts = 0;
+
+    for (size_t i = 0; i < kRequests; ++i) {
+        Timestamp const begin = monotonic_now();
+        can::TokenPtr token = jaguar.speed_set(static_cast<double>(i % 100));
+        token->block();
+        if (token->timed_out()) {
+            ++timeouts;
+            continue;
+        }
+        latencies.push_back((monotonic_now() - begin) * 1e-3);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("{\"benchmark\": \"ack_latency\", \"baud_rate\": %u, \"requests\": %zu, "
+           "\"timeouts\": %zu, \"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, "
+           "\"max_us\": %.1f}\n",
+           baud_rate, kRequests, timeouts,
+           percentile(latencies, 0.50), percentile(latencies, 0.99),
+           percentile(latencies, 0.999),
+           latencies.empty() ? 0.0 : latencies.back());
+}
+
+/*
+ * Periodic status ingest with every device reporting odometry each tick.
+ */
+static void count_odom(boost::detail::atomic_count *count, double, double)
+{
+    ++*count;
+}
+
+static void bench_periodic_ingest(size_t num_devices)
+{
+    unsigned const kDurationMs = 1000;
+
+    jaguar::SimulatorSettings settings;
+    settings.baud_rate = 0;
+
+    std::vector<uint8_t> devices;
+    for (size_t i = 0; i < num_devices; ++i) {
+        devices.push_back(i + 1);
+    }
+    jaguar::JaguarSimulator simulator(devices, settings);
+    can::JaguarBridge bridge(simulator.port());
+
+    boost::detail::atomic_count received(0);
+    std::vector<boost::shared_ptr<jaguar::Jaguar> > jaguars;
+    for (size_t i = 0; i < num_devices; ++i) {
+        boost::shared_ptr<jaguar::Jaguar> jaguar(new jaguar::Jaguar(bridge, devices[i]));
+        jaguar->periodic_config_odom(0, boost::bind(&count_odom, &received, _1, _2))->block();
+        jaguars.push_back(jaguar);
+    }
+
+    long const before = received;
+    Timestamp const begin = monotonic_now();
+    for (size_t i = 0; i < num_devices; ++i) {
+        jaguars[i]->periodic_enable(0, 1)->block();
+    }
+    usleep(kDurationMs * 1000);
+    long const after = received;
+    Timestamp const end = monotonic_now();
+
+    for (size_t i = 0; i < num_devices; ++i) {
+        jaguars[i]->periodic_disable(0)->block();
+    }
+
+    printf("{\"benchmark\": \"periodic_ingest\", \"devices\": %zu, \"period_ms\": 1, "
+           "\"frames\": %ld, \"frames_per_sec\": %.0f}\n",
+           num_devices, after - before, (after - before) / seconds(begin, end));
+}
+
+/*
+ * Cost of CallbackTable::dispatch(), both for looking up one id among many
+ * subscriptions and for fanning one frame out to many callbacks.
+ */
+static void count_frame(size_t *count, can::FramePtr const &)
+{
+    ++*count;
+}
+
+static void bench_callback_fanout(size_t subscriptions)
+{
+    size_t const kFrames = 200000;
+    can::FramePool pool(16);
+
+    can::CallbackTable lookup;
+    can::CallbackTable fanout;
+    size_t called = 0;
+    for (size_t i = 0; i < subscriptions; ++i) {
+        lookup.attach(i, can::CallbackTable::kExactMask, boost::bind(&count_frame, &called, _1));
+        fanout.attach(0, can::CallbackTable::kExactMask, boost::bind(&count_frame, &called, _1));
+    }
+
+    can::CANFrame frame = can::CANFrame();
+    std::vector<can::FramePtr> frames;
+    for (size_t i = 0; i < 8; ++i) {
+        frame.id = (i * 7919) % subscriptions;
+        frames.push_back(pool.allocate(frame));
+    }
+
+    Timestamp const lookup_begin = monotonic_now();
+    for (size_t i = 0; i < kFrames; ++i) {
+        lookup.dispatch(frames[i % frames.size()]);
+    }
+    Timestamp const lookup_end = monotonic_now();
+
+    frame.id = 0;
+    can::FramePtr const zero = pool.allocate(frame);
+
+    called = 0;
+    Timestamp const fanout_begin = monotonic_now();
+    for (size_t i = 0; i < kFrames; ++i) {
+        fanout.dispatch(zero);
+    }
+    Timestamp const fanout_end = monotonic_now();
+
+    printf("{\"benchmark\": \"callback_lookup\", \"subscriptions\": %zu, "
+           "\"ns_per_frame\": %.1f}\n",
+           subscriptions, (lookup_end - lookup_begin) / static_cast<double>(kFrames));
+    printf("{\"benchmark\": \"callback_fanout\", \"subscriptions\": %zu, "
+           "\"ns_per_frame\": %.1f, \"ns_per_callback\": %.2f}\n",
+           subscriptions, (fanout_end - fanout_begin) / static_cast<double>(kFrames),
+           (fanout_end - fanout_begin) / static_cast<double>(called));
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1) {
+        filter = argv[1];
+    }
+
+    if (enabled("codec")) {
+        bench_codec();
+    }
+
+    if (enabled("command_encode")) {
+        bench_command_encode();
+    }
+
+    if (enabled("status_decode")) {
+        bench_status_decode();
+    }
+
+    if (enabled("ack_latency")) {
+        bench_ack_latency(115200);
+        bench_ack_latency(0);
+    }
+
+    if (enabled("periodic_ingest")) {
+        size_t const counts[] = { 1, 2, 4, 8, 16 };
+        for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+            bench_periodic_ingest(counts[i]);
+        }
+    }
+
+    if (enabled("callback")) {
+        size_t const counts[] = { 1, 10, 100, 1000 };
+        for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+            bench_callback_fanout(counts[i]);
+        }
+    }
+    return 0;
+}
+
+/* vim: set et ts=4 sts=4 sw=4: */
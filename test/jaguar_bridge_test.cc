@@ -1,6 +1,8 @@
+#include <cstdlib>
+#include <fcntl.h>
 #include <iostream>
 #include <string>
-#include <fstream>
+#include <unistd.h>
 #include <boost/assign/list_of.hpp>
 #include <boost/shared_ptr.hpp>
 #include <gmock/gmock.h>
@@ -10,8 +12,6 @@
 using namespace testing;
 using boost::assign::list_of;
 
-static std::string const kPathReal = "/dev/ttys002";
-static std::string const kPathTest = "/dev/ttys003";
 static std::vector<uint8_t> const kEmptyPayload(0);
 
 class JaguarBridgeTest : public ::testing::Test
@@ -19,26 +19,44 @@ class JaguarBridgeTest : public ::testing::Test
 public:
 	virtual void SetUp(void)
 	{
-		stream_.open(kPathTest.c_str(), std::ios::in  | std::ios::ate
-		                              | std::ios::out | std::ios::app
-		                              | std::ios::binary);
-		bridge_ = new can::JaguarBridge(kPathReal);
+		// The bridge talks to the slave side of a pseudo-terminal, so the
+		// test can play the part of the Jaguar on the master side.
+		master_ = posix_openpt(O_RDWR | O_NOCTTY);
+		ASSERT_GE(master_, 0);
+		ASSERT_EQ(grantpt(master_), 0);
+		ASSERT_EQ(unlockpt(master_), 0);
+		bridge_ = new can::JaguarBridge(ptsname(master_));
 
 		called1a_ = 0;
 		called1b_ = 0;
 		called2_  = 0;
+		completed_ = 0;
+		errors_ = 0;
+		bridge_->attach_callback(boost::bind(&JaguarBridgeTest::callbackError, this, _1, _2, _3, _4));
 	}
 
 	virtual void TearDown(void)
 	{
 		delete bridge_;
-		stream_.close();
+		close(master_);
 	}
 
 	void write(char const *data, size_t length)
 	{
-		stream_.write(data, length);
-		stream_.flush();
+		ASSERT_EQ(::write(master_, data, length), static_cast<ssize_t>(length));
+	}
+
+	bool read(std::vector<char> &data)
+	{
+		size_t offset = 0;
+		while (offset < data.size()) {
+			ssize_t const count = ::read(master_, &data[offset], data.size() - offset);
+			if (count <= 0) {
+				return false;
+			}
+			offset += count;
+		}
+		return true;
 	}
 
 	void delay(void)
@@ -67,8 +85,31 @@ public:
 		ASSERT_THAT(msg->payload, ElementsAre(0x02, 0x02));
 	}
 
+	void callbackStamp(can::FramePtr const &frame)
+	{
+		stamps_.push_back(frame->timestamp);
+	}
+
+	void callbackError(char const *, char const *, unsigned, std::string const &msg)
+	{
+		++errors_;
+		error_ = msg;
+	}
+
+	void callbackComplete(can::Token &token)
+	{
+		++completed_;
+		completed_thread_ = boost::this_thread::get_id();
+		ASSERT_TRUE(token.ready());
+	}
+
 	can::JaguarBridge *bridge_;
-	std::fstream stream_;
+	boost::thread::id completed_thread_;
+	int completed_;
+	int errors_;
+	std::string error_;
+	std::vector<can::Timestamp> stamps_;
+	int master_;
 	int called1a_, called1b_, called2_;
 };
 
@@ -76,10 +117,9 @@ TEST_F(JaguarBridgeTest, sendIncludesSOF)
 {
 	bridge_->send(can::CANMessage(0x00000000, kEmptyPayload));
 
-	char sof;
-	stream_.get(sof);
-	ASSERT_EQ(sof, '\xFF');
-	ASSERT_TRUE(stream_.good());
+	std::vector<char> sof(1);
+	ASSERT_TRUE(read(sof));
+	ASSERT_EQ(sof[0], '\xFF');
 }
 
 TEST_F(JaguarBridgeTest, sendIncludesIdentifier)
@@ -87,11 +127,10 @@ TEST_F(JaguarBridgeTest, sendIncludesIdentifier)
 	bridge_->send(can::CANMessage(0x11223344, kEmptyPayload));
 
 	std::vector<char> packet(6);
-	stream_.read(&packet[0], packet.size());
+	ASSERT_TRUE(read(packet));
 
 	char const *expected = "\xFF\x04\x44\x33\x22\x11";
 	ASSERT_THAT(packet, ElementsAreArray(expected, packet.size()));
-	ASSERT_TRUE(stream_.good());
 }
 
 TEST_F(JaguarBridgeTest, sendIncludesPayload)
@@ -100,11 +139,10 @@ TEST_F(JaguarBridgeTest, sendIncludesPayload)
 	bridge_->send(can::CANMessage(0x00000000, payload));
 
 	std::vector<char> packet(8);
-	stream_.read(&packet[0], packet.size());
+	ASSERT_TRUE(read(packet));
 
 	char const *expected = "\xFF\x06\x00\x00\x00\x00\x11\x22";
 	ASSERT_THAT(packet, ElementsAreArray(expected, packet.size()));
-	ASSERT_TRUE(stream_.good());
 
 }
 
@@ -113,10 +151,9 @@ TEST_F(JaguarBridgeTest, sendEscapesSOF)
 	bridge_->send(can::CANMessage(0x000000FF, kEmptyPayload));
 
 	std::vector<char> packet(7);
-	stream_.read(&packet[0], packet.size());
+	ASSERT_TRUE(read(packet));
 	char const *expected = "\xFF\x04\xFE\xFE\x00\x00";
 	ASSERT_THAT(packet, ElementsAreArray(expected, packet.size()));
-	ASSERT_TRUE(stream_.good());
 }
 
 TEST_F(JaguarBridgeTest, sendEscapesESC)
@@ -124,11 +161,134 @@ TEST_F(JaguarBridgeTest, sendEscapesESC)
 	bridge_->send(can::CANMessage(0x000000FE, kEmptyPayload));
 
 	std::vector<char> packet(7);
-	stream_.read(&packet[0], packet.size());
+	ASSERT_TRUE(read(packet));
 
 	char const *expected = "\xFF\x04\xFE\xFD\x00\x00";
 	ASSERT_THAT(packet, ElementsAreArray(expected, packet.size()));
-	ASSERT_TRUE(stream_.good());
+}
+
+TEST_F(JaguarBridgeTest, sendBatchCoalescesMessages)
+{
+	std::vector<uint8_t> payload = list_of(0x11)(0x22);
+	can::CANMessage const messages[] = {
+		can::CANMessage(0x00000001, kEmptyPayload),
+		can::CANMessage(0x00000002, payload)
+	};
+	bridge_->send_batch(messages, messages + 2);
+
+	std::vector<char> packet(14);
+	ASSERT_TRUE(read(packet));
+
+	char const *expected = "\xFF\x04\x01\x00\x00\x00"
+	                       "\xFF\x06\x02\x00\x00\x00\x11\x22";
+	ASSERT_THAT(packet, ElementsAreArray(expected, packet.size()));
+}
+
+TEST_F(JaguarBridgeTest, sendHeartbeatOvertakesConfigBacklog)
+{
+	size_t const kBacklog = 20;
+	uint32_t const kConfigId = 0x02021C01;
+	uint32_t const kHeartbeatId = 0x00000140;
+
+	std::vector<can::CANMessage> config(kBacklog, can::CANMessage(kConfigId, kEmptyPayload));
+	bridge_->send_batch(&config[0], &config[0] + config.size());
+	bridge_->send(can::CANMessage(kHeartbeatId, kEmptyPayload));
+
+	std::vector<char> packets(6 * (kBacklog + 1));
+	ASSERT_TRUE(read(packets));
+
+	// Only the frames already released into the pacing window, plus any
+	// the pacing timer sends before the heartbeat is queued, may precede it.
+	size_t position = kBacklog + 1;
+	for (size_t i = 0; i <= kBacklog; ++i) {
+		if (static_cast<uint8_t>(packets[6 * i + 2]) == (kHeartbeatId & 0xFF)) {
+			position = i;
+			break;
+		}
+	}
+	ASSERT_LT(position, kBacklog / 2);
+	ASSERT_EQ(bridge_->tx_stats(can::TxClass::kSystem).frames, 1u);
+	ASSERT_EQ(bridge_->tx_stats(can::TxClass::kConfig).max_depth, kBacklog);
+}
+
+TEST_F(JaguarBridgeTest, txClassFollowsMessageType)
+{
+	using can::JaguarBridge;
+	using can::TxClass;
+	ASSERT_EQ(JaguarBridge::tx_class(0x00000140), TxClass::kSystem);   // heartbeat
+	ASSERT_EQ(JaguarBridge::tx_class(0x00000000), TxClass::kSystem);   // halt
+	ASSERT_EQ(JaguarBridge::tx_class(0x00000180), TxClass::kSetpoint); // synchronous update
+	ASSERT_EQ(JaguarBridge::tx_class(0x02020081), TxClass::kSetpoint); // voltage set
+	ASSERT_EQ(JaguarBridge::tx_class(0x020206C1), TxClass::kSetpoint); // speed set, no ACK
+	ASSERT_EQ(JaguarBridge::tx_class(0x02021C01), TxClass::kConfig);
+	ASSERT_EQ(JaguarBridge::tx_class(0x1F000000), TxClass::kBulk);
+}
+
+TEST_F(JaguarBridgeTest, linkUsageCountsTraffic)
+{
+	std::vector<uint8_t> payload = list_of(0x11)(0x22);
+	bridge_->send(can::CANMessage(0x00000002, payload));
+	write("\xFF\x06\x01\x00\x00\x00\x01\x01", 8);
+
+	std::vector<char> packet(8);
+	ASSERT_TRUE(read(packet));
+
+	can::JaguarBridge::LinkUsage usage = bridge_->link_usage();
+	for (int i = 0; i < 100 && usage.rx_frames == 0; ++i) {
+		delay();
+		usage = bridge_->link_usage();
+	}
+	ASSERT_EQ(usage.tx_bytes, 8u);
+	ASSERT_EQ(usage.tx_frames, 1u);
+	ASSERT_EQ(usage.tx_payload, 2u);
+	ASSERT_EQ(usage.rx_bytes, 8u);
+	ASSERT_EQ(usage.rx_frames, 1u);
+	ASSERT_EQ(usage.rx_payload, 2u);
+}
+
+TEST_F(JaguarBridgeTest, metricsCountEscapes)
+{
+	bridge_->send(can::CANMessage(0x000000FF, kEmptyPayload));
+
+	std::vector<char> packet(7);
+	ASSERT_TRUE(read(packet));
+
+	can::BridgeMetricsSnapshot const metrics = bridge_->metrics();
+	ASSERT_EQ(metrics.frames_out, 1u);
+	ASSERT_EQ(metrics.bytes_out, 7u);
+	ASSERT_EQ(metrics.escape_bytes_out, 1u);
+}
+
+TEST_F(JaguarBridgeTest, metricsCountFramingErrors)
+{
+	write("\xFF\x02", 2);
+	for (int i = 0; i < 100 && errors_ == 0; ++i) {
+		delay();
+	}
+
+	can::BridgeMetricsSnapshot const metrics = bridge_->metrics();
+	ASSERT_EQ(errors_, 1);
+	ASSERT_EQ(error_, can::BridgeError::message(can::BridgeError::kInvalidLength));
+	ASSERT_EQ(metrics.errors[can::BridgeError::kInvalidLength], 1u);
+	ASSERT_EQ(metrics.last_error_detail, 2u);
+	ASSERT_GE(metrics.read_size[0] + metrics.read_size[1], 1u);
+}
+
+TEST_F(JaguarBridgeTest, metricsTrackTokens)
+{
+	can::TokenPtr pending = bridge_->recv(0x00000001);
+	can::TokenPtr expiring = bridge_->recv(0x00000002, boost::posix_time::milliseconds(5));
+	ASSERT_EQ(bridge_->metrics().tokens_outstanding, 2u);
+
+	write("\xFF\x06\x01\x00\x00\x00\x01\x01", 8);
+	pending->block();
+	expiring->block();
+
+	can::BridgeMetricsSnapshot const metrics = bridge_->metrics();
+	ASSERT_EQ(metrics.tokens_outstanding, 0u);
+	ASSERT_EQ(metrics.tokens_timed_out, 1u);
+	ASSERT_EQ(metrics.frames_in, 1u);
+	ASSERT_EQ(metrics.payload_in, 2u);
 }
 
 TEST_F(JaguarBridgeTest, attach_callbackMatchingCallbackInvoked)
@@ -216,3 +376,160 @@ TEST_F(JaguarBridgeTest, recvResetsTokenStatus)
 
 	ASSERT_TRUE(token2->ready());
 }
+
+TEST_F(JaguarBridgeTest, recvPipelinedTokensMatchedInOrder)
+{
+	char const *packet = "\xFF\x06\x01\x00\x00\x00\x01\x01";
+	can::TokenPtr token1 = bridge_->recv(0x00000001);
+	can::TokenPtr token2 = bridge_->recv(0x00000001);
+
+	write(packet, 8);
+	token1->block();
+
+	ASSERT_TRUE(token1->ready());
+	ASSERT_FALSE(token2->ready());
+
+	write(packet, 8);
+	token2->block();
+
+	ASSERT_TRUE(token2->ready());
+	ASSERT_FALSE(token2->timed_out());
+}
+
+TEST_F(JaguarBridgeTest, recvTokenTimesOut)
+{
+	can::TokenPtr token = bridge_->recv(0x00000001, boost::posix_time::milliseconds(10));
+	token->block();
+
+	ASSERT_TRUE(token->ready());
+	ASSERT_TRUE(token->timed_out());
+}
+
+TEST_F(JaguarBridgeTest, recvTokenCompletesWithoutBlocking)
+{
+	can::TokenPtr token = bridge_->recv(0x00000001);
+	token->on_complete(boost::bind(&JaguarBridgeTest::callbackComplete, this, _1));
+
+	write("\xFF\x06\x01\x00\x00\x00\x01\x01", 8);
+	for (int i = 0; i < 100 && completed_ == 0; ++i) {
+		delay();
+	}
+
+	// Completion runs on the bridge's I/O thread, not this one.
+	ASSERT_EQ(completed_, 1);
+	ASSERT_NE(completed_thread_, boost::this_thread::get_id());
+	ASSERT_FALSE(token->timed_out());
+}
+
+TEST_F(JaguarBridgeTest, recvTokenExpiresWithoutBlocking)
+{
+	can::TokenPtr token = bridge_->recv(0x00000001, boost::posix_time::milliseconds(1));
+	token->on_complete(boost::bind(&JaguarBridgeTest::callbackComplete, this, _1));
+	usleep(20000);
+
+	ASSERT_EQ(completed_, 1);
+	ASSERT_TRUE(token->timed_out());
+}
+
+TEST_F(JaguarBridgeTest, requestRetransmitsUntilAnswered)
+{
+	can::TokenPtr token = bridge_->request(can::CANMessage(0x00000002, kEmptyPayload),
+		0x00000001, boost::posix_time::milliseconds(10), 3);
+
+	// Original request and one retransmission, then the response.
+	std::vector<char> packets(12);
+	ASSERT_TRUE(read(packets));
+	write("\xFF\x06\x01\x00\x00\x00\x01\x01", 8);
+	token->block();
+
+	ASSERT_FALSE(token->timed_out());
+	ASSERT_EQ(errors_, 0);
+}
+
+TEST_F(JaguarBridgeTest, requestDropsDuplicateResponse)
+{
+	can::TokenPtr token1 = bridge_->request(can::CANMessage(0x00000002, kEmptyPayload),
+		0x00000001, boost::posix_time::milliseconds(20), 1);
+
+	// The first attempt is answered late, after the retry went out.
+	std::vector<char> packets(12);
+	ASSERT_TRUE(read(packets));
+	write("\xFF\x06\x01\x00\x00\x00\x01\x01", 8);
+	token1->block();
+	ASSERT_FALSE(token1->timed_out());
+
+	// The answer to the retry must not complete the next request.
+	can::TokenPtr token2 = bridge_->request(can::CANMessage(0x00000002, kEmptyPayload),
+		0x00000001, boost::posix_time::milliseconds(20));
+	write("\xFF\x06\x01\x00\x00\x00\x01\x01", 8);
+	token2->block();
+
+	ASSERT_TRUE(token2->timed_out());
+}
+
+TEST_F(JaguarBridgeTest, requestRetransmitsOnlyWhenAlone)
+{
+	can::TokenPtr token1 = bridge_->request(can::CANMessage(0x00000002, kEmptyPayload),
+		0x00000001, boost::posix_time::milliseconds(5), 2);
+	can::TokenPtr token2 = bridge_->request(can::CANMessage(0x00000003, kEmptyPayload),
+		0x00000001, boost::posix_time::milliseconds(50));
+	token1->block();
+	token2->block();
+
+	// Neither request was sent again.
+	ASSERT_TRUE(token1->timed_out());
+	ASSERT_TRUE(token2->timed_out());
+	ASSERT_EQ(bridge_->metrics().frames_out, 2u);
+}
+
+TEST_F(JaguarBridgeTest, requestReportsFinalFailure)
+{
+	can::TokenPtr token = bridge_->request(can::CANMessage(0x00000002, kEmptyPayload),
+		0x00000001, boost::posix_time::milliseconds(5), 2);
+	token->block();
+
+	std::vector<char> packets(3 * 6);
+	ASSERT_TRUE(read(packets));
+	ASSERT_TRUE(token->timed_out());
+	ASSERT_EQ(errors_, 1);
+	ASSERT_EQ(error_, can::BridgeError::message(can::BridgeError::kRequestTimedOut));
+	ASSERT_EQ(bridge_->metrics().last_error_detail, 0x00000002u);
+}
+
+TEST_F(JaguarBridgeTest, requestTimeoutStartsWhenSent)
+{
+	uint32_t const kConfigId = 0x02021C01;
+	bridge_->tx_rate_limit_set(can::TxClass::kConfig, 5.0, 1);
+
+	// The second request waits 200 ms in the transmit queue, which must not
+	// count against its 50 ms timeout.
+	boost::posix_time::ptime const start = boost::posix_time::microsec_clock::universal_time();
+	can::TokenPtr token1 = bridge_->request(can::CANMessage(kConfigId, kEmptyPayload),
+		0x00000001, boost::posix_time::milliseconds(50));
+	can::TokenPtr token2 = bridge_->request(can::CANMessage(kConfigId, kEmptyPayload),
+		0x00000001, boost::posix_time::milliseconds(50));
+	token2->block();
+	boost::posix_time::time_duration const elapsed
+		= boost::posix_time::microsec_clock::universal_time() - start;
+
+	ASSERT_TRUE(token1->timed_out());
+	ASSERT_TRUE(token2->timed_out());
+	ASSERT_GE(elapsed, boost::posix_time::milliseconds(240));
+}
+
+TEST_F(JaguarBridgeTest, recvBackdatesFramesBySerialTime)
+{
+	bridge_->attach_frame_callback(0x00000001, boost::bind(&JaguarBridgeTest::callbackStamp, this, _1));
+
+	// Both frames arrive in one read. The first finished eight byte times
+	// (8 * 10 bits at 115200 baud) before the second.
+	can::Timestamp const before = can::monotonic_now();
+	write("\xFF\x06\x01\x00\x00\x00\x01\x01"
+	      "\xFF\x06\x01\x00\x00\x00\x01\x01", 16);
+	delay();
+
+	ASSERT_EQ(stamps_.size(), 2u);
+	ASSERT_EQ(stamps_[1] - stamps_[0], 8 * (10 * 1000000000ull / 115200));
+	ASSERT_LT(stamps_[1], can::monotonic_now());
+	ASSERT_GT(stamps_[0] + 16 * (10 * 1000000000ull / 115200), before);
+}
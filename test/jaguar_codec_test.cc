@@ -0,0 +1,212 @@
+#include <cstring>
+#include <vector>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/jaguar_codec.h>
+
+using namespace testing;
+
+// Everything a decoder reported, flattened so two runs can be compared.
+struct Event {
+	can::JaguarCodec::Status status;
+	uint32_t id;
+	uint8_t dlc;
+	uint8_t data[8];
+	uint8_t byte;
+
+	bool operator==(Event const &other) const
+	{
+		return status == other.status && id == other.id && dlc == other.dlc
+		    && memcmp(data, other.data, dlc) == 0 && byte == other.byte;
+	}
+};
+
+class EventRecorder : public can::JaguarCodec::Handler
+{
+public:
+	virtual void frame_decoded(can::CANFrame const &frame, size_t age)
+	{
+		Event event = Event();
+		event.status = can::JaguarCodec::kFrameComplete;
+		event.id  = frame.id;
+		event.dlc = frame.dlc;
+		memcpy(event.data, frame.data, frame.dlc);
+		events.push_back(event);
+		ages.push_back(age);
+	}
+
+	virtual void decode_error(can::JaguarCodec::Status status, uint8_t byte)
+	{
+		Event event = Event();
+		event.status = status;
+		// Only the length error identifies the offending byte.
+		event.byte = (status == can::JaguarCodec::kInvalidLength) ? byte : 0;
+		events.push_back(event);
+	}
+
+	std::vector<Event> events;
+	std::vector<size_t> ages;
+};
+
+class JaguarCodecTest : public ::testing::Test
+{
+public:
+	virtual void SetUp(void)
+	{
+		random_.seed(1234);
+	}
+
+	// Reference result: one byte at a time.
+	std::vector<Event> decode_bytewise(std::vector<uint8_t> const &stream)
+	{
+		can::JaguarCodec codec;
+		EventRecorder recorder;
+		can::CANFrame frame;
+
+		for (size_t i = 0; i < stream.size(); ++i) {
+			can::JaguarCodec::Status const status = codec.decode(stream[i], frame);
+			if (status == can::JaguarCodec::kFrameComplete) {
+				recorder.frame_decoded(frame, 0);
+			} else if (status == can::JaguarCodec::kInvalidLength) {
+				recorder.decode_error(status, codec.error_byte());
+			} else if (status == can::JaguarCodec::kInvalidEscape) {
+				recorder.decode_error(status, stream[i]);
+			}
+		}
+		return recorder.events;
+	}
+
+	// Bulk decoder, fed in randomly sized chunks like successive reads.
+	std::vector<Event> decode_bulk(std::vector<uint8_t> const &stream, size_t max_chunk)
+	{
+		boost::random::uniform_int_distribution<size_t> chunk(1, max_chunk);
+		can::JaguarCodec codec;
+		EventRecorder recorder;
+
+		size_t offset = 0;
+		while (offset < stream.size()) {
+			size_t const length = std::min(chunk(random_), stream.size() - offset);
+			codec.decode(&stream[offset], &stream[offset] + length, recorder);
+			offset += length;
+		}
+		return recorder.events;
+	}
+
+	void append_message(std::vector<uint8_t> &stream, uint32_t id, size_t dlc)
+	{
+		boost::random::uniform_int_distribution<int> byte(0, 0xFF);
+		can::CANMessage message(id);
+		for (size_t i = 0; i < dlc; ++i) {
+			message.payload.push_back(byte(random_));
+		}
+
+		uint8_t buffer[26];
+		size_t const length = can::JaguarCodec::encode_message(message, buffer);
+		stream.insert(stream.end(), buffer, buffer + length);
+	}
+
+	boost::random::mt19937 random_;
+};
+
+TEST_F(JaguarCodecTest, bulkDecodesValidStream)
+{
+	std::vector<uint8_t> stream;
+	for (size_t i = 0; i < 1000; ++i) {
+		append_message(stream, 0x00FF00FE + i, i % 9);
+	}
+
+	std::vector<Event> const expected = decode_bytewise(stream);
+	ASSERT_EQ(expected.size(), 1000u);
+	ASSERT_THAT(decode_bulk(stream, stream.size()), ContainerEq(expected));
+	ASSERT_THAT(decode_bulk(stream, 1), ContainerEq(expected));
+	ASSERT_THAT(decode_bulk(stream, 37), ContainerEq(expected));
+}
+
+TEST_F(JaguarCodecTest, bulkReportsInvalidLength)
+{
+	uint8_t const stream[] = { 0xFF, 0x02, 0x01, 0xFF, 0x0D, 0xFF, 0x04, 0x01, 0x02, 0x03, 0x04 };
+	EventRecorder recorder;
+	can::JaguarCodec codec;
+	codec.decode(stream, stream + sizeof(stream), recorder);
+
+	ASSERT_EQ(recorder.events.size(), 3u);
+	ASSERT_EQ(recorder.events[0].status, can::JaguarCodec::kInvalidLength);
+	ASSERT_EQ(recorder.events[0].byte, 0x02);
+	ASSERT_EQ(recorder.events[1].status, can::JaguarCodec::kInvalidLength);
+	ASSERT_EQ(recorder.events[1].byte, 0x0D);
+	ASSERT_EQ(recorder.events[2].status, can::JaguarCodec::kFrameComplete);
+	ASSERT_EQ(recorder.events[2].id, 0x04030201u);
+}
+
+TEST_F(JaguarCodecTest, bulkReportsInvalidEscape)
+{
+	uint8_t const stream[] = { 0xFF, 0x04, 0x01, 0xFE, 0x07, 0x03, 0x04 };
+	EventRecorder recorder;
+	can::JaguarCodec codec;
+	codec.decode(stream, stream + sizeof(stream), recorder);
+
+	ASSERT_EQ(recorder.events.size(), 1u);
+	ASSERT_EQ(recorder.events[0].status, can::JaguarCodec::kInvalidEscape);
+}
+
+TEST_F(JaguarCodecTest, bulkMatchesBytewiseOnCorruptStream)
+{
+	boost::random::uniform_int_distribution<int> action(0, 9);
+	boost::random::uniform_int_distribution<int> byte(0, 0xFF);
+	boost::random::uniform_int_distribution<int> special(0xFD, 0xFF);
+
+	// Valid messages interleaved with random noise that is biased towards
+	// the framing bytes, so every error path is exercised.
+	std::vector<uint8_t> stream;
+	for (size_t i = 0; i < 20000; ++i) {
+		switch (action(random_)) {
+		case 0:
+			stream.push_back(byte(random_));
+			break;
+		case 1:
+			stream.push_back(special(random_));
+			break;
+		case 2:
+			stream.push_back(0xFF);
+			stream.push_back(byte(random_) % 16);
+			break;
+		default:
+			append_message(stream, byte(random_) << 8 | byte(random_), i % 9);
+		}
+	}
+
+	std::vector<Event> const expected = decode_bytewise(stream);
+	ASSERT_THAT(decode_bulk(stream, stream.size()), ContainerEq(expected));
+	ASSERT_THAT(decode_bulk(stream, 3), ContainerEq(expected));
+	ASSERT_THAT(decode_bulk(stream, 300), ContainerEq(expected));
+	ASSERT_THAT(decode_bulk(stream, 1024), ContainerEq(expected));
+}
+
+TEST_F(JaguarCodecTest, bulkReportsFrameAge)
+{
+	// Two frames, the second of which has an escaped byte.
+	uint8_t const stream[] = { 0xFF, 0x04, 0x01, 0x02, 0x03, 0x04,
+	                           0xFF, 0x04, 0xFE, 0xFE, 0x02, 0x03, 0x04,
+	                           0x00, 0x00 };
+	EventRecorder recorder;
+	can::JaguarCodec codec;
+	codec.decode(stream, stream + sizeof(stream), recorder);
+
+	ASSERT_EQ(recorder.ages.size(), 2u);
+	ASSERT_EQ(recorder.ages[0], sizeof(stream));
+	ASSERT_EQ(recorder.ages[1], 7u + 2u);
+}
+
+TEST_F(JaguarCodecTest, bulkAgeSpansReads)
+{
+	uint8_t const stream[] = { 0xFF, 0x04, 0x01, 0x02, 0x03, 0x04, 0x00 };
+	EventRecorder recorder;
+	can::JaguarCodec codec;
+	codec.decode(stream, stream + 3, recorder);
+	codec.decode(stream + 3, stream + sizeof(stream), recorder);
+
+	ASSERT_EQ(recorder.ages.size(), 1u);
+	ASSERT_EQ(recorder.ages[0], sizeof(stream));
+}
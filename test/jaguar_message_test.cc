@@ -0,0 +1,76 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/jaguar_helper.h>
+#include <jaguar/jaguar_message.h>
+
+using namespace testing;
+using namespace jaguar;
+
+static std::vector<uint8_t> payload(can::CANFrame const &frame)
+{
+	return std::vector<uint8_t>(frame.data, frame.data + frame.dlc);
+}
+
+TEST(JaguarMessageTest, idMatchesPackId)
+{
+	can::CANFrame const frame = message::SpeedSet::pack(5, 0.0);
+	ASSERT_EQ(frame.id, pack_id(5, Manufacturer::kTexasInstruments, DeviceType::kMotorController,
+	                            APIClass::kSpeedControl, SpeedControl::kSpeedSet));
+}
+
+TEST(JaguarMessageTest, packAtOffsetsApiIndex)
+{
+	can::CANFrame const frame = message::PeriodicEnable::pack_at(3, 2, 50);
+	ASSERT_EQ(frame.id, pack_id(3, Manufacturer::kTexasInstruments, DeviceType::kMotorController,
+	                            APIClass::kPeriodicStatus, PeriodicStatus::kEnableMessage + 2));
+	ASSERT_THAT(payload(frame), ElementsAre(50, 0));
+}
+
+TEST(JaguarMessageTest, emptyPayload)
+{
+	can::CANFrame const frame = message::VoltageModeEnable::pack(1);
+	ASSERT_EQ(frame.dlc, 0);
+}
+
+TEST(JaguarMessageTest, fixedPointIsLittleEndian)
+{
+	ASSERT_THAT(payload(message::SpeedSet::pack(1, -1.5)), ElementsAre(0x00, 0x80, 0xFE, 0xFF));
+	ASSERT_THAT(payload(message::MaximumOutputVoltage::pack(1, 12.0)), ElementsAre(0x00, 0x0C));
+}
+
+TEST(JaguarMessageTest, fractionUsesFullScale)
+{
+	ASSERT_THAT(payload(message::VoltageSet::pack(1, 1.0)), ElementsAre(0xFF, 0x7F));
+	ASSERT_THAT(payload(message::VoltageSet::pack(1, -1.0)), ElementsAre(0x00, 0x80));
+	ASSERT_THAT(payload(message::VoltageSet::pack(1, 0.0)), ElementsAre(0x00, 0x00));
+}
+
+TEST(JaguarMessageTest, secondFieldFollowsFirst)
+{
+	can::CANFrame const frame = message::PositionSetGroup::pack(1, 1.0, 7);
+	ASSERT_THAT(payload(frame), ElementsAre(0x00, 0x00, 0x01, 0x00, 7));
+}
+
+TEST(JaguarMessageTest, shortLayoutIsTerminated)
+{
+	field::StatusLayout layout;
+	layout.items[0] = PeriodicStatusItem::kLimitNonClearing;
+	layout.items[1] = PeriodicStatusItem::kFaults;
+	layout.length = 2;
+
+	can::CANFrame const frame = message::PeriodicConfigure::pack(1, layout);
+	ASSERT_THAT(payload(frame), ElementsAre(PeriodicStatusItem::kLimitNonClearing,
+	                                        PeriodicStatusItem::kFaults,
+	                                        PeriodicStatusItem::kEndOfMessage));
+}
+
+TEST(JaguarMessageTest, fullLayoutIsNotTerminated)
+{
+	field::StatusLayout layout;
+	for (uint8_t i = 0; i < 8; ++i) {
+		layout.items[i] = PeriodicStatusItem::kPositionBase + i;
+	}
+	layout.length = 8;
+
+	ASSERT_EQ(message::PeriodicConfigure::pack(1, layout).dlc, 8);
+}
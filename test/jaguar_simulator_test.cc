@@ -0,0 +1,202 @@
+#include <cmath>
+#include <unistd.h>
+#include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/jaguar.h>
+#include <jaguar/jaguar_bridge.h>
+#include <jaguar/jaguar_broadcaster.h>
+#include <jaguar/jaguar_simulator.h>
+
+using namespace testing;
+using boost::assign::list_of;
+
+static uint8_t const kDevice = 1;
+
+class JaguarSimulatorTest : public ::testing::Test
+{
+public:
+	virtual void SetUp(void)
+	{
+		odom_called_ = 0;
+		odom_position_ = 0.0;
+		odom_speed_ = 0.0;
+	}
+
+	virtual void TearDown(void)
+	{
+		jaguar_.reset();
+		bridge_.reset();
+		sim_.reset();
+	}
+
+	void start(jaguar::SimulatorSettings const &settings = jaguar::SimulatorSettings())
+	{
+		std::vector<uint8_t> const devices = list_of(kDevice)(kDevice + 1);
+		sim_.reset(new jaguar::JaguarSimulator(devices, settings));
+		bridge_.reset(new can::JaguarBridge(sim_->port()));
+		jaguar_.reset(new jaguar::Jaguar(*bridge_, kDevice));
+		jaguar_->ack_timeout_set(boost::posix_time::milliseconds(100));
+	}
+
+	void acknowledged(can::TokenPtr token)
+	{
+		token->block();
+		ASSERT_FALSE(token->timed_out());
+	}
+
+	void odom_callback(double position, double speed)
+	{
+		++odom_called_;
+		odom_position_ = position;
+		odom_speed_ = speed;
+	}
+
+	boost::shared_ptr<jaguar::JaguarSimulator> sim_;
+	boost::shared_ptr<can::JaguarBridge> bridge_;
+	boost::shared_ptr<jaguar::Jaguar> jaguar_;
+	int odom_called_;
+	double odom_position_, odom_speed_;
+};
+
+TEST_F(JaguarSimulatorTest, commandsAreAcknowledged)
+{
+	start();
+
+	acknowledged(jaguar_->config_encoders_set(360));
+	acknowledged(jaguar_->speed_enable());
+	acknowledged(jaguar_->speed_set(120.0));
+
+	jaguar::VirtualJaguarState const state = sim_->state(kDevice);
+	ASSERT_EQ(state.encoder_lines, 360);
+	ASSERT_EQ(state.mode, jaguar::ControlMode::kSpeedMode);
+	ASSERT_TRUE(state.enabled);
+	ASSERT_DOUBLE_EQ(state.speed_target, 120.0);
+	ASSERT_EQ(state.acks_sent, 3u);
+	ASSERT_EQ(sim_->state(kDevice + 1).frames_received, 0u);
+}
+
+TEST_F(JaguarSimulatorTest, noAckSetpointsAreNotAcknowledged)
+{
+	start();
+
+	acknowledged(jaguar_->speed_enable());
+	jaguar_->speed_set_noack(50.0);
+	acknowledged(jaguar_->speed_set(60.0));
+
+	jaguar::VirtualJaguarState const state = sim_->state(kDevice);
+	ASSERT_EQ(state.frames_received, 3u);
+	ASSERT_EQ(state.acks_sent, 2u);
+}
+
+TEST_F(JaguarSimulatorTest, groupSetpointWaitsForSynchronousUpdate)
+{
+	start();
+	jaguar::JaguarBroadcaster broadcaster(*bridge_);
+
+	acknowledged(jaguar_->speed_enable());
+	acknowledged(jaguar_->speed_set(80.0, 1));
+	ASSERT_DOUBLE_EQ(sim_->state(kDevice).speed_target, 0.0);
+
+	broadcaster.synchronous_update(1);
+	usleep(10000);
+	ASSERT_DOUBLE_EQ(sim_->state(kDevice).speed_target, 80.0);
+}
+
+TEST_F(JaguarSimulatorTest, periodicStatusReportsMotion)
+{
+	start();
+
+	acknowledged(jaguar_->speed_enable());
+	acknowledged(jaguar_->periodic_config_odom(0,
+		boost::bind(&JaguarSimulatorTest::odom_callback, this, _1, _2)));
+	acknowledged(jaguar_->periodic_enable(0, 10));
+	acknowledged(jaguar_->speed_set(600.0));
+	usleep(300000);
+
+	ASSERT_GT(odom_called_, 10);
+	ASSERT_NEAR(odom_speed_, 600.0, 10.0);
+	ASSERT_GT(odom_position_, 0.0);
+	ASSERT_NEAR(odom_position_, sim_->state(kDevice).position, 1.0);
+}
+
+TEST_F(JaguarSimulatorTest, droppedCommandTimesOut)
+{
+	jaguar::SimulatorSettings settings;
+	settings.drop_rate = 1.0;
+	start(settings);
+
+	can::TokenPtr token = jaguar_->speed_enable();
+	token->block();
+
+	ASSERT_TRUE(token->timed_out());
+	ASSERT_GT(sim_->frames_dropped(), 0u);
+}
+
+TEST_F(JaguarSimulatorTest, lossyLinkIsRetransmitted)
+{
+	jaguar::SimulatorSettings settings;
+	settings.drop_rate = 0.2;
+	start(settings);
+	jaguar_->ack_timeout_set(boost::posix_time::milliseconds(20));
+	jaguar_->ack_retries_set(10);
+
+	// Only a request that is alone in waiting for an ACK is retransmitted.
+	for (int i = 0; i < 20; ++i) {
+		acknowledged(jaguar_->config_encoders_set(100 + i));
+	}
+
+	ASSERT_GT(sim_->frames_dropped(), 0u);
+	ASSERT_EQ(sim_->state(kDevice).encoder_lines, 119);
+}
+
+TEST_F(JaguarSimulatorTest, onlyConfigurationIsRetransmitted)
+{
+	start();
+
+	// Nothing answers this device, so every request times out.
+	jaguar::Jaguar missing(*bridge_, 9);
+	missing.ack_timeout_set(boost::posix_time::milliseconds(20));
+	missing.ack_retries_set(3);
+
+	uint64_t const before = bridge_->metrics().frames_out;
+	can::TokenPtr setpoint = missing.speed_set(100.0);
+	setpoint->block();
+	ASSERT_TRUE(setpoint->timed_out());
+	ASSERT_EQ(bridge_->metrics().frames_out - before, 1u);
+
+	can::TokenPtr config = missing.config_encoders_set(100);
+	config->block();
+	ASSERT_TRUE(config->timed_out());
+	ASSERT_EQ(bridge_->metrics().frames_out - before, 5u);
+}
+
+TEST_F(JaguarSimulatorTest, unansweredRequestIsCounted)
+{
+	start();
+	jaguar::Jaguar missing(*bridge_, 9);
+	missing.ack_timeout_set(boost::posix_time::milliseconds(20));
+
+	can::TokenPtr token = missing.speed_enable();
+	token->block();
+	ASSERT_TRUE(token->timed_out());
+
+	can::BridgeMetricsSnapshot const metrics = bridge_->metrics();
+	ASSERT_EQ(metrics.errors[can::BridgeError::kRequestTimedOut], 1u);
+	ASSERT_EQ(metrics.last_error, static_cast<uint32_t>(can::BridgeError::kRequestTimedOut));
+	ASSERT_EQ(metrics.last_error_detail & 0x3f, 9u);
+}
+
+TEST_F(JaguarSimulatorTest, latencyDelaysAcknowledgement)
+{
+	jaguar::SimulatorSettings settings;
+	settings.latency = boost::posix_time::milliseconds(30);
+	start(settings);
+
+	can::Timestamp const start = can::monotonic_now();
+	acknowledged(jaguar_->speed_enable());
+
+	ASSERT_GE(can::monotonic_now() - start, 30000000u);
+}
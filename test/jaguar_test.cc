@@ -26,8 +26,10 @@ class CANBridgeMock : public can::CANBridge
 public:
     MOCK_METHOD1(send, void (can::CANMessage const &message));
     MOCK_METHOD1(recv, can::TokenPtr (uint32_t id));
-    MOCK_METHOD2(attach_callback, void (uint32_t id, can::CANBridge::recv_callback cb));
-    MOCK_METHOD3(attach_callback, void (uint32_t id, uint32_t id_mask, can::CANBridge::recv_callback cb));
+    MOCK_METHOD2(recv, can::TokenPtr (uint32_t id, boost::posix_time::time_duration const &timeout));
+    MOCK_METHOD2(attach_frame_callback, can::CallbackToken (uint32_t id, can::CANBridge::frame_callback cb));
+    MOCK_METHOD3(attach_frame_callback, can::CallbackToken (uint32_t id, uint32_t id_mask, can::CANBridge::frame_callback cb));
+    MOCK_METHOD1(attach_callback, can::CallbackToken (can::CANBridge::error_callback cb));
 };
 
 class MockToken : public can::Token {
@@ -35,8 +37,14 @@ public:
     typedef boost::shared_ptr<MockToken> Ptr;
 
     MOCK_METHOD0(block, void (void));
+    MOCK_METHOD1(timed_block, bool (boost::posix_time::time_duration const &duration));
     MOCK_CONST_METHOD0(ready, bool (void));
+    MOCK_CONST_METHOD0(timed_out, bool (void));
     MOCK_CONST_METHOD0(message, boost::shared_ptr<can::CANMessage const> (void));
+    MOCK_CONST_METHOD0(frame, can::FramePtr (void));
+    MOCK_METHOD0(discard, void (void));
+    MOCK_CONST_METHOD0(cancelled, bool (void));
+    MOCK_METHOD1(on_complete, void (can::Token::completion_callback cb));
 };
 
 JAGUAR_MAKE_STATUS(Mock1, uint8_t, byte_(0x01), byte_);
@@ -84,7 +92,7 @@ TEST_F(JaguarTest, config_brushes_set)
         Field(&can::CANMessage::id, request_id),
         Field(&can::CANMessage::payload, ElementsAre(0x12))
     )));
-    EXPECT_CALL(*bridge_, recv(ack_id)).WillOnce(Return(token_));
+    EXPECT_CALL(*bridge_, recv(ack_id, _)).WillOnce(Return(token_));
 
     jaguar_->config_brushes_set(0x12);
 }
@@ -131,3 +139,103 @@ TEST_F(JaguarTest, AggregateStatus_writeChains)
 
     ASSERT_THAT(payload, ElementsAre(0x01, 0x02));
 }
+
+static void append_sample(std::vector<StatusSample> *samples, StatusSample const &sample)
+{
+	samples->push_back(sample);
+}
+
+TEST_F(JaguarTest, periodic_config_decodesWithPlan)
+{
+	uint32_t const status_id = pack_id(num_,
+		Manufacturer::kTexasInstruments,
+		DeviceType::kMotorController,
+		APIClass::kPeriodicStatus,
+		PeriodicStatus::kPeriodicStatus + 2
+	);
+	uint32_t const config_id = pack_id(num_,
+		Manufacturer::kTexasInstruments,
+		DeviceType::kMotorController,
+		APIClass::kPeriodicStatus,
+		PeriodicStatus::kConfigureMessage + 2
+	);
+
+	StatusPlan plan;
+	plan.add(StatusField::kBusVoltage);
+	plan.add(StatusField::kSpeed);
+
+	can::CANBridge::frame_callback frame_cb;
+	EXPECT_CALL(*bridge_, attach_frame_callback(status_id, _))
+		.WillOnce(DoAll(SaveArg<1>(&frame_cb), Return(can::CallbackToken())));
+	EXPECT_CALL(*bridge_, send(AllOf(
+		Field(&can::CANMessage::id, config_id),
+		Field(&can::CANMessage::payload, ElementsAre(3, 4, 13, 14, 15, 16, 0))
+	)));
+	EXPECT_CALL(*bridge_, recv(_, _)).WillOnce(Return(token_));
+
+	std::vector<StatusSample> samples;
+	jaguar_->periodic_config(2, plan,
+		boost::bind(&append_sample, &samples, _1));
+	ASSERT_TRUE(frame_cb);
+
+	can::CANFrame frame;
+	frame.id = status_id;
+	frame.dlc = 6;
+	frame.timestamp = 42;
+	uint8_t const data[] = { 0x00, 0x0C, 0x00, 0x80, 0xFF, 0xFF };
+	std::copy(data, data + 6, frame.data);
+
+	can::FramePool pool(1);
+	frame_cb(pool.allocate(frame));
+
+	ASSERT_EQ(samples.size(), 1u);
+	ASSERT_EQ(samples[0].stamp, 42u);
+	ASSERT_DOUBLE_EQ(samples[0].bus_voltage, 12.0);
+	ASSERT_DOUBLE_EQ(samples[0].speed, -0.5);
+}
+
+static void ignore_odom(double, double, can::Timestamp)
+{
+}
+
+static void ignore_diag(LimitStatus::Enum, Fault::Enum, double, double, can::Timestamp)
+{
+}
+
+TEST_F(JaguarTest, status_cachesDiagnosticsAndOdometry)
+{
+	can::CANBridge::frame_callback odom_cb, diag_cb;
+	EXPECT_CALL(*bridge_, attach_frame_callback(_, _))
+		.WillOnce(DoAll(SaveArg<1>(&odom_cb), Return(can::CallbackToken())))
+		.WillOnce(DoAll(SaveArg<1>(&diag_cb), Return(can::CallbackToken())));
+	EXPECT_CALL(*bridge_, send(_)).Times(2);
+	EXPECT_CALL(*bridge_, recv(_, _)).WillRepeatedly(Return(token_));
+
+	jaguar_->periodic_config_odom(0, &ignore_odom);
+	jaguar_->periodic_config_diag(1, &ignore_diag);
+	ASSERT_FALSE(jaguar_->status().has(StatusField::kPosition));
+
+	can::FramePool pool(2);
+	can::CANFrame odom;
+	odom.dlc = 8;
+	odom.timestamp = 5;
+	uint8_t const odom_data[] = { 0x00, 0x00, 0x02, 0x00, 0x00, 0x80, 0x00, 0x00 };
+	std::copy(odom_data, odom_data + 8, odom.data);
+	odom_cb(pool.allocate(odom));
+
+	can::CANFrame diag;
+	diag.dlc = 6;
+	diag.timestamp = 7;
+	uint8_t const diag_data[] = { 0x03, 0x00, 0x00, 0x0C, 0x80, 0x19 };
+	std::copy(diag_data, diag_data + 6, diag.data);
+	diag_cb(pool.allocate(diag));
+
+	DeviceStatus const status = jaguar_->status();
+	ASSERT_DOUBLE_EQ(status.latest.position, 2.0);
+	ASSERT_DOUBLE_EQ(status.latest.speed, 0.5);
+	ASSERT_DOUBLE_EQ(status.latest.bus_voltage, 12.0);
+	ASSERT_DOUBLE_EQ(status.latest.temperature, 25.5);
+	ASSERT_EQ(status.latest.limit_non_clearing, 0x03);
+	ASSERT_EQ(status.stamps[StatusField::kPosition], 5u);
+	ASSERT_EQ(status.stamps[StatusField::kTemperature], 7u);
+}
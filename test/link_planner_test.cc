@@ -0,0 +1,134 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/jaguar_codec.h>
+#include <jaguar/link_planner.h>
+
+using namespace testing;
+using jaguar::LinkLoad;
+using jaguar::LinkPlanner;
+
+// Bytes per second on a 115200 baud 8N1 link.
+static double const kSerialCapacity = 11520.0;
+
+TEST(LinkPlannerTest, serialBytesMatchesCodec)
+{
+	ASSERT_EQ(LinkPlanner::serial_bytes(8), can::JaguarCodec::kMaxEncodedLength);
+	ASSERT_EQ(LinkPlanner::serial_bytes(0), 10u);
+}
+
+TEST(LinkPlannerTest, busBitsIncludeWorstCaseStuffing)
+{
+	ASSERT_EQ(LinkPlanner::bus_bits(0), 80u);
+	ASSERT_EQ(LinkPlanner::bus_bits(8), 160u);
+}
+
+TEST(LinkPlannerTest, statusLoadsReceiveDirection)
+{
+	LinkPlanner plan;
+	plan.add_status("odometry", 8, 10, 2);
+
+	LinkLoad const load = plan.load();
+	ASSERT_DOUBLE_EQ(load.tx, 0.0);
+	ASSERT_DOUBLE_EQ(load.rx, 200 * 26 / kSerialCapacity);
+	ASSERT_DOUBLE_EQ(load.bus, 200 * 160 / 1e6);
+}
+
+TEST(LinkPlannerTest, acknowledgedCommandsLoadBothDirections)
+{
+	LinkPlanner plan;
+	plan.add_command("setpoint", 4, 20, 2, true);
+
+	LinkLoad const load = plan.load();
+	ASSERT_DOUBLE_EQ(load.tx, 100 * 18 / kSerialCapacity);
+	ASSERT_DOUBLE_EQ(load.rx, 100 * 10 / kSerialCapacity);
+	ASSERT_DOUBLE_EQ(load.bus, 100 * (120 + 80) / 1e6);
+}
+
+TEST(LinkPlannerTest, defaultRatesAreFeasible)
+{
+	LinkPlanner plan;
+	plan.add_status("odometry", 8, 50, 2);
+	plan.add_status("diagnostics", 6, 200, 2);
+	plan.add_command("heartbeat", 0, 20, 1, false);
+	plan.add_command("speed setpoint", 4, 20, 2, true);
+
+	ASSERT_TRUE(plan.feasible());
+	ASSERT_TRUE(plan.adjust());
+	ASSERT_EQ(plan.period_ms(0), 50);
+	ASSERT_EQ(plan.period_ms(1), 200);
+}
+
+TEST(LinkPlannerTest, adjustSlowsOnlyAdjustableStreams)
+{
+	LinkPlanner plan;
+	size_t const odom = plan.add_status("odometry", 8, 1, 2);
+	size_t const diag = plan.add_status("diagnostics", 6, 2, 2);
+	size_t const setpoint = plan.add_command("speed setpoint", 4, 20, 2, true);
+	ASSERT_FALSE(plan.feasible());
+
+	ASSERT_TRUE(plan.adjust());
+	ASSERT_TRUE(plan.feasible());
+	ASSERT_GT(plan.period_ms(odom), 1);
+	ASSERT_GT(plan.period_ms(diag), plan.period_ms(odom));
+	ASSERT_EQ(plan.period_ms(setpoint), 20);
+}
+
+TEST(LinkPlannerTest, adjustFailsWhenFixedTrafficSaturates)
+{
+	LinkPlanner plan;
+	plan.add_status("odometry", 8, 50, 2);
+	plan.add_command("speed setpoint", 8, 1, 4, true);
+
+	ASSERT_FALSE(plan.adjust());
+	ASSERT_FALSE(plan.feasible());
+}
+
+TEST(LinkPlannerTest, changeDrivenCommandsBudgetSteadyAndWorstCase)
+{
+	LinkPlanner plan;
+	plan.add_changes("speed setpoint", 5, 5, 500, 2, false);
+
+	LinkLoad const steady = plan.load();
+	LinkLoad const worst = plan.worst_load();
+	ASSERT_DOUBLE_EQ(steady.tx, 4 * 20 / kSerialCapacity);
+	ASSERT_DOUBLE_EQ(worst.tx, 400 * 20 / kSerialCapacity);
+	ASSERT_TRUE(plan.feasible());
+
+	plan.add_changes("synchronous update", 1, 1, 250, 1, false);
+	ASSERT_FALSE(plan.feasible());
+	ASSERT_FALSE(plan.adjust());
+}
+
+TEST(LinkPlannerTest, defaultLaunchIsFeasible)
+{
+	// diff_drive.launch: two motors, 200 Hz control and 50 ms heartbeat.
+	LinkPlanner plan;
+	size_t const odom = plan.add_status("odometry", 8, 50, 2);
+	size_t const diag = plan.add_status("diagnostics", 6, 200, 2);
+	plan.add_command("heartbeat", 0, 50, 1, false);
+	plan.add_changes("speed setpoint", 5, 5, 500, 2, false);
+	plan.add_changes("synchronous update", 1, 5, 250, 1, false);
+
+	ASSERT_TRUE(plan.feasible());
+	ASSERT_TRUE(plan.adjust());
+	ASSERT_EQ(plan.period_ms(odom), 50);
+	ASSERT_EQ(plan.period_ms(diag), 200);
+}
+
+TEST(LinkPlannerTest, measuredLoadFromCounters)
+{
+	can::JaguarBridge::LinkUsage before = can::JaguarBridge::LinkUsage();
+	can::JaguarBridge::LinkUsage after = before;
+	after.stamp = 1000000000ull;
+	after.tx_bytes = 5760;
+	after.rx_bytes = 1152;
+	after.tx_frames = 1000;
+	after.rx_frames = 1000;
+	after.rx_payload = 8000;
+
+	LinkLoad const load = LinkPlanner::measured(before, after);
+	ASSERT_DOUBLE_EQ(load.tx, 0.5);
+	ASSERT_DOUBLE_EQ(load.rx, 0.1);
+	ASSERT_DOUBLE_EQ(load.bus, (1000 * 80 + 1000 * 160) / 1e6);
+	ASSERT_DOUBLE_EQ(load.peak(), 0.5);
+}
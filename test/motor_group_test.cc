@@ -0,0 +1,123 @@
+#include <unistd.h>
+#include <boost/assign/list_of.hpp>
+#include <boost/shared_ptr.hpp>
+#include <gtest/gtest.h>
+#include <jaguar/jaguar.h>
+#include <jaguar/jaguar_bridge.h>
+#include <jaguar/jaguar_simulator.h>
+#include <jaguar/motor_group.h>
+
+using boost::assign::list_of;
+
+static uint8_t const kLeft  = 1;
+static uint8_t const kRight = 2;
+
+class MotorGroupTest : public ::testing::Test
+{
+public:
+	virtual void SetUp(void)
+	{
+		std::vector<uint8_t> const devices = list_of(kLeft)(kRight);
+		sim_.reset(new jaguar::JaguarSimulator(devices));
+		bridge_.reset(new can::JaguarBridge(sim_->port()));
+		left_.reset(new jaguar::Jaguar(*bridge_, kLeft));
+		right_.reset(new jaguar::Jaguar(*bridge_, kRight));
+		left_->ack_timeout_set(boost::posix_time::milliseconds(100));
+		right_->ack_timeout_set(boost::posix_time::milliseconds(100));
+
+		acknowledged(left_->speed_enable());
+		acknowledged(right_->speed_enable());
+	}
+
+	virtual void TearDown(void)
+	{
+		left_.reset();
+		right_.reset();
+		bridge_.reset();
+		sim_.reset();
+	}
+
+	void acknowledged(can::TokenPtr token)
+	{
+		token->block();
+		ASSERT_FALSE(token->timed_out());
+	}
+
+	// Wait for the simulator to process everything sent so far.
+	bool speed_reaches(uint8_t device, double target)
+	{
+		for (int i = 0; i < 100; ++i) {
+			if (sim_->state(device).speed_target == target) {
+				return true;
+			}
+			usleep(1000);
+		}
+		return false;
+	}
+
+	boost::shared_ptr<jaguar::JaguarSimulator> sim_;
+	boost::shared_ptr<can::JaguarBridge> bridge_;
+	boost::shared_ptr<jaguar::Jaguar> left_, right_;
+};
+
+TEST_F(MotorGroupTest, commitAppliesAllSetpoints)
+{
+	jaguar::MotorGroup group(*bridge_, jaguar::GroupMode::kSpeed, 0x02);
+	size_t const left = group.add(*left_);
+	size_t const right = group.add(*right_);
+	ASSERT_EQ(group.size(), 2u);
+
+	group.stage(left, 100.0);
+	group.stage(right, -50.0);
+	usleep(10000);
+	ASSERT_DOUBLE_EQ(sim_->state(kLeft).speed_target, 0.0);
+	ASSERT_DOUBLE_EQ(sim_->state(kRight).speed_target, 0.0);
+
+	jaguar::GroupCommit const commit = group.commit();
+	ASSERT_EQ(commit.motors, 2u);
+	ASSERT_TRUE(speed_reaches(kLeft, 100.0));
+	ASSERT_TRUE(speed_reaches(kRight, -50.0));
+
+	// Only the two speed_enable() commands were acknowledged.
+	ASSERT_EQ(sim_->state(kLeft).acks_sent, 1u);
+	ASSERT_EQ(sim_->state(kRight).acks_sent, 1u);
+}
+
+TEST_F(MotorGroupTest, unstagedMotorsKeepTheirSetpoint)
+{
+	jaguar::MotorGroup group(*bridge_, jaguar::GroupMode::kSpeed, 0x01);
+	size_t const left = group.add(*left_);
+	size_t const right = group.add(*right_);
+
+	group.stage(left, 10.0);
+	group.stage(right, 20.0);
+	group.commit();
+	ASSERT_TRUE(speed_reaches(kRight, 20.0));
+
+	group.stage(left, 30.0);
+	ASSERT_EQ(group.commit().motors, 1u);
+	ASSERT_TRUE(speed_reaches(kLeft, 30.0));
+	ASSERT_DOUBLE_EQ(sim_->state(kRight).speed_target, 20.0);
+}
+
+TEST_F(MotorGroupTest, commitReportsTiming)
+{
+	jaguar::MotorGroup group(*bridge_, jaguar::GroupMode::kSpeed, 0x01);
+	size_t const left = group.add(*left_);
+	size_t const right = group.add(*right_);
+
+	can::Timestamp const before = can::monotonic_now();
+	group.stage(left, 1.0);
+	usleep(2000);
+	group.stage(right, 1.0);
+	jaguar::GroupCommit const commit = group.commit();
+
+	ASSERT_GE(commit.staged, before);
+	ASSERT_GE(commit.committed, commit.staged + 2000000u);
+	ASSERT_EQ(group.last_commit().committed, commit.committed);
+
+	// Two 5-byte setpoints and a 1-byte synchronous update at 115200 baud,
+	// then the synchronous update on the bus.
+	double const expected = (2 * 20 + 12) * 10 / 115200.0 + 90e-6;
+	ASSERT_NEAR(commit.apply_skew * 1e-9, expected, 1e-6);
+}
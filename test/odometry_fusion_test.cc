@@ -0,0 +1,272 @@
+#include <gtest/gtest.h>
+#include <jaguar/odometry_fusion.h>
+
+using namespace jaguar;
+
+static WheelSample sample(can::Timestamp stamp, double position, double speed = 0.0)
+{
+	WheelSample s;
+	s.stamp = stamp;
+	s.position = position;
+	s.speed = speed;
+	return s;
+}
+
+TEST(WheelHistoryTest, insertKeepsTimeOrder)
+{
+	WheelHistory history(4);
+	history.insert(sample(10, 1.0));
+	history.insert(sample(30, 3.0));
+	history.insert(sample(20, 2.0));
+	ASSERT_EQ(history.size(), 3u);
+	ASSERT_EQ(history.at(0).stamp, 10u);
+	ASSERT_EQ(history.at(1).stamp, 20u);
+	ASSERT_EQ(history.at(2).stamp, 30u);
+}
+
+TEST(WheelHistoryTest, insertOverwritesOldest)
+{
+	WheelHistory history(3);
+	for (int i = 1; i <= 5; ++i) {
+		history.insert(sample(i * 10, i));
+	}
+	ASSERT_EQ(history.size(), 3u);
+	ASSERT_EQ(history.oldest().stamp, 30u);
+	ASSERT_EQ(history.latest().stamp, 50u);
+}
+
+TEST(WheelHistoryTest, interpolateBetweenSamples)
+{
+	WheelHistory history(4);
+	history.insert(sample(10, 1.0, 100.0));
+	history.insert(sample(20, 2.0, 200.0));
+	history.insert(sample(40, 6.0, 200.0));
+
+	ASSERT_DOUBLE_EQ(history.interpolate(15).position, 1.5);
+	ASSERT_DOUBLE_EQ(history.interpolate(15).speed, 150.0);
+	ASSERT_DOUBLE_EQ(history.interpolate(30).position, 4.0);
+	ASSERT_DOUBLE_EQ(history.interpolate(5).position, 1.0);
+	ASSERT_DOUBLE_EQ(history.interpolate(50).position, 6.0);
+}
+
+TEST(WheelHistoryTest, discard_beforeKeepsBracketingSample)
+{
+	WheelHistory history(4);
+	history.insert(sample(10, 1.0));
+	history.insert(sample(20, 2.0));
+	history.insert(sample(30, 3.0));
+
+	history.discard_before(25);
+	ASSERT_EQ(history.size(), 2u);
+	ASSERT_EQ(history.oldest().stamp, 20u);
+	ASSERT_DOUBLE_EQ(history.interpolate(25).position, 2.5);
+}
+
+TEST(OdometryFusionTest, firstSamplesSetTheReference)
+{
+	OdometryFusion fusion;
+	OdometryStep step;
+	ASSERT_FALSE(fusion.add(Wheel::kLeft, sample(0, 5.0), step));
+	ASSERT_FALSE(fusion.add(Wheel::kRight, sample(5, 7.0), step));
+
+	// The right wheel has not been sampled at 0, so the reference is set at
+	// 5 once the left wheel is known on both sides of it.
+	ASSERT_FALSE(fusion.add(Wheel::kLeft, sample(10, 6.0), step));
+	ASSERT_TRUE(fusion.add(Wheel::kRight, sample(15, 8.0), step));
+	ASSERT_EQ(step.stamp, 10u);
+	ASSERT_EQ(step.interval, 5u);
+	ASSERT_DOUBLE_EQ(step.revs[Wheel::kLeft], 0.5);
+	ASSERT_DOUBLE_EQ(step.revs[Wheel::kRight], 0.5);
+}
+
+TEST(OdometryFusionTest, everyInterleavedSampleProducesAStep)
+{
+	OdometryFusion fusion;
+	OdometryStep step;
+	fusion.add(Wheel::kLeft, sample(0, 0.0), step);
+	fusion.add(Wheel::kRight, sample(0, 0.0), step);
+
+	int steps = 0;
+	double left = 0.0, right = 0.0;
+	for (int i = 1; i <= 10; ++i) {
+		can::Timestamp const t = i * 10;
+		if (fusion.add(Wheel::kLeft, sample(t, t * 0.1, 60.0), step)) {
+			left += step.revs[Wheel::kLeft];
+			right += step.revs[Wheel::kRight];
+			++steps;
+		}
+		if (fusion.add(Wheel::kRight, sample(t + 5, (t + 5) * 0.2, 120.0), step)) {
+			left += step.revs[Wheel::kLeft];
+			right += step.revs[Wheel::kRight];
+			++steps;
+		}
+	}
+
+	// Both wheels are known up to the last left sample.
+	ASSERT_EQ(steps, 19);
+	ASSERT_EQ(step.stamp, 100u);
+	ASSERT_NEAR(left, 10.0, 1e-9);
+	ASSERT_NEAR(right, 20.0, 1e-9);
+	ASSERT_DOUBLE_EQ(step.rpm_start[Wheel::kLeft], 60.0);
+	ASSERT_DOUBLE_EQ(step.rpm[Wheel::kRight], 120.0);
+}
+
+TEST(OdometryFusionTest, repeatedWheelIsNotDropped)
+{
+	OdometryFusion fusion;
+	OdometryStep step;
+	fusion.add(Wheel::kLeft, sample(0, 0.0), step);
+	fusion.add(Wheel::kRight, sample(0, 0.0), step);
+
+	// The right wheel reports twice before the left wheel catches up.
+	ASSERT_FALSE(fusion.add(Wheel::kRight, sample(10, 1.0), step));
+	ASSERT_FALSE(fusion.add(Wheel::kRight, sample(20, 2.0), step));
+	ASSERT_TRUE(fusion.add(Wheel::kLeft, sample(15, 3.0), step));
+	ASSERT_EQ(step.stamp, 15u);
+	ASSERT_DOUBLE_EQ(step.revs[Wheel::kLeft], 3.0);
+	ASSERT_DOUBLE_EQ(step.revs[Wheel::kRight], 1.5);
+
+	ASSERT_TRUE(fusion.add(Wheel::kLeft, sample(25, 5.0), step));
+	ASSERT_EQ(step.stamp, 20u);
+	ASSERT_DOUBLE_EQ(step.revs[Wheel::kLeft], 1.0);
+	ASSERT_DOUBLE_EQ(step.revs[Wheel::kRight], 0.5);
+	ASSERT_EQ(fusion.late(), 0u);
+}
+
+TEST(OdometryFusionTest, reorderedSampleIsInterpolated)
+{
+	OdometryFusion fusion;
+	OdometryStep step;
+	fusion.add(Wheel::kLeft, sample(0, 0.0), step);
+	fusion.add(Wheel::kRight, sample(0, 0.0), step);
+
+	fusion.add(Wheel::kRight, sample(20, 2.0), step);
+	fusion.add(Wheel::kRight, sample(10, 0.5), step);
+	ASSERT_TRUE(fusion.add(Wheel::kLeft, sample(15, 1.0), step));
+	ASSERT_DOUBLE_EQ(step.revs[Wheel::kRight], 1.25);
+}
+
+TEST(OdometryFusionTest, lateSampleIsIgnored)
+{
+	OdometryFusion fusion;
+	OdometryStep step;
+	fusion.add(Wheel::kLeft, sample(0, 0.0), step);
+	fusion.add(Wheel::kRight, sample(0, 0.0), step);
+	fusion.add(Wheel::kLeft, sample(20, 2.0), step);
+	ASSERT_TRUE(fusion.add(Wheel::kRight, sample(20, 2.0), step));
+
+	ASSERT_FALSE(fusion.add(Wheel::kLeft, sample(10, 1.0), step));
+	ASSERT_EQ(fusion.late(), 1u);
+
+	fusion.reset();
+	ASSERT_EQ(fusion.late(), 0u);
+	ASSERT_FALSE(fusion.add(Wheel::kLeft, sample(10, 1.0), step));
+}
+
+TEST(OdometryFusionTest, staleStreamIsLeftOut)
+{
+	OdometryFusion fusion(3, 8, 100);
+	OdometryStep step;
+	for (size_t i = 0; i < 3; ++i) {
+		fusion.add(i, sample(0, 0.0), step);
+	}
+
+	// Stream 2 stops reporting; the others wait for it until it is more than
+	// the timeout behind.
+	ASSERT_FALSE(fusion.add(0, sample(50, 5.0), step));
+	ASSERT_FALSE(fusion.add(1, sample(50, 5.0), step));
+	ASSERT_FALSE(fusion.add(0, sample(100, 10.0), step));
+	ASSERT_TRUE(fusion.add(1, sample(150, 15.0), step));
+	ASSERT_EQ(step.stamp, 100u);
+	ASSERT_TRUE(step.live[0]);
+	ASSERT_TRUE(step.live[1]);
+	ASSERT_FALSE(step.live[2]);
+	ASSERT_DOUBLE_EQ(step.revs[0], 10.0);
+	ASSERT_DOUBLE_EQ(step.revs[2], 0.0);
+
+	// Once it reports again it is re-referenced from its new samples only,
+	// then contributes.
+	ASSERT_FALSE(fusion.add(2, sample(160, 40.0), step));
+	ASSERT_TRUE(fusion.add(0, sample(200, 20.0), step));
+	ASSERT_EQ(step.stamp, 150u);
+	ASSERT_FALSE(step.live[2]);
+
+	ASSERT_TRUE(fusion.add(1, sample(200, 20.0), step));
+	ASSERT_EQ(step.stamp, 160u);
+	ASSERT_TRUE(step.live[2]);
+	ASSERT_DOUBLE_EQ(step.revs[0], 1.0);
+	ASSERT_DOUBLE_EQ(step.revs[2], 0.0);
+}
+
+TEST(OdometryFusionTest, silentStreamDoesNotBlockStart)
+{
+	OdometryFusion fusion(3, 8, 100);
+	OdometryStep step;
+
+	// Stream 2 never reports. The others wait for it until the timeout has
+	// passed since the first sample, then start without it.
+	for (can::Timestamp t = 0; t <= 100; t += 50) {
+		ASSERT_FALSE(fusion.add(0, sample(t, t * 0.1), step));
+		ASSERT_FALSE(fusion.add(1, sample(t, t * 0.1), step));
+	}
+	ASSERT_FALSE(fusion.add(0, sample(150, 15.0), step));
+	ASSERT_TRUE(fusion.add(1, sample(150, 15.0), step));
+	ASSERT_EQ(step.stamp, 150u);
+	ASSERT_TRUE(step.live[0]);
+	ASSERT_FALSE(step.live[2]);
+	ASSERT_DOUBLE_EQ(step.revs[0], 5.0);
+}
+
+TEST(OdometryFusionTest, outageIsNotInterpolated)
+{
+	OdometryFusion fusion(3, 8, 100);
+	OdometryStep step;
+	for (size_t i = 0; i < 3; ++i) {
+		fusion.add(i, sample(0, 0.0), step);
+	}
+
+	// Stream 2 goes silent and moves during the outage.
+	fusion.add(0, sample(100, 10.0), step);
+	fusion.add(1, sample(100, 10.0), step);
+	ASSERT_TRUE(fusion.add(0, sample(150, 15.0), step));
+	ASSERT_FALSE(step.live[2]);
+
+	ASSERT_FALSE(fusion.add(2, sample(200, 50.0), step));
+	ASSERT_TRUE(fusion.add(1, sample(150, 15.0), step));
+	ASSERT_FALSE(step.live[2]);
+
+	// It stood still since it came back, so it contributes nothing.
+	fusion.add(0, sample(250, 25.0), step);
+	ASSERT_TRUE(fusion.add(1, sample(250, 25.0), step));
+	ASSERT_EQ(step.stamp, 200u);
+	ASSERT_TRUE(step.live[2]);
+	ASSERT_DOUBLE_EQ(step.revs[2], 0.0);
+}
+
+TEST(FuseTest, median)
+{
+	std::vector<double> odd;
+	odd.push_back(3.0);
+	odd.push_back(1.0);
+	odd.push_back(2.0);
+	ASSERT_DOUBLE_EQ(fuse(odd, FusionMethod::kMedian), 2.0);
+
+	std::vector<double> even(odd);
+	even.push_back(10.0);
+	ASSERT_DOUBLE_EQ(fuse(even, FusionMethod::kMedian), 2.5);
+}
+
+TEST(FuseTest, rejectOutliers)
+{
+	std::vector<double> values;
+	values.push_back(1.00);
+	values.push_back(1.02);
+	values.push_back(0.98);
+	values.push_back(5.00); // slipping wheel
+	ASSERT_NEAR(fuse(values, FusionMethod::kRejectOutliers), 1.0, 1e-12);
+
+	std::vector<double> pair;
+	pair.push_back(1.0);
+	pair.push_back(3.0);
+	ASSERT_DOUBLE_EQ(fuse(pair, FusionMethod::kRejectOutliers), 2.0);
+}
@@ -0,0 +1,150 @@
+#include <cmath>
+#include <gtest/gtest.h>
+#include <jaguar/pose_integrator.h>
+
+using namespace jaguar;
+
+static double const kSeparation = 0.5;
+
+static DriveMotion motion(double left, double right,
+                          double v_left0 = 1.0, double v_left1 = 1.0,
+                          double v_right0 = 1.0, double v_right1 = 1.0)
+{
+	DriveMotion m;
+	m.separation = kSeparation;
+	m.left = left;
+	m.right = right;
+	m.variance_left = 0.0;
+	m.variance_right = 0.0;
+	m.v_left[0] = v_left0;
+	m.v_left[1] = v_left1;
+	m.v_right[0] = v_right0;
+	m.v_right[1] = v_right1;
+	return m;
+}
+
+static double position_error(Pose2D const &pose, double x, double y)
+{
+	return hypot(pose.x - x, pose.y - y);
+}
+
+TEST(PoseIntegratorTest, straightLine)
+{
+	for (int method = Integrator::kMidpoint; method <= Integrator::kRungeKutta4; ++method) {
+		Pose2D pose;
+		pose.theta = M_PI / 2;
+		pose_integrator(static_cast<Integrator::Enum>(method)).step(pose, motion(1.0, 1.0));
+		ASSERT_NEAR(pose.x, 0.0, 1e-12);
+		ASSERT_NEAR(pose.y, 1.0, 1e-12);
+		ASSERT_NEAR(pose.theta, M_PI / 2, 1e-12);
+	}
+}
+
+TEST(PoseIntegratorTest, turnInPlace)
+{
+	for (int method = Integrator::kMidpoint; method <= Integrator::kRungeKutta4; ++method) {
+		Pose2D pose;
+		double const arc = M_PI / 4 * kSeparation;
+		pose_integrator(static_cast<Integrator::Enum>(method)).step(pose, motion(-arc, arc, -1, -1));
+		ASSERT_NEAR(pose.x, 0.0, 1e-12);
+		ASSERT_NEAR(pose.y, 0.0, 1e-12);
+		ASSERT_NEAR(pose.theta, M_PI / 2, 1e-12);
+	}
+}
+
+TEST(PoseIntegratorTest, thetaIsNormalized)
+{
+	Pose2D pose;
+	pose.theta = 3.0;
+	pose_integrator(Integrator::kExactArc).step(pose, motion(0.0, 0.5));
+	ASSERT_NEAR(pose.theta, 4.0 - 2 * M_PI, 1e-12);
+}
+
+// A quarter circle of radius 1 m in one update ends at (1, 1).
+TEST(PoseIntegratorTest, exactArcFollowsCircle)
+{
+	double const left  = (1.0 - kSeparation / 2) * M_PI / 2;
+	double const right = (1.0 + kSeparation / 2) * M_PI / 2;
+	DriveMotion const m = motion(left, right, 0.75, 0.75, 1.25, 1.25);
+
+	Pose2D arc, midpoint, rk4;
+	pose_integrator(Integrator::kExactArc).step(arc, m);
+	pose_integrator(Integrator::kMidpoint).step(midpoint, m);
+	pose_integrator(Integrator::kRungeKutta4).step(rk4, m);
+
+	ASSERT_NEAR(position_error(arc, 1.0, 1.0), 0.0, 1e-12);
+	ASSERT_NEAR(arc.theta, M_PI / 2, 1e-12);
+	ASSERT_GT(position_error(midpoint, 1.0, 1.0), 0.1);
+	ASSERT_LT(position_error(rk4, 1.0, 1.0), 1e-2);
+}
+
+// Accelerating one wheel into a turn changes the curvature within the
+// update, which only RK4 follows.
+TEST(PoseIntegratorTest, rungeKuttaFollowsChangingCurvature)
+{
+	double const duration = 0.25;
+	double const v_left = 1.0, v_right0 = 1.0, v_right1 = 2.0;
+
+	// Reference: the same motion in many small steps.
+	Pose2D reference;
+	int const n = 10000;
+	for (int i = 0; i < n; ++i) {
+		double const t = (i + 0.5) / n;
+		double const right = (v_right0 + (v_right1 - v_right0) * t) * duration / n;
+		pose_integrator(Integrator::kExactArc).step(reference, motion(v_left * duration / n, right));
+	}
+
+	DriveMotion const m = motion(v_left * duration, (v_right0 + v_right1) / 2 * duration,
+	                             v_left, v_left, v_right0, v_right1);
+	Pose2D arc, rk4;
+	pose_integrator(Integrator::kExactArc).step(arc, m);
+	pose_integrator(Integrator::kRungeKutta4).step(rk4, m);
+
+	double const rk4_error = position_error(rk4, reference.x, reference.y);
+	ASSERT_NEAR(rk4.theta, reference.theta, 1e-9);
+	ASSERT_LT(rk4_error, 1e-3);
+	ASSERT_GT(position_error(arc, reference.x, reference.y), 10 * rk4_error);
+}
+
+TEST(PoseIntegratorTest, covarianceOfStraightLine)
+{
+	Pose2D pose;
+	DriveMotion m = motion(1.0, 1.0);
+	m.variance_left = 0.01;
+	m.variance_right = 0.01;
+	pose_integrator(Integrator::kExactArc).step(pose, m);
+
+	// Independent wheel errors average along the path, and differ across it.
+	ASSERT_NEAR(pose.covariance[0][0], 0.005, 1e-12);
+	ASSERT_NEAR(pose.covariance[2][2], 0.02 / (kSeparation * kSeparation), 1e-12);
+	ASSERT_NEAR(pose.covariance[0][2], 0.0, 1e-12);
+	ASSERT_GT(pose.covariance[1][1], 0.0);
+}
+
+TEST(PoseIntegratorTest, covarianceGrowsAndStaysSymmetric)
+{
+	Pose2D pose;
+	double previous = 0.0;
+	for (int i = 0; i < 20; ++i) {
+		DriveMotion m = motion(0.1, 0.12);
+		m.variance_left = 0.001;
+		m.variance_right = 0.001;
+		pose_integrator(Integrator::kRungeKutta4).step(pose, m);
+
+		double const trace = pose.covariance[0][0] + pose.covariance[1][1] + pose.covariance[2][2];
+		ASSERT_GT(trace, previous);
+		previous = trace;
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 3; ++c) {
+				ASSERT_NEAR(pose.covariance[r][c], pose.covariance[c][r], 1e-15);
+			}
+		}
+	}
+}
+
+TEST(PoseIntegratorTest, namesAreDistinct)
+{
+	ASSERT_STREQ(pose_integrator(Integrator::kMidpoint).name(), "midpoint");
+	ASSERT_STREQ(pose_integrator(Integrator::kExactArc).name(), "exact_arc");
+	ASSERT_STREQ(pose_integrator(Integrator::kRungeKutta4).name(), "rk4");
+}
@@ -0,0 +1,216 @@
+#include <unistd.h>
+#include <boost/assign/list_of.hpp>
+#include <boost/shared_ptr.hpp>
+#include <gtest/gtest.h>
+#include <jaguar/jaguar.h>
+#include <jaguar/jaguar_bridge.h>
+#include <jaguar/jaguar_simulator.h>
+#include <jaguar/motor_group.h>
+#include <jaguar/setpoint_stream.h>
+
+using boost::assign::list_of;
+
+static uint8_t const kLeft  = 1;
+static uint8_t const kRight = 2;
+
+static void ignore_odom(double, double, can::Timestamp)
+{
+}
+
+class SetpointStreamTest : public ::testing::Test
+{
+public:
+	virtual void SetUp(void)
+	{
+		// Slow enough that a 1000 RPM setpoint can never be reached.
+		jaguar::SimulatorSettings sim_settings;
+		sim_settings.max_rpm = 500.0;
+		sim_settings.time_constant = 0.01;
+
+		std::vector<uint8_t> const devices = list_of(kLeft)(kRight);
+		sim_.reset(new jaguar::JaguarSimulator(devices, sim_settings));
+		bridge_.reset(new can::JaguarBridge(sim_->port()));
+		left_.reset(new jaguar::Jaguar(*bridge_, kLeft));
+		right_.reset(new jaguar::Jaguar(*bridge_, kRight));
+		left_->ack_timeout_set(boost::posix_time::milliseconds(100));
+		right_->ack_timeout_set(boost::posix_time::milliseconds(100));
+
+		acknowledged(left_->speed_enable());
+		acknowledged(right_->speed_enable());
+
+		group_.reset(new jaguar::MotorGroup(*bridge_, jaguar::GroupMode::kSpeed, 0x01));
+		group_->add(*left_);
+		group_->add(*right_);
+		jaguars_ = list_of<jaguar::Jaguar const *>(left_.get())(right_.get());
+
+		settings_.verify_period_s = 0.0;
+		settings_.status_timeout_s = 0.1;
+		settings_.settle_s = 0.05;
+	}
+
+	virtual void TearDown(void)
+	{
+		group_.reset();
+		left_.reset();
+		right_.reset();
+		bridge_.reset();
+		sim_.reset();
+	}
+
+	void acknowledged(can::TokenPtr token)
+	{
+		token->block();
+		ASSERT_FALSE(token->timed_out());
+	}
+
+	void stream_odometry(void)
+	{
+		acknowledged(left_->periodic_config_odom(0, &ignore_odom));
+		acknowledged(right_->periodic_config_odom(0, &ignore_odom));
+		acknowledged(left_->periodic_enable(0, 5));
+		acknowledged(right_->periodic_enable(0, 5));
+	}
+
+	// Run the control loop at 100 Hz for the given number of ticks and
+	// return the total number of verification failures.
+	size_t run(jaguar::SetpointStream &stream, double left, double right, int ticks)
+	{
+		size_t failures = 0;
+		for (int i = 0; i < ticks; ++i) {
+			can::Timestamp const now = can::monotonic_now();
+			stream.begin_tick(now, 0.01);
+			stream.set(0, left);
+			stream.set(1, right);
+			failures += stream.commit(now);
+			usleep(10000);
+		}
+		return failures;
+	}
+
+	boost::shared_ptr<jaguar::JaguarSimulator> sim_;
+	boost::shared_ptr<can::JaguarBridge> bridge_;
+	boost::shared_ptr<jaguar::Jaguar> left_, right_;
+	boost::shared_ptr<jaguar::MotorGroup> group_;
+	std::vector<jaguar::Jaguar const *> jaguars_;
+	jaguar::SetpointStreamSettings settings_;
+};
+
+TEST_F(SetpointStreamTest, begin_tickCountsOverruns)
+{
+	jaguar::SetpointStream stream(*group_, jaguars_, settings_);
+	stream.begin_tick(1000000000u, 0.01);
+	stream.begin_tick(1010000000u, 0.01);
+	stream.begin_tick(1024000000u, 0.01);
+	stream.begin_tick(1040000000u, 0.01);
+
+	jaguar::SetpointStreamStats const &stats = stream.stats();
+	ASSERT_EQ(stats.ticks, 4u);
+	ASSERT_EQ(stats.overruns, 1u);
+	ASSERT_EQ(stats.max_interval, 16000000u);
+}
+
+TEST_F(SetpointStreamTest, commit_streamsWithoutACKs)
+{
+	jaguar::SetpointStream stream(*group_, jaguars_, settings_);
+	run(stream, 100.0, -100.0, 3);
+	usleep(10000);
+
+	ASSERT_DOUBLE_EQ(sim_->state(kLeft).speed_target, 100.0);
+	ASSERT_DOUBLE_EQ(sim_->state(kRight).speed_target, -100.0);
+	ASSERT_EQ(sim_->state(kLeft).acks_sent, 1u);
+	ASSERT_EQ(sim_->state(kRight).acks_sent, 1u);
+}
+
+TEST_F(SetpointStreamTest, commit_flagsMissingStatus)
+{
+	jaguar::SetpointStream stream(*group_, jaguars_, settings_);
+	ASSERT_GT(run(stream, 100.0, 100.0, 15), 0u);
+	ASSERT_GT(stream.stats().stale, 0u);
+	ASSERT_EQ(stream.stats().readbacks, 0u);
+}
+
+TEST_F(SetpointStreamTest, commit_verifiesReadback)
+{
+	stream_odometry();
+	jaguar::SetpointStream stream(*group_, jaguars_, settings_);
+	ASSERT_EQ(run(stream, 200.0, -200.0, 20), 0u);
+	ASSERT_GT(stream.stats().readbacks, 0u);
+	ASSERT_EQ(stream.stats().mismatches, 0u);
+	ASSERT_EQ(stream.stats().stale, 0u);
+}
+
+TEST_F(SetpointStreamTest, commit_flagsMismatch)
+{
+	stream_odometry();
+	jaguar::SetpointStream stream(*group_, jaguars_, settings_);
+	ASSERT_GT(run(stream, 200.0, 1000.0, 20), 0u);
+	ASSERT_GT(stream.stats().mismatches, 0u);
+	ASSERT_EQ(stream.stats().stale, 0u);
+}
+
+TEST_F(SetpointStreamTest, commit_sendsOnlyChanges)
+{
+	settings_.refresh_s = 10.0;
+	jaguar::SetpointStream stream(*group_, jaguars_, settings_);
+	run(stream, 100.0, -100.0, 10);
+	run(stream, 50.0, -100.0, 10);
+	usleep(10000);
+
+	// Mode enable, then one setpoint per change.
+	ASSERT_EQ(stream.stats().sent, 3u);
+	ASSERT_EQ(stream.stats().suppressed, 37u);
+	ASSERT_EQ(sim_->state(kLeft).frames_received, 3u);
+	ASSERT_EQ(sim_->state(kRight).frames_received, 2u);
+	ASSERT_DOUBLE_EQ(sim_->state(kLeft).speed_target, 50.0);
+}
+
+TEST_F(SetpointStreamTest, commit_refreshesUnchangedSetpoints)
+{
+	settings_.refresh_s = 0.02;
+	jaguar::SetpointStream stream(*group_, jaguars_, settings_);
+	run(stream, 100.0, -100.0, 10);
+	ASSERT_GT(stream.stats().sent, 2u);
+	ASSERT_GT(stream.stats().suppressed, 0u);
+}
+
+TEST_F(SetpointStreamTest, set_rampsOnHost)
+{
+	jaguar::SetpointStream stream(*group_, jaguars_, settings_);
+	stream.ramp_set(1000.0);
+	run(stream, 100.0, -100.0, 3);
+	usleep(10000);
+
+	// 1000 RPM/s is 10 RPM per 10 ms tick.
+	ASSERT_DOUBLE_EQ(sim_->state(kLeft).speed_target, 30.0);
+	ASSERT_DOUBLE_EQ(sim_->state(kRight).speed_target, -30.0);
+	run(stream, 100.0, -100.0, 10);
+	usleep(10000);
+	ASSERT_DOUBLE_EQ(sim_->state(kLeft).speed_target, 100.0);
+	ASSERT_DOUBLE_EQ(sim_->state(kRight).speed_target, -100.0);
+}
+
+TEST_F(SetpointStreamTest, set_leavesRampToVoltageDevices)
+{
+	acknowledged(left_->voltage_enable());
+	acknowledged(right_->voltage_enable());
+	acknowledged(left_->voltage_set_ramp(2.0));
+	acknowledged(right_->voltage_set_ramp(2.0));
+	ASSERT_NEAR(sim_->state(kLeft).voltage_ramp, 2.0, 0.02);
+
+	jaguar::MotorGroup group(*bridge_, jaguar::GroupMode::kVoltage, 0x02);
+	group.add(*left_);
+	group.add(*right_);
+	ASSERT_TRUE(group.ramps_on_device());
+
+	jaguar::SetpointStream stream(group, jaguars_, settings_);
+	stream.ramp_set(0.1);
+	run(stream, 0.5, -0.5, 5);
+	usleep(10000);
+
+	// The targets are sent once, unlimited, and the device ramps to them.
+	ASSERT_EQ(stream.stats().sent, 2u);
+	ASSERT_NEAR(sim_->state(kLeft).voltage_target, 0.5, 1e-4);
+	ASSERT_NEAR(sim_->state(kRight).voltage_target, -0.5, 1e-4);
+	ASSERT_GT(sim_->state(kLeft).voltage_output, 0.0);
+	ASSERT_LT(sim_->state(kLeft).voltage_output, 0.5);
+}
@@ -0,0 +1,142 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/socketcan_bridge.h>
+
+using namespace testing;
+using boost::assign::list_of;
+
+// These tests need a virtual CAN interface:
+//   modprobe vcan
+//   ip link add dev vcan0 type vcan
+//   ip link set up vcan0
+static std::string const kInterface = "vcan0";
+
+class SocketCANBridgeTest : public ::testing::Test
+{
+public:
+	virtual void SetUp(void)
+	{
+		called_ = 0;
+		socket_ = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+		struct ifreq ifr;
+		memset(&ifr, 0, sizeof(ifr));
+		strncpy(ifr.ifr_name, kInterface.c_str(), IFNAMSIZ - 1);
+		if (socket_ < 0 || ioctl(socket_, SIOCGIFINDEX, &ifr) < 0) {
+			std::cerr << "[ SKIPPED  ] " << kInterface << " is not available" << std::endl;
+			return;
+		}
+
+		struct sockaddr_can addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.can_family  = AF_CAN;
+		addr.can_ifindex = ifr.ifr_ifindex;
+		bind(socket_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+
+		bridge_.reset(new can::SocketCANBridge(kInterface));
+	}
+
+	virtual void TearDown(void)
+	{
+		bridge_.reset();
+		if (socket_ >= 0) {
+			close(socket_);
+		}
+	}
+
+	void write(uint32_t id, uint8_t dlc, char const *data)
+	{
+		struct can_frame frame;
+		memset(&frame, 0, sizeof(frame));
+		frame.can_id  = id | CAN_EFF_FLAG;
+		frame.can_dlc = dlc;
+		memcpy(frame.data, data, dlc);
+		::write(socket_, &frame, sizeof(frame));
+	}
+
+	bool read(struct can_frame &frame)
+	{
+		return ::read(socket_, &frame, sizeof(frame)) == sizeof(frame);
+	}
+
+	void delay(void)
+	{
+		usleep(1000);
+	}
+
+	void callback(can::FramePtr const &frame)
+	{
+		++called_;
+		ASSERT_EQ(frame->id, 0x00000001);
+		ASSERT_EQ(frame->dlc, 2);
+		ASSERT_NE(frame->timestamp, 0u);
+	}
+
+	boost::shared_ptr<can::SocketCANBridge> bridge_;
+	int socket_;
+	int called_;
+};
+
+TEST_F(SocketCANBridgeTest, sendWritesExtendedFrame)
+{
+	if (!bridge_) return;
+
+	std::vector<uint8_t> payload = list_of(0x11)(0x22);
+	bridge_->send(can::CANMessage(0x02020085, payload));
+
+	struct can_frame frame;
+	ASSERT_TRUE(read(frame));
+	ASSERT_EQ(frame.can_id, 0x02020085 | CAN_EFF_FLAG);
+	ASSERT_EQ(frame.can_dlc, 2);
+	ASSERT_EQ(frame.data[0], 0x11);
+	ASSERT_EQ(frame.data[1], 0x22);
+}
+
+TEST_F(SocketCANBridgeTest, attach_callbackMatchingCallbackInvoked)
+{
+	if (!bridge_) return;
+
+	bridge_->attach_frame_callback(0x00000001, boost::bind(&SocketCANBridgeTest::callback, this, _1));
+
+	write(0x00000001, 2, "\x01\x01");
+	write(0x00000002, 2, "\x02\x02");
+	delay();
+
+	ASSERT_EQ(called_, 1);
+}
+
+TEST_F(SocketCANBridgeTest, filtersIncludeCallbacksAndTokens)
+{
+	if (!bridge_) return;
+
+	bridge_->attach_frame_callback(0x100, 0xF00, boost::bind(&SocketCANBridgeTest::callback, this, _1));
+	can::TokenPtr token = bridge_->recv(0x00000001);
+
+	std::vector<can::BasicCANBridge::filter> filters = bridge_->filters();
+	ASSERT_EQ(filters.size(), 2u);
+}
+
+TEST_F(SocketCANBridgeTest, recvTokenBlocksUntilReady)
+{
+	if (!bridge_) return;
+
+	can::TokenPtr token = bridge_->recv(0x00000001);
+	ASSERT_FALSE(token->ready());
+
+	write(0x00000001, 2, "\x01\x01");
+	token->block();
+
+	ASSERT_TRUE(token->ready());
+	ASSERT_EQ(token->frame()->id, 0x00000001);
+}
@@ -0,0 +1,106 @@
+#include <limits>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+#include <jaguar/seqlock.h>
+#include <jaguar/status_cache.h>
+
+using namespace jaguar;
+
+static can::Timestamp const kMillisecond = 1000000ull;
+
+struct Pair {
+	uint64_t a;
+	uint64_t b;
+};
+
+static void write_pairs(SeqLock<Pair> *lock, boost::atomic<bool> *done)
+{
+	for (uint64_t i = 1; i <= 200000; ++i) {
+		Pair const pair = { i, ~i };
+		lock->store(pair);
+	}
+	done->store(true);
+}
+
+TEST(SeqLockTest, loadReturnsLastStore)
+{
+	SeqLock<Pair> lock;
+	ASSERT_EQ(lock.version(), 0u);
+	ASSERT_EQ(lock.load().a, 0u);
+
+	Pair const pair = { 1, 2 };
+	lock.store(pair);
+	ASSERT_EQ(lock.version(), 1u);
+	ASSERT_EQ(lock.load().a, 1u);
+	ASSERT_EQ(lock.load().b, 2u);
+}
+
+TEST(SeqLockTest, readersNeverSeeTornValues)
+{
+	SeqLock<Pair> lock;
+	boost::atomic<bool> done(false);
+	boost::thread writer(boost::bind(&write_pairs, &lock, &done));
+
+	uint64_t last = 0;
+	size_t reads = 0;
+	while (!done.load() || reads == 0) {
+		Pair const pair = lock.load();
+		if (pair.a != 0) {
+			ASSERT_EQ(pair.b, ~pair.a);
+		}
+		ASSERT_GE(pair.a, last);
+		last = pair.a;
+		++reads;
+	}
+	writer.join();
+	ASSERT_EQ(lock.load().a, 200000u);
+}
+
+TEST(StatusCacheTest, mergesFieldsFromSeveralMessages)
+{
+	StatusCache cache;
+
+	StatusSample odom;
+	odom.valid = (1u << StatusField::kPosition) | (1u << StatusField::kSpeed);
+	odom.stamp = 10 * kMillisecond;
+	odom.position = 1.5;
+	odom.speed = 60.0;
+	cache.update(odom);
+
+	StatusSample diag;
+	diag.valid = (1u << StatusField::kBusVoltage) | (1u << StatusField::kTemperature);
+	diag.stamp = 20 * kMillisecond;
+	diag.bus_voltage = 12.0;
+	diag.temperature = 30.0;
+	cache.update(diag);
+
+	DeviceStatus const status = cache.load();
+	ASSERT_EQ(cache.version(), 2u);
+	ASSERT_EQ(status.latest.stamp, 20 * kMillisecond);
+	ASSERT_DOUBLE_EQ(status.latest.position, 1.5);
+	ASSERT_DOUBLE_EQ(status.latest.speed, 60.0);
+	ASSERT_DOUBLE_EQ(status.latest.bus_voltage, 12.0);
+	ASSERT_DOUBLE_EQ(status.latest.temperature, 30.0);
+	ASSERT_EQ(status.stamps[StatusField::kPosition], 10 * kMillisecond);
+	ASSERT_EQ(status.stamps[StatusField::kBusVoltage], 20 * kMillisecond);
+	ASSERT_FALSE(status.has(StatusField::kCurrent));
+}
+
+TEST(StatusCacheTest, ageIsPerField)
+{
+	StatusCache cache;
+
+	StatusSample sample;
+	sample.valid = 1u << StatusField::kSpeed;
+	sample.stamp = 100 * kMillisecond;
+	sample.speed = 1.0;
+	cache.update(sample);
+
+	DeviceStatus const status = cache.load();
+	ASSERT_DOUBLE_EQ(status.age(StatusField::kSpeed, 350 * kMillisecond), 0.25);
+	ASSERT_DOUBLE_EQ(status.age(StatusField::kSpeed, 50 * kMillisecond), 0.0);
+	ASSERT_EQ(status.age(StatusField::kCurrent, 350 * kMillisecond),
+	          std::numeric_limits<double>::infinity());
+}
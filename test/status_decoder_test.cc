@@ -0,0 +1,128 @@
+#include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/jaguar.h>
+#include <jaguar/status_decoder.h>
+
+using namespace jaguar;
+using namespace testing;
+using boost::assign::list_of;
+
+static void store(double *dst, double value)
+{
+	*dst = value;
+}
+
+static std::vector<uint8_t> layout_items(StatusPlan const &plan)
+{
+	field::StatusLayout const &layout = plan.layout();
+	return std::vector<uint8_t>(layout.items, layout.items + layout.length);
+}
+
+TEST(StatusPlanTest, addAppendsAllItemsOfAField)
+{
+	StatusPlan plan;
+	ASSERT_TRUE(plan.add(StatusField::kBusVoltage));
+	ASSERT_TRUE(plan.add(StatusField::kPosition));
+	ASSERT_TRUE(plan.add(StatusField::kFaults));
+	ASSERT_TRUE(plan.add(StatusField::kLimitClearing));
+
+	ASSERT_THAT(layout_items(plan), ElementsAre(3, 4, 9, 10, 11, 12, 19, 18));
+	ASSERT_EQ(plan.length(), 8u);
+	ASSERT_EQ(plan.size(), 4u);
+
+	ASSERT_EQ(plan.entry(1).offset, 2u);
+	ASSERT_EQ(plan.entry(1).width, 4u);
+	ASSERT_EQ(plan.entry(1).field, StatusField::kPosition);
+}
+
+TEST(StatusPlanTest, addRejectsFieldsThatDoNotFit)
+{
+	StatusPlan plan;
+	ASSERT_TRUE(plan.add(StatusField::kPosition));
+	ASSERT_TRUE(plan.add(StatusField::kCurrent));
+	ASSERT_FALSE(plan.add(StatusField::kSpeed));
+	ASSERT_EQ(plan.length(), 6u);
+	ASSERT_TRUE(plan.add(StatusField::kTemperature));
+	ASSERT_EQ(plan.length(), 8u);
+}
+
+TEST(StatusPlanTest, decodesFixedPointToEngineeringUnits)
+{
+	StatusPlan plan;
+	plan.add(StatusField::kBusVoltage);
+	plan.add(StatusField::kPosition);
+	plan.add(StatusField::kOutputVoltagePercent);
+
+	// 12.5 V, -1.5 revolutions, -50% output.
+	uint8_t const data[] = { 0x80, 0x0C, 0x00, 0x80, 0xFE, 0xFF, 0x00, 0xC0 };
+	StatusSample sample;
+	ASSERT_TRUE(plan.decode(data, 8, sample));
+
+	ASSERT_DOUBLE_EQ(sample.bus_voltage, 12.5);
+	ASSERT_DOUBLE_EQ(sample.position, -1.5);
+	ASSERT_DOUBLE_EQ(sample.output_voltage_percent, -0.5);
+
+	ASSERT_TRUE(sample.has(StatusField::kBusVoltage));
+	ASSERT_TRUE(sample.has(StatusField::kPosition));
+	ASSERT_TRUE(sample.has(StatusField::kOutputVoltagePercent));
+	ASSERT_FALSE(sample.has(StatusField::kSpeed));
+}
+
+TEST(StatusPlanTest, shortPayloadDecodesLeadingFields)
+{
+	StatusPlan plan;
+	plan.add(StatusField::kTemperature);
+	plan.add(StatusField::kSpeed);
+
+	uint8_t const data[] = { 0x00, 0x19, 0x00, 0x00 };
+	StatusSample sample;
+	ASSERT_FALSE(plan.decode(data, 4, sample));
+	ASSERT_TRUE(sample.has(StatusField::kTemperature));
+	ASSERT_FALSE(sample.has(StatusField::kSpeed));
+	ASSERT_DOUBLE_EQ(sample.temperature, 25.0);
+}
+
+TEST(StatusPlanTest, partialFieldsAreNotDecoded)
+{
+	// Only the integer part of the position, then a complete speed.
+	field::StatusLayout layout;
+	uint8_t const items[] = { 11, 12, 13, 14, 15, 16 };
+	std::copy(items, items + 6, layout.items);
+	layout.length = 6;
+
+	StatusPlan plan(layout);
+	ASSERT_EQ(plan.size(), 1u);
+	ASSERT_EQ(plan.entry(0).offset, 2u);
+	ASSERT_EQ(plan.entry(0).field, StatusField::kSpeed);
+
+	uint8_t const data[] = { 0x01, 0x00, 0x00, 0x00, 0x64, 0x00 };
+	StatusSample sample;
+	ASSERT_TRUE(plan.decode(data, 6, sample));
+	ASSERT_FALSE(sample.has(StatusField::kPosition));
+	ASSERT_DOUBLE_EQ(sample.speed, 100.0);
+}
+
+TEST(StatusPlanTest, compilesAggregateStatus)
+{
+	using namespace PeriodicStatus;
+	boost::function<void (double)> ignore_double;
+	boost::function<void (uint8_t)> ignore_byte;
+
+	StatusPlan plan(Speed(ignore_double) << Current(ignore_double)
+	                                     << GateFaultCounter(ignore_byte));
+	ASSERT_THAT(layout_items(plan), ElementsAre(13, 14, 15, 16, 5, 6, 27));
+	ASSERT_EQ(plan.size(), 3u);
+	ASSERT_EQ(plan.entry(2).field, StatusField::kGateFaultCounter);
+}
+
+TEST(StatusPlanTest, fixedStatusReadsEngineeringUnits)
+{
+	std::vector<uint8_t> payload = list_of(0x40)(0xFF);
+	double value = 0;
+	Status::Ptr status = PeriodicStatus::BusVoltage(boost::bind(&store, &value, _1));
+
+	status->read(&payload.front(), &payload.back() + 1);
+	ASSERT_DOUBLE_EQ(value, -0.75);
+}
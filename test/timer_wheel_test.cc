@@ -0,0 +1,104 @@
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/thread.hpp>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/can_frame.h>
+#include <jaguar/timer_wheel.h>
+
+using namespace testing;
+using boost::posix_time::milliseconds;
+
+class TimerWheelTest : public ::testing::Test
+{
+public:
+	TimerWheelTest(void)
+		: work_(io_)
+		, wheel_(io_, milliseconds(1), 16)
+		, fired_(0)
+	{
+	}
+
+	virtual void SetUp(void)
+	{
+		thread_ = boost::thread(boost::bind(&boost::asio::io_service::run, &io_));
+	}
+
+	virtual void TearDown(void)
+	{
+		io_.stop();
+		thread_.join();
+	}
+
+	void record(size_t index)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		order_.push_back(index);
+		stamps_.push_back(can::monotonic_now());
+	}
+
+	void count(void)
+	{
+		++fired_;
+	}
+
+	boost::asio::io_service io_;
+	boost::asio::io_service::work work_;
+	can::TimerWheel wheel_;
+	boost::thread thread_;
+	boost::detail::atomic_count fired_;
+
+	boost::mutex mutex_;
+	std::vector<size_t> order_;
+	std::vector<can::Timestamp> stamps_;
+};
+
+TEST_F(TimerWheelTest, firesInDeadlineOrder)
+{
+	wheel_.schedule(milliseconds(30), boost::bind(&TimerWheelTest::record, this, 2));
+	wheel_.schedule(milliseconds(5),  boost::bind(&TimerWheelTest::record, this, 0));
+	wheel_.schedule(milliseconds(12), boost::bind(&TimerWheelTest::record, this, 1));
+	ASSERT_EQ(wheel_.pending(), 3u);
+
+	usleep(60000);
+	ASSERT_EQ(wheel_.pending(), 0u);
+	ASSERT_THAT(order_, ElementsAre(0, 1, 2));
+}
+
+TEST_F(TimerWheelTest, longDelaysTakeSeveralRounds)
+{
+	// 16 slots of 1 ms, so this wraps around the wheel several times.
+	can::Timestamp const begin = can::monotonic_now();
+	wheel_.schedule(milliseconds(50), boost::bind(&TimerWheelTest::record, this, 0));
+
+	usleep(30000);
+	ASSERT_EQ(wheel_.pending(), 1u);
+	usleep(60000);
+	ASSERT_EQ(order_.size(), 1u);
+	ASSERT_GE(stamps_[0] - begin, 49000000u);
+}
+
+TEST_F(TimerWheelTest, scalesToManyTimers)
+{
+	size_t const kTimers = 10000;
+	for (size_t i = 0; i < kTimers; ++i) {
+		wheel_.schedule(milliseconds(1 + i % 40), boost::bind(&TimerWheelTest::count, this));
+	}
+
+	usleep(100000);
+	ASSERT_EQ(fired_, static_cast<long>(kTimers));
+	ASSERT_EQ(wheel_.pending(), 0u);
+}
+
+TEST_F(TimerWheelTest, restartsAfterIdle)
+{
+	wheel_.schedule(milliseconds(1), boost::bind(&TimerWheelTest::count, this));
+	usleep(20000);
+	ASSERT_EQ(fired_, 1);
+
+	wheel_.schedule(milliseconds(1), boost::bind(&TimerWheelTest::count, this));
+	usleep(20000);
+	ASSERT_EQ(fired_, 2);
+}
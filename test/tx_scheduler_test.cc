@@ -0,0 +1,103 @@
+#include <vector>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <jaguar/tx_scheduler.h>
+
+using namespace testing;
+using can::TxClass;
+
+static can::Timestamp const kMillisecond = 1000000ull;
+static std::vector<uint8_t> const kEmptyPayload(0);
+
+class TxSchedulerTest : public ::testing::Test
+{
+public:
+	void push(TxClass::Enum cls, uint32_t id, can::Timestamp now)
+	{
+		scheduler_.push(cls, can::CANMessage(id, kEmptyPayload), now);
+	}
+
+	std::vector<uint32_t> drain(can::Timestamp now)
+	{
+		std::vector<uint32_t> ids;
+		can::CANMessage message(0);
+		can::Timestamp wake;
+		while (scheduler_.pop(now, message, wake)) {
+			ids.push_back(message.id);
+		}
+		return ids;
+	}
+
+protected:
+	can::TxScheduler scheduler_;
+};
+
+TEST_F(TxSchedulerTest, emptyPopReturnsFalse)
+{
+	can::CANMessage message(0);
+	can::Timestamp wake = 1;
+	ASSERT_TRUE(scheduler_.empty());
+	ASSERT_FALSE(scheduler_.pop(0, message, wake));
+	ASSERT_EQ(wake, 0u);
+}
+
+TEST_F(TxSchedulerTest, higherClassesGoFirst)
+{
+	push(TxClass::kBulk,     4, 0);
+	push(TxClass::kConfig,   3, 0);
+	push(TxClass::kSetpoint, 2, 0);
+	push(TxClass::kSystem,   1, 0);
+
+	ASSERT_THAT(drain(0), ElementsAre(1, 2, 3, 4));
+	ASSERT_TRUE(scheduler_.empty());
+}
+
+TEST_F(TxSchedulerTest, classesAreFIFO)
+{
+	push(TxClass::kConfig, 1, 0);
+	push(TxClass::kConfig, 2, 0);
+	push(TxClass::kConfig, 3, 0);
+
+	ASSERT_THAT(drain(0), ElementsAre(1, 2, 3));
+}
+
+TEST_F(TxSchedulerTest, rateLimitedClassYields)
+{
+	scheduler_.rate_limit_set(TxClass::kSystem, 1000.0, 1);
+	push(TxClass::kSystem, 1, 0);
+	push(TxClass::kSystem, 2, 0);
+	push(TxClass::kBulk,   3, 0);
+
+	// The second system frame must wait a millisecond for its token, so
+	// the bulk frame is allowed to overtake it.
+	can::Timestamp const now = can::monotonic_now();
+	ASSERT_THAT(drain(now), ElementsAre(1, 3));
+
+	can::CANMessage message(0);
+	can::Timestamp wake;
+	ASSERT_FALSE(scheduler_.pop(now, message, wake));
+	ASSERT_GT(wake, now);
+	ASSERT_LE(wake, now + kMillisecond);
+
+	ASSERT_THAT(drain(now + kMillisecond), ElementsAre(2));
+}
+
+TEST_F(TxSchedulerTest, statsTrackDepthAndWait)
+{
+	push(TxClass::kConfig, 1, 0);
+	push(TxClass::kConfig, 2, 0);
+	push(TxClass::kConfig, 3, 5 * kMillisecond);
+
+	can::TxClassStats stats = scheduler_.stats(TxClass::kConfig);
+	ASSERT_EQ(stats.depth, 3u);
+	ASSERT_EQ(stats.max_depth, 3u);
+	ASSERT_EQ(stats.frames, 0u);
+
+	drain(10 * kMillisecond);
+
+	stats = scheduler_.stats(TxClass::kConfig);
+	ASSERT_EQ(stats.depth, 0u);
+	ASSERT_EQ(stats.max_depth, 3u);
+	ASSERT_EQ(stats.frames, 3u);
+	ASSERT_EQ(stats.max_wait, 10 * kMillisecond);
+}